@@ -0,0 +1,69 @@
+#ifndef _HARDWARE_I2C_H
+#define _HARDWARE_I2C_H
+
+#include "pico/types.h"
+
+#define I2C_IC_DATA_CMD_RESTART_BITS 0x00000400
+#define I2C_IC_DATA_CMD_STOP_BITS 0x00000200
+#define I2C_IC_DATA_CMD_CMD_BITS 0x00000100
+#define I2C_IC_DATA_CMD_DAT_BITS 0x000000ff
+#define I2C_IC_INTR_STAT_R_STOP_DET_BITS 0x00000200
+#define I2C_IC_INTR_STAT_R_TX_ABRT_BITS 0x00000040
+#define I2C_IC_INTR_MASK_M_STOP_DET_BITS 0x00000200
+#define I2C_IC_INTR_MASK_M_TX_ABRT_BITS 0x00000040
+#define I2C_IC_TX_ABRT_SOURCE_TX_FLUSH_CNT_BITS 0xff800000
+#define I2C_IC_TX_ABRT_SOURCE_TX_FLUSH_CNT_LSB 23
+#define I2C_IC_DMA_CR_TDMAE_BITS 0x00000002
+#define I2C_IC_DMA_CR_RDMAE_BITS 0x00000001
+#define DREQ_I2C0_TX 32
+#define DREQ_I2C0_RX 33
+#define DREQ_I2C1_TX 34
+#define DREQ_I2C1_RX 35
+
+// Only the registers touched by src/ are modelled. The block only sees
+// data_cmd as DMA writes it, and its interrupt status reads as set for the
+// length of the interrupt, see host/sim/sim_i2c.c.
+typedef struct {
+    volatile uint32_t con;
+    volatile uint32_t tar;
+    volatile uint32_t data_cmd;
+    volatile uint32_t intr_stat;
+    volatile uint32_t intr_mask;
+    volatile uint32_t clr_intr;
+    volatile uint32_t clr_tx_abrt;
+    volatile uint32_t clr_stop_det;
+    volatile uint32_t enable;
+    volatile uint32_t status;
+    volatile uint32_t tx_abrt_source;
+    volatile uint32_t dma_cr;
+} i2c_hw_t;
+
+typedef struct i2c_inst {
+    i2c_hw_t *hw;
+    bool restart_on_next;
+} i2c_inst_t;
+
+extern i2c_inst_t i2c0_inst;
+extern i2c_inst_t i2c1_inst;
+
+#define i2c0 (&i2c0_inst)
+#define i2c1 (&i2c1_inst)
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+void i2c_deinit(i2c_inst_t *i2c);
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop);
+
+static inline uint i2c_hw_index(i2c_inst_t *i2c) {
+    return i2c == i2c1 ? 1 : 0;
+}
+
+static inline i2c_hw_t *i2c_get_hw(i2c_inst_t *i2c) {
+    return i2c->hw;
+}
+
+static inline uint i2c_get_dreq(i2c_inst_t *i2c, bool is_tx) {
+    return DREQ_I2C0_TX + 2 * i2c_hw_index(i2c) + (is_tx ? 0 : 1);
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _HARDWARE_PWM_H
+#define _HARDWARE_PWM_H
+
+#include "pico/types.h"
+
+#define NUM_PWM_SLICES 8
+#define DREQ_PWM_WRAP0 24
+
+typedef struct {
+    uint32_t csr;
+    uint32_t div; // 8.4 fixed point
+    uint32_t top;
+} pwm_config;
+
+typedef struct {
+    struct {
+        volatile uint32_t csr;
+        volatile uint32_t div;
+        volatile uint32_t ctr;
+        volatile uint32_t cc;
+        volatile uint32_t top;
+    } slice[NUM_PWM_SLICES];
+    volatile uint32_t en;
+    volatile uint32_t intr;
+    volatile uint32_t inte;
+    volatile uint32_t intf;
+    volatile uint32_t ints;
+} pwm_hw_t;
+
+extern pwm_hw_t *pwm_hw;
+
+static inline uint pwm_gpio_to_slice_num(uint gpio) {
+    return (gpio >> 1u) & 7u;
+}
+
+static inline uint pwm_gpio_to_channel(uint gpio) {
+    return gpio & 1u;
+}
+
+static inline uint pwm_get_dreq(uint slice_num) {
+    return DREQ_PWM_WRAP0 + slice_num;
+}
+
+pwm_config pwm_get_default_config(void);
+void pwm_config_set_clkdiv(pwm_config *c, float div);
+void pwm_config_set_clkdiv_int(pwm_config *c, uint div);
+void pwm_config_set_wrap(pwm_config *c, uint16_t wrap);
+void pwm_init(uint slice_num, pwm_config *c, bool start);
+void pwm_set_enabled(uint slice_num, bool enabled);
+void pwm_set_gpio_level(uint gpio, uint16_t level);
+void pwm_clear_irq(uint slice_num);
+void pwm_set_irq_enabled(uint slice_num, bool enabled);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef _HARDWARE_RTC_H
+#define _HARDWARE_RTC_H
+
+#include "pico/types.h"
+#include "pico/util/datetime.h"
+
+void rtc_init(void);
+bool rtc_set_datetime(datetime_t *t);
+bool rtc_get_datetime(datetime_t *t);
+bool rtc_running(void);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef _HARDWARE_SPI_H
+#define _HARDWARE_SPI_H
+
+#include "pico/types.h"
+
+#define SPI_SSPSR_BSY_BITS 0x00000010
+#define SPI_SSPSR_RNE_BITS 0x00000004
+#define SPI_SSPICR_RORIC_BITS 0x00000001
+#define DREQ_SPI0_TX 16
+#define DREQ_SPI0_RX 17
+#define DREQ_SPI1_TX 18
+#define DREQ_SPI1_RX 19
+
+// Only the registers touched by src/ are modelled. Nothing is ever left in
+// the FIFOs, a blocking call or a DMA transfer completes the bytes it moves.
+typedef struct {
+    volatile uint32_t cr0;
+    volatile uint32_t cr1;
+    volatile uint32_t dr;
+    volatile uint32_t sr;
+    volatile uint32_t cpsr;
+    volatile uint32_t imsc;
+    volatile uint32_t ris;
+    volatile uint32_t mis;
+    volatile uint32_t icr;
+    volatile uint32_t dmacr;
+} spi_hw_t;
+
+typedef struct spi_inst {
+    spi_hw_t *hw;
+} spi_inst_t;
+
+extern spi_inst_t spi0_inst;
+extern spi_inst_t spi1_inst;
+
+#define spi0 (&spi0_inst)
+#define spi1 (&spi1_inst)
+
+typedef enum { SPI_CPHA_0 = 0, SPI_CPHA_1 = 1 } spi_cpha_t;
+typedef enum { SPI_CPOL_0 = 0, SPI_CPOL_1 = 1 } spi_cpol_t;
+typedef enum { SPI_LSB_FIRST = 0, SPI_MSB_FIRST = 1 } spi_order_t;
+
+uint spi_init(spi_inst_t *spi, uint baudrate);
+void spi_deinit(spi_inst_t *spi);
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate);
+void spi_set_format(spi_inst_t *spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order);
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len);
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len);
+int spi_write_read_blocking(spi_inst_t *spi, const uint8_t *src, uint8_t *dst, size_t len);
+
+static inline uint spi_get_index(const spi_inst_t *spi) {
+    return spi == spi1 ? 1 : 0;
+}
+
+static inline spi_hw_t *spi_get_hw(spi_inst_t *spi) {
+    return spi->hw;
+}
+
+static inline uint spi_get_dreq(spi_inst_t *spi, bool is_tx) {
+    return DREQ_SPI0_TX + 2 * spi_get_index(spi) + (is_tx ? 0 : 1);
+}
+
+static inline bool spi_is_busy(const spi_inst_t *spi) {
+    return false;
+}
+
+static inline bool spi_is_readable(const spi_inst_t *spi) {
+    return false;
+}
+
+#endif
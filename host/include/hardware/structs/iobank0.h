@@ -0,0 +1,23 @@
+#ifndef _HARDWARE_STRUCTS_IOBANK0_H
+#define _HARDWARE_STRUCTS_IOBANK0_H
+
+#include "pico/types.h"
+
+// Only the interrupt registers, four bits a pin, eight pins a register.
+// Both cores' copies of ints always read the same, the sim raises every
+// IO_IRQ_BANK0 interrupt on whichever core is running.
+typedef struct {
+    volatile uint32_t inte[4];
+    volatile uint32_t intf[4];
+    volatile uint32_t ints[4];
+} io_irq_ctrl_hw_t;
+
+typedef struct {
+    volatile uint32_t intr[4];
+    io_irq_ctrl_hw_t proc0_irq_ctrl;
+    io_irq_ctrl_hw_t proc1_irq_ctrl;
+} iobank0_hw_t;
+
+extern iobank0_hw_t *iobank0_hw;
+
+#endif
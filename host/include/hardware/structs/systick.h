@@ -0,0 +1,19 @@
+#ifndef _HARDWARE_STRUCTS_SYSTICK_H
+#define _HARDWARE_STRUCTS_SYSTICK_H
+
+#include "pico/types.h"
+
+#define M0PLUS_SYST_CSR_ENABLE_BITS    0x00000001u
+#define M0PLUS_SYST_CSR_CLKSOURCE_BITS 0x00000004u
+
+// Never counts on the host, so "xip bench" and "mcp9808 bench" report 0 cycles.
+typedef struct {
+    volatile uint32_t csr;
+    volatile uint32_t rvr;
+    volatile uint32_t cvr;
+    volatile uint32_t calib;
+} systick_hw_t;
+
+extern systick_hw_t *systick_hw;
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef _HARDWARE_STRUCTS_XIP_CTRL_H
+#define _HARDWARE_STRUCTS_XIP_CTRL_H
+
+#include "pico/types.h"
+
+// There is no flash on the host, the counters stay at 0.
+typedef struct {
+    volatile uint32_t ctrl;
+    volatile uint32_t flush;
+    volatile uint32_t stat;
+    volatile uint32_t ctr_hit;
+    volatile uint32_t ctr_acc;
+    volatile uint32_t stream_addr;
+    volatile uint32_t stream_ctr;
+    volatile uint32_t stream_fifo;
+} xip_ctrl_hw_t;
+
+extern xip_ctrl_hw_t *xip_ctrl_hw;
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+
+#include "pico/types.h"
+
+// Simulated interrupts only run at the main loop's idle point so masking is
+// a no-op and the fences only need to stop the compiler reordering.
+
+typedef volatile uint32_t spin_lock_t;
+
+void sim_idle(void);
+void sim_sev(void);
+void sim_wfe(void);
+
+static inline void __dmb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void __dsb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void __isb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void __mem_fence_acquire(void) { __atomic_thread_fence(__ATOMIC_ACQUIRE); }
+static inline void __mem_fence_release(void) { __atomic_thread_fence(__ATOMIC_RELEASE); }
+static inline void __nop(void) {}
+static inline void __sev(void) { sim_sev(); }
+static inline void __wfe(void) { sim_wfe(); }
+static inline void __wfi(void) { sim_wfe(); }
+
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t status) { (void) status; }
+
+int spin_lock_claim_unused(bool required);
+spin_lock_t *spin_lock_instance(uint lock_num);
+
+static inline uint32_t spin_lock_blocking(spin_lock_t *lock) {
+    (void) lock;
+    return 0;
+}
+
+static inline void spin_unlock(spin_lock_t *lock, uint32_t saved_irq) {
+    (void) lock;
+    (void) saved_irq;
+}
+
+#endif
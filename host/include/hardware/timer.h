@@ -0,0 +1,37 @@
+#ifndef _HARDWARE_TIMER_H
+#define _HARDWARE_TIMER_H
+
+#include "pico/types.h"
+
+typedef struct {
+    volatile uint32_t timehw;
+    volatile uint32_t timelw;
+    volatile uint32_t timehr;
+    volatile uint32_t timelr;
+    volatile uint32_t alarm[4];
+    volatile uint32_t armed;
+    volatile uint32_t timerawh;
+    volatile uint32_t timerawl;
+    volatile uint32_t dbgpause;
+    volatile uint32_t pause;
+    volatile uint32_t intr;
+    volatile uint32_t inte;
+    volatile uint32_t intf;
+    volatile uint32_t ints;
+} timer_hw_t;
+
+extern timer_hw_t *timer_hw;
+
+// Alarm 3 is the default alarm pool's. Callbacks run as events on the
+// virtual clock.
+typedef void (*hardware_alarm_callback_t)(uint alarm_num);
+
+void hardware_alarm_claim(uint alarm_num);
+int hardware_alarm_claim_unused(bool required);
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback);
+// True if the target has already passed, the callback isn't called then.
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t);
+void hardware_alarm_cancel(uint alarm_num);
+void hardware_alarm_force_irq(uint alarm_num);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _LWIP_IP_ADDR_H
+#define _LWIP_IP_ADDR_H
+
+#include "lwip/err.h"
+
+// IPv4 only, as configured in include/lwipopts.h. addr is in network order.
+typedef struct ip4_addr {
+    u32_t addr;
+} ip4_addr_t;
+typedef ip4_addr_t ip_addr_t;
+
+#define IPADDR_TYPE_V4 0U
+#define IPADDR_TYPE_ANY 46U
+
+extern const ip_addr_t ip_addr_any;
+#define IP_ADDR_ANY (&ip_addr_any)
+#define IP4_ADDR_ANY (&ip_addr_any)
+
+#define ip_2_ip4(ipaddr) (ipaddr)
+#define ip4_addr_get_u32(ipaddr) ((ipaddr)->addr)
+#define ip4_addr_set_u32(ipaddr, value) ((ipaddr)->addr = (value))
+#define ip4_addr1(ipaddr) (((const u8_t *) (&(ipaddr)->addr))[0])
+#define ip4_addr2(ipaddr) (((const u8_t *) (&(ipaddr)->addr))[1])
+#define ip4_addr3(ipaddr) (((const u8_t *) (&(ipaddr)->addr))[2])
+#define ip4_addr4(ipaddr) (((const u8_t *) (&(ipaddr)->addr))[3])
+#define IP4_ADDR(ipaddr, a, b, c, d) ((ipaddr)->addr = (u32_t) (a) | (u32_t) (b) << 8 | (u32_t) (c) << 16 | (u32_t) (d) << 24)
+#define ip_addr_cmp(addr1, addr2) ((addr1)->addr == (addr2)->addr)
+#define ip_addr_copy(dest, src) ((dest) = (src))
+#define ip_addr_isany(ipaddr) ((ipaddr) == NULL || (ipaddr)->addr == 0)
+
+char *ipaddr_ntoa(const ip_addr_t *addr);
+int ipaddr_aton(const char *cp, ip_addr_t *addr);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef _LWIP_PBUF_H
+#define _LWIP_PBUF_H
+
+#include <stddef.h>
+
+#include "lwip/err.h"
+
+typedef enum {
+    PBUF_TRANSPORT = 74,
+    PBUF_IP = 54,
+    PBUF_LINK = 14,
+    PBUF_RAW_TX = 0,
+    PBUF_RAW = 0
+} pbuf_layer;
+
+typedef enum {
+    PBUF_RAM = 0x0280,
+    PBUF_ROM = 0x0001,
+    PBUF_REF = 0x0041,
+    PBUF_POOL = 0x0182
+} pbuf_type;
+
+struct pbuf {
+    struct pbuf *next;
+    void *payload;
+    u16_t tot_len;
+    u16_t len;
+    u8_t type_internal;
+    u8_t flags;
+    u16_t ref;
+};
+
+typedef void (*pbuf_free_custom_fn)(struct pbuf *p);
+
+struct pbuf_custom {
+    struct pbuf pbuf;
+    pbuf_free_custom_fn custom_free_function;
+};
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type);
+struct pbuf *pbuf_alloced_custom(pbuf_layer l, u16_t length, pbuf_type type, struct pbuf_custom *p,
+                                 void *payload_mem, u16_t payload_mem_len);
+u8_t pbuf_free(struct pbuf *p);
+void pbuf_ref(struct pbuf *p);
+u8_t pbuf_get_at(const struct pbuf *p, u16_t offset);
+void pbuf_put_at(struct pbuf *p, u16_t offset, u8_t data);
+u16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, u16_t len, u16_t offset);
+err_t pbuf_take(struct pbuf *buf, const void *dataptr, u16_t len);
+err_t pbuf_take_at(struct pbuf *buf, const void *dataptr, u16_t len, u16_t offset);
+
+#endif
@@ -0,0 +1,12 @@
+// The pools the host build models, a subset of lwIP's list in its order.
+// Expands LWIP_MEMPOOL(name, num, size, desc) for each, as lwIP's does.
+// Sizes are the RP2040 build's element sizes.
+
+LWIP_MEMPOOL(UDP_PCB,        MEMP_NUM_UDP_PCB,        32,   "UDP_PCB")
+LWIP_MEMPOOL(TCP_PCB,        MEMP_NUM_TCP_PCB,        164,  "TCP_PCB")
+LWIP_MEMPOOL(TCP_PCB_LISTEN, MEMP_NUM_TCP_PCB_LISTEN, 28,   "TCP_PCB_LISTEN")
+LWIP_MEMPOOL(TCP_SEG,        MEMP_NUM_TCP_SEG,        20,   "TCP_SEG")
+LWIP_MEMPOOL(PBUF,           MEMP_NUM_PBUF,           16,   "PBUF_REF/ROM")
+LWIP_MEMPOOL(PBUF_POOL,      PBUF_POOL_SIZE,          1532, "PBUF_POOL")
+
+#undef LWIP_MEMPOOL
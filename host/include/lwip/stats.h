@@ -0,0 +1,25 @@
+#ifndef _LWIP_STATS_H
+#define _LWIP_STATS_H
+
+#include "lwip/memp.h"
+
+// Only the memory statistics, kept by host/sim/sim_net.c as lwIP's
+// mem.c and memp.c would.
+
+struct stats_mem {
+    const char *name;
+    u16_t err;
+    u16_t avail;
+    u16_t used;
+    u16_t max;
+    u16_t illegal;
+};
+
+struct stats_ {
+    struct stats_mem mem;
+    struct stats_mem *memp[MEMP_MAX];
+};
+
+extern struct stats_ lwip_stats;
+
+#endif
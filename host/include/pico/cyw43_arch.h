@@ -0,0 +1,43 @@
+#ifndef _PICO_CYW43_ARCH_H
+#define _PICO_CYW43_ARCH_H
+
+#include "pico/stdlib.h"
+#include "lwip/dns.h"
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+
+#define CYW43_WL_GPIO_LED_PIN 0
+#define CYW43_ITF_STA 0
+#define CYW43_ITF_AP 1
+#define CYW43_AUTH_OPEN 0
+#define CYW43_AUTH_WPA2_AES_PSK 0x00400004
+
+#define CYW43_LINK_DOWN 0
+#define CYW43_LINK_JOIN 1
+#define CYW43_LINK_NOIP 2
+#define CYW43_LINK_UP 3
+#define CYW43_LINK_FAIL -1
+#define CYW43_LINK_NONET -2
+#define CYW43_LINK_BADAUTH -3
+
+typedef struct _cyw43_t {
+    int itf_state;
+    bool initialized;
+} cyw43_t;
+
+extern cyw43_t cyw43_state;
+
+bool cyw43_is_initialized(cyw43_t *self);
+int cyw43_arch_init(void);
+void cyw43_arch_deinit(void);
+void cyw43_arch_enable_sta_mode(void);
+int cyw43_arch_wifi_connect_async(const char *ssid, const char *pw, uint32_t auth);
+int cyw43_wifi_leave(cyw43_t *self, int itf);
+int cyw43_tcpip_link_status(cyw43_t *self, int itf);
+void cyw43_arch_gpio_put(uint wl_gpio, bool value);
+bool cyw43_arch_gpio_get(uint wl_gpio);
+void cyw43_arch_lwip_begin(void);
+void cyw43_arch_lwip_end(void);
+
+#endif
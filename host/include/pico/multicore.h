@@ -0,0 +1,11 @@
+#ifndef _PICO_MULTICORE_H
+#define _PICO_MULTICORE_H
+
+#include "pico/types.h"
+
+// Core1 runs as a coroutine, it gets the CPU whenever core0 idles or blocks
+// and hands it back when it idles or blocks itself.
+void multicore_launch_core1(void (*entry)(void));
+void multicore_reset_core1(void);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef _PICO_PLATFORM_H
+#define _PICO_PLATFORM_H
+
+#include "pico/types.h"
+
+uint get_core_num(void);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef _PICO_STDLIB_H
+#define _PICO_STDLIB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "pico/types.h"
+#include "pico/platform.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+bool stdio_init_all(void);
+int putchar_raw(int c);
+int puts_raw(const char *s);
+int getchar_timeout_us(uint32_t timeout_us);
+
+// The main loop's idle point, the simulated clock advances here.
+void sim_idle(void);
+
+static inline void tight_loop_contents(void) {
+    sim_idle();
+}
+
+#endif
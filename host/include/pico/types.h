@@ -0,0 +1,27 @@
+#ifndef _PICO_TYPES_H
+#define _PICO_TYPES_H
+
+// Host stand-in for the pico-sdk, see host/sim/sim.h.
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+#define __not_in_flash(group)
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __no_inline_not_in_flash_func(func_name) func_name
+#define hard_assert(x) ((void) 0)
+
+#define PICO_OK 0
+#define PICO_ERROR_NONE 0
+#define PICO_ERROR_TIMEOUT -1
+#define PICO_ERROR_GENERIC -2
+
+#endif
@@ -0,0 +1,582 @@
+#include <ucontext.h>
+
+#include "sim/sim.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/xip_ctrl.h"
+#include "hardware/timer.h"
+#include "pico/multicore.h"
+
+#define SIM_DEFAULT_SECONDS 600
+// Idle calls before the clock jumps to the next event, lets the main loop
+// drain its queues a microsecond at a time as it would on the device.
+#define SIM_IDLE_SPINS 256
+#define SIM_CLK_SYS_HZ 125000000
+#define SIM_STATS 32
+#define SIM_STDIN_SIZE 256
+#define SIM_CORE1_STACK (256 * 1024)
+#define SIM_IRQ_HANDLERS 4 // Shared handlers per interrupt
+
+typedef struct sim_event {
+    uint64_t at;
+    sim_event_id_t id;
+    sim_event_fn fn;
+    void *arg;
+    struct sim_event *next;
+} sim_event_t;
+
+typedef struct sim_alarm {
+    alarm_id_t id;
+    uint64_t target;
+    alarm_callback_t callback;
+    void *user_data;
+    sim_event_id_t event;
+    struct sim_alarm *next;
+} sim_alarm_t;
+
+static uint64_t now;
+static uint64_t end_us;
+static sim_event_t *events;
+static sim_event_id_t last_event_id;
+static sim_alarm_t *alarms;
+static alarm_id_t last_alarm_id;
+static uint idle_spins;
+
+static struct {
+    const char *name;
+    uint32_t count;
+} stats[SIM_STATS];
+
+static char stdin_buf[SIM_STDIN_SIZE];
+static uint stdin_head;
+static uint stdin_tail;
+
+static timer_hw_t timer_regs;
+timer_hw_t *timer_hw = &timer_regs;
+static systick_hw_t systick_regs;
+systick_hw_t *systick_hw = &systick_regs;
+static xip_ctrl_hw_t xip_ctrl_regs;
+xip_ctrl_hw_t *xip_ctrl_hw = &xip_ctrl_regs;
+
+static spin_lock_t spin_locks[32];
+static uint spin_locks_claimed;
+
+static bool event_flag[2];
+static ucontext_t core_context[2];
+static void (*core1_entry)(void);
+static uint core;
+
+static irq_handler_t irq_handlers[NUM_IRQS][SIM_IRQ_HANDLERS];
+static uint32_t irq_enabled;
+static uint user_irqs_claimed;
+
+static void sim_finish(void) {
+    fflush(stdout);
+    fprintf(stderr, "sim: %llu.%06llu s\n", (unsigned long long) (now / 1000000), (unsigned long long) (now % 1000000));
+    for (uint i = 0; i < SIM_STATS && stats[i].name; i++) {
+        fprintf(stderr, "sim: %-24s %lu\n", stats[i].name, (unsigned long) stats[i].count);
+    }
+    sim_lwip_report();
+    sim_ili9341_report();
+    exit(0);
+}
+
+static void sim_advance(uint64_t to) {
+    if (to >= end_us) {
+        now = end_us;
+        sim_finish();
+    }
+    if (to > now) {
+        now = to;
+    }
+}
+
+// Runs everything that is due, including events scheduled by those events.
+static bool sim_run_due(void) {
+    bool ran = false;
+    while (events && events->at <= now) {
+        sim_event_t *event = events;
+        events = event->next;
+        event->fn(event->arg);
+        free(event);
+        ran = true;
+    }
+    return ran;
+}
+
+__attribute__((constructor)) static void sim_init(void) {
+    const char *seconds = getenv("SIM_SECONDS");
+    end_us = (uint64_t) (seconds ? strtoul(seconds, NULL, 0) : SIM_DEFAULT_SECONDS) * 1000000;
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+    sim_board_init();
+}
+
+uint64_t sim_now(void) {
+    return now;
+}
+
+sim_event_id_t sim_schedule(uint64_t at_us, sim_event_fn fn, void *arg) {
+    sim_event_t *event = malloc(sizeof(sim_event_t));
+    if (!event) {
+        abort();
+    }
+    event->at = at_us;
+    event->id = ++last_event_id;
+    event->fn = fn;
+    event->arg = arg;
+
+    // Equal times run in the order they were scheduled.
+    sim_event_t **pos = &events;
+    while (*pos && (*pos)->at <= at_us) {
+        pos = &(*pos)->next;
+    }
+    event->next = *pos;
+    *pos = event;
+    return event->id;
+}
+
+bool sim_cancel(sim_event_id_t id) {
+    for (sim_event_t **pos = &events; *pos; pos = &(*pos)->next) {
+        if ((*pos)->id == id) {
+            sim_event_t *event = *pos;
+            *pos = event->next;
+            free(event);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hands the CPU to the other core until it idles or blocks.
+static void sim_core_switch(void) {
+    if (!core1_entry) {
+        return;
+    }
+    uint from = core;
+    core = !from;
+    swapcontext(&core_context[from], &core_context[core]);
+}
+
+static void sim_core1_start(void) {
+    core1_entry();
+    // Returning from the entry point parks core1.
+    while (true) {
+        sim_core_switch();
+    }
+}
+
+// One pass of core0's idle: let core1 run, then run what is due or move the
+// clock on, no further than limit.
+static void sim_step(uint64_t limit) {
+    sim_core_switch();
+    if (sim_run_due()) {
+        idle_spins = 0;
+        return;
+    }
+    uint64_t next = events && events->at < limit ? events->at : limit;
+    if (++idle_spins < SIM_IDLE_SPINS && now + 1 < next) {
+        sim_advance(now + 1);
+    } else {
+        idle_spins = 0;
+        sim_advance(next);
+        sim_run_due();
+    }
+}
+
+// Only core0 moves the clock, core1 waits by handing back to it.
+void sim_run_until(uint64_t at_us) {
+    while (now < at_us) {
+        if (core) {
+            sim_core_switch();
+        } else {
+            sim_step(at_us);
+        }
+    }
+    if (!core) {
+        sim_run_due();
+    }
+}
+
+void sim_sev(void) {
+    event_flag[0] = true;
+    event_flag[1] = true;
+}
+
+// Returns at once if an event was signalled since the last wait, otherwise
+// after core0 has let time run on to the next interrupt. Core1 waits by
+// handing back to core0.
+void sim_wfe(void) {
+    if (!event_flag[core]) {
+        if (core) {
+            sim_core_switch();
+        } else {
+            sim_core_switch();
+            if (!event_flag[0] && !sim_run_due() && events) {
+                idle_spins = 0;
+                sim_advance(events->at);
+                sim_run_due();
+            }
+        }
+    }
+    event_flag[core] = false;
+}
+
+void sim_idle(void) {
+    if (core) {
+        sim_core_switch();
+    } else {
+        sim_step(UINT64_MAX);
+    }
+}
+
+void sim_stat(const char *name, uint32_t delta) {
+    for (uint i = 0; i < SIM_STATS; i++) {
+        if (!stats[i].name) {
+            stats[i].name = name;
+        }
+        if (!strcmp(stats[i].name, name)) {
+            stats[i].count += delta;
+            return;
+        }
+    }
+}
+
+void sim_stdin_push(const char *text) {
+    for (; *text; text++) {
+        if (stdin_head - stdin_tail < SIM_STDIN_SIZE) {
+            stdin_buf[stdin_head++ % SIM_STDIN_SIZE] = *text;
+        }
+    }
+}
+
+// Time
+
+uint64_t time_us_64(void) {
+    return now;
+}
+
+uint32_t time_us_32(void) {
+    return (uint32_t) now;
+}
+
+void busy_wait_us(uint64_t us) {
+    sim_run_until(now + us);
+}
+
+void busy_wait_us_32(uint32_t us) {
+    sim_run_until(now + us);
+}
+
+void sleep_us(uint64_t us) {
+    sim_run_until(now + us);
+}
+
+void sleep_ms(uint32_t ms) {
+    sim_run_until(now + (uint64_t) ms * 1000);
+}
+
+// Marks an alarm whose callback is running, it is not in the event queue.
+#define SIM_ALARM_FIRING -1
+
+static void sim_alarm_fire(void *arg) {
+    sim_alarm_t *alarm = arg;
+    alarm->event = SIM_ALARM_FIRING;
+    sim_stat("timer irqs", 1);
+    int64_t next = alarm->callback(alarm->id, alarm->user_data);
+
+    if (next == 0 && alarm->event == SIM_ALARM_FIRING) {
+        cancel_alarm(alarm->id);
+    }
+    // Cancelled, possibly from inside its own callback.
+    if (alarm->event != SIM_ALARM_FIRING) {
+        free(alarm);
+        return;
+    }
+    alarm->target = next > 0 ? alarm->target + next : now - next;
+    if (alarm->target <= now) {
+        alarm->target = now + 1;
+    }
+    alarm->event = sim_schedule(alarm->target, sim_alarm_fire, alarm);
+}
+
+alarm_id_t add_alarm_at(absolute_time_t time, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    if (time <= now && !fire_if_past) {
+        return 0;
+    }
+    sim_alarm_t *alarm = calloc(1, sizeof(sim_alarm_t));
+    if (!alarm) {
+        return -1;
+    }
+    alarm->id = ++last_alarm_id;
+    alarm->target = time > now ? time : now;
+    alarm->callback = callback;
+    alarm->user_data = user_data;
+    alarm->event = sim_schedule(alarm->target, sim_alarm_fire, alarm);
+    alarm->next = alarms;
+    alarms = alarm;
+    return alarm->id;
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    return add_alarm_at(now + us, callback, user_data, fire_if_past);
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    return add_alarm_at(now + (uint64_t) ms * 1000, callback, user_data, fire_if_past);
+}
+
+bool cancel_alarm(alarm_id_t alarm_id) {
+    for (sim_alarm_t **pos = &alarms; *pos; pos = &(*pos)->next) {
+        sim_alarm_t *alarm = *pos;
+        if (alarm->id == alarm_id) {
+            *pos = alarm->next;
+            // While its callback runs sim_alarm_fire frees it.
+            if (alarm->event == SIM_ALARM_FIRING) {
+                alarm->event = 0;
+            } else {
+                sim_cancel(alarm->event);
+                free(alarm);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static int64_t sim_repeating_timer_fire(alarm_id_t id, void *user_data) {
+    repeating_timer_t *rt = user_data;
+    if (!rt->callback(rt)) {
+        rt->alarm_id = 0;
+        return 0;
+    }
+    return rt->delay_us;
+}
+
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void *user_data, repeating_timer_t *out) {
+    if (!delay_us) {
+        delay_us = 1;
+    }
+    out->delay_us = delay_us;
+    out->callback = callback;
+    out->user_data = user_data;
+    out->alarm_id = add_alarm_in_us(delay_us < 0 ? -delay_us : delay_us, sim_repeating_timer_fire, out, true);
+    return out->alarm_id > 0;
+}
+
+bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t callback, void *user_data, repeating_timer_t *out) {
+    return add_repeating_timer_us((int64_t) delay_ms * 1000, callback, user_data, out);
+}
+
+bool cancel_repeating_timer(repeating_timer_t *timer) {
+    bool cancelled = timer->alarm_id && cancel_alarm(timer->alarm_id);
+    timer->alarm_id = 0;
+    return cancelled;
+}
+
+alarm_pool_t *alarm_pool_create(uint hardware_alarm_num, uint max_timers) {
+    return (alarm_pool_t *) &alarms;
+}
+
+alarm_pool_t *alarm_pool_get_default(void) {
+    return (alarm_pool_t *) &alarms;
+}
+
+alarm_id_t alarm_pool_add_alarm_in_ms(alarm_pool_t *pool, uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    return add_alarm_in_ms(ms, callback, user_data, fire_if_past);
+}
+
+bool alarm_pool_cancel_alarm(alarm_pool_t *pool, alarm_id_t alarm_id) {
+    return cancel_alarm(alarm_id);
+}
+
+bool alarm_pool_add_repeating_timer_us(alarm_pool_t *pool, int64_t delay_us, repeating_timer_callback_t callback, void *user_data, repeating_timer_t *out) {
+    return add_repeating_timer_us(delay_us, callback, user_data, out);
+}
+
+bool alarm_pool_add_repeating_timer_ms(alarm_pool_t *pool, int32_t delay_ms, repeating_timer_callback_t callback, void *user_data, repeating_timer_t *out) {
+    return add_repeating_timer_ms(delay_ms, callback, user_data, out);
+}
+
+// Hardware alarms, as the SDK's default pool has alarm 3 it starts claimed.
+
+static struct {
+    bool claimed;
+    hardware_alarm_callback_t callback;
+    sim_event_id_t event;
+} hardware_alarms[4] = {[3] = {.claimed = true}};
+
+static void sim_hardware_alarm_fire(void *arg) {
+    uint alarm_num = (uint) (uintptr_t) arg;
+    hardware_alarms[alarm_num].event = 0;
+    sim_stat("timer irqs", 1);
+    if (hardware_alarms[alarm_num].callback) {
+        hardware_alarms[alarm_num].callback(alarm_num);
+    }
+}
+
+void hardware_alarm_claim(uint alarm_num) {
+    hardware_alarms[alarm_num].claimed = true;
+}
+
+int hardware_alarm_claim_unused(bool required) {
+    for (uint i = 0; i < count_of(hardware_alarms); i++) {
+        if (!hardware_alarms[i].claimed) {
+            hardware_alarms[i].claimed = true;
+            return (int) i;
+        }
+    }
+    if (required) {
+        abort();
+    }
+    return -1;
+}
+
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback) {
+    hardware_alarms[alarm_num].callback = callback;
+}
+
+void hardware_alarm_cancel(uint alarm_num) {
+    if (hardware_alarms[alarm_num].event) {
+        sim_cancel(hardware_alarms[alarm_num].event);
+        hardware_alarms[alarm_num].event = 0;
+    }
+}
+
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t) {
+    hardware_alarm_cancel(alarm_num);
+    if (t <= now) {
+        return true;
+    }
+    hardware_alarms[alarm_num].event = sim_schedule(t, sim_hardware_alarm_fire, (void *) (uintptr_t) alarm_num);
+    return false;
+}
+
+void hardware_alarm_force_irq(uint alarm_num) {
+    hardware_alarm_cancel(alarm_num);
+    hardware_alarms[alarm_num].event = sim_schedule(now, sim_hardware_alarm_fire, (void *) (uintptr_t) alarm_num);
+}
+
+// Cores
+
+void multicore_launch_core1(void (*entry)(void)) {
+    if (core1_entry) {
+        return;
+    }
+    getcontext(&core_context[1]);
+    core_context[1].uc_stack.ss_sp = malloc(SIM_CORE1_STACK);
+    core_context[1].uc_stack.ss_size = SIM_CORE1_STACK;
+    core_context[1].uc_link = NULL;
+    makecontext(&core_context[1], sim_core1_start, 0);
+    core1_entry = entry;
+    // Core1 starts straight away, as on the device.
+    sim_core_switch();
+}
+
+void multicore_reset_core1(void) {
+}
+
+uint get_core_num(void) {
+    return core;
+}
+
+// stdio, the firmware's output goes to stdout unchanged.
+
+bool stdio_init_all(void) {
+    return true;
+}
+
+int putchar_raw(int c) {
+    return putchar(c);
+}
+
+int puts_raw(const char *s) {
+    return puts(s);
+}
+
+int getchar_timeout_us(uint32_t timeout_us) {
+    if (stdin_head == stdin_tail) {
+        return PICO_ERROR_TIMEOUT;
+    }
+    return (uint8_t) stdin_buf[stdin_tail++ % SIM_STDIN_SIZE];
+}
+
+// Sync, irq and clocks
+
+int spin_lock_claim_unused(bool required) {
+    if (spin_locks_claimed >= count_of(spin_locks)) {
+        if (required) {
+            abort();
+        }
+        return -1;
+    }
+    return (int) spin_locks_claimed++;
+}
+
+spin_lock_t *spin_lock_instance(uint lock_num) {
+    return &spin_locks[lock_num];
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+    if (enabled) {
+        irq_enabled |= 1u << num;
+    } else {
+        irq_enabled &= ~(1u << num);
+    }
+}
+
+bool irq_is_enabled(uint num) {
+    return irq_enabled & (1u << num);
+}
+
+void irq_set_priority(uint num, uint8_t hardware_priority) {
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    memset(irq_handlers[num], 0, sizeof(irq_handlers[num]));
+    irq_handlers[num][0] = handler;
+}
+
+// Run in the order they were added, order_priority is not modelled.
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority) {
+    for (uint i = 0; i < SIM_IRQ_HANDLERS; i++) {
+        if (!irq_handlers[num][i]) {
+            irq_handlers[num][i] = handler;
+            return;
+        }
+    }
+    abort();
+}
+
+irq_handler_t irq_get_exclusive_handler(uint num) {
+    return irq_handlers[num][0];
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler) {
+    for (uint i = 0; i < SIM_IRQ_HANDLERS; i++) {
+        if (irq_handlers[num][i] == handler) {
+            memmove(&irq_handlers[num][i], &irq_handlers[num][i + 1], (SIM_IRQ_HANDLERS - 1 - i) * sizeof(irq_handler_t));
+            irq_handlers[num][SIM_IRQ_HANDLERS - 1] = NULL;
+            return;
+        }
+    }
+}
+
+void irq_set_pending(uint num) {
+    for (uint i = 0; i < SIM_IRQ_HANDLERS && irq_is_enabled(num) && irq_handlers[num][i]; i++) {
+        irq_handlers[num][i]();
+    }
+}
+
+int user_irq_claim_unused(bool required) {
+    if (user_irqs_claimed == NUM_IRQS - FIRST_USER_IRQ) {
+        if (required) {
+            abort();
+        }
+        return -1;
+    }
+    return FIRST_USER_IRQ + (int) user_irqs_claimed++;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+    return clk_index == clk_rtc ? 46875 : clk_index == clk_usb || clk_index == clk_adc ? 48000000 : SIM_CLK_SYS_HZ;
+}
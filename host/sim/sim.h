@@ -0,0 +1,139 @@
+#ifndef _SIM_H
+#define _SIM_H
+
+// Host simulation of the parts of the RP2040 and the board used by the
+// firmware. Everything runs on one thread against a virtual microsecond
+// clock. Interrupt handlers, timer callbacks and device models are events on
+// that clock and only run when the firmware idles (tight_loop_contents,
+// __wfe, sleep_*) or blocks in a simulated SDK call, so interrupt masking is
+// not needed and the run is deterministic.
+//
+// Environment:
+//   SIM_SECONDS  virtual seconds to run before exiting, default 600
+//   SIM_SCRIPT   file of "<seconds> <command> [args]" lines, see sim_script.c
+//   SIM_EPOCH    unix time served by the simulated NTP server at boot
+//   SIM_SENSORS  MCP9808s fitted, default 2, see sim_board.c
+//   SIM_LCD_PPM  file the display is written to at exit, see sim_ili9341.c
+
+#include "pico/stdlib.h"
+#include "lwip/memp.h"
+#include "lwip/pbuf.h"
+
+typedef void (*sim_event_fn)(void *arg);
+typedef int32_t sim_event_id_t;
+
+// Virtual time in microseconds since boot.
+uint64_t sim_now(void);
+
+// Run fn(arg) at the given virtual time, ids are always positive.
+sim_event_id_t sim_schedule(uint64_t at_us, sim_event_fn fn, void *arg);
+bool sim_cancel(sim_event_id_t id);
+
+// Run events up to and including the given time, as a blocking call would.
+void sim_run_until(uint64_t at_us);
+
+// Count of something the summary at exit should report.
+void sim_stat(const char *name, uint32_t delta);
+
+// Board inputs. Open drain outputs on a shared line, like the MCP9808
+// alerts, each hold the line low until they all release it to its pull.
+void sim_gpio_set_input(uint gpio, bool level);
+void sim_gpio_open_drain(uint gpio, bool low);
+// count pulses low of an open drain on the line, interval_us per half, as a
+// bouncing contact or a chattering alert would.
+void sim_gpio_chatter(uint gpio, uint32_t count, uint32_t interval_us);
+
+// I2C devices. The model handles a whole transaction: the register pointer
+// write, an optional data write, then an optional read after a restart.
+// Returning false NAKs the address.
+typedef struct sim_i2c_device {
+    uint8_t addr;
+    bool (*write)(struct sim_i2c_device *dev, const uint8_t *src, size_t len);
+    bool (*read)(struct sim_i2c_device *dev, uint8_t *dst, size_t len);
+    struct sim_i2c_device *next;
+} sim_i2c_device_t;
+
+void sim_i2c_attach(uint bus, sim_i2c_device_t *dev);
+// A command word DMA has written to the block's data_cmd, and a byte read
+// for the channel reading it. The words of the last transaction, for tests.
+void sim_i2c_dma_write(uint bus, uint32_t value);
+void sim_dma_i2c_received(uint bus, uint8_t byte);
+uint sim_i2c_last_commands(uint bus, uint16_t *dst, uint max);
+
+// MCP9808 model, temperatures are in sixteenths of a degree. Once attached
+// a model is named by its address with 0x80 set on bus 1, as the firmware
+// names its sensors.
+void sim_mcp9808_init(uint bus, uint8_t addr, uint alert_gpio);
+void sim_mcp9808_set_temp(uint8_t addr, int16_t temp);
+void sim_mcp9808_set_drift(uint8_t addr, int16_t mean, int16_t amplitude, uint32_t period_s);
+void sim_mcp9808_set_failed(uint8_t addr, bool failed);
+// Swap between two temperatures count times, interval_us apart, ending on
+// low. Across a limit that is an alert each time the output changes.
+void sim_mcp9808_storm(uint8_t addr, int16_t low, int16_t high, uint32_t count, uint32_t interval_us);
+// Moves the sensor's next conversion, and so all after it, delay_us later.
+void sim_mcp9808_delay(uint8_t addr, uint32_t delay_us);
+
+// SPI devices, each selected by its own chip select GPIO going low. A
+// transfer gets the bytes shifted out while it is selected, and fills dst,
+// which may be NULL, with those shifted back.
+typedef struct sim_spi_device {
+    uint cs_gpio;
+    void (*transfer)(struct sim_spi_device *dev, const uint8_t *src, uint8_t *dst, size_t len);
+    struct sim_spi_device *next;
+} sim_spi_device_t;
+
+void sim_spi_attach(uint bus, sim_spi_device_t *dev);
+// Time the bus takes to shift len bytes at its current baud rate.
+uint64_t sim_spi_transfer_us(uint bus, size_t len);
+// An element DMA has written to the bus's data register, and the byte the
+// bus shifted in at the same time, for a channel reading the bus.
+void sim_spi_dma_write(uint bus, uint32_t value);
+void sim_dma_spi_received(uint bus, uint8_t byte);
+
+// ILI9341 panel model. A dump is a binary PPM of the panel as it stands.
+void sim_ili9341_init(uint bus, uint cs_gpio, uint dc_gpio);
+bool sim_ili9341_dump(const char *path);
+void sim_ili9341_report(void);
+
+// XPT2046 touch controller model, on the bus with its chip select and
+// driving pen_gpio. A press is at panel coordinates and held for hold_us,
+// each conversion gets some noise and the odd spike. A trace plays back
+// recorded bursts instead, see sim_xpt2046.c.
+void sim_xpt2046_init(uint bus, uint cs_gpio, uint pen_gpio);
+void sim_xpt2046_press(uint x, uint y, uint32_t hold_us);
+bool sim_xpt2046_trace(const char *path);
+
+// Network.
+void sim_net_set_up(bool up);
+void sim_ntp_set_server(uint32_t delay_us, uint8_t loss_percent);
+// Server n, numbered in the order their names are resolved, offset_us is on
+// top of sim_ntp_set_clock.
+void sim_ntp_set_peer(uint n, uint32_t delay_us, uint32_t jitter_us, uint8_t loss_percent, int64_t offset_us);
+// The servers' clock against the board's timer.
+void sim_ntp_set_clock(int64_t offset_us, int32_t drift_ppb);
+// Server n follows each of its next count replies with a copy, with the
+// originate zeroed if zero_originate.
+void sim_ntp_replay(uint n, bool zero_originate, uint32_t count);
+// Closed loop HTTP clients scraping /metrics for the given time, each
+// waiting interval_us between a reply and its next request. Requests per
+// second and latency are reported at the end.
+void sim_http_load(uint clients, uint32_t interval_us, uint32_t seconds);
+// One scrape, its body printed to stderr a line at a time.
+void sim_http_get(void);
+// lwIP's pools and heap as lwip_stats counts them, false or 0 when lwIP's
+// allocation would fail. The peaks are reported at exit.
+bool sim_lwip_memp_alloc(memp_t type);
+void sim_lwip_memp_free(memp_t type);
+u16_t sim_lwip_mem_alloc(pbuf_layer layer, u16_t length);
+void sim_lwip_mem_free(u16_t size);
+void sim_lwip_report(void);
+
+// Characters for getchar_timeout_us, as if typed on the console.
+void sim_stdin_push(const char *text);
+
+void sim_script_load(const char *path);
+
+// Wires the device models to the pins the firmware uses, see sim_board.c.
+void sim_board_init(void);
+
+#endif
@@ -0,0 +1,41 @@
+#include "sim/sim.h"
+#include "pico/unique_id.h"
+#include "src/ili9341.h"
+#include "src/mcp9808.h"
+#include "src/msp2807.h"
+#include "src/xpt2046.h"
+
+// The board as wired on the bench: two MCP9808s on i2c0 sharing the alert
+// line, the ILI9341 on spi0 and the XPT2046 on spi1. Without a script the
+// first sensor swings through all three limits every ten minutes and the
+// second sits between them. SIM_SENSORS fits more, as on the larger installs: the
+// rest of i2c0's addresses then i2c1's, all on the one alert line and each
+// a quarter degree warmer than the last.
+
+#define SIM_DRIFT_PERIOD_S 600
+#define SIM_SENSORS 2
+#define SIM_SENSORS_PER_BUS 8
+#define SIM_BOARD_ID "\xE6\x60\x58\x38\x83\x1A\x2B\x2C"
+
+void pico_get_unique_board_id(pico_unique_board_id_t *id_out) {
+    memcpy(id_out->id, SIM_BOARD_ID, PICO_UNIQUE_BOARD_ID_SIZE_BYTES);
+}
+
+void sim_board_init(void) {
+    const char *sensors = getenv("SIM_SENSORS");
+    uint count = sensors ? (uint) atoi(sensors) : SIM_SENSORS;
+    for (uint i = 0; i < count && i < 2 * SIM_SENSORS_PER_BUS; i++) {
+        uint bus = i / SIM_SENSORS_PER_BUS;
+        uint8_t addr = 0x18 + i % SIM_SENSORS_PER_BUS;
+        sim_mcp9808_init(bus, addr, MCP9808_IRQ);
+        sim_mcp9808_set_temp(addr | (bus ? MCP9808_I2C1 : 0), MCP9808_TEMP(21) + i * MCP9808_TEMP(0.25));
+    }
+    sim_mcp9808_set_drift(0x18, MCP9808_TEMP(18), MCP9808_TEMP(10), SIM_DRIFT_PERIOD_S);
+    sim_ili9341_init(spi_get_index(ILI9341_SPI), ILI9341_CS, ILI9341_DC);
+    sim_xpt2046_init(spi_get_index(XPT2046_SPI), XPT2046_CS, TOUCHSCREEN_IRQ);
+
+    const char *script = getenv("SIM_SCRIPT");
+    if (script && *script) {
+        sim_script_load(script);
+    }
+}
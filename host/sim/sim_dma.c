@@ -0,0 +1,342 @@
+#include "sim/sim.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/i2c.h"
+#include "hardware/pwm.h"
+#include "hardware/spi.h"
+
+// DMA channels move one element per pacing event. Only the PWM wrap, SPI,
+// I2C and DREQ_FORCE DREQs are modelled: a PWM paced channel moves an
+// element each time its slice wraps, an SPI TX paced one moves the whole
+// block to the SPI model once the bus has had time to shift it out, an I2C
+// TX paced one moves its commands into the I2C model at once as they fit in
+// its FIFO, an SPI or I2C RX paced one takes each byte as the bus shifts it
+// in, and an unpaced one moves them all at once. A channel with its DMA_IRQ_0 enabled raises the
+// interrupt as it completes.
+
+#define CTRL_SIZE_SHIFT 0
+#define CTRL_READ_INCR (1u << 2)
+#define CTRL_WRITE_INCR (1u << 3)
+#define CTRL_CHAIN_SHIFT 4
+#define CTRL_DREQ_SHIFT 8
+
+typedef struct {
+    uint32_t ctrl;
+    const volatile uint8_t *read_addr;
+    volatile uint8_t *write_addr;
+    uint32_t count;
+    bool claimed;
+    bool busy;
+    bool irq0;
+    sim_event_id_t event;
+} SIM_DMA_T;
+
+static SIM_DMA_T channels[NUM_DMA_CHANNELS];
+static uint32_t irq0_status;
+static pwm_hw_t pwm_regs;
+pwm_hw_t *pwm_hw = &pwm_regs;
+
+static void sim_dma_transfer(void *arg);
+
+static uint sim_dma_dreq(SIM_DMA_T *channel) {
+    return (channel->ctrl >> CTRL_DREQ_SHIFT) & 0x3F;
+}
+
+static bool sim_dma_spi_tx(uint dreq) {
+    return dreq == DREQ_SPI0_TX || dreq == DREQ_SPI1_TX;
+}
+
+static bool sim_dma_spi_rx(uint dreq) {
+    return dreq == DREQ_SPI0_RX || dreq == DREQ_SPI1_RX;
+}
+
+static bool sim_dma_i2c_tx(uint dreq) {
+    return dreq == DREQ_I2C0_TX || dreq == DREQ_I2C1_TX;
+}
+
+static bool sim_dma_i2c_rx(uint dreq) {
+    return dreq == DREQ_I2C0_RX || dreq == DREQ_I2C1_RX;
+}
+
+// One wrap of the pacing slice, (top + 1) * div / clk_sys with div in 8.4.
+static uint64_t sim_pwm_wrap_us(uint slice) {
+    uint64_t ticks = (uint64_t) (pwm_hw->slice[slice].top + 1) * pwm_hw->slice[slice].div;
+    uint64_t us = ticks * 1000000 / 16 / clock_get_hz(clk_sys);
+    return us ? us : 1;
+}
+
+static void sim_dma_pace(uint index) {
+    SIM_DMA_T *channel = &channels[index];
+    uint dreq = sim_dma_dreq(channel);
+    uint64_t delay = 0;
+    if (dreq >= DREQ_PWM_WRAP0 && dreq < DREQ_PWM_WRAP0 + NUM_PWM_SLICES) {
+        uint slice = dreq - DREQ_PWM_WRAP0;
+        if (!(pwm_hw->en & (1u << slice))) {
+            // Stalls until the slice runs, never in this firmware.
+            return;
+        }
+        delay = sim_pwm_wrap_us(slice);
+    } else if (sim_dma_spi_tx(dreq)) {
+        uint size = 1u << ((channel->ctrl >> CTRL_SIZE_SHIFT) & 3);
+        delay = sim_spi_transfer_us((dreq - DREQ_SPI0_TX) / 2, channel->count * size);
+    } else if (sim_dma_spi_rx(dreq) || sim_dma_i2c_rx(dreq)) {
+        // Fed by sim_dma_spi_received or sim_dma_i2c_received.
+        return;
+    }
+    channel->event = sim_schedule(sim_now() + delay, sim_dma_transfer, (void *) (uintptr_t) index);
+}
+
+static void sim_dma_trigger(uint index) {
+    SIM_DMA_T *channel = &channels[index];
+    if (channel->busy) {
+        return;
+    }
+    if (!channel->count) {
+        // A zero length transfer completes, and chains, straight away.
+        uint chain = (channel->ctrl >> CTRL_CHAIN_SHIFT) & 0xF;
+        if (chain != index) {
+            sim_dma_trigger(chain);
+        }
+        return;
+    }
+    channel->busy = true;
+    sim_dma_pace(index);
+}
+
+static void sim_dma_complete(uint index) {
+    SIM_DMA_T *channel = &channels[index];
+    channel->busy = false;
+    if (channel->irq0) {
+        irq0_status |= 1u << index;
+        irq_set_pending(DMA_IRQ_0);
+    }
+    uint chain = (channel->ctrl >> CTRL_CHAIN_SHIFT) & 0xF;
+    if (chain != index) {
+        sim_dma_trigger(chain);
+    }
+}
+
+static void sim_dma_transfer(void *arg) {
+    uint index = (uint) (uintptr_t) arg;
+    SIM_DMA_T *channel = &channels[index];
+    uint size = 1u << ((channel->ctrl >> CTRL_SIZE_SHIFT) & 3);
+    uint dreq = sim_dma_dreq(channel);
+
+    channel->event = 0;
+    do {
+        memcpy((void *) channel->write_addr, (const void *) channel->read_addr, size);
+        sim_stat("dma transfers", 1);
+        if (sim_dma_spi_tx(dreq)) {
+            uint32_t value = 0;
+            memcpy(&value, (const void *) channel->read_addr, size);
+            sim_spi_dma_write((dreq - DREQ_SPI0_TX) / 2, value);
+        } else if (sim_dma_i2c_tx(dreq)) {
+            uint32_t value = 0;
+            memcpy(&value, (const void *) channel->read_addr, size);
+            sim_i2c_dma_write((dreq - DREQ_I2C0_TX) / 2, value);
+        }
+        if (channel->ctrl & CTRL_READ_INCR) {
+            channel->read_addr += size;
+        }
+        if (channel->ctrl & CTRL_WRITE_INCR) {
+            channel->write_addr += size;
+        }
+    } while (--channel->count && (sim_dma_spi_tx(dreq) || sim_dma_i2c_tx(dreq)));
+    if (channel->count) {
+        sim_dma_pace(index);
+        return;
+    }
+    sim_dma_complete(index);
+}
+
+// A byte the bus shifted in goes to the channel reading that bus's data
+// register, with none it is dropped as if the FIFO had overrun.
+static void sim_dma_received(uint dreq, uint8_t byte) {
+    for (uint index = 0; index < NUM_DMA_CHANNELS; index++) {
+        SIM_DMA_T *channel = &channels[index];
+        if (channel->busy && sim_dma_dreq(channel) == dreq) {
+            uint size = 1u << ((channel->ctrl >> CTRL_SIZE_SHIFT) & 3);
+            uint32_t value = byte;
+            memcpy((void *) channel->write_addr, &value, size);
+            sim_stat("dma transfers", 1);
+            if (channel->ctrl & CTRL_WRITE_INCR) {
+                channel->write_addr += size;
+            }
+            if (!--channel->count) {
+                sim_dma_complete(index);
+            }
+            return;
+        }
+    }
+}
+
+void sim_dma_spi_received(uint bus, uint8_t byte) {
+    sim_dma_received(DREQ_SPI0_RX + 2 * bus, byte);
+}
+
+void sim_dma_i2c_received(uint bus, uint8_t byte) {
+    sim_dma_received(DREQ_I2C0_RX + 2 * bus, byte);
+}
+
+int dma_claim_unused_channel(bool required) {
+    for (uint i = 0; i < NUM_DMA_CHANNELS; i++) {
+        if (!channels[i].claimed) {
+            channels[i].claimed = true;
+            return (int) i;
+        }
+    }
+    if (required) {
+        abort();
+    }
+    return -1;
+}
+
+void dma_channel_unclaim(uint channel) {
+    channels[channel].claimed = false;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    dma_channel_config c = {0};
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, DREQ_FORCE);
+    channel_config_set_chain_to(&c, channel);
+    return c;
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    c->ctrl = (c->ctrl & ~(3u << CTRL_SIZE_SHIFT)) | (uint32_t) size << CTRL_SIZE_SHIFT;
+}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    c->ctrl = incr ? c->ctrl | CTRL_READ_INCR : c->ctrl & ~CTRL_READ_INCR;
+}
+
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    c->ctrl = incr ? c->ctrl | CTRL_WRITE_INCR : c->ctrl & ~CTRL_WRITE_INCR;
+}
+
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    c->ctrl = (c->ctrl & ~(0x3Fu << CTRL_DREQ_SHIFT)) | (dreq & 0x3F) << CTRL_DREQ_SHIFT;
+}
+
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to) {
+    c->ctrl = (c->ctrl & ~(0xFu << CTRL_CHAIN_SHIFT)) | (chain_to & 0xF) << CTRL_CHAIN_SHIFT;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    channels[channel].ctrl = config->ctrl;
+    channels[channel].write_addr = write_addr;
+    channels[channel].read_addr = read_addr;
+    channels[channel].count = transfer_count;
+    if (trigger) {
+        sim_dma_trigger(channel);
+    }
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger) {
+    channels[channel].read_addr = read_addr;
+    if (trigger) {
+        sim_dma_trigger(channel);
+    }
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger) {
+    channels[channel].write_addr = write_addr;
+    if (trigger) {
+        sim_dma_trigger(channel);
+    }
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+    channels[channel].count = trans_count;
+    if (trigger) {
+        sim_dma_trigger(channel);
+    }
+}
+
+void dma_channel_start(uint channel) {
+    sim_dma_trigger(channel);
+}
+
+void dma_channel_abort(uint channel) {
+    if (channels[channel].event) {
+        sim_cancel(channels[channel].event);
+        channels[channel].event = 0;
+    }
+    channels[channel].busy = false;
+}
+
+bool dma_channel_is_busy(uint channel) {
+    return channels[channel].busy;
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled) {
+    channels[channel].irq0 = enabled;
+}
+
+bool dma_channel_get_irq0_status(uint channel) {
+    return irq0_status & (1u << channel);
+}
+
+void dma_channel_acknowledge_irq0(uint channel) {
+    irq0_status &= ~(1u << channel);
+}
+
+// PWM, only the registers the DMA pacing and the backlight need.
+
+pwm_config pwm_get_default_config(void) {
+    pwm_config c = {0};
+    c.div = 1 << 4;
+    c.top = 0xFFFF;
+    return c;
+}
+
+void pwm_config_set_clkdiv(pwm_config *c, float div) {
+    c->div = (uint32_t) (div * 16.f);
+}
+
+void pwm_config_set_clkdiv_int(pwm_config *c, uint div) {
+    c->div = div << 4;
+}
+
+void pwm_config_set_wrap(pwm_config *c, uint16_t wrap) {
+    c->top = wrap;
+}
+
+void pwm_init(uint slice_num, pwm_config *c, bool start) {
+    pwm_hw->slice[slice_num].csr = 0;
+    pwm_hw->slice[slice_num].ctr = 0;
+    pwm_hw->slice[slice_num].cc = 0;
+    pwm_hw->slice[slice_num].div = c->div;
+    pwm_hw->slice[slice_num].top = c->top;
+    pwm_set_enabled(slice_num, start);
+}
+
+void pwm_set_enabled(uint slice_num, bool enabled) {
+    if (enabled) {
+        pwm_hw->en |= 1u << slice_num;
+    } else {
+        pwm_hw->en &= ~(1u << slice_num);
+    }
+}
+
+void pwm_set_gpio_level(uint gpio, uint16_t level) {
+    uint slice = pwm_gpio_to_slice_num(gpio);
+    uint shift = pwm_gpio_to_channel(gpio) ? 16 : 0;
+    pwm_hw->slice[slice].cc = (pwm_hw->slice[slice].cc & ~(0xFFFFu << shift)) | (uint32_t) level << shift;
+}
+
+void pwm_clear_irq(uint slice_num) {
+    pwm_hw->intr = 1u << slice_num;
+}
+
+void pwm_set_irq_enabled(uint slice_num, bool enabled) {
+    if (enabled) {
+        pwm_hw->inte |= 1u << slice_num;
+    } else {
+        pwm_hw->inte &= ~(1u << slice_num);
+    }
+}
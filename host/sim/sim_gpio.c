@@ -0,0 +1,186 @@
+#include "sim/sim.h"
+#include "hardware/structs/iobank0.h"
+
+// Edges latch in intr whether or not they are enabled, as on the chip, and
+// ints is recomputed from intr, the levels and inte on every change. Any
+// enabled event pending raises IO_IRQ_BANK0, whose shared handlers are the
+// raw handlers and, once a callback is set, the SDK's default one.
+
+typedef struct {
+    bool out;
+    bool level;      // Output value, or the input as driven or pulled
+    bool pull_up;
+    uint8_t drains;  // Open drain outputs holding the line low
+} SIM_GPIO_T;
+
+static SIM_GPIO_T pins[NUM_BANK0_GPIOS];
+static gpio_irq_callback_t irq_callback;
+static iobank0_hw_t iobank0_regs;
+iobank0_hw_t *iobank0_hw = &iobank0_regs;
+
+#define EDGE_EVENTS (GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE)
+
+static uint sim_gpio_shift(uint gpio) {
+    return 4 * (gpio % 8);
+}
+
+static uint32_t sim_gpio_raw(uint gpio) {
+    uint32_t level = pins[gpio].level ? GPIO_IRQ_LEVEL_HIGH : GPIO_IRQ_LEVEL_LOW;
+    return level | ((iobank0_hw->intr[gpio / 8] >> sim_gpio_shift(gpio)) & EDGE_EVENTS);
+}
+
+// Returns whether any enabled event is pending.
+static bool sim_gpio_update(void) {
+    bool pending = false;
+    for (uint reg = 0; reg < count_of(iobank0_hw->intr); reg++) {
+        uint32_t raw = 0;
+        for (uint gpio = reg * 8; gpio < reg * 8 + 8 && gpio < NUM_BANK0_GPIOS; gpio++) {
+            raw |= sim_gpio_raw(gpio) << sim_gpio_shift(gpio);
+        }
+        uint32_t ints = raw & iobank0_hw->proc0_irq_ctrl.inte[reg];
+        iobank0_hw->proc0_irq_ctrl.ints[reg] = ints;
+        iobank0_hw->proc1_irq_ctrl.ints[reg] = ints;
+        pending |= ints != 0;
+    }
+    return pending;
+}
+
+static void sim_gpio_edge(uint gpio, bool level) {
+    SIM_GPIO_T *pin = &pins[gpio];
+    if (pin->level == level) {
+        return;
+    }
+    pin->level = level;
+
+    uint32_t edge = level ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+    iobank0_hw->intr[gpio / 8] |= edge << sim_gpio_shift(gpio);
+    if (sim_gpio_update() && irq_is_enabled(IO_IRQ_BANK0)) {
+        sim_stat("gpio irqs", 1);
+        irq_set_pending(IO_IRQ_BANK0);
+    }
+}
+
+// The SDK's handler behind gpio_set_irq_callback, every pending pin in turn.
+static void sim_gpio_default_irq(void) {
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++) {
+        uint32_t events = gpio_get_irq_event_mask(gpio);
+        if (events) {
+            gpio_acknowledge_irq(gpio, events);
+            irq_callback(gpio, events);
+        }
+    }
+}
+
+void sim_gpio_set_input(uint gpio, bool level) {
+    sim_gpio_edge(gpio, level);
+}
+
+void sim_gpio_open_drain(uint gpio, bool low) {
+    SIM_GPIO_T *pin = &pins[gpio];
+    if (low) {
+        pin->drains++;
+    } else if (pin->drains) {
+        pin->drains--;
+    }
+    sim_gpio_edge(gpio, pin->drains ? false : pin->pull_up);
+}
+
+static struct {
+    uint gpio;
+    uint32_t halves;
+    uint32_t interval_us;
+} chatter;
+
+static void sim_gpio_chatter_step(void *arg) {
+    chatter.halves--;
+    sim_gpio_open_drain(chatter.gpio, chatter.halves & 1);
+    if (chatter.halves) {
+        sim_schedule(sim_now() + chatter.interval_us, sim_gpio_chatter_step, NULL);
+    }
+}
+
+void sim_gpio_chatter(uint gpio, uint32_t count, uint32_t interval_us) {
+    if (count && !chatter.halves) {
+        chatter.gpio = gpio;
+        chatter.halves = 2 * count;
+        chatter.interval_us = interval_us;
+        sim_gpio_chatter_step(NULL);
+    }
+}
+
+void gpio_init(uint gpio) {
+    pins[gpio] = (SIM_GPIO_T) {0};
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+}
+
+void gpio_pull_up(uint gpio) {
+    pins[gpio].pull_up = true;
+    if (!pins[gpio].out && !pins[gpio].drains) {
+        pins[gpio].level = true;
+    }
+}
+
+void gpio_pull_down(uint gpio) {
+    pins[gpio].pull_up = false;
+    if (!pins[gpio].out && !pins[gpio].drains) {
+        pins[gpio].level = false;
+    }
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+    pins[gpio].out = out;
+}
+
+void gpio_put(uint gpio, bool value) {
+    pins[gpio].level = value;
+}
+
+bool gpio_get(uint gpio) {
+    return pins[gpio].level;
+}
+
+// Stale edges are acknowledged first, as the SDK does, so enabling one
+// doesn't fire for an edge from before.
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled) {
+    volatile uint32_t *inte = &iobank0_hw->proc0_irq_ctrl.inte[gpio / 8];
+    gpio_acknowledge_irq(gpio, event_mask);
+    if (enabled) {
+        *inte |= event_mask << sim_gpio_shift(gpio);
+    } else {
+        *inte &= ~(event_mask << sim_gpio_shift(gpio));
+    }
+    iobank0_hw->proc1_irq_ctrl.inte[gpio / 8] = *inte;
+    sim_gpio_update();
+}
+
+void gpio_set_irq_callback(gpio_irq_callback_t callback) {
+    if (!irq_callback) {
+        irq_add_shared_handler(IO_IRQ_BANK0, sim_gpio_default_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    }
+    irq_callback = callback;
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback) {
+    gpio_set_irq_enabled(gpio, event_mask, enabled);
+    gpio_set_irq_callback(callback);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+void gpio_add_raw_irq_handler_masked(uint32_t gpio_mask, irq_handler_t handler) {
+    irq_add_shared_handler(IO_IRQ_BANK0, handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+}
+
+void gpio_add_raw_irq_handler(uint gpio, irq_handler_t handler) {
+    gpio_add_raw_irq_handler_masked(1u << gpio, handler);
+}
+
+void gpio_acknowledge_irq(uint gpio, uint32_t events) {
+    iobank0_hw->intr[gpio / 8] &= ~((events & EDGE_EVENTS) << sim_gpio_shift(gpio));
+    sim_gpio_update();
+}
+
+uint32_t gpio_get_irq_event_mask(uint gpio) {
+    return (iobank0_hw->proc0_irq_ctrl.ints[gpio / 8] >> sim_gpio_shift(gpio)) & 0xF;
+}
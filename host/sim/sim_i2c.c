@@ -0,0 +1,163 @@
+#include "sim/sim.h"
+#include "hardware/i2c.h"
+
+// Both i2c blocks with their attached device models. The blocking calls
+// complete in one go. For the DMA driven i2c_async engine the block is
+// modelled at the register level: command words written to data_cmd by DMA
+// collect until one with STOP, then the transaction completes after the
+// time it would take on the wire at the configured baud rate. Read data
+// goes to the channel reading data_cmd, and an address or data NAK aborts
+// with the rest of the commands counted as flushed, as the controller
+// does. The interrupt status reads as set only while the interrupt runs,
+// reads of the clear registers aren't seen.
+
+#define SIM_I2C_FIFO 16
+
+typedef struct {
+    uint baudrate;
+    sim_i2c_device_t *devices;
+    uint16_t cmd[SIM_I2C_FIFO]; // Since the last STOP
+    uint count;
+    uint16_t last[SIM_I2C_FIFO]; // The last transaction's, for tests
+    uint last_count;
+} SIM_I2C_T;
+
+static i2c_hw_t i2c_regs[2];
+i2c_inst_t i2c0_inst = {&i2c_regs[0], false};
+i2c_inst_t i2c1_inst = {&i2c_regs[1], false};
+
+static SIM_I2C_T buses[2];
+
+static sim_i2c_device_t *sim_i2c_find(uint bus, uint8_t addr) {
+    for (sim_i2c_device_t *dev = buses[bus].devices; dev; dev = dev->next) {
+        if (dev->addr == addr) {
+            return dev;
+        }
+    }
+    return NULL;
+}
+
+// Start, address and a byte per 9 clocks, with a restart and address for a read.
+static uint64_t sim_i2c_bus_time(uint bus, size_t tx_len, size_t rx_len) {
+    uint baudrate = buses[bus].baudrate ? buses[bus].baudrate : 100 * 1000;
+    uint32_t bits = 9 * (1 + tx_len) + 2;
+    if (rx_len) {
+        bits += 9 * (1 + rx_len) + 1;
+    }
+    return ((uint64_t) bits * 1000000 + baudrate - 1) / baudrate;
+}
+
+void sim_i2c_attach(uint bus, sim_i2c_device_t *dev) {
+    dev->next = buses[bus].devices;
+    buses[bus].devices = dev;
+}
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate) {
+    buses[i2c_hw_index(i2c)].baudrate = baudrate;
+    return baudrate;
+}
+
+void i2c_deinit(i2c_inst_t *i2c) {
+    buses[i2c_hw_index(i2c)].baudrate = 0;
+}
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop) {
+    uint bus = i2c_hw_index(i2c);
+    sim_i2c_device_t *dev = sim_i2c_find(bus, addr);
+    sim_run_until(sim_now() + sim_i2c_bus_time(bus, len, 0));
+    sim_stat("i2c transactions", 1);
+    if (!dev || !dev->write(dev, src, len)) {
+        sim_stat("i2c naks", 1);
+        return PICO_ERROR_GENERIC;
+    }
+    return (int) len;
+}
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
+    uint bus = i2c_hw_index(i2c);
+    sim_i2c_device_t *dev = sim_i2c_find(bus, addr);
+    sim_run_until(sim_now() + sim_i2c_bus_time(bus, 0, len));
+    sim_stat("i2c transactions", 1);
+    if (!dev || !dev->read(dev, dst, len)) {
+        sim_stat("i2c naks", 1);
+        return PICO_ERROR_GENERIC;
+    }
+    return (int) len;
+}
+
+static void sim_i2c_complete(void *arg) {
+    uint bus = (uint) (uintptr_t) arg;
+    SIM_I2C_T *b = &buses[bus];
+    i2c_hw_t *hw = &i2c_regs[bus];
+    uint8_t tx[SIM_I2C_FIFO], rx[SIM_I2C_FIFO];
+    uint tx_len = 0, rx_len = 0;
+
+    for (uint i = 0; i < b->count; i++) {
+        if (b->cmd[i] & I2C_IC_DATA_CMD_CMD_BITS) {
+            rx_len++;
+        } else {
+            tx[tx_len++] = (uint8_t) (b->cmd[i] & I2C_IC_DATA_CMD_DAT_BITS);
+        }
+    }
+    memcpy(b->last, b->cmd, sizeof(b->cmd));
+    b->last_count = b->count;
+    b->count = 0;
+
+    // The controller has the first command in hand when the address is
+    // NAKed, and the read with the restart when that address is.
+    sim_i2c_device_t *dev = sim_i2c_find(bus, (uint8_t) (hw->tar & 0x7F));
+    uint32_t status = I2C_IC_INTR_STAT_R_STOP_DET_BITS;
+    uint32_t flushed = 0;
+    sim_stat("i2c transactions", 1);
+    if (!dev || !dev->write(dev, tx, tx_len)) {
+        status |= I2C_IC_INTR_STAT_R_TX_ABRT_BITS;
+        flushed = b->last_count - 1;
+    } else if (rx_len && !dev->read(dev, rx, rx_len)) {
+        status |= I2C_IC_INTR_STAT_R_TX_ABRT_BITS;
+        flushed = rx_len - 1;
+    } else {
+        for (uint i = 0; i < rx_len; i++) {
+            sim_dma_i2c_received(bus, rx[i]);
+        }
+    }
+    if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+        sim_stat("i2c naks", 1);
+    }
+
+    hw->tx_abrt_source = flushed << I2C_IC_TX_ABRT_SOURCE_TX_FLUSH_CNT_LSB;
+    hw->intr_stat = status & hw->intr_mask;
+    if (hw->intr_stat) {
+        irq_set_pending(I2C0_IRQ + bus);
+    }
+    hw->intr_stat = 0;
+    hw->tx_abrt_source = 0;
+}
+
+// A command word DMA has written to data_cmd, the transaction goes on the
+// wire once it has its STOP.
+void sim_i2c_dma_write(uint bus, uint32_t value) {
+    SIM_I2C_T *b = &buses[bus];
+    uint tx_len = 0, rx_len = 0;
+
+    if (b->count == SIM_I2C_FIFO) {
+        return;
+    }
+    b->cmd[b->count++] = (uint16_t) value;
+    if (!(value & I2C_IC_DATA_CMD_STOP_BITS)) {
+        return;
+    }
+    for (uint i = 0; i < b->count; i++) {
+        if (b->cmd[i] & I2C_IC_DATA_CMD_CMD_BITS) {
+            rx_len++;
+        } else {
+            tx_len++;
+        }
+    }
+    sim_schedule(sim_now() + sim_i2c_bus_time(bus, tx_len, rx_len), sim_i2c_complete, (void *) (uintptr_t) bus);
+}
+
+uint sim_i2c_last_commands(uint bus, uint16_t *dst, uint max) {
+    uint count = buses[bus].last_count < max ? buses[bus].last_count : max;
+    memcpy(dst, buses[bus].last, count * sizeof(uint16_t));
+    return count;
+}
@@ -0,0 +1,169 @@
+#include "sim/sim.h"
+
+// ILI9341 panel on the SPI model. Commands and their parameters are told
+// apart by the D/C line as each byte arrives, as the controller does. Only
+// what the firmware sends is decoded: the column and page address windows,
+// memory writes in 16 bit RGB565 and the row/column exchange of MADCTL.
+// Anything else is counted and otherwise ignored. The panel is dumped as a
+// PPM to SIM_LCD_PPM at exit and by the "lcd" script command.
+
+#define SIM_LCD_LONG 320
+#define SIM_LCD_SHORT 240
+#define SIM_LCD_PARAMS 4
+
+#define CMD_SWRESET 0x01
+#define CMD_SLPOUT 0x11
+#define CMD_DISPON 0x29
+#define CMD_CASET 0x2A
+#define CMD_PASET 0x2B
+#define CMD_RAMWR 0x2C
+#define CMD_MADCTL 0x36
+#define MADCTL_MV 0x20
+
+typedef struct {
+    sim_spi_device_t spi;
+    uint dc_gpio;
+    uint8_t cmd;
+    uint8_t params[SIM_LCD_PARAMS];
+    uint nparams;
+    uint8_t madctl;
+    bool awake;
+    bool on;
+    uint16_t col_start, col_end;
+    uint16_t page_start, page_end;
+    uint16_t col, page;
+    bool high_byte; // Odd byte of a pixel pending
+    uint8_t pending;
+    uint16_t pixels[SIM_LCD_SHORT * SIM_LCD_LONG]; // In the order they are scanned, row by row
+} SIM_ILI9341_T;
+
+static SIM_ILI9341_T *panel;
+
+static uint sim_ili9341_width(const SIM_ILI9341_T *lcd) {
+    return lcd->madctl & MADCTL_MV ? SIM_LCD_LONG : SIM_LCD_SHORT;
+}
+
+static uint sim_ili9341_height(const SIM_ILI9341_T *lcd) {
+    return lcd->madctl & MADCTL_MV ? SIM_LCD_SHORT : SIM_LCD_LONG;
+}
+
+static void sim_ili9341_pixel(SIM_ILI9341_T *lcd, uint16_t rgb565) {
+    uint width = sim_ili9341_width(lcd);
+    if (lcd->col < width && lcd->page < sim_ili9341_height(lcd)) {
+        lcd->pixels[lcd->page * width + lcd->col] = rgb565;
+        sim_stat("lcd pixels", 1);
+    }
+    if (lcd->col++ >= lcd->col_end) {
+        lcd->col = lcd->col_start;
+        if (lcd->page++ >= lcd->page_end) {
+            lcd->page = lcd->page_start;
+        }
+    }
+}
+
+static void sim_ili9341_command(SIM_ILI9341_T *lcd, uint8_t cmd) {
+    lcd->cmd = cmd;
+    lcd->nparams = 0;
+    switch (cmd) {
+        case CMD_SWRESET:
+            lcd->madctl = 0;
+            lcd->awake = false;
+            lcd->on = false;
+            break;
+        case CMD_SLPOUT:
+            lcd->awake = true;
+            break;
+        case CMD_DISPON:
+            lcd->on = true;
+            break;
+        case CMD_RAMWR:
+            lcd->col = lcd->col_start;
+            lcd->page = lcd->page_start;
+            lcd->high_byte = false;
+            break;
+    }
+    sim_stat("lcd commands", 1);
+}
+
+static void sim_ili9341_data(SIM_ILI9341_T *lcd, uint8_t byte) {
+    if (lcd->cmd == CMD_RAMWR) {
+        if (lcd->high_byte) {
+            sim_ili9341_pixel(lcd, (uint16_t) (lcd->pending << 8 | byte));
+        }
+        lcd->pending = byte;
+        lcd->high_byte = !lcd->high_byte;
+        return;
+    }
+    if (lcd->nparams < SIM_LCD_PARAMS) {
+        lcd->params[lcd->nparams] = byte;
+    }
+    lcd->nparams++;
+    uint16_t start = (uint16_t) (lcd->params[0] << 8 | lcd->params[1]);
+    uint16_t end = (uint16_t) (lcd->params[2] << 8 | lcd->params[3]);
+    if (lcd->cmd == CMD_CASET && lcd->nparams == 4) {
+        lcd->col_start = start;
+        lcd->col_end = end;
+    } else if (lcd->cmd == CMD_PASET && lcd->nparams == 4) {
+        lcd->page_start = start;
+        lcd->page_end = end;
+    } else if (lcd->cmd == CMD_MADCTL && lcd->nparams == 1) {
+        lcd->madctl = byte;
+    }
+}
+
+static void sim_ili9341_transfer(sim_spi_device_t *dev, const uint8_t *src, uint8_t *dst, size_t len) {
+    SIM_ILI9341_T *lcd = (SIM_ILI9341_T *) dev;
+    bool data = gpio_get(lcd->dc_gpio);
+    for (size_t i = 0; i < len; i++) {
+        if (data) {
+            sim_ili9341_data(lcd, src[i]);
+        } else {
+            sim_ili9341_command(lcd, src[i]);
+        }
+    }
+}
+
+void sim_ili9341_init(uint bus, uint cs_gpio, uint dc_gpio) {
+    panel = calloc(1, sizeof(SIM_ILI9341_T));
+    if (!panel) {
+        abort();
+    }
+    panel->spi.cs_gpio = cs_gpio;
+    panel->spi.transfer = sim_ili9341_transfer;
+    panel->dc_gpio = dc_gpio;
+    panel->col_end = SIM_LCD_SHORT - 1;
+    panel->page_end = SIM_LCD_LONG - 1;
+    sim_spi_attach(bus, &panel->spi);
+}
+
+// Black until the panel is out of sleep with its display on.
+bool sim_ili9341_dump(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!panel || !f) {
+        if (f) {
+            fclose(f);
+        }
+        return false;
+    }
+    uint width = sim_ili9341_width(panel);
+    uint height = sim_ili9341_height(panel);
+    fprintf(f, "P6\n%u %u\n255\n", width, height);
+    for (uint i = 0; i < width * height; i++) {
+        uint16_t p = panel->awake && panel->on ? panel->pixels[i] : 0;
+        uint8_t rgb[3] = {
+            (uint8_t) ((p >> 11) * 255 / 31),
+            (uint8_t) ((p >> 5 & 0x3F) * 255 / 63),
+            (uint8_t) ((p & 0x1F) * 255 / 31),
+        };
+        fwrite(rgb, 1, sizeof(rgb), f);
+    }
+    fclose(f);
+    return true;
+}
+
+void sim_ili9341_report(void) {
+    const char *path = getenv("SIM_LCD_PPM");
+    if (path && !sim_ili9341_dump(path)) {
+        fprintf(stderr, "sim: can't write %s\n", path);
+    }
+}
@@ -0,0 +1,293 @@
+#include <math.h>
+
+#include "sim/sim.h"
+
+// Register level MCP9808 model. The ambient temperature follows a sine
+// around a mean, converted every SIM_MCP9808_CONVERSION_US, and the alert
+// output behaves as the datasheet describes for the window and critical
+// limits, in comparator or interrupt mode, with the hysteresis on the
+// falling side of each limit. The models convert in step unless a
+// sensor's conversions are moved later, as real sensors' drift apart.
+
+#define SIM_MCP9808_DEVICES 16
+#define SIM_MCP9808_I2C1 0x80 // In the names the models are found by, as MCP9808_I2C1
+#define SIM_MCP9808_CONVERSION_US 250000
+#define SIM_MCP9808_MANUFACTURER_ID 0x0054
+#define SIM_MCP9808_DEVICE_ID 0x0400
+
+#define REG_CONFIG 0x01
+#define REG_UPPER 0x02
+#define REG_LOWER 0x03
+#define REG_CRIT 0x04
+#define REG_AMBIENT 0x05
+#define REG_MANUFACTURER 0x06
+#define REG_DEVICE 0x07
+#define REG_RESOLUTION 0x08
+
+#define CONFIG_ALERT_MODE (1 << 0)
+#define CONFIG_ALERT_POLARITY (1 << 1)
+#define CONFIG_ALERT_SELECT (1 << 2)
+#define CONFIG_ALERT_CONTROL (1 << 3)
+#define CONFIG_ALERT_STATUS (1 << 4)
+#define CONFIG_INT_CLEAR (1 << 5)
+#define CONFIG_SHUTDOWN (1 << 8)
+
+enum { WINDOW_BELOW, WINDOW_INSIDE, WINDOW_ABOVE };
+
+typedef struct {
+    sim_i2c_device_t i2c;
+    uint8_t id; // Address, with SIM_MCP9808_I2C1 on the second bus
+    uint alert_gpio;
+    uint8_t pointer;
+    uint16_t config;
+    uint16_t upper;
+    uint16_t lower;
+    uint16_t crit;
+    uint8_t resolution;
+    int16_t ambient;
+    int16_t mean;
+    int16_t amplitude;
+    uint32_t period_s;
+    uint8_t window;
+    bool critical;
+    bool alert; // Output asserted, whatever the polarity
+    bool failed;
+    int16_t storm[2]; // Temperatures to swap between
+    uint32_t storm_left;
+    uint32_t storm_interval_us;
+    sim_event_id_t conversion;
+    uint64_t conversion_at;
+} SIM_MCP9808_T;
+
+static SIM_MCP9808_T models[SIM_MCP9808_DEVICES];
+static uint model_count;
+
+static SIM_MCP9808_T *sim_mcp9808_find(uint8_t id) {
+    for (uint i = 0; i < model_count; i++) {
+        if (models[i].id == id) {
+            return &models[i];
+        }
+    }
+    return NULL;
+}
+
+static int16_t sim_mcp9808_limit(uint16_t reg) {
+    int16_t raw = (int16_t) (reg & 0x1FFC);
+    return raw & 0x1000 ? raw - 0x2000 : raw;
+}
+
+// Sixteenths of a degree per hysteresis setting.
+static int16_t sim_mcp9808_hysteresis(uint16_t config) {
+    static const int16_t hysteresis[4] = {0, 24, 48, 96};
+    return hysteresis[(config >> 9) & 3];
+}
+
+static void sim_mcp9808_update_alert(SIM_MCP9808_T *model) {
+    bool alert = false;
+    if (model->config & CONFIG_ALERT_CONTROL) {
+        if (model->critical) {
+            alert = true;
+        } else if (!(model->config & CONFIG_ALERT_SELECT)) {
+            alert = model->config & CONFIG_ALERT_MODE ? model->config & CONFIG_ALERT_STATUS : model->window != WINDOW_INSIDE;
+        }
+    }
+    if (alert != model->alert) {
+        model->alert = alert;
+        // Active low by default, open drain either way.
+        bool low = alert != !!(model->config & CONFIG_ALERT_POLARITY);
+        sim_gpio_open_drain(model->alert_gpio, low);
+        sim_stat(alert ? "mcp9808 alerts" : "mcp9808 alert releases", 1);
+    }
+}
+
+static int16_t sim_mcp9808_sample(SIM_MCP9808_T *model) {
+    int16_t temp = model->mean;
+    if (model->amplitude && model->period_s) {
+        double phase = (double) sim_now() / 1e6 / model->period_s;
+        temp += (int16_t) lround(model->amplitude * sin(2 * M_PI * phase));
+    }
+    return temp & ~((1 << (3 - (model->resolution & 3))) - 1);
+}
+
+static void sim_mcp9808_convert(void *arg) {
+    SIM_MCP9808_T *model = arg;
+    model->conversion_at = sim_now() + SIM_MCP9808_CONVERSION_US;
+    model->conversion = sim_schedule(model->conversion_at, sim_mcp9808_convert, model);
+    if (model->config & CONFIG_SHUTDOWN) {
+        return;
+    }
+
+    int16_t temp = sim_mcp9808_sample(model);
+    model->ambient = temp;
+
+    int16_t hysteresis = sim_mcp9808_hysteresis(model->config);
+    int16_t upper = sim_mcp9808_limit(model->upper);
+    int16_t lower = sim_mcp9808_limit(model->lower);
+    uint8_t window = model->window;
+    if (temp > upper) {
+        window = WINDOW_ABOVE;
+    } else if (temp < lower - hysteresis) {
+        window = WINDOW_BELOW;
+    } else if ((window == WINDOW_ABOVE && temp <= upper - hysteresis) || (window == WINDOW_BELOW && temp >= lower)) {
+        window = WINDOW_INSIDE;
+    }
+    int16_t crit = sim_mcp9808_limit(model->crit);
+    model->critical = temp >= crit || (model->critical && temp > crit - hysteresis);
+
+    if (window != model->window) {
+        model->window = window;
+        if (model->config & CONFIG_ALERT_MODE) {
+            model->config |= CONFIG_ALERT_STATUS;
+        }
+    }
+    sim_mcp9808_update_alert(model);
+}
+
+static uint16_t sim_mcp9808_register(SIM_MCP9808_T *model) {
+    switch (model->pointer) {
+        case REG_CONFIG:
+            // The status bit reads the output, critical included.
+            return (model->config & ~CONFIG_ALERT_STATUS) | (model->alert ? CONFIG_ALERT_STATUS : 0);
+        case REG_UPPER:
+            return model->upper;
+        case REG_LOWER:
+            return model->lower;
+        case REG_CRIT:
+            return model->crit;
+        case REG_AMBIENT: {
+            int16_t upper = sim_mcp9808_limit(model->upper);
+            int16_t lower = sim_mcp9808_limit(model->lower);
+            int16_t crit = sim_mcp9808_limit(model->crit);
+            return ((uint16_t) model->ambient & 0x1FFF) | (model->ambient >= crit) << 15 |
+                (model->ambient > upper) << 14 | (model->ambient < lower) << 13;
+        }
+        case REG_MANUFACTURER:
+            return SIM_MCP9808_MANUFACTURER_ID;
+        case REG_DEVICE:
+            return SIM_MCP9808_DEVICE_ID;
+        case REG_RESOLUTION:
+            return model->resolution;
+    }
+    return 0;
+}
+
+static bool sim_mcp9808_write(sim_i2c_device_t *dev, const uint8_t *src, size_t len) {
+    SIM_MCP9808_T *model = (SIM_MCP9808_T *) dev;
+    if (model->failed || len == 0) {
+        return !model->failed;
+    }
+    model->pointer = src[0] & 0x0F;
+    if (len == 2 && model->pointer == REG_RESOLUTION) {
+        model->resolution = src[1] & 3;
+    } else if (len >= 3) {
+        uint16_t value = src[1] << 8 | src[2];
+        switch (model->pointer) {
+            case REG_CONFIG:
+                // Status is read only, clear is write only.
+                if (value & CONFIG_INT_CLEAR) {
+                    model->config &= ~CONFIG_ALERT_STATUS;
+                }
+                model->config = (model->config & CONFIG_ALERT_STATUS) | (value & ~(CONFIG_ALERT_STATUS | CONFIG_INT_CLEAR));
+                sim_mcp9808_update_alert(model);
+                break;
+            case REG_UPPER:
+                model->upper = value & 0x1FFC;
+                break;
+            case REG_LOWER:
+                model->lower = value & 0x1FFC;
+                break;
+            case REG_CRIT:
+                model->crit = value & 0x1FFC;
+                break;
+        }
+    }
+    return true;
+}
+
+static bool sim_mcp9808_read(sim_i2c_device_t *dev, uint8_t *dst, size_t len) {
+    SIM_MCP9808_T *model = (SIM_MCP9808_T *) dev;
+    if (model->failed) {
+        return false;
+    }
+    uint16_t value = sim_mcp9808_register(model);
+    if (model->pointer == REG_RESOLUTION) {
+        dst[0] = (uint8_t) value;
+    } else {
+        dst[0] = value >> 8;
+        if (len > 1) {
+            dst[1] = value & 0xFF;
+        }
+    }
+    return true;
+}
+
+void sim_mcp9808_init(uint bus, uint8_t addr, uint alert_gpio) {
+    if (model_count >= SIM_MCP9808_DEVICES) {
+        return;
+    }
+    SIM_MCP9808_T *model = &models[model_count++];
+    model->i2c.addr = addr;
+    model->id = addr | (bus ? SIM_MCP9808_I2C1 : 0);
+    model->i2c.write = sim_mcp9808_write;
+    model->i2c.read = sim_mcp9808_read;
+    model->alert_gpio = alert_gpio;
+    model->resolution = 3;
+    model->mean = 21 * 16;
+    model->window = WINDOW_INSIDE;
+    model->ambient = model->mean;
+    sim_i2c_attach(bus, &model->i2c);
+    model->conversion_at = sim_now() + SIM_MCP9808_CONVERSION_US;
+    model->conversion = sim_schedule(model->conversion_at, sim_mcp9808_convert, model);
+}
+
+void sim_mcp9808_delay(uint8_t addr, uint32_t delay_us) {
+    SIM_MCP9808_T *model = sim_mcp9808_find(addr);
+    if (model && sim_cancel(model->conversion)) {
+        model->conversion_at += delay_us;
+        model->conversion = sim_schedule(model->conversion_at, sim_mcp9808_convert, model);
+    }
+}
+
+void sim_mcp9808_set_temp(uint8_t addr, int16_t temp) {
+    sim_mcp9808_set_drift(addr, temp, 0, 0);
+}
+
+void sim_mcp9808_set_drift(uint8_t addr, int16_t mean, int16_t amplitude, uint32_t period_s) {
+    SIM_MCP9808_T *model = sim_mcp9808_find(addr);
+    if (model) {
+        model->mean = mean;
+        model->amplitude = amplitude;
+        model->period_s = period_s;
+        if (!sim_now()) {
+            // Power on, the first conversion has already happened.
+            model->ambient = sim_mcp9808_sample(model);
+        }
+    }
+}
+
+void sim_mcp9808_set_failed(uint8_t addr, bool failed) {
+    SIM_MCP9808_T *model = sim_mcp9808_find(addr);
+    if (model) {
+        model->failed = failed;
+    }
+}
+
+static void sim_mcp9808_storm_step(void *arg) {
+    SIM_MCP9808_T *model = arg;
+    model->mean = model->storm[model->storm_left & 1];
+    model->amplitude = 0;
+    if (--model->storm_left) {
+        sim_schedule(sim_now() + model->storm_interval_us, sim_mcp9808_storm_step, model);
+    }
+}
+
+void sim_mcp9808_storm(uint8_t addr, int16_t low, int16_t high, uint32_t count, uint32_t interval_us) {
+    SIM_MCP9808_T *model = sim_mcp9808_find(addr);
+    if (model && count) {
+        model->storm[0] = low;
+        model->storm[1] = high;
+        model->storm_left = count;
+        model->storm_interval_us = interval_us;
+        sim_mcp9808_storm_step(model);
+    }
+}
@@ -0,0 +1,577 @@
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "sim/sim.h"
+#include "pico/cyw43_arch.h"
+#include "lwip/stats.h"
+
+// Wi-Fi and just enough lwIP for the firmware's UDP traffic. cyw43_arch_init
+// blocks for SIM_CYW43_INIT_US, as the firmware download does, so the other
+// core runs on meanwhile. A join takes
+// SIM_JOIN_US and ends up, or with no network while the access point is
+// down, and taking the access point down drops a joined link. Nothing is
+// sent or resolved unless the link is up. Each new name
+// resolves after SIM_DNS_DELAY_US to the next of SIM_NTP_SERVERS loopback
+// addresses, 127.0.0.1 upwards, and datagrams sent to one on the NTP port
+// are answered by an NTP server running on the virtual clock, each with its
+// own delay, jitter, loss and offset. The servers' clock is SIM_EPOCH, or a
+// fixed date, plus the virtual time, with an optional common offset and
+// drift against the board's timer. A server can also be made to follow its
+// replies with a replayed copy, as is or with the originate zeroed. Datagrams
+// to anywhere else go out of a real socket, so a listener on the host can
+// receive the telemetry.
+//
+// lwIP's memory is counted as it would be in lwip_stats: pcbs and pool
+// pbufs against their pools, PBUF_RAM against the MEM_SIZE heap with its
+// per allocation header, and an allocation fails when lwIP's would.
+// Received datagrams are PBUF_POOL, as the Wi-Fi driver allocates them.
+
+#define SIM_NTP_SERVERS 4
+#define SIM_SERVER_ADDR(n) (0x0000007F | (uint32_t) ((n) + 1) << 24) // 127.0.0.n+1 in network order
+#define SIM_LOCAL_PORT_BASE 49152
+#define SIM_CYW43_INIT_US (250 * 1000)
+#define SIM_JOIN_US (2 * 1000 * 1000)
+#define SIM_DNS_DELAY_US (15 * 1000)
+#define SIM_NTP_PORT 123
+#define SIM_NTP_MSG_LEN 48
+#define SIM_NTP_DELTA 2208988800u
+#define SIM_NTP_REPLAY_US 1000 // After the reply it copies
+#define SIM_DEFAULT_EPOCH 1760000000u
+#define SIM_PBUF_STRUCT_LEN 16 // sizeof(struct pbuf) on the RP2040
+#define SIM_MEM_HEADER_LEN 8   // lwIP's struct mem, aligned
+#define SIM_MEM_MIN_LEN 12     // lwIP's MIN_SIZE
+
+struct udp_pcb {
+    ip_addr_t local_ip;
+    u16_t local_port;
+    udp_recv_fn recv;
+    void *recv_arg;
+    struct udp_pcb *next;
+};
+
+typedef struct {
+    struct udp_pcb *pcb;
+    uint32_t from;
+    u16_t port;
+    uint8_t data[SIM_NTP_MSG_LEN];
+} SIM_DATAGRAM_T;
+
+typedef struct {
+    struct udp_pcb *pcb;
+    uint server;
+    uint8_t request[SIM_NTP_MSG_LEN];
+} SIM_NTP_REQUEST_T;
+
+typedef struct {
+    char name[64];
+    uint32_t delay_us;
+    uint32_t jitter_us;
+    uint8_t loss_percent;
+    int64_t offset_us;
+    uint32_t replays; // Replies still to be followed by a copy
+    bool replay_zero; // With the originate zeroed
+} SIM_NTP_SERVER_T;
+
+// pbuf_free needs to know what to give back.
+typedef struct {
+    u16_t heap;
+    pbuf_type type;
+    struct pbuf pbuf;
+} SIM_PBUF_T;
+
+typedef struct {
+    char name[64];
+    dns_found_callback found;
+    void *arg;
+} SIM_DNS_T;
+
+cyw43_t cyw43_state;
+const ip_addr_t ip_addr_any = {0};
+
+static struct udp_pcb *pcbs;
+static u16_t next_port = SIM_LOCAL_PORT_BASE;
+static bool net_up = true;
+static int link_status = CYW43_LINK_DOWN;
+static sim_event_id_t join_event;
+static bool wl_led;
+static SIM_NTP_SERVER_T servers[SIM_NTP_SERVERS] = {
+    {.delay_us = 20 * 1000}, {.delay_us = 20 * 1000}, {.delay_us = 20 * 1000}, {.delay_us = 20 * 1000},
+};
+static uint32_t random_seed = 1;
+static int forward_fd = -1;
+static uint32_t epoch = SIM_DEFAULT_EPOCH;
+static int64_t server_offset_us;
+static int32_t server_drift_ppb;
+
+#define LWIP_MEMPOOL(pool, num, size, desc) {.name = desc, .avail = (num)},
+static struct stats_mem pools[MEMP_MAX] = {
+#include "lwip/priv/memp_std.h"
+};
+struct stats_ lwip_stats = {.mem = {.name = "MEM", .avail = MEM_SIZE}};
+
+void sim_net_set_up(bool up) {
+    net_up = up;
+    if (!up && link_status == CYW43_LINK_UP) {
+        link_status = CYW43_LINK_DOWN;
+        sim_stat("wifi drops", 1);
+    }
+}
+
+void sim_ntp_set_server(uint32_t delay_us, uint8_t loss_percent) {
+    for (uint i = 0; i < SIM_NTP_SERVERS; i++) {
+        servers[i].delay_us = delay_us;
+        servers[i].loss_percent = loss_percent;
+    }
+}
+
+void sim_ntp_set_peer(uint n, uint32_t delay_us, uint32_t jitter_us, uint8_t loss_percent, int64_t offset_us) {
+    if (n < SIM_NTP_SERVERS) {
+        servers[n].delay_us = delay_us;
+        servers[n].jitter_us = jitter_us;
+        servers[n].loss_percent = loss_percent;
+        servers[n].offset_us = offset_us;
+    }
+}
+
+void sim_ntp_replay(uint n, bool zero_originate, uint32_t count) {
+    if (n < SIM_NTP_SERVERS) {
+        servers[n].replays = count;
+        servers[n].replay_zero = zero_originate;
+    }
+}
+
+void sim_ntp_set_clock(int64_t offset_us, int32_t drift_ppb) {
+    server_offset_us = offset_us;
+    server_drift_ppb = drift_ppb;
+}
+
+// Deterministic so a run with loss or jitter can be repeated.
+static uint32_t sim_net_random(uint32_t range) {
+    random_seed = random_seed * 1103515245 + 12345;
+    return range ? (random_seed >> 8) % range : 0;
+}
+
+static bool sim_net_lost(uint8_t percent) {
+    return sim_net_random(100) < percent;
+}
+
+// One way trip, half the round trip plus up to the jitter.
+static uint32_t sim_ntp_path_us(const SIM_NTP_SERVER_T *server) {
+    return server->delay_us / 2 + sim_net_random(server->jitter_us + 1);
+}
+
+static void sim_put_u32(uint8_t *p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+// Seconds and fraction since 1900 on the server's clock.
+static void sim_ntp_timestamp(const SIM_NTP_SERVER_T *server, uint8_t *p) {
+    uint64_t us = sim_now() + server_offset_us + server->offset_us + (int64_t) sim_now() * server_drift_ppb / 1000000000;
+    sim_put_u32(p, epoch + SIM_NTP_DELTA + (uint32_t) (us / 1000000));
+    sim_put_u32(p + 4, (uint32_t) (((us % 1000000) << 32) / 1000000));
+}
+
+static void sim_udp_deliver(void *arg) {
+    SIM_DATAGRAM_T *datagram = arg;
+    for (struct udp_pcb *pcb = pcbs; pcb; pcb = pcb->next) {
+        if (pcb == datagram->pcb && pcb->recv) {
+            struct pbuf *p = pbuf_alloc(PBUF_RAW, SIM_NTP_MSG_LEN, PBUF_POOL);
+            ip_addr_t from;
+            if (!p) {
+                sim_stat("udp rx dropped", 1);
+                break;
+            }
+            ip4_addr_set_u32(&from, datagram->from);
+            memcpy(p->payload, datagram->data, SIM_NTP_MSG_LEN);
+            sim_stat("udp received", 1);
+            pcb->recv(pcb->recv_arg, pcb, p, &from, datagram->port);
+            break;
+        }
+    }
+    free(datagram);
+}
+
+// The request arrives half way through the delay and is answered at once.
+static void sim_ntp_answer(void *arg) {
+    SIM_NTP_REQUEST_T *request = arg;
+    SIM_NTP_SERVER_T *server = &servers[request->server];
+    SIM_DATAGRAM_T *reply = calloc(1, sizeof(SIM_DATAGRAM_T));
+
+    reply->pcb = request->pcb;
+    reply->from = SIM_SERVER_ADDR(request->server);
+    reply->port = SIM_NTP_PORT;
+    reply->data[0] = (request->request[0] & 0x38) | 0x4; // Same version, mode 4 (server)
+    reply->data[1] = 2;                                  // Stratum
+    reply->data[2] = request->request[2];                // Poll
+    reply->data[3] = (uint8_t) -20;                      // Precision, about a microsecond
+    reply->data[6] = 0x07;                               // Root delay, about 27ms
+    reply->data[10] = 0x03;                              // Root dispersion, about 12ms
+    memcpy(&reply->data[12], "SIM", 3);                  // Reference id
+    sim_ntp_timestamp(server, &reply->data[16]);         // Reference
+    memcpy(&reply->data[24], &request->request[40], 8);  // Originate is the client's transmit
+    sim_ntp_timestamp(server, &reply->data[32]);         // Receive
+    sim_ntp_timestamp(server, &reply->data[40]);         // Transmit
+    uint64_t at = sim_now() + sim_ntp_path_us(server);
+    sim_schedule(at, sim_udp_deliver, reply);
+    if (server->replays) {
+        SIM_DATAGRAM_T *copy = malloc(sizeof(SIM_DATAGRAM_T));
+        *copy = *reply;
+        if (server->replay_zero) {
+            memset(&copy->data[24], 0, 8);
+        }
+        server->replays -= 1;
+        sim_stat("ntp replays", 1);
+        sim_schedule(at + SIM_NTP_REPLAY_US, sim_udp_deliver, copy);
+    }
+    free(request);
+}
+
+static void sim_ntp_serve(struct udp_pcb *pcb, struct pbuf *p, uint n) {
+    const SIM_NTP_SERVER_T *server = &servers[n];
+    if (p->tot_len != SIM_NTP_MSG_LEN || sim_net_lost(server->loss_percent) || sim_net_lost(server->loss_percent)) {
+        sim_stat("ntp lost", 1);
+        return;
+    }
+    SIM_NTP_REQUEST_T *request = calloc(1, sizeof(SIM_NTP_REQUEST_T));
+    request->pcb = pcb;
+    request->server = n;
+    pbuf_copy_partial(p, request->request, SIM_NTP_MSG_LEN, 0);
+    sim_schedule(sim_now() + sim_ntp_path_us(server), sim_ntp_answer, request);
+}
+
+__attribute__((constructor)) static void sim_net_init(void) {
+    for (uint i = 0; i < MEMP_MAX; i++) {
+        lwip_stats.memp[i] = &pools[i];
+    }
+    const char *value = getenv("SIM_EPOCH");
+    if (value) {
+        epoch = strtoul(value, NULL, 0);
+    }
+}
+
+// cyw43
+
+bool cyw43_is_initialized(cyw43_t *self) {
+    return self->initialized;
+}
+
+int cyw43_arch_init(void) {
+    sim_run_until(sim_now() + SIM_CYW43_INIT_US);
+    cyw43_state.initialized = true;
+    return 0;
+}
+
+void cyw43_arch_deinit(void) {
+    cyw43_state.initialized = false;
+}
+
+void cyw43_arch_enable_sta_mode(void) {
+}
+
+static void sim_wifi_joined(void *arg) {
+    join_event = 0;
+    if (net_up) {
+        link_status = CYW43_LINK_UP;
+        sim_stat("wifi joins", 1);
+    } else {
+        link_status = CYW43_LINK_NONET;
+        sim_stat("wifi join failures", 1);
+    }
+}
+
+int cyw43_arch_wifi_connect_async(const char *ssid, const char *pw, uint32_t auth) {
+    sim_cancel(join_event);
+    link_status = CYW43_LINK_JOIN;
+    join_event = sim_schedule(sim_now() + SIM_JOIN_US, sim_wifi_joined, NULL);
+    return 0;
+}
+
+int cyw43_wifi_leave(cyw43_t *self, int itf) {
+    sim_cancel(join_event);
+    join_event = 0;
+    link_status = CYW43_LINK_DOWN;
+    return 0;
+}
+
+int cyw43_tcpip_link_status(cyw43_t *self, int itf) {
+    return link_status;
+}
+
+void cyw43_arch_gpio_put(uint wl_gpio, bool value) {
+    if (value != wl_led) {
+        sim_stat("wl led toggles", 1);
+    }
+    wl_led = value;
+}
+
+bool cyw43_arch_gpio_get(uint wl_gpio) {
+    return wl_led;
+}
+
+void cyw43_arch_lwip_begin(void) {
+}
+
+void cyw43_arch_lwip_end(void) {
+}
+
+// lwIP
+
+char *ipaddr_ntoa(const ip_addr_t *addr) {
+    static char str[16];
+    snprintf(str, sizeof(str), "%u.%u.%u.%u", ip4_addr1(addr), ip4_addr2(addr), ip4_addr3(addr), ip4_addr4(addr));
+    return str;
+}
+
+int ipaddr_aton(const char *cp, ip_addr_t *addr) {
+    unsigned a, b, c, d;
+    if (sscanf(cp, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+        return 0;
+    }
+    IP4_ADDR(addr, a, b, c, d);
+    return 1;
+}
+
+static bool sim_lwip_count(struct stats_mem *stats, u16_t n) {
+    if (stats->used + n > stats->avail) {
+        stats->err++;
+        return false;
+    }
+    stats->used += n;
+    stats->max = stats->used > stats->max ? stats->used : stats->max;
+    return true;
+}
+
+bool sim_lwip_memp_alloc(memp_t type) {
+    return sim_lwip_count(lwip_stats.memp[type], 1);
+}
+
+void sim_lwip_memp_free(memp_t type) {
+    lwip_stats.memp[type]->used--;
+}
+
+// The heap bytes a PBUF_RAM pbuf of length after layer takes, 0 if it
+// doesn't fit.
+u16_t sim_lwip_mem_alloc(pbuf_layer layer, u16_t length) {
+    u16_t size = (u16_t) (LWIP_MEM_ALIGN_SIZE(SIM_PBUF_STRUCT_LEN + layer) + LWIP_MEM_ALIGN_SIZE(length));
+    size = (u16_t) (SIM_MEM_HEADER_LEN + (size < SIM_MEM_MIN_LEN ? SIM_MEM_MIN_LEN : size));
+    return sim_lwip_count(&lwip_stats.mem, size) ? size : 0;
+}
+
+void sim_lwip_mem_free(u16_t size) {
+    lwip_stats.mem.used -= size;
+}
+
+void sim_lwip_report(void) {
+    fprintf(stderr, "sim: lwip %-15s peak %5u of %5u bytes, %u failed\n", lwip_stats.mem.name, lwip_stats.mem.max,
+            lwip_stats.mem.avail, lwip_stats.mem.err);
+    for (uint i = 0; i < MEMP_MAX; i++) {
+        fprintf(stderr, "sim: lwip %-15s peak %5u of %5u, %u failed\n", pools[i].name, pools[i].max, pools[i].avail,
+                pools[i].err);
+    }
+}
+
+// Pool pbufs are one per allocation, nothing here needs a chain.
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type) {
+    u16_t heap = 0;
+    if (type == PBUF_RAM) {
+        heap = sim_lwip_mem_alloc(layer, length);
+        if (!heap) {
+            return NULL;
+        }
+    } else if (!sim_lwip_memp_alloc(type == PBUF_POOL ? MEMP_PBUF_POOL : MEMP_PBUF)) {
+        return NULL;
+    }
+    SIM_PBUF_T *sp = malloc(sizeof(SIM_PBUF_T) + length);
+    memset(sp, 0, sizeof(SIM_PBUF_T));
+    sp->heap = heap;
+    sp->type = type;
+    struct pbuf *p = &sp->pbuf;
+    p->payload = sp + 1;
+    p->tot_len = length;
+    p->len = length;
+    p->ref = 1;
+    return p;
+}
+
+struct pbuf *pbuf_alloced_custom(pbuf_layer l, u16_t length, pbuf_type type, struct pbuf_custom *p,
+                                 void *payload_mem, u16_t payload_mem_len) {
+    u16_t offset = LWIP_MEM_ALIGN_SIZE(l);
+    if (offset + length > payload_mem_len) {
+        return NULL;
+    }
+    memset(&p->pbuf, 0, sizeof(struct pbuf));
+    p->pbuf.payload = (u8_t *) payload_mem + offset;
+    p->pbuf.tot_len = length;
+    p->pbuf.len = length;
+    p->pbuf.ref = 1;
+    p->pbuf.flags = 0x02; // PBUF_FLAG_IS_CUSTOM
+    return &p->pbuf;
+}
+
+u8_t pbuf_free(struct pbuf *p) {
+    if (!p || --p->ref) {
+        return 0;
+    }
+    if (p->flags & 0x02) {
+        ((struct pbuf_custom *) p)->custom_free_function(p);
+        return 1;
+    }
+    SIM_PBUF_T *sp = (SIM_PBUF_T *) ((u8_t *) p - offsetof(SIM_PBUF_T, pbuf));
+    if (sp->type == PBUF_RAM) {
+        sim_lwip_mem_free(sp->heap);
+    } else {
+        sim_lwip_memp_free(sp->type == PBUF_POOL ? MEMP_PBUF_POOL : MEMP_PBUF);
+    }
+    free(sp);
+    return 1;
+}
+
+void pbuf_ref(struct pbuf *p) {
+    p->ref++;
+}
+
+u8_t pbuf_get_at(const struct pbuf *p, u16_t offset) {
+    return offset < p->len ? ((const u8_t *) p->payload)[offset] : 0;
+}
+
+void pbuf_put_at(struct pbuf *p, u16_t offset, u8_t data) {
+    if (offset < p->len) {
+        ((u8_t *) p->payload)[offset] = data;
+    }
+}
+
+u16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, u16_t len, u16_t offset) {
+    if (offset >= p->len) {
+        return 0;
+    }
+    if (len > p->len - offset) {
+        len = p->len - offset;
+    }
+    memcpy(dataptr, (const u8_t *) p->payload + offset, len);
+    return len;
+}
+
+err_t pbuf_take(struct pbuf *buf, const void *dataptr, u16_t len) {
+    return pbuf_take_at(buf, dataptr, len, 0);
+}
+
+err_t pbuf_take_at(struct pbuf *buf, const void *dataptr, u16_t len, u16_t offset) {
+    if (offset + len > buf->len) {
+        return ERR_MEM;
+    }
+    memcpy((u8_t *) buf->payload + offset, dataptr, len);
+    return ERR_OK;
+}
+
+// Best effort, as UDP is, nothing listening is not an error.
+static void sim_udp_forward(struct pbuf *p, const ip_addr_t *dst_ip, u16_t dst_port) {
+    uint8_t data[1500];
+    struct sockaddr_in to = {
+        .sin_family = AF_INET,
+        .sin_port = htons(dst_port),
+        .sin_addr.s_addr = ip4_addr_get_u32(dst_ip),
+    };
+    if (forward_fd < 0) {
+        forward_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    }
+    u16_t len = pbuf_copy_partial(p, data, sizeof(data), 0);
+    if (forward_fd >= 0 && sendto(forward_fd, data, len, 0, (struct sockaddr *) &to, sizeof(to)) == len) {
+        sim_stat("udp forwarded", 1);
+    }
+}
+
+struct udp_pcb *udp_new(void) {
+    if (!sim_lwip_memp_alloc(MEMP_UDP_PCB)) {
+        return NULL;
+    }
+    struct udp_pcb *pcb = calloc(1, sizeof(struct udp_pcb));
+    if (pcb) {
+        pcb->next = pcbs;
+        pcbs = pcb;
+    }
+    return pcb;
+}
+
+struct udp_pcb *udp_new_ip_type(u8_t type) {
+    return udp_new();
+}
+
+void udp_remove(struct udp_pcb *pcb) {
+    for (struct udp_pcb **pos = &pcbs; *pos; pos = &(*pos)->next) {
+        if (*pos == pcb) {
+            *pos = pcb->next;
+            free(pcb);
+            sim_lwip_memp_free(MEMP_UDP_PCB);
+            return;
+        }
+    }
+}
+
+err_t udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port) {
+    pcb->local_ip = ipaddr ? *ipaddr : ip_addr_any;
+    pcb->local_port = port;
+    return ERR_OK;
+}
+
+void udp_recv(struct udp_pcb *pcb, udp_recv_fn recv, void *recv_arg) {
+    pcb->recv = recv;
+    pcb->recv_arg = recv_arg;
+}
+
+err_t udp_sendto(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *dst_ip, u16_t dst_port) {
+    if (link_status != CYW43_LINK_UP) {
+        return ERR_RTE;
+    }
+    if (!pcb->local_port) {
+        pcb->local_port = next_port++;
+    }
+    sim_stat("udp sent", 1);
+    if (dst_port == SIM_NTP_PORT) {
+        for (uint i = 0; i < SIM_NTP_SERVERS; i++) {
+            if (ip4_addr_get_u32(dst_ip) == SIM_SERVER_ADDR(i) && servers[i].name[0]) {
+                sim_ntp_serve(pcb, p, i);
+            }
+        }
+    } else {
+        sim_udp_forward(p, dst_ip, dst_port);
+    }
+    return ERR_OK;
+}
+
+// Names are given servers in the order they are first asked for, any
+// beyond SIM_NTP_SERVERS don't resolve.
+static void sim_dns_answer(void *arg) {
+    SIM_DNS_T *query = arg;
+    ip_addr_t addr;
+    uint n;
+    for (n = 0; n < SIM_NTP_SERVERS && servers[n].name[0]; n++) {
+        if (!strcmp(servers[n].name, query->name)) {
+            break;
+        }
+    }
+    if (n < SIM_NTP_SERVERS && !servers[n].name[0]) {
+        snprintf(servers[n].name, sizeof(servers[n].name), "%s", query->name);
+    }
+    ip4_addr_set_u32(&addr, SIM_SERVER_ADDR(n));
+    query->found(query->name, link_status == CYW43_LINK_UP && n < SIM_NTP_SERVERS ? &addr : NULL, query->arg);
+    free(query);
+}
+
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg) {
+    if (link_status != CYW43_LINK_UP) {
+        return ERR_RTE;
+    }
+    SIM_DNS_T *query = calloc(1, sizeof(SIM_DNS_T));
+    if (!query) {
+        return ERR_MEM;
+    }
+    snprintf(query->name, sizeof(query->name), "%s", hostname);
+    query->found = found;
+    query->arg = callback_arg;
+    sim_stat("dns queries", 1);
+    sim_schedule(sim_now() + SIM_DNS_DELAY_US, sim_dns_answer, query);
+    return ERR_INPROGRESS;
+}
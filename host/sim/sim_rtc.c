@@ -0,0 +1,49 @@
+#include "sim/sim.h"
+#include "hardware/rtc.h"
+
+// The RTC counts whole seconds from the virtual clock once it has been set.
+
+static bool running;
+static time_t set_time;
+static uint64_t set_at;
+
+void rtc_init(void) {
+    running = false;
+}
+
+bool rtc_set_datetime(datetime_t *t) {
+    struct tm tm = {
+        .tm_year = t->year - 1900,
+        .tm_mon = t->month - 1,
+        .tm_mday = t->day,
+        .tm_hour = t->hour,
+        .tm_min = t->min,
+        .tm_sec = t->sec,
+    };
+    set_time = timegm(&tm);
+    set_at = sim_now();
+    running = true;
+    sim_stat("rtc sets", 1);
+    return true;
+}
+
+bool rtc_get_datetime(datetime_t *t) {
+    if (!running) {
+        return false;
+    }
+    time_t now = set_time + (time_t) ((sim_now() - set_at) / 1000000);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    t->year = tm.tm_year + 1900;
+    t->month = tm.tm_mon + 1;
+    t->day = tm.tm_mday;
+    t->dotw = tm.tm_wday;
+    t->hour = tm.tm_hour;
+    t->min = tm.tm_min;
+    t->sec = tm.tm_sec;
+    return true;
+}
+
+bool rtc_running(void) {
+    return running;
+}
@@ -0,0 +1,136 @@
+#include <ctype.h>
+
+#include "sim/sim.h"
+#include "src/ili9341.h"
+
+// A script is a list of timed board events, one per line:
+//
+//   <seconds> temp <addr> <celsius>
+//   <seconds> drift <addr> <mean> <amplitude> <period seconds>
+//   <seconds> fail <addr> <0|1>          NAK everything addressed to a sensor
+//   <seconds> storm <addr> <low> <high> <count> <interval ms>
+//                                        swap a sensor's temperature, an alert storm
+//   <seconds> delay <addr> <us>          move a sensor's conversions later
+//   <seconds> chatter <gpio> <count> <interval us>
+//                                        pulse a pin low, a bouncing or chattering line
+//   <seconds> touch [<x> <y> [<ms>]]     press the touch screen, by default
+//                                        its middle for 50ms
+//   <seconds> touchtrace <path>          play back recorded touch samples,
+//                                        see sim_xpt2046.c
+//   <seconds> net <0|1>                  access point up or down, down drops the link
+//   <seconds> ntp <delay ms> <loss %>    NTP servers' round trip and loss
+//   <seconds> ntpclock <offset ms> <drift ppm>  NTP servers' clock error
+//   <seconds> ntpserver <n> <delay ms> <jitter ms> <loss %> <offset ms>
+//                                        one NTP server, n from 0 in DNS order
+//   <seconds> ntpreplay <n> <dup|zero> <count>
+//                                        follow server n's next replies with a
+//                                        copy, or one with a zero originate
+//   <seconds> httpload <clients> <interval ms> <seconds>
+//                                        scrape /metrics, see sim_tcp.c
+//   <seconds> httpget                    scrape /metrics once and print the body
+//   <seconds> input <text>               console input, \n for a newline
+//   <seconds> lcd <path>                 write the display to a PPM file
+//
+// Sensor addresses have 0x80 set for those on i2c1. Blank lines and lines
+// starting with # are ignored.
+
+#define SIM_TOUCH_MS 50
+
+static void sim_script_run(void *arg) {
+    char *line = arg;
+    char command[16] = "";
+    char kind[16];
+    int used = 0;
+    unsigned addr, value;
+    double a, b;
+    unsigned period;
+
+    sscanf(line, "%15s %n", command, &used);
+    const char *args = line + used;
+
+    if (!strcmp(command, "temp") && sscanf(args, "%x %lf", &addr, &a) == 2) {
+        sim_mcp9808_set_temp(addr, (int16_t) (a * 16));
+    } else if (!strcmp(command, "drift") && sscanf(args, "%x %lf %lf %u", &addr, &a, &b, &period) == 4) {
+        sim_mcp9808_set_drift(addr, (int16_t) (a * 16), (int16_t) (b * 16), period);
+    } else if (!strcmp(command, "delay") && sscanf(args, "%x %u", &addr, &value) == 2) {
+        sim_mcp9808_delay(addr, value);
+    } else if (!strcmp(command, "fail") && sscanf(args, "%x %u", &addr, &value) == 2) {
+        sim_mcp9808_set_failed(addr, value);
+    } else if (!strcmp(command, "storm") &&
+               sscanf(args, "%x %lf %lf %u %u", &addr, &a, &b, &value, &period) == 5) {
+        sim_mcp9808_storm(addr, (int16_t) (a * 16), (int16_t) (b * 16), value, period * 1000);
+    } else if (!strcmp(command, "chatter") && sscanf(args, "%u %u %u", &addr, &value, &period) == 3) {
+        sim_gpio_chatter(addr, value, period);
+    } else if (!strcmp(command, "touch")) {
+        unsigned x = ILI9341_WIDTH / 2, y = ILI9341_HEIGHT / 2, ms = SIM_TOUCH_MS;
+        sscanf(args, "%u %u %u", &x, &y, &ms);
+        sim_xpt2046_press(x, y, ms * 1000);
+    } else if (!strcmp(command, "touchtrace") && *args) {
+        if (!sim_xpt2046_trace(args)) {
+            fprintf(stderr, "sim: can't read %s\n", args);
+        }
+    } else if (!strcmp(command, "net") && sscanf(args, "%u", &value) == 1) {
+        sim_net_set_up(value);
+    } else if (!strcmp(command, "ntp") && sscanf(args, "%u %u", &period, &value) == 2) {
+        sim_ntp_set_server(period * 1000, value);
+    } else if (!strcmp(command, "ntpserver") &&
+               sscanf(args, "%u %u %lf %u %lf", &addr, &period, &a, &value, &b) == 5) {
+        sim_ntp_set_peer(addr, period * 1000, (uint32_t) (a * 1000), value, (int64_t) (b * 1000));
+    } else if (!strcmp(command, "ntpreplay") && sscanf(args, "%u %15s %u", &addr, kind, &value) == 3 &&
+               (!strcmp(kind, "dup") || !strcmp(kind, "zero"))) {
+        sim_ntp_replay(addr, !strcmp(kind, "zero"), value);
+    } else if (!strcmp(command, "ntpclock") && sscanf(args, "%lf %lf", &a, &b) == 2) {
+        sim_ntp_set_clock((int64_t) (a * 1000), (int32_t) (b * 1000));
+    } else if (!strcmp(command, "httpload") && sscanf(args, "%u %lf %u", &value, &a, &period) == 3) {
+        sim_http_load(value, (uint32_t) (a * 1000), period);
+    } else if (!strcmp(command, "httpget")) {
+        sim_http_get();
+    } else if (!strcmp(command, "input")) {
+        char text[128];
+        uint n = 0;
+        for (const char *c = args; *c && n < sizeof(text) - 1; c++) {
+            if (c[0] == '\\' && c[1] == 'n') {
+                text[n++] = '\n';
+                c++;
+            } else {
+                text[n++] = *c;
+            }
+        }
+        text[n] = 0;
+        sim_stdin_push(text);
+    } else if (!strcmp(command, "lcd") && *args) {
+        if (!sim_ili9341_dump(args)) {
+            fprintf(stderr, "sim: can't write %s\n", args);
+        }
+    } else {
+        fprintf(stderr, "sim: bad script line: %s\n", line);
+    }
+    free(line);
+}
+
+void sim_script_load(const char *path) {
+    FILE *file = fopen(path, "r");
+    char line[160];
+    if (!file) {
+        fprintf(stderr, "sim: cannot open %s\n", path);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), file)) {
+        double seconds;
+        int used = 0;
+        line[strcspn(line, "\r\n")] = 0;
+        char *start = line;
+        while (isspace((unsigned char) *start)) {
+            start++;
+        }
+        if (!*start || *start == '#') {
+            continue;
+        }
+        if (sscanf(start, "%lf %n", &seconds, &used) != 1 || seconds < 0) {
+            fprintf(stderr, "sim: bad script line: %s\n", start);
+            continue;
+        }
+        sim_schedule((uint64_t) (seconds * 1e6), sim_script_run, strdup(start + used));
+    }
+    fclose(file);
+}
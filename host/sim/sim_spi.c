@@ -0,0 +1,102 @@
+#include "sim/sim.h"
+#include "hardware/spi.h"
+
+// The SPI blocks at the byte level. Blocking calls complete in no virtual
+// time, they are only used for a few command bytes, while DMA is paced at
+// the baud rate, see sim_dma.c. Bytes go to whichever attached device has
+// its chip select low, with none selected they are lost and reads see 0xff.
+// The bytes shifted in while DMA sends go to a channel reading the bus.
+
+#define SIM_SPI_CLK_PERI_HZ 125000000
+
+static spi_hw_t spi_regs[2];
+spi_inst_t spi0_inst = {&spi_regs[0]};
+spi_inst_t spi1_inst = {&spi_regs[1]};
+
+static struct {
+    uint baudrate;
+    sim_spi_device_t *devices;
+} buses[2];
+
+void sim_spi_attach(uint bus, sim_spi_device_t *dev) {
+    dev->next = buses[bus].devices;
+    buses[bus].devices = dev;
+}
+
+static sim_spi_device_t *sim_spi_selected(uint bus) {
+    for (sim_spi_device_t *dev = buses[bus].devices; dev; dev = dev->next) {
+        if (!gpio_get(dev->cs_gpio)) {
+            return dev;
+        }
+    }
+    return NULL;
+}
+
+static void sim_spi_transfer(uint bus, const uint8_t *src, uint8_t *dst, size_t len) {
+    sim_spi_device_t *dev = sim_spi_selected(bus);
+    sim_stat("spi bytes", len);
+    if (dst) {
+        memset(dst, 0xFF, len);
+    }
+    if (dev) {
+        dev->transfer(dev, src, dst, len);
+    }
+}
+
+uint64_t sim_spi_transfer_us(uint bus, size_t len) {
+    uint baudrate = buses[bus].baudrate ? buses[bus].baudrate : 1000000;
+    return ((uint64_t) len * 8 * 1000000 + baudrate - 1) / baudrate;
+}
+
+void sim_spi_dma_write(uint bus, uint32_t value) {
+    uint8_t byte = (uint8_t) value;
+    uint8_t in;
+    sim_spi_transfer(bus, &byte, &in, 1);
+    sim_dma_spi_received(bus, in);
+}
+
+// As the SDK, the nearest rate at or below the one asked for that
+// clk_peri / (prescale * (1 + postdiv)) gives, prescale even.
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate) {
+    uint prescale, postdiv;
+    for (prescale = 2; prescale <= 254; prescale += 2) {
+        if ((uint64_t) SIM_SPI_CLK_PERI_HZ < (uint64_t) (prescale + 2) * 256 * baudrate) {
+            break;
+        }
+    }
+    for (postdiv = 256; postdiv > 1; --postdiv) {
+        if (SIM_SPI_CLK_PERI_HZ / (prescale * (postdiv - 1)) > baudrate) {
+            break;
+        }
+    }
+    buses[spi_get_index(spi)].baudrate = SIM_SPI_CLK_PERI_HZ / (prescale * postdiv);
+    return buses[spi_get_index(spi)].baudrate;
+}
+
+uint spi_init(spi_inst_t *spi, uint baudrate) {
+    return spi_set_baudrate(spi, baudrate);
+}
+
+void spi_deinit(spi_inst_t *spi) {
+    buses[spi_get_index(spi)].baudrate = 0;
+}
+
+void spi_set_format(spi_inst_t *spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order) {
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len) {
+    sim_spi_transfer(spi_get_index(spi), src, NULL, len);
+    return (int) len;
+}
+
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len) {
+    uint8_t src[len ? len : 1];
+    memset(src, repeated_tx_data, len);
+    sim_spi_transfer(spi_get_index(spi), src, dst, len);
+    return (int) len;
+}
+
+int spi_write_read_blocking(spi_inst_t *spi, const uint8_t *src, uint8_t *dst, size_t len) {
+    sim_spi_transfer(spi_get_index(spi), src, dst, len);
+    return (int) len;
+}
@@ -0,0 +1,472 @@
+#include "sim/sim.h"
+#include "lwip/tcp.h"
+
+// The lwIP raw TCP API for the firmware's listeners, and HTTP clients to
+// load them. Connections are in memory with a fixed round trip, data is
+// read from the firmware's buffers when a segment goes out, not when it is
+// written, so a buffer reused before it was sent shows up as a bad reply.
+//
+// lwIP's memory is counted in lwip_stats, see sim_net.c: a pcb per
+// connection and a listen pcb per listener, and per write a segment, a
+// PBUF_RAM for the headers, holding the bytes too with TCP_WRITE_FLAG_COPY,
+// and otherwise a referencing pbuf. A request arrives in a PBUF_POOL pbuf.
+// The peaks are in the summary at exit.
+
+#define SIM_TCP_RTT_US (10 * 1000)
+#define SIM_TCP_TICK_US (500 * 1000) // lwIP's coarse timer, for tcp_poll
+#define SIM_HTTP_PORT 80
+#define SIM_HTTP_REQUEST "GET /metrics HTTP/1.0\r\nHost: pico\r\n\r\n"
+#define SIM_HTTP_HEAD_LEN 256
+#define SIM_HTTP_RETRY_US (100 * 1000)
+
+typedef struct sim_tcp_seg {
+    struct sim_tcp_seg *next;
+    struct tcp_pcb *pcb;
+    const u8_t *data; // The firmware's, or a copy
+    u16_t len;
+    u16_t heap; // Header pbuf's, with the copy
+    bool copied;
+    bool delivered;
+    sim_event_id_t event;
+} SIM_TCP_SEG_T;
+
+typedef struct sim_http_client SIM_HTTP_CLIENT_T;
+
+struct tcp_pcb {
+    struct tcp_pcb *next;
+    bool listening;
+    bool closed; // By the firmware, FIN after the last segment
+    bool dead;
+    u16_t port;
+    void *arg;
+    tcp_accept_fn accept;
+    tcp_recv_fn recv;
+    tcp_sent_fn sent;
+    tcp_poll_fn poll;
+    tcp_err_fn err;
+    u8_t poll_interval;
+    sim_event_id_t poll_event;
+    u32_t unacked;
+    u16_t queued;
+    SIM_TCP_SEG_T *segs;
+    SIM_HTTP_CLIENT_T *client;
+};
+
+struct sim_http_client {
+    struct tcp_pcb *pcb;
+    uint64_t started;
+    uint32_t received;
+    char head[SIM_HTTP_HEAD_LEN];
+};
+
+typedef struct {
+    uint clients;
+    uint32_t interval_us;
+    uint64_t start;
+    uint64_t end;
+    uint32_t ok;
+    uint32_t failed;
+    uint32_t refused;
+    uint64_t latency_max;
+    uint64_t latency_total;
+} SIM_HTTP_LOAD_T;
+
+static struct tcp_pcb *pcbs;
+static SIM_HTTP_LOAD_T load;
+
+// One scrape whose reply is kept whole and printed, for the scenarios.
+static struct {
+    SIM_HTTP_CLIENT_T client;
+    char *reply;
+    uint32_t len;
+} get;
+
+static void sim_http_done(SIM_HTTP_CLIENT_T *client, bool reset);
+
+static void sim_tcp_reap(void *arg) {
+    for (struct tcp_pcb **pos = &pcbs; *pos;) {
+        struct tcp_pcb *pcb = *pos;
+        if (pcb->dead) {
+            *pos = pcb->next;
+            free(pcb);
+        } else {
+            pos = &pcb->next;
+        }
+    }
+}
+
+static void sim_tcp_free_seg(SIM_TCP_SEG_T *seg) {
+    sim_lwip_memp_free(MEMP_TCP_SEG);
+    sim_lwip_mem_free(seg->heap);
+    if (seg->copied) {
+        free((void *) seg->data);
+    } else {
+        sim_lwip_memp_free(MEMP_PBUF);
+    }
+    free(seg);
+}
+
+// Freed after the event that killed it, the firmware may still be in a
+// callback with it.
+static void sim_tcp_kill(struct tcp_pcb *pcb) {
+    if (pcb->dead) {
+        return;
+    }
+    pcb->dead = true;
+    sim_lwip_memp_free(pcb->listening ? MEMP_TCP_PCB_LISTEN : MEMP_TCP_PCB);
+    sim_cancel(pcb->poll_event);
+    while (pcb->segs) {
+        SIM_TCP_SEG_T *seg = pcb->segs;
+        pcb->segs = seg->next;
+        sim_cancel(seg->event);
+        sim_tcp_free_seg(seg);
+    }
+    sim_schedule(sim_now(), sim_tcp_reap, NULL);
+}
+
+static void sim_tcp_poll(void *arg) {
+    struct tcp_pcb *pcb = arg;
+    pcb->poll_event = sim_schedule(sim_now() + pcb->poll_interval * SIM_TCP_TICK_US, sim_tcp_poll, pcb);
+    if (pcb->poll && !pcb->closed) {
+        pcb->poll(pcb->arg, pcb);
+    }
+}
+
+static void sim_tcp_fin(void *arg) {
+    struct tcp_pcb *pcb = arg;
+    SIM_HTTP_CLIENT_T *client = pcb->client;
+    sim_tcp_kill(pcb);
+    if (client) {
+        sim_http_done(client, false);
+    }
+}
+
+static void sim_tcp_ack(void *arg) {
+    SIM_TCP_SEG_T *seg = arg;
+    struct tcp_pcb *pcb = seg->pcb;
+    u16_t len = seg->len;
+
+    pcb->segs = seg->next;
+    pcb->unacked -= len;
+    pcb->queued -= 1;
+    sim_tcp_free_seg(seg);
+    // A close from the callback schedules its own FIN.
+    if (pcb->closed) {
+        if (!pcb->segs) {
+            sim_tcp_fin(pcb);
+        }
+    } else if (pcb->sent) {
+        pcb->sent(pcb->arg, pcb, len);
+    }
+}
+
+// The bytes are taken now, as the driver would.
+static void sim_tcp_deliver(void *arg) {
+    SIM_TCP_SEG_T *seg = arg;
+    SIM_HTTP_CLIENT_T *client = seg->pcb->client;
+    if (client) {
+        for (u16_t i = 0; i < seg->len; i++, client->received++) {
+            if (client->received < SIM_HTTP_HEAD_LEN - 1) {
+                client->head[client->received] = (char) seg->data[i];
+            }
+        }
+        if (client == &get.client) {
+            get.reply = realloc(get.reply, get.len + seg->len + 1);
+            memcpy(&get.reply[get.len], seg->data, seg->len);
+            get.len += seg->len;
+            get.reply[get.len] = 0;
+        }
+    }
+    seg->delivered = true;
+    seg->event = sim_schedule(sim_now() + SIM_TCP_RTT_US / 2, sim_tcp_ack, seg);
+}
+
+struct tcp_pcb *tcp_new(void) {
+    if (!sim_lwip_memp_alloc(MEMP_TCP_PCB)) {
+        return NULL;
+    }
+    struct tcp_pcb *pcb = calloc(1, sizeof(struct tcp_pcb));
+    if (pcb) {
+        pcb->next = pcbs;
+        pcbs = pcb;
+    }
+    return pcb;
+}
+
+struct tcp_pcb *tcp_new_ip_type(u8_t type) {
+    return tcp_new();
+}
+
+err_t tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port) {
+    for (struct tcp_pcb *other = pcbs; other; other = other->next) {
+        if (other->listening && !other->dead && other->port == port) {
+            return ERR_USE;
+        }
+    }
+    pcb->port = port;
+    return ERR_OK;
+}
+
+// lwIP swaps the pcb for a smaller listen pcb.
+struct tcp_pcb *tcp_listen_with_backlog(struct tcp_pcb *pcb, u8_t backlog) {
+    if (!sim_lwip_memp_alloc(MEMP_TCP_PCB_LISTEN)) {
+        return NULL;
+    }
+    sim_lwip_memp_free(MEMP_TCP_PCB);
+    pcb->listening = true;
+    return pcb;
+}
+
+void tcp_arg(struct tcp_pcb *pcb, void *arg) {
+    pcb->arg = arg;
+}
+
+void tcp_accept(struct tcp_pcb *pcb, tcp_accept_fn accept) {
+    pcb->accept = accept;
+}
+
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv) {
+    pcb->recv = recv;
+}
+
+void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent) {
+    pcb->sent = sent;
+}
+
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err) {
+    pcb->err = err;
+}
+
+void tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval) {
+    pcb->poll = poll;
+    pcb->poll_interval = interval;
+    sim_cancel(pcb->poll_event);
+    pcb->poll_event = 0;
+    if (poll && interval) {
+        pcb->poll_event = sim_schedule(sim_now() + interval * SIM_TCP_TICK_US, sim_tcp_poll, pcb);
+    }
+}
+
+void tcp_setprio(struct tcp_pcb *pcb, u8_t prio) {
+}
+
+void tcp_recved(struct tcp_pcb *pcb, u16_t len) {
+}
+
+u16_t tcp_sndbuf(const struct tcp_pcb *pcb) {
+    return (u16_t) (TCP_SND_BUF - pcb->unacked);
+}
+
+u16_t tcp_sndqueuelen(const struct tcp_pcb *pcb) {
+    return pcb->queued;
+}
+
+err_t tcp_write(struct tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags) {
+    bool copy = apiflags & TCP_WRITE_FLAG_COPY;
+    if (pcb->dead || pcb->closed || !pcb->client) {
+        return ERR_CONN;
+    }
+    u16_t heap;
+    if (len > tcp_sndbuf(pcb) || pcb->queued >= TCP_SND_QUEUELEN || !sim_lwip_memp_alloc(MEMP_TCP_SEG)) {
+        sim_stat("tcp write ERR_MEM", 1);
+        return ERR_MEM;
+    }
+    heap = sim_lwip_mem_alloc(PBUF_TRANSPORT, copy ? len : 0);
+    if (!heap || (!copy && !sim_lwip_memp_alloc(MEMP_PBUF))) {
+        sim_lwip_memp_free(MEMP_TCP_SEG);
+        sim_lwip_mem_free(heap);
+        sim_stat("tcp write ERR_MEM", 1);
+        return ERR_MEM;
+    }
+    SIM_TCP_SEG_T *seg = calloc(1, sizeof(SIM_TCP_SEG_T));
+    seg->pcb = pcb;
+    seg->len = len;
+    seg->heap = heap;
+    seg->copied = copy;
+    if (copy) {
+        seg->data = malloc(len);
+        memcpy((void *) seg->data, dataptr, len);
+    } else {
+        seg->data = dataptr;
+    }
+    SIM_TCP_SEG_T **tail = &pcb->segs;
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    *tail = seg;
+    pcb->unacked += len;
+    pcb->queued += 1;
+    seg->event = sim_schedule(sim_now() + SIM_TCP_RTT_US / 2, sim_tcp_deliver, seg);
+    return ERR_OK;
+}
+
+err_t tcp_output(struct tcp_pcb *pcb) {
+    return ERR_OK;
+}
+
+err_t tcp_close(struct tcp_pcb *pcb) {
+    if (pcb->listening || !pcb->client) {
+        sim_tcp_kill(pcb);
+    } else if (!pcb->closed) {
+        pcb->closed = true;
+        if (!pcb->segs) {
+            sim_schedule(sim_now() + SIM_TCP_RTT_US / 2, sim_tcp_fin, pcb);
+        }
+    }
+    return ERR_OK;
+}
+
+void tcp_abort(struct tcp_pcb *pcb) {
+    SIM_HTTP_CLIENT_T *client = pcb->client;
+    tcp_err_fn err = pcb->err;
+    void *arg = pcb->arg;
+    sim_tcp_kill(pcb);
+    if (err) {
+        err(arg, ERR_ABRT);
+    }
+    if (client) {
+        sim_http_done(client, true);
+    }
+}
+
+// HTTP load clients
+
+static void sim_http_connect(void *arg);
+
+static void sim_http_request(void *arg) {
+    struct tcp_pcb *pcb = arg;
+    if (pcb->dead) {
+        return;
+    }
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, sizeof(SIM_HTTP_REQUEST) - 1, PBUF_POOL);
+    if (!p) {
+        // Dropped by the driver, the client gives up on it.
+        tcp_abort(pcb);
+        return;
+    }
+    memcpy(p->payload, SIM_HTTP_REQUEST, sizeof(SIM_HTTP_REQUEST) - 1);
+    if (pcb->recv) {
+        pcb->recv(pcb->arg, pcb, p, ERR_OK);
+    } else {
+        pbuf_free(p);
+    }
+}
+
+// A good reply is a 200 with as many bytes after the header as it says.
+static bool sim_http_check(SIM_HTTP_CLIENT_T *client) {
+    unsigned length;
+    const char *body = strstr(client->head, "\r\n\r\n");
+    const char *field = strstr(client->head, "Content-Length: ");
+    return !strncmp(client->head, "HTTP/1.0 200 ", 13) && body && field && sscanf(field + 16, "%u", &length) == 1 &&
+           client->received == (uint32_t) (body + 4 - client->head) + length;
+}
+
+// The body a line at a time, each after "sim: http ".
+static void sim_http_print(bool reset) {
+    const char *body = get.reply ? strstr(get.reply, "\r\n\r\n") : NULL;
+    if (reset || !body || !sim_http_check(&get.client)) {
+        fprintf(stderr, "sim: http get failed\n");
+        return;
+    }
+    for (const char *line = body + 4; *line;) {
+        const char *end = strchr(line, '\n');
+        int len = end ? (int) (end - line) : (int) strlen(line);
+        fprintf(stderr, "sim: http %.*s\n", len, line);
+        line += len + (end != NULL);
+    }
+}
+
+static void sim_http_done(SIM_HTTP_CLIENT_T *client, bool reset) {
+    uint64_t latency = sim_now() - client->started;
+    uint32_t wait_us = load.interval_us + 1;
+    if (client == &get.client) {
+        client->pcb = NULL;
+        sim_http_print(reset);
+        return;
+    }
+    if (reset && !client->received) {
+        // Turned away by the server, as when it has no pcb to spare.
+        load.refused++;
+        sim_stat("http refused", 1);
+        wait_us = SIM_HTTP_RETRY_US;
+    } else if (!reset && sim_http_check(client)) {
+        load.ok++;
+        load.latency_total += latency;
+        load.latency_max = latency > load.latency_max ? latency : load.latency_max;
+        sim_stat("http ok", 1);
+    } else {
+        load.failed++;
+        sim_stat("http failed", 1);
+    }
+    client->pcb = NULL;
+    if (sim_now() + wait_us < load.end) {
+        sim_schedule(sim_now() + wait_us, sim_http_connect, client);
+    }
+}
+
+static void sim_http_connect(void *arg) {
+    SIM_HTTP_CLIENT_T *client = arg;
+    struct tcp_pcb *listener = NULL;
+
+    memset(client, 0, sizeof(SIM_HTTP_CLIENT_T));
+    client->started = sim_now();
+    for (struct tcp_pcb *pcb = pcbs; pcb; pcb = pcb->next) {
+        if (pcb->listening && !pcb->dead && pcb->port == SIM_HTTP_PORT && pcb->accept) {
+            listener = pcb;
+        }
+    }
+    // lwIP would reset the SYN with no pcb to spare.
+    struct tcp_pcb *pcb = listener ? tcp_new() : NULL;
+    if (!pcb) {
+        sim_http_done(client, true);
+        return;
+    }
+    pcb->port = listener->port;
+    pcb->arg = listener->arg;
+    pcb->client = client;
+    client->pcb = pcb;
+    if (listener->accept(listener->arg, pcb, ERR_OK) != ERR_OK) {
+        if (!pcb->dead) {
+            tcp_abort(pcb);
+        }
+        return;
+    }
+    sim_schedule(sim_now() + SIM_TCP_RTT_US / 2, sim_http_request, pcb);
+}
+
+static void sim_http_report(void *arg) {
+    uint64_t elapsed = sim_now() - load.start;
+    fprintf(stderr, "sim: http load %u clients, %lu ok %lu failed %lu refused in %.1f s, %.1f requests/s\n",
+            load.clients, (unsigned long) load.ok, (unsigned long) load.failed, (unsigned long) load.refused,
+            elapsed / 1e6, load.ok * 1e6 / elapsed);
+    fprintf(stderr, "sim: http latency mean %.1f ms max %.1f ms\n",
+            load.ok ? load.latency_total / 1e3 / load.ok : 0.0, load.latency_max / 1e3);
+}
+
+void sim_http_load(uint clients, uint32_t interval_us, uint32_t seconds) {
+    static SIM_HTTP_CLIENT_T *pool;
+    static uint pool_size;
+    if (clients > pool_size) {
+        pool = realloc(pool, clients * sizeof(SIM_HTTP_CLIENT_T));
+        pool_size = clients;
+    }
+    load = (SIM_HTTP_LOAD_T) {
+        .clients = clients,
+        .interval_us = interval_us,
+        .start = sim_now(),
+        .end = sim_now() + (uint64_t) seconds * 1000000,
+    };
+    for (uint i = 0; i < clients; i++) {
+        sim_schedule(sim_now() + i * (SIM_TCP_RTT_US / clients) + 1, sim_http_connect, &pool[i]);
+    }
+    // Time for the last requests to finish.
+    sim_schedule(load.end + SIM_TCP_RTT_US * 10, sim_http_report, NULL);
+}
+
+void sim_http_get(void) {
+    if (get.client.pcb) {
+        return;
+    }
+    get.len = 0;
+    sim_schedule(sim_now() + 1, sim_http_connect, &get.client);
+}
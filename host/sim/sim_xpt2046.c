@@ -0,0 +1,217 @@
+#include <ctype.h>
+
+#include "sim/sim.h"
+#include "src/xpt2046.h"
+
+// XPT2046 on the SPI model. A control byte, one with the start bit set,
+// starts a conversion whose 12 bit result is shifted out in the next two
+// bytes, so a control byte may overlap the last byte of the conversion
+// before it as the firmware's 16 clock bursts do. The power down bits of
+// each control byte enable or disable PENIRQ, which is driven low while
+// the panel is pressed and it is enabled.
+//
+// A press answers each conversion from the panel coordinates, through the
+// firmware's default calibration, give or take SIM_TOUCH_NOISE with a spike
+// every SIM_TOUCH_SPIKE_EVERY conversions. A trace file instead has one
+// recorded burst per line, the firmware's XPT2046_SAMPLES conversions each
+// of X, Y, Z1 and Z2 in that order, or "up" for the pen lifted. A line is
+// used up by the power down command that ends each burst, and the pen is
+// lifted at the end of the file. Blank lines and # comments are skipped.
+
+#define SIM_TOUCH_NOISE 6
+#define SIM_TOUCH_SPIKE 700
+#define SIM_TOUCH_SPIKE_EVERY 7
+#define SIM_TOUCH_Z1 600 // Z1 + 4095 - Z2 of a firm press, 1200
+#define SIM_TOUCH_Z2 3495
+#define SIM_TOUCH_TRACE_LINES 1024
+
+#define CTRL_START 0x80
+#define CTRL_CHANNEL_SHIFT 4
+#define CTRL_PD_MASK 0x03
+
+typedef struct {
+    uint16_t samples[XPT2046_CHANNELS][XPT2046_SAMPLES];
+    bool up;
+} SIM_TOUCH_BURST_T;
+
+static struct {
+    sim_spi_device_t spi;
+    uint pen_gpio;
+    bool pressed;
+    bool pen_enabled;
+    bool pen_low;       // Holding PENIRQ low
+    uint16_t raw[XPT2046_CHANNELS];
+    uint8_t out[2];     // Result bytes still to shift out
+    uint pending;
+    uint32_t noise;     // LFSR
+    uint conversions;
+    sim_event_id_t release;
+    SIM_TOUCH_BURST_T *trace;
+    uint trace_lines;
+    uint trace_line;
+    uint trace_used[XPT2046_CHANNELS];
+} touch;
+
+static void sim_xpt2046_pen(void) {
+    bool low = touch.pressed && touch.pen_enabled;
+    if (low != touch.pen_low) {
+        touch.pen_low = low;
+        sim_gpio_open_drain(touch.pen_gpio, low);
+    }
+}
+
+static uint8_t sim_xpt2046_channel(uint8_t ctrl) {
+    switch ((ctrl >> CTRL_CHANNEL_SHIFT) & 7) {
+        case XPT2046_CTRL_X >> CTRL_CHANNEL_SHIFT & 7:
+            return XPT2046_X;
+        case XPT2046_CTRL_Y >> CTRL_CHANNEL_SHIFT & 7:
+            return XPT2046_Y;
+        case XPT2046_CTRL_Z1 >> CTRL_CHANNEL_SHIFT & 7:
+            return XPT2046_Z1;
+        default:
+            return XPT2046_Z2;
+    }
+}
+
+static uint16_t sim_xpt2046_noisy(uint16_t value) {
+    int32_t v = value;
+    touch.noise = touch.noise >> 1 ^ (-(touch.noise & 1) & 0xB4BCD35Cu);
+    v += (int32_t) (touch.noise % (2 * SIM_TOUCH_NOISE + 1)) - SIM_TOUCH_NOISE;
+    if (++touch.conversions % SIM_TOUCH_SPIKE_EVERY == 0) {
+        v += SIM_TOUCH_SPIKE;
+    }
+    return (uint16_t) (v < 0 ? 0 : v > 4095 ? 4095 : v);
+}
+
+static uint16_t sim_xpt2046_convert(uint8_t ctrl) {
+    uint channel = sim_xpt2046_channel(ctrl);
+    if (touch.trace && touch.trace_line < touch.trace_lines && !touch.trace[touch.trace_line].up) {
+        uint used = touch.trace_used[channel]++;
+        return touch.trace[touch.trace_line].samples[channel][used < XPT2046_SAMPLES ? used : XPT2046_SAMPLES - 1];
+    }
+    if (!touch.pressed) {
+        // Nothing drives the plates, the readings sit at the rails.
+        return channel == XPT2046_Z2 ? 4095 : 0;
+    }
+    return sim_xpt2046_noisy(touch.raw[channel]);
+}
+
+// A trace line is used up as its burst ends, the next one may lift the pen.
+static void sim_xpt2046_trace_next(void) {
+    if (!touch.trace) {
+        return;
+    }
+    memset(touch.trace_used, 0, sizeof(touch.trace_used));
+    if (++touch.trace_line >= touch.trace_lines || touch.trace[touch.trace_line].up) {
+        touch.pressed = false;
+    }
+    if (touch.trace_line >= touch.trace_lines) {
+        free(touch.trace);
+        touch.trace = NULL;
+    }
+}
+
+static void sim_xpt2046_transfer(sim_spi_device_t *dev, const uint8_t *src, uint8_t *dst, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint8_t out = 0;
+        if (touch.pending) {
+            out = touch.out[2 - touch.pending--];
+        }
+        if (dst) {
+            dst[i] = out;
+        }
+        if (src[i] & CTRL_START) {
+            // A busy clock, the 12 bits, then zeros.
+            uint16_t value = sim_xpt2046_convert(src[i]);
+            touch.out[0] = (uint8_t) (value >> 5);
+            touch.out[1] = (uint8_t) (value << 3);
+            touch.pending = 2;
+            bool pen_enabled = !(src[i] & CTRL_PD_MASK);
+            if (pen_enabled && !touch.pen_enabled) {
+                sim_xpt2046_trace_next();
+            }
+            touch.pen_enabled = pen_enabled;
+        }
+    }
+    sim_xpt2046_pen();
+}
+
+static void sim_xpt2046_release(void *arg) {
+    touch.release = 0;
+    touch.pressed = false;
+    sim_xpt2046_pen();
+}
+
+static uint16_t sim_xpt2046_raw(uint pos, uint size, uint16_t raw_min, uint16_t raw_max) {
+    return (uint16_t) (raw_min + (uint32_t) pos * (raw_max - raw_min) / (size - 1));
+}
+
+void sim_xpt2046_press(uint x, uint y, uint32_t hold_us) {
+    uint16_t raw_x = sim_xpt2046_raw(x, ILI9341_WIDTH, XPT2046_CAL_X_MIN, XPT2046_CAL_X_MAX);
+    uint16_t raw_y = sim_xpt2046_raw(y, ILI9341_HEIGHT, XPT2046_CAL_Y_MIN, XPT2046_CAL_Y_MAX);
+    // The calibration maps raw X to screen y when swapped.
+    touch.raw[XPT2046_X] = XPT2046_CAL_SWAP ? raw_y : raw_x;
+    touch.raw[XPT2046_Y] = XPT2046_CAL_SWAP ? raw_x : raw_y;
+    touch.raw[XPT2046_Z1] = SIM_TOUCH_Z1;
+    touch.raw[XPT2046_Z2] = SIM_TOUCH_Z2;
+    touch.pressed = true;
+    sim_xpt2046_pen();
+    if (touch.release) {
+        sim_cancel(touch.release);
+    }
+    touch.release = sim_schedule(sim_now() + hold_us, sim_xpt2046_release, NULL);
+}
+
+bool sim_xpt2046_trace(const char *path) {
+    FILE *file = fopen(path, "r");
+    char line[256];
+    if (!file) {
+        return false;
+    }
+    free(touch.trace);
+    touch.trace = calloc(SIM_TOUCH_TRACE_LINES, sizeof(SIM_TOUCH_BURST_T));
+    touch.trace_lines = 0;
+    while (touch.trace && touch.trace_lines < SIM_TOUCH_TRACE_LINES && fgets(line, sizeof(line), file)) {
+        SIM_TOUCH_BURST_T *burst = &touch.trace[touch.trace_lines];
+        char *c = line;
+        while (isspace((unsigned char) *c)) {
+            c++;
+        }
+        if (!*c || *c == '#') {
+            continue;
+        }
+        if (!strncmp(c, "up", 2)) {
+            burst->up = true;
+            touch.trace_lines++;
+            continue;
+        }
+        uint n = 0;
+        for (char *end; n < XPT2046_CHANNELS * XPT2046_SAMPLES; n++, c = end) {
+            unsigned long value = strtoul(c, &end, 0);
+            if (end == c) {
+                break;
+            }
+            burst->samples[n / XPT2046_SAMPLES][n % XPT2046_SAMPLES] = (uint16_t) (value > 4095 ? 4095 : value);
+        }
+        if (n == XPT2046_CHANNELS * XPT2046_SAMPLES) {
+            touch.trace_lines++;
+        } else {
+            fprintf(stderr, "sim: bad touch trace line: %s", line);
+        }
+    }
+    fclose(file);
+    touch.trace_line = 0;
+    memset(touch.trace_used, 0, sizeof(touch.trace_used));
+    touch.pressed = touch.trace_lines && !touch.trace[0].up;
+    sim_xpt2046_pen();
+    return true;
+}
+
+void sim_xpt2046_init(uint bus, uint cs_gpio, uint pen_gpio) {
+    touch.spi.cs_gpio = cs_gpio;
+    touch.spi.transfer = sim_xpt2046_transfer;
+    touch.pen_gpio = pen_gpio;
+    touch.pen_enabled = true;
+    touch.noise = 0xACE1u;
+    sim_spi_attach(bus, &touch.spi);
+}
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""Run the host build on a scenario and check what it prints.
+
+A scenario is a SIM_SCRIPT (see host/sim/sim_script.c) whose "#!" comment
+lines say how to run it and what to expect. The sim's stdout is decoded
+with tools/trace_decode.py and its exit summary from stderr appended, and
+each check runs against those lines:
+
+    #! seconds <n>           virtual seconds to run, default 60
+    #! env <NAME>=<value>    extra environment, SIM_* is otherwise cleared
+    #! golden <file>         the whole output must equal host/tests/golden/<file>
+    #! match <regex>         a line must match, after the line the last match matched
+    #! never <regex>         no line may match
+    #! count <op> <n> <regex>  the number of lines matching, op is one of == != < <= > >=
+    #! value <op> <n> <regex>  the regex's first group, on the last line it matches
+
+Paths in script commands may start with @ for the scenario's directory.
+
+    host/tests/sim_test.py build-host/wifi_blinkwifigpio_host host/tests/scenarios/boot.txt
+    host/tests/sim_test.py --update ...   rewrites the golden file instead
+"""
+
+import argparse
+import difflib
+import io
+import operator
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(HERE, "..", "..", "tools"))
+import trace_decode  # noqa: E402
+
+OPS = {"==": operator.eq, "!=": operator.ne, "<": operator.lt, "<=": operator.le,
+       ">": operator.gt, ">=": operator.ge}
+
+
+def parse(path):
+    directives, script = [], []
+    base = os.path.dirname(os.path.abspath(path))
+    with open(path, encoding="utf-8") as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if line.startswith("#!"):
+                keyword, _, rest = line[2:].strip().partition(" ")
+                directives.append((keyword, rest.strip()))
+            else:
+                script.append(line.replace(" @", " " + base + os.sep))
+    return directives, "\n".join(script) + "\n"
+
+
+def run(binary, script, seconds, env_extra):
+    env = {k: v for k, v in os.environ.items() if not k.startswith("SIM_")}
+    env.update(env_extra)
+    env["SIM_SECONDS"] = str(seconds)
+    with tempfile.NamedTemporaryFile("w", suffix=".txt", delete=False) as f:
+        f.write(script)
+    try:
+        env["SIM_SCRIPT"] = f.name
+        result = subprocess.run([binary], env=env, capture_output=True, timeout=600)
+    finally:
+        os.unlink(f.name)
+    if result.returncode != 0:
+        raise SystemExit("sim exited with %d\n%s" % (result.returncode, result.stderr.decode()))
+
+    names, formats = trace_decode.load_formats(os.path.join(HERE, "..", "..", "src", "trace_ids.h"))
+    out = io.StringIO()
+    decoder = trace_decode.Decoder(names, formats, out)
+    decoder.text(decoder.feed(result.stdout))
+    return out.getvalue() + result.stderr.decode("utf-8", errors="replace")
+
+
+def check(directives, output):
+    lines = output.splitlines()
+    failures = []
+    pos = 0
+    for keyword, rest in directives:
+        if keyword == "match":
+            regex = re.compile(rest)
+            for i in range(pos, len(lines)):
+                if regex.search(lines[i]):
+                    pos = i + 1
+                    break
+            else:
+                failures.append("no line matches %r after line %d" % (rest, pos))
+        elif keyword == "never":
+            regex = re.compile(rest)
+            hits = [line for line in lines if regex.search(line)]
+            if hits:
+                failures.append("%r matches %r" % (rest, hits[0]))
+        elif keyword in ("count", "value"):
+            op, n, pattern = rest.split(" ", 2)
+            regex = re.compile(pattern)
+            hits = [m for m in map(regex.search, lines) if m]
+            if keyword == "count":
+                got = len(hits)
+            elif hits:
+                got = int(hits[-1].group(1))
+            else:
+                failures.append("no line matches %r" % pattern)
+                continue
+            if not OPS[op](got, int(n)):
+                failures.append("%s of %r is %d, expected %s %s" % (keyword, pattern, got, op, n))
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("binary")
+    parser.add_argument("scenario")
+    parser.add_argument("--update", action="store_true", help="rewrite the golden file")
+    options = parser.parse_args()
+
+    directives, script = parse(options.scenario)
+    seconds = next((int(rest) for keyword, rest in directives if keyword == "seconds"), 60)
+    env = dict(rest.split("=", 1) for keyword, rest in directives if keyword == "env")
+    output = run(options.binary, script, seconds, env)
+
+    failures = check(directives, output)
+    for keyword, rest in directives:
+        if keyword != "golden":
+            continue
+        golden = os.path.join(HERE, "golden", rest)
+        if options.update:
+            with open(golden, "w", encoding="utf-8") as f:
+                f.write(output)
+            continue
+        with open(golden, encoding="utf-8") as f:
+            expected = f.read()
+        if output != expected:
+            diff = difflib.unified_diff(expected.splitlines(), output.splitlines(), "golden/" + rest, "output",
+                                        lineterm="", n=2)
+            failures.append("output differs from golden/%s:\n%s" % (rest, "\n".join(list(diff)[:60])))
+
+    for keyword, rest in directives:
+        if keyword not in ("seconds", "env", "golden", "match", "never", "count", "value"):
+            failures.append("unknown directive %r" % keyword)
+    if failures:
+        sys.stdout.write(output if len(output) < 20000 else output[-20000:])
+        for failure in failures:
+            print("FAIL: " + failure)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
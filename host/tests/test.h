@@ -0,0 +1,83 @@
+#ifndef _TEST_H
+#define _TEST_H
+
+// Unit tests run against the firmware and the sim like the host build, with
+// their own main in place of the firmware's. CHECK records a failure and
+// carries on, test_report ends the test with its exit status. The sim
+// exits 0 once SIM_SECONDS have passed, so a test that gets there instead
+// of returning from main is failed here.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim/sim.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static uint test_checks;
+static uint test_failures;
+static bool test_reported;
+
+#define CHECK(cond) test_check((cond), #cond, __FILE__, __LINE__)
+#define CHECK_EQ(a, b) test_check_eq((long long) (a), (long long) (b), #a, #b, __FILE__, __LINE__)
+
+static inline bool test_check(bool ok, const char *what, const char *file, int line) {
+    test_checks++;
+    if (!ok) {
+        test_failures++;
+        printf("%s:%d: FAIL %s\n", file, line, what);
+    }
+    return ok;
+}
+
+static inline bool test_check_eq(long long a, long long b, const char *sa, const char *sb, const char *file, int line) {
+    test_checks++;
+    if (a != b) {
+        test_failures++;
+        printf("%s:%d: FAIL %s == %s (%lld != %lld)\n", file, line, sa, sb, a, b);
+    }
+    return a == b;
+}
+
+static void test_exit_check(void) {
+    if (!test_reported) {
+        fflush(stdout);
+        fprintf(stderr, "FAIL: exited at %llu us before test_report\n", (unsigned long long) sim_now());
+        _exit(1);
+    }
+}
+
+__attribute__((constructor(200))) static void test_init(void) {
+    atexit(test_exit_check);
+}
+
+// For benchmarks, cycles where the host has a counter to read, nanoseconds
+// elsewhere.
+#if defined(__x86_64__) || defined(__i386__)
+#define TEST_TICKS_UNIT "cycles"
+#else
+#define TEST_TICKS_UNIT "ns"
+#endif
+
+static inline uint64_t test_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+static inline int test_report(const char *name) {
+    test_reported = true;
+    printf("%s: %u checks, %u failed\n", name, test_checks, test_failures);
+    fflush(stdout);
+    return test_failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,102 @@
+#include "tests/test.h"
+#include "src/gpio_event.h"
+#include "src/timer_wheel.h"
+
+// Floods the gpio_event ring from the interrupt and checks every edge is
+// either delivered to its task or counted as dropped, then that a holdoff
+// suppresses chatter and still passes on its last edge.
+
+#define TEST_GPIO 5
+#define TEST_HOLDOFF_GPIO 6
+#define TEST_HOLDOFF_MS 10
+
+static uint32_t delivered[NUM_BANK0_GPIOS];
+static uint32_t isr_calls;
+
+static void test_task(uint gpio, uint32_t events) {
+    CHECK_EQ(events, GPIO_IRQ_EDGE_FALL);
+    delivered[gpio]++;
+}
+
+static void test_isr(uint gpio, uint32_t events, uint32_t timestamp) {
+    isr_calls++;
+}
+
+static void test_fall(uint gpio) {
+    sim_gpio_set_input(gpio, false);
+    sim_gpio_set_input(gpio, true);
+}
+
+static void test_flood(void) {
+    uint32_t edges = 3 * GPIO_EVENT_RING_SIZE + 5;
+    gpio_event_stats_t stats;
+
+    for (uint32_t i = 0; i < edges; i++) {
+        test_fall(TEST_GPIO);
+    }
+    gpio_event_dispatch();
+    CHECK_EQ(delivered[TEST_GPIO], GPIO_EVENT_RING_SIZE);
+    CHECK_EQ(gpio_event_dropped(), edges - GPIO_EVENT_RING_SIZE);
+    CHECK_EQ(delivered[TEST_GPIO] + gpio_event_dropped(), edges);
+    CHECK_EQ(isr_calls, edges);
+    CHECK(gpio_event_get_stats(TEST_GPIO, &stats));
+    CHECK_EQ(stats.edges, edges);
+    CHECK_EQ(stats.suppressed, 0);
+
+    // A consumer that keeps up loses nothing, however long the flood.
+    uint32_t dropped = gpio_event_dropped();
+    delivered[TEST_GPIO] = 0;
+    for (uint32_t i = 0; i < 100 * GPIO_EVENT_RING_SIZE; i++) {
+        test_fall(TEST_GPIO);
+        if (i % (GPIO_EVENT_RING_SIZE / 2) == 0) {
+            gpio_event_dispatch();
+        }
+    }
+    gpio_event_dispatch();
+    CHECK_EQ(delivered[TEST_GPIO], 100 * GPIO_EVENT_RING_SIZE);
+    CHECK_EQ(gpio_event_dropped(), dropped);
+}
+
+static void test_holdoff(void) {
+    gpio_event_stats_t stats;
+
+    // Chatter for 2ms: the first edge is passed on, the rest are held.
+    for (uint i = 0; i < 20; i++) {
+        test_fall(TEST_HOLDOFF_GPIO);
+        sleep_us(100);
+    }
+    gpio_event_dispatch();
+    CHECK_EQ(delivered[TEST_HOLDOFF_GPIO], 1);
+    CHECK(gpio_event_get_stats(TEST_HOLDOFF_GPIO, &stats));
+    CHECK_EQ(stats.edges, 20);
+    CHECK_EQ(stats.suppressed, 19);
+
+    // As the holdoff ends the held edges go on as one event.
+    sleep_ms(TEST_HOLDOFF_MS + 2);
+    gpio_event_dispatch();
+    CHECK_EQ(delivered[TEST_HOLDOFF_GPIO], 2);
+    CHECK(gpio_event_get_stats(TEST_HOLDOFF_GPIO, &stats));
+    CHECK_EQ(stats.coalesced, 1);
+
+    // Then nothing more, and an edge once the holdoff is over goes straight
+    // through.
+    sleep_ms(5 * TEST_HOLDOFF_MS);
+    gpio_event_dispatch();
+    CHECK_EQ(delivered[TEST_HOLDOFF_GPIO], 2);
+    test_fall(TEST_HOLDOFF_GPIO);
+    gpio_event_dispatch();
+    CHECK_EQ(delivered[TEST_HOLDOFF_GPIO], 3);
+}
+
+int main(void) {
+    timer_wheel_init();
+    gpio_event_init();
+    gpio_event_register(TEST_GPIO, GPIO_IRQ_EDGE_FALL, 0, test_isr, test_task);
+    gpio_event_register(TEST_HOLDOFF_GPIO, GPIO_IRQ_EDGE_FALL, TEST_HOLDOFF_MS, NULL, test_task);
+    gpio_pull_up(TEST_GPIO);
+    gpio_pull_up(TEST_HOLDOFF_GPIO);
+
+    test_flood();
+    test_holdoff();
+    return test_report("gpio_event");
+}
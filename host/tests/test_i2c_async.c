@@ -0,0 +1,234 @@
+#include "tests/test.h"
+#include "src/i2c_async.h"
+
+// The i2c_async engine and its DMA backend against the register level model
+// of the i2c block in host/sim/sim_i2c.c: the command words each
+// transaction puts on the bus, queueing and the order of callbacks, and the
+// write and read error paths.
+
+#define TEST_BUS 1
+#define TEST_ADDR 0x50
+#define TEST_OTHER_ADDR 0x51
+#define TEST_ABSENT_ADDR 0x52
+#define TEST_MAX_DONE 8
+
+typedef struct {
+    sim_i2c_device_t dev;
+    uint8_t regs[256];
+    uint8_t ptr;
+    bool nak_write;
+    bool nak_read;
+} TEST_DEVICE_T;
+
+typedef struct {
+    i2c_async_xfer_t *xfer;
+    i2c_async_result_t result;
+    uint32_t tar;  // The block's target as the callback ran
+    bool idle;
+} TEST_DONE_T;
+
+static TEST_DEVICE_T devices[2];
+static TEST_DONE_T done[TEST_MAX_DONE];
+static uint done_count;
+static i2c_async_xfer_t *chained;
+
+static bool test_device_write(sim_i2c_device_t *dev, const uint8_t *src, size_t len) {
+    TEST_DEVICE_T *device = (TEST_DEVICE_T *) dev;
+    if (device->nak_write) {
+        return false;
+    }
+    device->ptr = src[0];
+    for (size_t i = 1; i < len; i++) {
+        device->regs[device->ptr++] = src[i];
+    }
+    return true;
+}
+
+static bool test_device_read(sim_i2c_device_t *dev, uint8_t *dst, size_t len) {
+    TEST_DEVICE_T *device = (TEST_DEVICE_T *) dev;
+    if (device->nak_read) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = device->regs[(uint8_t) (device->ptr + i)];
+    }
+    return true;
+}
+
+static void test_callback(i2c_async_xfer_t *xfer, i2c_async_result_t result) {
+    if (done_count < TEST_MAX_DONE) {
+        done[done_count++] = (TEST_DONE_T) {xfer, result, i2c_get_hw(i2c1)->tar, i2c_async_idle(i2c1)};
+    }
+    if (chained) {
+        CHECK(i2c_async_submit(i2c1, chained));
+        chained = NULL;
+    }
+}
+
+static void test_reset(void) {
+    done_count = 0;
+    for (uint i = 0; i < count_of(devices); i++) {
+        devices[i].nak_write = false;
+        devices[i].nak_read = false;
+    }
+}
+
+static void test_run(void) {
+    sleep_ms(5);
+}
+
+static void test_check_commands(const uint16_t *expected, uint count) {
+    uint16_t cmd[16];
+    uint got = sim_i2c_last_commands(TEST_BUS, cmd, count_of(cmd));
+    if (CHECK_EQ(got, count)) {
+        for (uint i = 0; i < count; i++) {
+            CHECK_EQ(cmd[i], expected[i]);
+        }
+    }
+}
+
+static void test_sequencing(void) {
+    static i2c_async_xfer_t xfer = {.callback = test_callback};
+    const uint8_t data[2] = {0xAA, 0xBB};
+
+    // A write: the register pointer then the data, STOP on the last byte.
+    test_reset();
+    i2c_async_set_write(&xfer, TEST_ADDR, 0x01, data, 2);
+    CHECK(i2c_async_submit(i2c1, &xfer));
+    CHECK(!i2c_async_submit(i2c1, &xfer)); // Still queued
+    test_run();
+    CHECK_EQ(done_count, 1);
+    CHECK_EQ(done[0].result, I2C_ASYNC_OK);
+    CHECK_EQ(devices[0].regs[1], 0xAA);
+    CHECK_EQ(devices[0].regs[2], 0xBB);
+    test_check_commands((const uint16_t[]) {0x01, 0xAA, 0xBB | I2C_IC_DATA_CMD_STOP_BITS}, 3);
+
+    // A read: the pointer, then a RESTART on the first read and a STOP on
+    // the last.
+    test_reset();
+    devices[0].regs[5] = 0x12;
+    devices[0].regs[6] = 0x34;
+    i2c_async_set_read(&xfer, TEST_ADDR, 0x05, 2);
+    CHECK(i2c_async_submit(i2c1, &xfer));
+    test_run();
+    CHECK_EQ(done_count, 1);
+    CHECK_EQ(done[0].result, I2C_ASYNC_OK);
+    CHECK_EQ(xfer.rx[0], 0x12);
+    CHECK_EQ(xfer.rx[1], 0x34);
+    test_check_commands((const uint16_t[]) {0x05, I2C_IC_DATA_CMD_CMD_BITS | I2C_IC_DATA_CMD_RESTART_BITS,
+        I2C_IC_DATA_CMD_CMD_BITS | I2C_IC_DATA_CMD_STOP_BITS}, 3);
+
+    // A single byte read has RESTART and STOP on the one command.
+    test_reset();
+    i2c_async_set_read(&xfer, TEST_ADDR, 0x06, 1);
+    CHECK(i2c_async_submit(i2c1, &xfer));
+    test_run();
+    CHECK_EQ(xfer.rx[0], 0x34);
+    test_check_commands((const uint16_t[]) {0x06,
+        I2C_IC_DATA_CMD_CMD_BITS | I2C_IC_DATA_CMD_RESTART_BITS | I2C_IC_DATA_CMD_STOP_BITS}, 2);
+}
+
+static void test_queue(void) {
+    static i2c_async_xfer_t xfers[3] = {{.callback = test_callback}, {.callback = test_callback},
+        {.callback = test_callback}};
+    static i2c_async_xfer_t next = {.callback = test_callback};
+
+    // Completed in order, and the next is on the bus before each callback.
+    test_reset();
+    i2c_async_set_read(&xfers[0], TEST_ADDR, 0x05, 1);
+    i2c_async_set_read(&xfers[1], TEST_OTHER_ADDR, 0x05, 1);
+    i2c_async_set_read(&xfers[2], TEST_ADDR, 0x06, 1);
+    for (uint i = 0; i < count_of(xfers); i++) {
+        CHECK(i2c_async_submit(i2c1, &xfers[i]));
+    }
+    CHECK(!i2c_async_idle(i2c1));
+    test_run();
+    CHECK_EQ(done_count, 3);
+    for (uint i = 0; i < done_count; i++) {
+        CHECK(done[i].xfer == &xfers[i]);
+        CHECK_EQ(done[i].result, I2C_ASYNC_OK);
+    }
+    CHECK_EQ(done[0].tar, TEST_OTHER_ADDR);
+    CHECK(!done[0].idle);
+    CHECK_EQ(done[1].tar, TEST_ADDR);
+    CHECK(done[2].idle);
+
+    // A callback can submit the next transaction itself.
+    test_reset();
+    chained = &next;
+    i2c_async_set_read(&next, TEST_OTHER_ADDR, 0x05, 1);
+    CHECK(i2c_async_submit(i2c1, &xfers[0]));
+    test_run();
+    CHECK_EQ(done_count, 2);
+    CHECK(done[1].xfer == &next);
+    CHECK(i2c_async_idle(i2c1));
+}
+
+static void test_errors(void) {
+    static i2c_async_xfer_t xfers[4] = {{.callback = test_callback}, {.callback = test_callback},
+        {.callback = test_callback}, {.callback = test_callback}};
+    const uint8_t data = 0x55;
+
+    // Nothing at the address: the write phase isn't acknowledged, for a
+    // read as for a write.
+    test_reset();
+    i2c_async_set_read(&xfers[0], TEST_ABSENT_ADDR, 0x05, 2);
+    i2c_async_set_write(&xfers[1], TEST_ABSENT_ADDR, 0x01, &data, 1);
+    for (uint i = 0; i < 2; i++) {
+        CHECK(i2c_async_submit(i2c1, &xfers[i]));
+    }
+    test_run();
+    CHECK_EQ(done_count, 2);
+    CHECK_EQ(done[0].result, I2C_ASYNC_WRITE_ERROR);
+    CHECK_EQ(done[1].result, I2C_ASYNC_WRITE_ERROR);
+
+    // A device NAKing the data of a write.
+    test_reset();
+    devices[0].nak_write = true;
+    i2c_async_set_write(&xfers[0], TEST_ADDR, 0x01, &data, 1);
+    CHECK(i2c_async_submit(i2c1, &xfers[0]));
+    test_run();
+    CHECK_EQ(done[0].result, I2C_ASYNC_WRITE_ERROR);
+
+    // A device that went away on the repeated start is a read error, and
+    // the read buffer is left alone. The transactions queued behind either
+    // kind of error still go through.
+    test_reset();
+    devices[0].nak_read = true;
+    devices[1].regs[7] = 0x77;
+    xfers[0].rx[0] = 0xEE;
+    xfers[0].rx[1] = 0xEE;
+    i2c_async_set_read(&xfers[0], TEST_ADDR, 0x05, 2);
+    i2c_async_set_read(&xfers[1], TEST_OTHER_ADDR, 0x07, 1);
+    i2c_async_set_read(&xfers[2], TEST_ABSENT_ADDR, 0x05, 1);
+    i2c_async_set_read(&xfers[3], TEST_OTHER_ADDR, 0x07, 1);
+    for (uint i = 0; i < count_of(xfers); i++) {
+        CHECK(i2c_async_submit(i2c1, &xfers[i]));
+    }
+    test_run();
+    CHECK_EQ(done_count, 4);
+    CHECK_EQ(done[0].result, I2C_ASYNC_READ_ERROR);
+    CHECK_EQ(xfers[0].rx[0], 0xEE);
+    CHECK_EQ(xfers[0].rx[1], 0xEE);
+    CHECK_EQ(done[1].result, I2C_ASYNC_OK);
+    CHECK_EQ(xfers[1].rx[0], 0x77);
+    CHECK_EQ(done[2].result, I2C_ASYNC_WRITE_ERROR);
+    CHECK_EQ(done[3].result, I2C_ASYNC_OK);
+    CHECK_EQ(xfers[3].rx[0], 0x77);
+    CHECK(i2c_async_idle(i2c1));
+}
+
+int main(void) {
+    const uint8_t addrs[count_of(devices)] = {TEST_ADDR, TEST_OTHER_ADDR};
+    for (uint i = 0; i < count_of(devices); i++) {
+        devices[i].dev = (sim_i2c_device_t) {.addr = addrs[i], .write = test_device_write, .read = test_device_read};
+        sim_i2c_attach(TEST_BUS, &devices[i].dev);
+    }
+    i2c_init(i2c1, 400 * 1000);
+    i2c_async_init(i2c1);
+
+    test_sequencing();
+    test_queue();
+    test_errors();
+    return test_report("i2c_async");
+}
@@ -0,0 +1,128 @@
+#include "tests/test.h"
+#include "src/mcp9808.h"
+
+// The sixteenths conversions against the float ones they replaced (from
+// src/mcp9808.c before the change), over every value the 13 bit ambient
+// register can hold, then the cost of each per call. The host has an FPU,
+// so that is only a check the formatting hasn't regressed, the cycles the
+// RP2040's soft float costs are measured on the board with "mcp9808 bench".
+
+#define TEST_REGISTERS 0x2000
+#define TEST_BENCH_ROUNDS 64
+
+// The float conversion as it was. Below zero it returns the magnitude with
+// the wrong sign, the datasheet's formula, so mcp9808_temp_from_register
+// is checked against it above zero and against the corrected sum below.
+static __attribute__((noinline)) float test_float_convert_temp(uint8_t upper_byte, uint8_t lower_byte) {
+    float temperature;
+
+    if ((upper_byte & 0x10) == 0x10) {
+        upper_byte = upper_byte & 0x0F;
+        temperature = 256 - (((float) upper_byte * 16) + ((float) lower_byte / 16));
+    } else {
+        temperature = (((float) upper_byte * 16) + ((float) lower_byte / 16));
+    }
+    return temperature;
+}
+
+static __attribute__((noinline)) uint16_t test_float_calc_register(float temp) {
+    return (int16_t) temp << 4 | (int16_t) ((temp - (int16_t) temp) / .25) << 2;
+}
+
+static void test_from_register(void) {
+    uint failures = test_failures;
+
+    for (uint reg = 0; reg < TEST_REGISTERS && test_failures - failures < 10; reg++) {
+        uint8_t upper = reg >> 8, lower = reg & 0xFF;
+        float expected = test_float_convert_temp(upper, lower);
+        if (upper & 0x10) {
+            expected = (upper & 0x0F) * 16.0f + lower / 16.0f - 256;
+        }
+        mcp9808_temp_t temp = mcp9808_temp_from_register(upper, lower);
+        CHECK(temp / 16.0f == expected);
+        // The alert flags in bits 15-13 don't change the reading.
+        CHECK_EQ(mcp9808_temp_from_register(upper | 0xE0, lower), temp);
+    }
+}
+
+static void test_format(void) {
+    uint failures = test_failures;
+    char text[MCP9808_TEMP_STR_LEN];
+    char expected[16];
+
+    for (uint reg = 0; reg < TEST_REGISTERS && test_failures - failures < 10; reg++) {
+        mcp9808_temp_t temp = mcp9808_temp_from_register(reg >> 8, reg & 0xFF);
+        snprintf(expected, sizeof(expected), "%.2f", temp / 16.0f);
+        if (!test_check(strcmp(mcp9808_temp_format(text, temp), expected) == 0, expected, __FILE__, __LINE__)) {
+            printf("  got %s\n", text);
+        }
+        mcp9808_temp_t parsed;
+        CHECK(mcp9808_temp_parse(text, &parsed));
+        CHECK_EQ(parsed, temp);
+    }
+}
+
+static void test_to_register(void) {
+    uint failures = test_failures;
+
+    // The float version only got the limit registers right from 0°C up.
+    for (mcp9808_temp_t temp = 0; temp < MCP9808_TEMP(256) && test_failures - failures < 10; temp++) {
+        CHECK_EQ(mcp9808_temp_to_register(temp), test_float_calc_register(temp / 16.0f));
+    }
+    CHECK_EQ(mcp9808_temp_to_register(MCP9808_TEMP(11)), 0x00B0);
+    CHECK_EQ(mcp9808_temp_to_register(MCP9808_TEMP(20.5)), 0x0148);
+    CHECK_EQ(mcp9808_temp_to_register(MCP9808_TEMP(25.5)), 0x0198);
+    CHECK_EQ(mcp9808_temp_to_register(MCP9808_TEMP(-0.25)), 0x1FFC);
+}
+
+static volatile float float_sink;
+static volatile int32_t fixed_sink;
+
+static void test_bench(void) {
+    const uint calls = TEST_BENCH_ROUNDS * TEST_REGISTERS;
+    char text[16];
+    uint64_t start;
+
+    start = test_ticks();
+    for (uint round = 0; round < TEST_BENCH_ROUNDS; round++) {
+        for (uint reg = 0; reg < TEST_REGISTERS; reg++) {
+            float_sink = test_float_convert_temp(reg >> 8, reg & 0xFF);
+        }
+    }
+    uint64_t float_convert = test_ticks() - start;
+
+    start = test_ticks();
+    for (uint round = 0; round < TEST_BENCH_ROUNDS; round++) {
+        for (uint reg = 0; reg < TEST_REGISTERS; reg++) {
+            fixed_sink = mcp9808_temp_from_register(reg >> 8, reg & 0xFF);
+        }
+    }
+    uint64_t fixed_convert = test_ticks() - start;
+
+    start = test_ticks();
+    for (uint reg = 0; reg < TEST_REGISTERS; reg++) {
+        snprintf(text, sizeof(text), "%.2f", test_float_convert_temp(reg >> 8, reg & 0xFF));
+    }
+    uint64_t float_format = test_ticks() - start;
+
+    start = test_ticks();
+    for (uint reg = 0; reg < TEST_REGISTERS; reg++) {
+        mcp9808_temp_format(text, mcp9808_temp_from_register(reg >> 8, reg & 0xFF));
+    }
+    uint64_t fixed_format = test_ticks() - start;
+
+    printf("convert: float %.2f, sixteenths %.2f " TEST_TICKS_UNIT "/call\n", (double) float_convert / calls,
+        (double) fixed_convert / calls);
+    printf("format: float %.1f, sixteenths %.1f " TEST_TICKS_UNIT "/call\n", (double) float_format / TEST_REGISTERS,
+        (double) fixed_format / TEST_REGISTERS);
+    // Even against the host's FPU, formatting sixteenths beats printf's %.2f.
+    CHECK(fixed_format < float_format);
+}
+
+int main(void) {
+    test_from_register();
+    test_format();
+    test_to_register();
+    test_bench();
+    return test_report("mcp9808_temp");
+}
@@ -0,0 +1,183 @@
+#include "tests/test.h"
+#include "src/temp_history.h"
+
+// The history store against a plain array of what was appended: every sample
+// kept comes back, windows and stats match, the oldest blocks go first and a
+// clock stepped back doesn't hide samples from a query. Then how well it
+// packs and what appends and queries cost.
+
+#define TEST_PERIOD 30
+#define TEST_SENSORS 2
+#define TEST_BLOCKS (TEMP_HISTORY_POOL_BLOCKS / TEST_SENSORS)
+#define TEST_MAX_SAMPLES 8000
+#define TEST_START 1760000000u
+
+static temp_sample_t appended[TEST_MAX_SAMPLES];
+static uint appended_count;
+static uint32_t random_state = 1;
+
+static uint32_t test_random(void) {
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 16;
+}
+
+static void test_append(uint sensor, uint32_t time, mcp9808_temp_t temp) {
+    CHECK(temp_history_append(sensor, time, temp));
+    if (appended_count < TEST_MAX_SAMPLES) {
+        appended[appended_count++] = (temp_sample_t) {time, temp};
+    }
+}
+
+// Appends count samples a period apart, wandering up to a quarter a sample.
+static uint32_t test_append_noisy(uint sensor, uint32_t time, uint count) {
+    static mcp9808_temp_t temp = MCP9808_TEMP(20);
+    for (uint i = 0; i < count; i++, time += TEST_PERIOD) {
+        temp += (mcp9808_temp_t) ((int) (test_random() % 3) - 1) * MCP9808_TEMP(0.25);
+        test_append(sensor, time, temp);
+    }
+    return time;
+}
+
+// The appended samples from first on, in order, between from and to, must be
+// exactly what the store returns.
+static void test_check_query(uint sensor, uint first, uint32_t from, uint32_t to) {
+    temp_history_iter_t iter;
+    temp_history_stats_t stats;
+    temp_sample_t sample;
+    uint failures = test_failures;
+    uint count = 0;
+    int32_t sum = 0;
+    mcp9808_temp_t min = INT16_MAX, max = INT16_MIN;
+
+    temp_history_iter_init(&iter, sensor, from, to);
+    for (uint i = first; i < appended_count && test_failures - failures < 5; i++) {
+        if (appended[i].time < from || appended[i].time > to) {
+            continue;
+        }
+        if (!CHECK(temp_history_iter_next(&iter, &sample))) {
+            break;
+        }
+        CHECK_EQ(sample.time, appended[i].time);
+        CHECK_EQ(sample.temp, appended[i].temp);
+        count++;
+        sum += appended[i].temp;
+        min = appended[i].temp < min ? appended[i].temp : min;
+        max = appended[i].temp > max ? appended[i].temp : max;
+    }
+    CHECK(!temp_history_iter_next(&iter, &sample));
+
+    CHECK_EQ(temp_history_stats(sensor, from, to, &stats), count > 0);
+    if (count) {
+        CHECK_EQ(stats.count, count);
+        CHECK_EQ(stats.min, min);
+        CHECK_EQ(stats.max, max);
+        CHECK_EQ(stats.mean, (sum + (int32_t) count / 2) / (int32_t) count);
+    }
+}
+
+static double test_ratio(uint sensor) {
+    return (double) (temp_history_samples(sensor) * sizeof(temp_sample_t)) / temp_history_bytes(sensor);
+}
+
+static void test_steady(void) {
+    temp_history_init(TEST_PERIOD, TEST_SENSORS);
+    appended_count = 0;
+    for (uint i = 0; i < 3000; i++) {
+        test_append(0, TEST_START + i * TEST_PERIOD, MCP9808_TEMP(21.25));
+    }
+    // One block, a byte for each 64 samples.
+    CHECK_EQ(temp_history_samples(0), 3000);
+    CHECK_EQ(temp_history_bytes(0), sizeof(temp_history_block_t));
+    test_check_query(0, 0, 0, UINT32_MAX);
+    printf("steady: %u samples in %u bytes, %.0fx smaller than raw\n", (uint) temp_history_samples(0),
+        (uint) temp_history_bytes(0), test_ratio(0));
+}
+
+static void test_noisy(void) {
+    uint32_t time;
+
+    temp_history_init(TEST_PERIOD, TEST_SENSORS);
+    appended_count = 0;
+    time = test_append_noisy(1, TEST_START, 1000);
+    CHECK_EQ(temp_history_samples(1), 1000);
+    CHECK(test_ratio(1) > 5);
+    printf("noisy: %u samples in %u bytes, %.1fx smaller than raw\n", (uint) temp_history_samples(1),
+        (uint) temp_history_bytes(1), test_ratio(1));
+    test_check_query(1, 0, 0, UINT32_MAX);
+    test_check_query(1, 0, TEST_START + 200 * TEST_PERIOD, TEST_START + 700 * TEST_PERIOD);
+    test_check_query(1, 0, TEST_START + 200 * TEST_PERIOD + 1, TEST_START + 200 * TEST_PERIOD + 1);
+
+    // Late and early samples, and jumps too big for a step.
+    time += 7;
+    test_append(1, time, MCP9808_TEMP(30));
+    time += TEST_PERIOD - 11;
+    test_append(1, time, MCP9808_TEMP(-5));
+    time += 3600;
+    test_append(1, time, MCP9808_TEMP(-5.25));
+    test_check_query(1, 0, time - 3700, UINT32_MAX);
+
+    // Once full the oldest blocks are dropped, what is left is the newest.
+    test_append_noisy(1, time + TEST_PERIOD, 3000);
+    CHECK_EQ(temp_history_bytes(1), TEST_BLOCKS * sizeof(temp_history_block_t));
+    CHECK(temp_history_samples(1) < appended_count);
+    test_check_query(1, appended_count - temp_history_samples(1), 0, UINT32_MAX);
+
+    // Other sensors are untouched, and those past the ones found keep nothing.
+    CHECK_EQ(temp_history_samples(0), 0);
+    CHECK(!temp_history_append(TEST_SENSORS, TEST_START, MCP9808_TEMP(20)));
+    CHECK_EQ(temp_history_samples(TEST_SENSORS), 0);
+}
+
+static void test_stepped_back(void) {
+    temp_history_init(TEST_PERIOD, TEST_SENSORS);
+    appended_count = 0;
+    // An hour, then the clock is stepped back half an hour and it carries on.
+    uint32_t time = test_append_noisy(0, TEST_START, 120);
+    test_append_noisy(0, time - 1800, 120);
+    CHECK_EQ(temp_history_samples(0), 240);
+
+    // The overlap has samples from both.
+    test_check_query(0, 0, TEST_START + 2400, TEST_START + 3000);
+    // Only in the first run, from a block that starts before a later one.
+    test_check_query(0, 0, TEST_START + 3590, TEST_START + 3600);
+    // Only in the second.
+    test_check_query(0, 0, TEST_START + 5000, UINT32_MAX);
+    test_check_query(0, 0, 0, UINT32_MAX);
+}
+
+static void test_bench(void) {
+    const uint samples = TEST_BLOCKS * 57;
+    temp_history_stats_t stats;
+    mcp9808_temp_t temp = MCP9808_TEMP(20);
+    uint64_t start;
+
+    temp_history_init(TEST_PERIOD, TEST_SENSORS);
+    start = test_ticks();
+    for (uint i = 0; i < samples; i++) {
+        temp += (mcp9808_temp_t) ((int) (test_random() % 3) - 1) * MCP9808_TEMP(0.25);
+        temp_history_append(0, TEST_START + i * TEST_PERIOD, temp);
+    }
+    uint64_t append = test_ticks() - start;
+
+    start = test_ticks();
+    temp_history_stats(0, 0, UINT32_MAX, &stats);
+    uint64_t all = test_ticks() - start;
+
+    // The last hour, as the console asks for.
+    uint32_t end = TEST_START + (samples - 1) * TEST_PERIOD;
+    start = test_ticks();
+    temp_history_stats(0, end - 3600, end, &stats);
+    uint64_t hour = test_ticks() - start;
+
+    printf("append: %.1f " TEST_TICKS_UNIT "/sample\n", (double) append / samples);
+    printf("query: %.1f " TEST_TICKS_UNIT "/sample over all %u, %llu " TEST_TICKS_UNIT " for the last hour\n",
+        (double) all / samples, samples, (unsigned long long) hour);
+}
+
+int main(void) {
+    test_steady();
+    test_noisy();
+    test_stepped_back();
+    test_bench();
+    return test_report("temp_history");
+}
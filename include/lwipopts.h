@@ -21,25 +21,43 @@
 #define MEM_LIBC_MALLOC             0
 #endif
 #define MEM_ALIGNMENT               4
+#if LWIP_PROFILE_MINIMAL
+// Sized from the host build's pool peaks for NTP, telemetry and three
+// concurrent /metrics scrapes, with room for DHCP and the Wi-Fi driver's
+// receive bursts. The SRAM saved, mostly PBUF_POOL, goes to temp_history.
+#define MEM_SIZE                    2048
+#define MEMP_NUM_TCP_SEG            12
+#define MEMP_NUM_TCP_PCB            4
+#define MEMP_NUM_TCP_PCB_LISTEN     2
+#define MEMP_NUM_ARP_QUEUE          4
+#define PBUF_POOL_SIZE              12
+#define TCP_WND                     (2 * TCP_MSS)
+#define TCP_SND_BUF                 (2 * TCP_MSS)
+#else
 #define MEM_SIZE                    4000
 #define MEMP_NUM_TCP_SEG            32
 #define MEMP_NUM_ARP_QUEUE          10
 #define PBUF_POOL_SIZE              24
+#define TCP_WND                     (8 * TCP_MSS)
+#define TCP_SND_BUF                 (8 * TCP_MSS)
+#endif
 #define LWIP_ARP                    1
 #define LWIP_ETHERNET               1
 #define LWIP_ICMP                   1
 #define LWIP_RAW                    1
-#define TCP_WND                     (8 * TCP_MSS)
 #define TCP_MSS                     1460
-#define TCP_SND_BUF                 (8 * TCP_MSS)
 #define TCP_SND_QUEUELEN            ((4 * (TCP_SND_BUF) + (TCP_MSS - 1)) / (TCP_MSS))
 #define LWIP_NETIF_STATUS_CALLBACK  1
 #define LWIP_NETIF_LINK_CALLBACK    1
 #define LWIP_NETIF_HOSTNAME         1
 #define LWIP_NETCONN                0
-#define MEM_STATS                   0
+// Pool use and high-water marks are always counted, a few increments per
+// allocation, and read with the "lwip" console command. The protocol
+// counters are only kept in debug builds.
+#define LWIP_STATS                  1
+#define MEM_STATS                   1
 #define SYS_STATS                   0
-#define MEMP_STATS                  0
+#define MEMP_STATS                  1
 #define LINK_STATS                  0
 // #define ETH_PAD_SIZE                2
 #define LWIP_CHKSUM_ALGORITHM       3
@@ -55,8 +73,14 @@
 
 #ifndef NDEBUG
 #define LWIP_DEBUG                  1
-#define LWIP_STATS                  1
 #define LWIP_STATS_DISPLAY          1
+#else
+#define ETHARP_STATS                0
+#define IP_STATS                    0
+#define IPFRAG_STATS                0
+#define ICMP_STATS                  0
+#define UDP_STATS                   0
+#define TCP_STATS                   0
 #endif
 
 #define ETHARP_DEBUG                LWIP_DBG_OFF
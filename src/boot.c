@@ -0,0 +1,145 @@
+#include <string.h>
+
+#include "hardware/sync.h"
+
+#include "src/boot.h"
+#include "src/console.h"
+
+static_assert(BOOT_STAGE_COUNT <= 32, "after masks are 32 bit");
+
+typedef struct {
+    const boot_step_t *steps;
+    uint count;
+    uint32_t pending; // Steps still to run, a bit each
+} BOOT_CORE_T;
+
+#define X(id, name) name,
+static const char *const stage_names[] = {BOOT_STAGES(X)};
+#undef X
+
+// Each core only touches its own entry. A stamp is written before its
+// reached flag, so a flag seen set has its stamp. The lock makes the check
+// and the stamp one step, so a stage marked by both cores at once keeps the
+// first stamp. It is claimed by the first mark, BOOT_MAIN, made on core0
+// before core1 is launched.
+static BOOT_CORE_T cores[2];
+static volatile uint64_t stamps[BOOT_STAGE_COUNT];
+static volatile bool reached[BOOT_STAGE_COUNT];
+static bool reported = false;
+static spin_lock_t *lock = NULL;
+
+void boot_mark(boot_stage_t stage) {
+    if (reached[stage]) {
+        return;
+    }
+    if (!lock) {
+        lock = spin_lock_instance(spin_lock_claim_unused(true));
+    }
+    uint32_t save = spin_lock_blocking(lock);
+    if (reached[stage]) {
+        spin_unlock(lock, save);
+        return;
+    }
+    stamps[stage] = time_us_64();
+    __dmb();
+    reached[stage] = true;
+    spin_unlock(lock, save);
+    // A step on the other core may be waiting for it.
+    __sev();
+}
+
+bool boot_reached(boot_stage_t stage) {
+    return reached[stage];
+}
+
+static bool boot_ready(uint32_t after) {
+    while (after) {
+        uint stage = (uint) __builtin_ctz(after);
+        after &= after - 1;
+        if (!reached[stage]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Runs the first ready step and looks again from the top, so a step always
+// goes before those below it that are ready at the same time.
+static void boot_run(BOOT_CORE_T *core) {
+    uint i = 0;
+    while (i < core->count) {
+        const boot_step_t *step = &core->steps[i];
+        if (core->pending & (1u << i) && boot_ready(step->after)) {
+            core->pending &= ~(1u << i);
+            step->init();
+            boot_mark(step->stage);
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+}
+
+// In the order they were reached, with the time since the one before.
+static void boot_report(void) {
+    uint32_t printed = 0;
+    uint64_t last = 0;
+    int width = 0;
+
+    for (uint i = 0; i < BOOT_STAGE_COUNT; i++) {
+        int len = (int) strlen(stage_names[i]);
+        width = len > width ? len : width;
+    }
+
+    printf("boot, us since reset:\n");
+    while (true) {
+        int next = -1;
+        for (uint i = 0; i < BOOT_STAGE_COUNT; i++) {
+            if (reached[i] && !(printed & (1u << i)) && (next < 0 || stamps[i] < stamps[next])) {
+                next = (int) i;
+            }
+        }
+        if (next < 0) {
+            break;
+        }
+        printed |= 1u << next;
+        printf("  %-*s %10llu +%llu\n", width, stage_names[next],
+            (unsigned long long) stamps[next], (unsigned long long) (last ? stamps[next] - last : 0));
+        last = stamps[next];
+    }
+    for (uint i = 0; i < BOOT_STAGE_COUNT; i++) {
+        if (!reached[i]) {
+            printf("  %-*s pending\n", width, stage_names[i]);
+        }
+    }
+}
+
+void boot_start(const boot_step_t *steps, uint count) {
+    BOOT_CORE_T *core = &cores[get_core_num()];
+    core->steps = steps;
+    core->count = count;
+    core->pending = count < 32 ? (1u << count) - 1 : UINT32_MAX;
+    boot_run(core);
+}
+
+void boot_task(void) {
+    BOOT_CORE_T *core = &cores[get_core_num()];
+    if (core->pending) {
+        boot_run(core);
+    }
+    if (reported || get_core_num() || !reached[BOOT_CORE0_LOOP] || !reached[BOOT_CORE1_LOOP]) {
+        return;
+    }
+    if (reached[BOOT_FIRST_SAMPLE] || time_us_64() - stamps[BOOT_CORE1_LOOP] > BOOT_REPORT_TIMEOUT_MS * 1000ull) {
+        reported = true;
+        boot_report();
+    }
+}
+
+static void boot_command(const char *args) {
+    boot_report();
+}
+
+void boot_init(void) {
+    console_register("boot", "time each boot stage was reached", boot_command);
+}
@@ -0,0 +1,72 @@
+#ifndef _BOOT_H
+#define _BOOT_H
+
+#include "pico/stdlib.h"
+
+// Boot profile and init order. Each stage is stamped with time_us_64 the
+// first time it is reached, from either core or an interrupt handler, and
+// core0 prints the stages in the order they were reached once both main
+// loops are running and the first temperature sample is in, or after
+// BOOT_REPORT_TIMEOUT_MS if no sample comes. The "boot" console command
+// prints them again along with any still to come.
+//
+// Each core hands boot_start a table of init steps. A step runs once every
+// stage in its after mask has been reached, on either core, and its own
+// stage is marked when it returns. Steps run in table order as they become
+// ready, boot_start runs all it can and boot_task, from the core's main
+// loop, runs the rest. A step that waits on a late stage, the link coming
+// up say, is so loaded lazily. Work that finishes after its step returns,
+// like the sensor scan, marks its own stage.
+
+#define BOOT_REPORT_TIMEOUT_MS 10000
+
+#define BOOT_STAGES(X) \
+    X(BOOT_MAIN,         "main") \
+    X(BOOT_STDIO,        "stdio") \
+    X(BOOT_CORE1,        "core1 launched") \
+    X(BOOT_I2C,          "i2c buses") \
+    X(BOOT_SENSORS,      "mcp9808 init") \
+    X(BOOT_RTC,          "rtc") \
+    X(BOOT_BACKLIGHT,    "backlight") \
+    X(BOOT_TOUCH,        "touch screen") \
+    X(BOOT_DISPLAY,      "display init") \
+    X(BOOT_CORE1_LOOP,   "core1 loop") \
+    X(BOOT_SCAN,         "mcp9808 scan") \
+    X(BOOT_FIRST_SAMPLE, "first sample") \
+    X(BOOT_LIMITS,       "mcp9808 limits") \
+    X(BOOT_FIRST_FRAME,  "display first frame") \
+    X(BOOT_CYW43,        "cyw43 firmware") \
+    X(BOOT_WIFI,         "wifi init") \
+    X(BOOT_NTP,          "ntp init") \
+    X(BOOT_TELEMETRY,    "telemetry init") \
+    X(BOOT_CORE0_LOOP,   "core0 loop") \
+    X(BOOT_LINK_UP,      "wifi link up") \
+    X(BOOT_METRICS,      "metrics http") \
+    X(BOOT_NTP_SYNC,     "ntp sync")
+
+#define X(id, name) id,
+typedef enum {
+    BOOT_STAGES(X)
+    BOOT_STAGE_COUNT
+} boot_stage_t;
+#undef X
+
+#define BOOT_AFTER(stage) (1u << (stage))
+
+typedef struct {
+    boot_stage_t stage;
+    uint32_t after; // BOOT_AFTER of each stage it needs
+    void (*init)(void);
+} boot_step_t;
+
+// At most 32 steps a core. The table must outlive the boot.
+void boot_start(const boot_step_t *steps, uint count);
+void boot_task(void);
+// Safe from either core and from interrupt context, the first to mark a
+// stage stamps it.
+void boot_mark(boot_stage_t stage);
+bool boot_reached(boot_stage_t stage);
+// core0, registers the console command.
+void boot_init(void);
+
+#endif
@@ -0,0 +1,66 @@
+#include <string.h>
+
+#include "src/console.h"
+
+typedef struct {
+    const char *name;
+    const char *help;
+    console_handler_t handler;
+} CONSOLE_COMMAND_T;
+
+static CONSOLE_COMMAND_T commands[CONSOLE_MAX_COMMANDS];
+static uint command_count = 0;
+static char line[CONSOLE_LINE_LEN];
+static uint line_len = 0;
+
+static void console_help(const char *args) {
+    for (uint i = 0; i < command_count; i++) {
+        printf("%-8s %s\n", commands[i].name, commands[i].help);
+    }
+}
+
+bool console_register(const char *name, const char *help, console_handler_t handler) {
+    if (command_count == 0) {
+        commands[command_count++] = (CONSOLE_COMMAND_T) {"help", "list commands", console_help};
+    }
+    if (command_count == CONSOLE_MAX_COMMANDS) {
+        return false;
+    }
+    commands[command_count++] = (CONSOLE_COMMAND_T) {name, help, handler};
+    return true;
+}
+
+static void console_run(char *text) {
+    char *args = text;
+    while (*args && *args != ' ') {
+        args++;
+    }
+    size_t name_len = args - text;
+    while (*args == ' ') {
+        args++;
+    }
+    if (name_len == 0) {
+        return;
+    }
+    for (uint i = 0; i < command_count; i++) {
+        if (strlen(commands[i].name) == name_len && !strncmp(commands[i].name, text, name_len)) {
+            commands[i].handler(args);
+            return;
+        }
+    }
+    printf("unknown command, try help\n");
+}
+
+// Called from the main loop, takes whatever input is waiting without blocking.
+void console_task(void) {
+    int c;
+    while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
+        if (c == '\r' || c == '\n') {
+            line[line_len] = 0;
+            line_len = 0;
+            console_run(line);
+        } else if (line_len < CONSOLE_LINE_LEN - 1) {
+            line[line_len++] = (char) c;
+        }
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef _CONSOLE_H
+#define _CONSOLE_H
+
+#include "pico/stdlib.h"
+
+// Line based commands over stdio. A line is "<name> [args]", the handler gets
+// whatever follows the name with leading spaces removed. Output is plain text
+// so it passes straight through tools/trace_decode.py. Input is polled, so it
+// is picked up the next time core0 wakes.
+
+#define CONSOLE_MAX_COMMANDS 16
+#define CONSOLE_LINE_LEN 64
+
+typedef void (*console_handler_t)(const char *args);
+
+bool console_register(const char *name, const char *help, console_handler_t handler);
+void console_task(void);
+
+#endif
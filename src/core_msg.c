@@ -0,0 +1,48 @@
+#include "hardware/sync.h"
+
+#include "src/core_msg.h"
+
+// Single producer (core0) and single consumer (core1), the same scheme as
+// gpio_event. The fences order the record against the index across cores.
+// core0 sends from its main loop and from interrupts, so a send is made
+// with core0's interrupts off and the senders there take turns.
+static_assert((CORE_MSG_RING_SIZE & (CORE_MSG_RING_SIZE - 1)) == 0, "CORE_MSG_RING_SIZE must be a power of two");
+
+static core_msg_t ring[CORE_MSG_RING_SIZE];
+static volatile uint32_t head = 0;
+static volatile uint32_t tail = 0;
+static volatile uint32_t dropped = 0;
+
+bool core_msg_send(core_msg_type_t type, uint32_t arg) {
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t h = head;
+    if (h - tail == CORE_MSG_RING_SIZE) {
+        dropped += 1;
+        restore_interrupts(save);
+        return false;
+    }
+    core_msg_t *msg = &ring[h & (CORE_MSG_RING_SIZE - 1)];
+    msg->type = (uint8_t) type;
+    msg->arg = arg;
+    __mem_fence_release();
+    head = h + 1;
+    restore_interrupts(save);
+    __sev();
+    return true;
+}
+
+bool core_msg_receive(core_msg_t *msg) {
+    uint32_t t = tail;
+    if (head == t) {
+        return false;
+    }
+    __mem_fence_acquire();
+    *msg = ring[t & (CORE_MSG_RING_SIZE - 1)];
+    __mem_fence_release();
+    tail = t + 1;
+    return true;
+}
+
+uint32_t core_msg_dropped(void) {
+    return dropped;
+}
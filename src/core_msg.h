@@ -0,0 +1,32 @@
+#ifndef _CORE_MSG_H
+#define _CORE_MSG_H
+
+#include "pico/stdlib.h"
+
+// Messages from core0 (Wi-Fi, NTP, console) to core1 (sensors, display).
+// A lock free ring in shared RAM rather than the SIO FIFO, which the SDK
+// uses itself for launching core1 and for multicore lockout.
+
+// Must be a power of two.
+#define CORE_MSG_RING_SIZE 16
+
+typedef enum {
+    CORE_MSG_TIME_SET, // arg: seconds since 1970 for the RTC
+    CORE_MSG_MCP9808_LIMIT, // arg: mcp9808_limit_t << 16 | mcp9808_temp_t
+    CORE_MSG_DISPLAY_REDRAW, // arg: unused
+    CORE_MSG_BACKLIGHT_FADE, // arg: hold seconds << 16 | fade seconds << 8 | gamma tenths
+} core_msg_type_t;
+
+typedef struct {
+    uint8_t type;
+    uint32_t arg;
+} core_msg_t;
+
+// core0 only, from its main loop or its interrupts. Wakes core1 if it is
+// waiting for an event.
+bool core_msg_send(core_msg_type_t type, uint32_t arg);
+// core1 only.
+bool core_msg_receive(core_msg_t *msg);
+uint32_t core_msg_dropped(void);
+
+#endif
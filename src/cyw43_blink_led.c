@@ -1,10 +1,13 @@
 #include "src/cyw43_blink_led.h"
+#include "src/isr_stats.h"
+#include "src/timer_wheel.h"
 
 #define BLINK_LED_CALLBACK_TIME (3 * 1000)
+#define BLINK_LED_CALLBACK_SLACK 500 // ms, it can share a wakeup
 
-static bool cyw43_blink_led_process(repeating_timer_t *rt);
+static uint32_t cyw43_blink_led_process(timer_wheel_timer_t *timer);
 
-static repeating_timer_t timer;
+static timer_wheel_timer_t timer;
 
 void cyw43_blink_led_init(void) {
     if (!cyw43_is_initialized(&cyw43_state)) {
@@ -13,10 +16,12 @@ void cyw43_blink_led_init(void) {
             return;
         }
     }
-    add_repeating_timer_ms(BLINK_LED_CALLBACK_TIME, cyw43_blink_led_process, NULL, &timer);
+    timer_wheel_timer_init(&timer, cyw43_blink_led_process, NULL, BLINK_LED_CALLBACK_SLACK);
+    timer_wheel_add(&timer, BLINK_LED_CALLBACK_TIME);
 }
 
-bool cyw43_blink_led_process(repeating_timer_t *rt) {
+uint32_t __not_in_flash_func(cyw43_blink_led_process)(timer_wheel_timer_t *timer) {
+    ISR_STATS_ENTER_TIMER(ISR_BLINK_LED, BLINK_LED_CALLBACK_TIME * 1000);
     static int blink_led_state = 0;
     if (blink_led_state == 0) {
         cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
@@ -24,5 +29,6 @@ bool cyw43_blink_led_process(repeating_timer_t *rt) {
         cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 0);
     }
     blink_led_state = !blink_led_state;
-return true;
+    ISR_STATS_EXIT(ISR_BLINK_LED);
+return BLINK_LED_CALLBACK_TIME;
 }
@@ -1,29 +1,71 @@
+#include "hardware/sync.h"
 #include "pico/cyw43_arch.h"
-#include "hardware/rtc.h"
 #include "lwip/dns.h"
-#include "pico/util/datetime.h"
+#include "src/boot.h"
+#include "src/core_msg.h"
 #include "src/cyw43_ntp.h"
+#include "src/isr_stats.h"
+#include "src/ntp_clock.h"
+#include "src/ntp_select.h"
+#include "src/timer_wheel.h"
+#include "src/trace.h"
+#include "src/wall_clock.h"
+#include "src/wifi_link.h"
 
-#define NTP_SERVER "pool.ntp.org"
+#define NTP_SERVERS {"0.pool.ntp.org", "1.pool.ntp.org", "2.pool.ntp.org"}
+#define NTP_SERVER_COUNT 3
 #define NTP_MSG_LEN 48
 #define NTP_PORT 123
 #define NTP_DELTA 2208988800 // seconds between 1 Jan 1900 and 1 Jan 1970
-#define NTP_TEST_TIME (30 * 1000)
-#define NTP_RESEND_TIME (10 * 1000)
+#define NTP_BURST 4                      // requests per server per poll
+#define NTP_BURST_SPACING (250)          // ms between the requests of a burst
+#define NTP_BURST_WAIT (2 * 1000)        // ms for the last replies
+#define NTP_RESEND_TIME (60 * 1000)      // retry when no servers agreed
 #define NTP_CALLBACK_TIME (60 * 60 * 1000)
-#define NTP_LOGON_TIMEOUT (30 * 1000)
+// ms each timer may run late to share a wakeup, the burst's spacing only
+// needs to be roughly even.
+#define NTP_BURST_SLACK 20
+#define NTP_RESEND_SLACK (5 * 1000)
+#define NTP_CALLBACK_SLACK (60 * 1000)
+#define NTP_DNS_CACHE_TIME (24 * 60 * 60 * 1000)
+#define NTP_SERVER_MISSES 3              // silent polls before resolving a server again
+// Work for cyw43_ntp_task, a bit each.
+#define NTP_DUE_POLL 0x1                 // start a burst
+#define NTP_DUE_ROUND 0x2                // the burst timer ran out
+#define NTP_DUE_END 0x4                  // every request of the burst answered
 
 #define ntp_packet_li(packet)   (uint8_t) ((packet->li_vn_mode & 0xC0) >> 6) // (li   & 11 000 000) >> 6
 #define ntp_packet_vn(packet)   (uint8_t) ((packet->li_vn_mode & 0x38) >> 3) // (vn   & 00 111 000) >> 3
 #define ntp_packet_mode(packet) (uint8_t) ((packet->li_vn_mode & 0x07) >> 0) // (mode & 00 000 111) >> 0
 
-static repeating_timer_t timer;
+static_assert(NTP_BURST <= NTP_FILTER_SAMPLES, "a burst must fit the clock filter");
+static_assert(NTP_BURST <= 8, "answered is a bit per request");
+static_assert(NTP_SERVER_COUNT <= NTP_SELECT_MAX_PEERS, "too many servers to select from");
+
+// A pool name resolves to a different server each time, so the address is
+// kept while the server answers. lwIP's own cache honours the record's TTL,
+// which for the pool is shorter than a poll, so it would rotate servers on
+// every poll and the clock filter would never see the same one twice.
+typedef struct {
+    const char *name;
+    ip_addr_t address;
+    absolute_time_t address_expiry; // nil_time when not resolved
+    bool dns_pending;
+    uint8_t misses;
+    uint8_t sent;
+    uint8_t answered; // A bit per request, each is only answered once
+    uint8_t request_ts[NTP_BURST][8]; // T1 as sent, a reply must echo one
+    ntp_filter_t filter;
+} NTP_SERVER_T;
+
 typedef struct NTP_T_ {
-    ip_addr_t ntp_server_address;
-    bool dns_request_sent;
+    NTP_SERVER_T servers[NTP_SERVER_COUNT];
     struct udp_pcb *ntp_pcb;
-    absolute_time_t ntp_test_time;
-    alarm_id_t ntp_resend_alarm;
+    bool burst_running;
+    uint8_t burst_round;
+    uint8_t outstanding;
+    timer_wheel_timer_t burst_timer;
+    timer_wheel_timer_t resend_timer;
 } NTP_T;
 
 // ntp time stamp structure
@@ -33,45 +75,57 @@ struct ntp_ts_t {
 };
 
 static void ntp_result(NTP_T* state, int status, time_t *result);
-static int64_t ntp_failed_handler(alarm_id_t id, void *user_data);
-static void ntp_request(NTP_T *state);
-static int64_t ntp_failed_handler(alarm_id_t id, void *user_data);
+static void ntp_request(NTP_T *state, NTP_SERVER_T *server);
+static void ntp_resolve(NTP_T *state, NTP_SERVER_T *server);
+static uint32_t ntp_burst_handler(timer_wheel_timer_t *timer);
+static uint32_t ntp_resend_handler(timer_wheel_timer_t *timer);
+static void ntp_burst_round(NTP_T *state);
+static void ntp_burst_end(NTP_T *state);
 static void ntp_dns_found(const char *hostname, const ip_addr_t *ipaddr, void *arg);
-static void ntp_to_timeval(struct ntp_ts_t *ntp, struct timeval *tv);
-static void timeval_to_ntp(struct timeval *tv, struct ntp_ts_t *ntp);
+static int64_t ntp_to_us(struct ntp_ts_t *ntp);
+static void us_to_ntp(uint64_t us, struct ntp_ts_t *ntp);
+static void ntp_get_ts(struct pbuf *p, uint16_t offset, struct ntp_ts_t *ntp);
+static void ntp_put_ts(uint8_t *buf, struct ntp_ts_t *ntp);
 static void ntp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port);
 static NTP_T* cyw43_ntp_get_state(void);
-static int32_t cyw43_ntp_initiate_request(void);
-static bool cyw43_ntp_process(repeating_timer_t *rt);
+static void cyw43_ntp_initiate_request(void);
+static uint32_t cyw43_ntp_process(timer_wheel_timer_t *timer);
 
-static repeating_timer_t timer;
+static timer_wheel_timer_t timer;
+static volatile uint32_t due;
 
-void cyw43_ntp_init() {
-    if (!cyw43_is_initialized(&cyw43_state)) {
-        if (cyw43_arch_init()) {
-            printf("Wi-Fi init failed \n");
-            return;
-        }
-    }
-    cyw43_arch_enable_sta_mode();
-    if (cyw43_arch_wifi_connect_timeout_ms(WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK, NTP_LOGON_TIMEOUT)) {
-        printf("Connect to local Wi-Fi failed to initiate \n");
-        return;
-    }
+// From the timers and the lwIP callbacks, which can preempt each other.
+static void ntp_due(uint32_t work) {
+    uint32_t save = save_and_disable_interrupts();
+    due |= work;
+    restore_interrupts(save);
+    __sev();
+}
 
-    cyw43_ntp_initiate_request();
+// Each time the link comes up, the clock may have drifted while it was down.
+static void cyw43_ntp_link(bool up) {
+    if (up) {
+        cyw43_ntp_initiate_request();
+    }
+}
 
-    add_repeating_timer_ms(NTP_CALLBACK_TIME, cyw43_ntp_process, NULL, &timer);
+void cyw43_ntp_init() {
+    wifi_link_subscribe(cyw43_ntp_link);
+    timer_wheel_timer_init(&timer, cyw43_ntp_process, NULL, NTP_CALLBACK_SLACK);
+    timer_wheel_add(&timer, NTP_CALLBACK_TIME);
 }
 
-bool cyw43_ntp_process(repeating_timer_t *rt) {
-        cyw43_ntp_initiate_request();
-        return true;
+uint32_t __not_in_flash_func(cyw43_ntp_process)(timer_wheel_timer_t *timer) {
+        ISR_STATS_ENTER_TIMER(ISR_NTP, NTP_CALLBACK_TIME * 1000u);
+        ntp_due(NTP_DUE_POLL);
+        ISR_STATS_EXIT(ISR_NTP);
+        return NTP_CALLBACK_TIME;
 }
 
 
 // Perform initialisation
 NTP_T* cyw43_ntp_get_state(void) {
+    static const char *const names[NTP_SERVER_COUNT] = NTP_SERVERS;
     static NTP_T *state;
     if (!state) {
         state = (NTP_T*)calloc(1, sizeof(NTP_T));
@@ -85,6 +139,12 @@ NTP_T* cyw43_ntp_get_state(void) {
             free(state);
             return NULL;
         }
+        for (uint i = 0; i < NTP_SERVER_COUNT; i++) {
+            state->servers[i].name = names[i];
+            state->servers[i].address_expiry = nil_time;
+        }
+        timer_wheel_timer_init(&state->burst_timer, ntp_burst_handler, state, NTP_BURST_SLACK);
+        timer_wheel_timer_init(&state->resend_timer, ntp_resend_handler, state, NTP_RESEND_SLACK);
         udp_recv(state->ntp_pcb, ntp_recv, state);
     }
     return state;
@@ -93,127 +153,294 @@ NTP_T* cyw43_ntp_get_state(void) {
 // Called with results of operation
 static void ntp_result(NTP_T* state, int status, time_t *result) {
     if (status == 0 && result) {
-        // Start on Friday 5th of June 2020 15:45:00
-        struct tm *utc = gmtime(result);
-        datetime_t t = {
-            .year  = utc->tm_year + 1900,
-            .month = utc->tm_mon + 1,
-            .day   = utc->tm_mday,
-            .dotw  = utc->tm_wday, // 0 is Sunday, so 5 is Friday
-            .hour  = utc->tm_hour,
-            .min   = utc->tm_min,
-            .sec   = utc->tm_sec
-        };
-        printf("rtc(%02d/%02d/%04d %02d:%02d:%02d) \n", t.day, t.month, t.year, t.hour, t.min, t.sec);
-        rtc_set_datetime(&t);
+        // The RTC belongs to core1, it is only set when the clock steps.
+        TRACE1(TRACE_NTP_TIME, *result);
+        core_msg_send(CORE_MSG_TIME_SET, (uint32_t) *result);
+    }
+    if (status == 0) {
+        // Lets the trace decoder follow the clock as it slews.
+        uint64_t now = wall_clock_us();
+        TRACE2(TRACE_WALL_CLOCK, now / 1000000, now % 1000000);
+        boot_mark(BOOT_NTP_SYNC);
     }
 
-    if (state->ntp_resend_alarm > 0) {
-        cancel_alarm(state->ntp_resend_alarm);
-        state->ntp_resend_alarm = 0;
+    timer_wheel_cancel(&state->burst_timer);
+    state->burst_running = false;
+    if (status != 0 && !timer_wheel_pending(&state->resend_timer)) {
+        timer_wheel_add(&state->resend_timer, NTP_RESEND_TIME);
     }
-    state->ntp_test_time = make_timeout_time_ms(NTP_TEST_TIME);
-    state->dns_request_sent = false;
 }
 
-
+static bool ntp_resolved(NTP_SERVER_T *server) {
+    return !is_nil_time(server->address_expiry) &&
+           absolute_time_diff_us(get_absolute_time(), server->address_expiry) > 0;
+}
 
 // Make an NTP request
-static void ntp_request(NTP_T *state) {
+static void ntp_request(NTP_T *state, NTP_SERVER_T *server) {
     // cyw43_arch_lwip_begin/end should be used around calls into lwIP to ensure correct locking.
     // You can omit them if you are in a callback from lwIP. Note that when using pico_cyw_arch_poll
     // these calls are a no-op and can be omitted, but it is a good practice to use them in
     // case you switch the cyw43_arch type later.
     cyw43_arch_lwip_begin();
     struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, NTP_MSG_LEN, PBUF_RAM);
-    uint8_t *req = (uint8_t *) p->payload;
-    memset(req, 0, NTP_MSG_LEN);
-    req[0] = 0x1b;
-    udp_sendto(state->ntp_pcb, p, &state->ntp_server_address, NTP_PORT);
-    pbuf_free(p);
+    if (p) {
+        uint8_t *req = (uint8_t *) p->payload;
+        struct ntp_ts_t t1;
+        memset(req, 0, NTP_MSG_LEN);
+        req[0] = 0x1b;
+        // T1, the server returns it as the originate timestamp.
+        us_to_ntp(ntp_clock_now_us(), &t1);
+        ntp_put_ts(&req[40], &t1);
+        memcpy(server->request_ts[server->sent], &req[40], sizeof(server->request_ts[0]));
+        if (udp_sendto(state->ntp_pcb, p, &server->address, NTP_PORT) == ERR_OK) {
+            server->sent++;
+            state->outstanding++;
+        }
+        pbuf_free(p);
+    }
     cyw43_arch_lwip_end();
 }
 
-static int64_t ntp_failed_handler(alarm_id_t id, void *user_data)
+static void ntp_resolve(NTP_T *state, NTP_SERVER_T *server) {
+    if (ntp_resolved(server) || server->dns_pending) {
+        return;
+    }
+    // cyw43_arch_lwip_begin/end should be used around calls into lwIP to ensure correct locking.
+    cyw43_arch_lwip_begin();
+    int err = dns_gethostbyname(server->name, &server->address, ntp_dns_found, state);
+    cyw43_arch_lwip_end();
+
+    if (err == ERR_OK) {
+        server->address_expiry = make_timeout_time_ms(NTP_DNS_CACHE_TIME);
+    } else if (err == ERR_INPROGRESS) { // ERR_INPROGRESS means expect a callback
+        server->dns_pending = true;
+    } else {
+        TRACE0(TRACE_NTP_DNS_FAILED);
+    }
+}
+
+static uint32_t ntp_burst_handler(timer_wheel_timer_t *timer)
+{
+    ntp_due(NTP_DUE_ROUND);
+    return 0;
+}
+
+static uint32_t ntp_resend_handler(timer_wheel_timer_t *timer)
 {
-    NTP_T* state = (NTP_T*)user_data;
-    printf("ntp request failed\n");
-    ntp_result(state, -1, NULL);
+    ntp_due(NTP_DUE_POLL);
     return 0;
 }
 
+// One request to every resolved server per round, close together so the
+// radio wakes for the burst rather than for each request. A server whose
+// name resolves part way through joins at the next round.
+static void ntp_burst_round(NTP_T *state) {
+    if (state->burst_round < NTP_BURST) {
+        for (uint i = 0; i < NTP_SERVER_COUNT; i++) {
+            if (ntp_resolved(&state->servers[i])) {
+                ntp_request(state, &state->servers[i]);
+            }
+        }
+        state->burst_round++;
+        timer_wheel_add(&state->burst_timer, state->burst_round < NTP_BURST ? NTP_BURST_SPACING : NTP_BURST_WAIT);
+    } else {
+        ntp_burst_end(state);
+    }
+}
+
+// Each server's burst goes through its clock filter, then the servers that
+// agree are combined into one adjustment.
+static void ntp_burst_end(NTP_T *state) {
+    ntp_peer_t peers[NTP_SERVER_COUNT];
+    uint count = 0;
+    for (uint i = 0; i < NTP_SERVER_COUNT; i++) {
+        NTP_SERVER_T *server = &state->servers[i];
+        if (ntp_filter_peer(&server->filter, &peers[count])) {
+            ntp_peer_t *peer = &peers[count++];
+            // Clamped for the trace, the first offset is decades.
+            TRACE4(TRACE_NTP_PEER, i, peer->offset_us > INT32_MAX ? INT32_MAX : peer->offset_us < INT32_MIN ? INT32_MIN : peer->offset_us,
+                   peer->delay_us, peer->jitter_us);
+            server->misses = 0;
+        } else if (server->sent && ++server->misses >= NTP_SERVER_MISSES) {
+            TRACE1(TRACE_NTP_SERVER_LOST, i);
+            server->address_expiry = nil_time;
+            server->misses = 0;
+        }
+    }
+
+    int64_t offset;
+    uint64_t timer_us;
+    uint survivors = ntp_select(peers, count, &offset, &timer_us);
+    TRACE2(TRACE_NTP_SELECT, survivors, count);
+    if (!survivors) {
+        TRACE0(TRACE_NTP_FAILED);
+        ntp_result(state, -1, NULL);
+    } else if (ntp_clock_adjust(offset, timer_us) == NTP_CLOCK_STEPPED) {
+        time_t epoch = (time_t) (ntp_clock_now_us() / 1000000);
+        ntp_result(state, 0, &epoch);
+    } else {
+        TRACE1(TRACE_NTP_FREQ, ntp_clock_freq_ppb());
+        ntp_result(state, 0, NULL);
+    }
+}
+
 // Call back with a DNS result
 static void ntp_dns_found(const char *hostname, const ip_addr_t *ipaddr, void *arg) {
     NTP_T *state = (NTP_T*)arg;
-    if (ipaddr) {
-        state->ntp_server_address = *ipaddr;
-        printf("Addr(%s) ", ipaddr_ntoa(ipaddr));
-        ntp_request(state);
-    } else {
-        printf("ntp dns request failed\n");
-        ntp_result(state, -1, NULL);
+    for (uint i = 0; i < NTP_SERVER_COUNT; i++) {
+        NTP_SERVER_T *server = &state->servers[i];
+        if (!server->dns_pending || strcmp(server->name, hostname)) {
+            continue;
+        }
+        server->dns_pending = false;
+        if (ipaddr) {
+            server->address = *ipaddr;
+            server->address_expiry = make_timeout_time_ms(NTP_DNS_CACHE_TIME);
+            TRACE4(TRACE_NTP_ADDR, ip4_addr1(ip_2_ip4(ipaddr)), ip4_addr2(ip_2_ip4(ipaddr)), ip4_addr3(ip_2_ip4(ipaddr)), ip4_addr4(ip_2_ip4(ipaddr)));
+        } else {
+            TRACE0(TRACE_NTP_DNS_FAILED);
+        }
     }
 }
 
 // 1900/01/01 to 1970/01/01 is NTP_DELTA seconds. Remove those extra seconds to get unix time.
-void ntp_to_timeval(struct ntp_ts_t *ntp, struct timeval *tv) {
-    tv->tv_sec = ntp->seconds - NTP_DELTA;
-    tv->tv_usec = (uint32_t)((double)ntp->fraction * 1.0e6 / (double)(1LL << 32));
+static int64_t __not_in_flash_func(ntp_to_us)(struct ntp_ts_t *ntp) {
+    int64_t seconds = (int64_t) ntp->seconds - NTP_DELTA;
+    return seconds * 1000000 + (int64_t) (((uint64_t) ntp->fraction * 1000000) >> 32);
 }
 
 // 1900/01/01 to 1970/01/01 is NTP_DELTA seconds. Add those extra seconds to get ntp time.
-void timeval_to_ntp(struct timeval *tv, struct ntp_ts_t *ntp) {
-    ntp->seconds = tv->tv_sec + NTP_DELTA;
-    ntp->fraction = (uint32_t)((double)(tv->tv_usec + 1) * (double)(1LL << 32) * 1.0e-6);
+static void us_to_ntp(uint64_t us, struct ntp_ts_t *ntp) {
+    ntp->seconds = (uint32_t) (us / 1000000 + NTP_DELTA);
+    ntp->fraction = (uint32_t) (((us % 1000000) << 32) / 1000000);
+}
+
+static void __not_in_flash_func(ntp_get_ts)(struct pbuf *p, uint16_t offset, struct ntp_ts_t *ntp) {
+    uint8_t buf[8] = {0};
+    pbuf_copy_partial(p, buf, sizeof(buf), offset);
+    ntp->seconds = buf[0] << 24 | buf[1] << 16 | buf[2] << 8 | buf[3];
+    ntp->fraction = buf[4] << 24 | buf[5] << 16 | buf[6] << 8 | buf[7];
+}
+
+static void ntp_put_ts(uint8_t *buf, struct ntp_ts_t *ntp) {
+    for (uint i = 0; i < 4; i++) {
+        buf[i] = (uint8_t) (ntp->seconds >> (24 - 8 * i));
+        buf[4 + i] = (uint8_t) (ntp->fraction >> (24 - 8 * i));
+    }
+}
+
+// Root delay and dispersion are 16.16 seconds.
+static uint32_t __not_in_flash_func(ntp_get_short_us)(struct pbuf *p, uint16_t offset) {
+    uint8_t buf[4] = {0};
+    pbuf_copy_partial(p, buf, sizeof(buf), offset);
+    uint32_t value = buf[0] << 24 | buf[1] << 16 | buf[2] << 8 | buf[3];
+    return (uint32_t) (((uint64_t) value * 1000000) >> 16);
 }
 
 // NTP data received
-static void ntp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+static void __not_in_flash_func(ntp_recv)(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+    // T4, before anything else.
+    uint64_t t4_timer = time_us_64();
+    int64_t t4 = (int64_t) ntp_clock_at_us(t4_timer);
     NTP_T *state = (NTP_T*)arg;
+    NTP_SERVER_T *server = NULL;
+    int request = -1;
+    uint8_t li = pbuf_get_at(p, 0) >> 6;
     uint8_t mode = pbuf_get_at(p, 0) & 0x7;
     uint8_t stratum = pbuf_get_at(p, 1);
-    if (ip_addr_cmp(addr, &state->ntp_server_address) && port == NTP_PORT && p->tot_len == NTP_MSG_LEN &&
-        mode == 0x4 && stratum != 0) {
-        uint8_t seconds_buf[4] = {0};
-        pbuf_copy_partial(p, seconds_buf, sizeof(seconds_buf), 40);
-        uint32_t seconds_since_1900 = seconds_buf[0] << 24 | seconds_buf[1] << 16 | seconds_buf[2] << 8 | seconds_buf[3];
-        uint32_t seconds_since_1970 = seconds_since_1900 - NTP_DELTA;
-        printf("SecsSince1970(%0lu) ", seconds_since_1970);
-        time_t epoch = seconds_since_1970;
-
-        uint8_t fract_buf[4] = {0};
-        pbuf_copy_partial(p, fract_buf, sizeof(fract_buf), 44);
-        uint32_t fractional_seconds = fract_buf[0] << 24 | fract_buf[1] << 16 | fract_buf[2] << 8 | fract_buf[3];
-        printf("FracSecs(%0lu) ", fractional_seconds);
-        ntp_result(state, 0, &epoch);
+    uint8_t originate[8] = {0};
+    pbuf_copy_partial(p, originate, sizeof(originate), 24);
+
+    for (uint i = 0; i < NTP_SERVER_COUNT && !server; i++) {
+        if (ntp_resolved(&state->servers[i]) && ip_addr_cmp(addr, &state->servers[i].address)) {
+            server = &state->servers[i];
+        }
+    }
+    // The originate check drops stale, duplicate and spoofed replies.
+    for (uint i = 0; server && i < server->sent && request < 0; i++) {
+        if (!(server->answered & 1u << i) && !memcmp(originate, server->request_ts[i], sizeof(originate))) {
+            request = i;
+        }
+    }
+
+    // li 3 is an unsynchronised server.
+    if (request >= 0 && port == NTP_PORT && p->tot_len == NTP_MSG_LEN && mode == 0x4 && stratum != 0 && li != 3) {
+        struct ntp_ts_t ts;
+        ntp_get_ts(p, 24, &ts);
+        int64_t t1 = ntp_to_us(&ts);
+        ntp_get_ts(p, 32, &ts);
+        int64_t t2 = ntp_to_us(&ts);
+        ntp_get_ts(p, 40, &ts);
+        int64_t t3 = ntp_to_us(&ts);
+
+        ntp_sample_t sample = {
+            .offset_us = ((t2 - t1) + (t3 - t4)) / 2,
+            .delay_us = (t4 - t1) - (t3 - t2),
+            .root_us = ntp_get_short_us(p, 4) / 2 + ntp_get_short_us(p, 8),
+            .timer_us = t4_timer,
+        };
+        ntp_filter_add(&server->filter, &sample);
+        server->answered |= 1u << request;
+        state->outstanding--;
+
+        // Every request answered, no need to wait out the burst.
+        if (state->burst_running && state->burst_round == NTP_BURST && !state->outstanding) {
+            ntp_due(NTP_DUE_END);
+        }
     } else {
-        printf("invalid ntp response \n");
-        ntp_result(state, -1, NULL);
+        TRACE0(TRACE_NTP_INVALID);
     }
     pbuf_free(p);
 }
 
-// Periodically send an ntp request which will be serviced via callbacks.
-int32_t cyw43_ntp_initiate_request() {
+// Periodically send a burst of ntp requests which will be serviced via callbacks.
+void cyw43_ntp_initiate_request() {
     NTP_T *state = cyw43_ntp_get_state();
-    if (absolute_time_diff_us(get_absolute_time(), state->ntp_test_time) < 0 && !state->dns_request_sent) {
-        // Set alarm in case udp requests are lost
-        state->ntp_resend_alarm = add_alarm_in_ms(NTP_RESEND_TIME, ntp_failed_handler, state, true);
-
-        // cyw43_arch_lwip_begin/end should be used around calls into lwIP to ensure correct locking.
-        // You can omit them if you are in a callback from lwIP. Note that when using pico_cyw_arch_poll
-        // these calls are a no-op and can be omitted, but it is a good practice to use them in
-        // case you switch the cyw43_arch type later.
-        cyw43_arch_lwip_begin();
-        int err = dns_gethostbyname(NTP_SERVER, &state->ntp_server_address, ntp_dns_found, state);
-        cyw43_arch_lwip_end();
-
-        state->dns_request_sent = true;
-        if (err == ERR_OK) {
-            ntp_request(state); // Cached result
-        } else if (err != ERR_INPROGRESS) { // ERR_INPROGRESS means expect a callback
-            printf("dns request failed\n");
-            ntp_result(state, -1, NULL);
-        }
+    if (!state || state->burst_running) {
+        return;
+    }
+    timer_wheel_cancel(&state->resend_timer);
+    state->burst_running = true;
+    state->burst_round = 0;
+    state->outstanding = 0;
+    for (uint i = 0; i < NTP_SERVER_COUNT; i++) {
+        NTP_SERVER_T *server = &state->servers[i];
+        server->sent = 0;
+        server->answered = 0;
+        ntp_filter_reset(&server->filter);
+        ntp_resolve(state, server);
+    }
+    // The first round waits for the names that aren't cached.
+    timer_wheel_add(&state->burst_timer, NTP_BURST_SPACING);
+}
+
+void cyw43_ntp_task(void) {
+    if (!due) {
+        return;
     }
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t work = due;
+    due = 0;
+    restore_interrupts(save);
+
+    NTP_T *state = cyw43_ntp_get_state();
+    if (!state) {
+        return;
+    }
+    // Holds off the lwIP callbacks, ntp_recv among them, for the duration.
+    cyw43_arch_lwip_begin();
+    if (work & NTP_DUE_ROUND && state->burst_running) {
+        ntp_burst_round(state);
+    }
+    // The burst may have ended on its timer meanwhile.
+    if (work & NTP_DUE_END && state->burst_running && state->burst_round == NTP_BURST && !state->outstanding) {
+        timer_wheel_cancel(&state->burst_timer);
+        ntp_burst_end(state);
+    }
+    // Otherwise the link coming up starts the next one.
+    if (work & NTP_DUE_POLL && wifi_link_up()) {
+        cyw43_ntp_initiate_request();
+    }
+    cyw43_arch_lwip_end();
 }
@@ -3,6 +3,10 @@
 
 #include "pico/stdlib.h"
 
+// core0, after wifi_link_init. Polls start each time the link comes up.
 void cyw43_ntp_init();
+// core0's main loop. The timers and the replies only flag the work, it is
+// done here where lwIP may be called.
+void cyw43_ntp_task(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware/sync.h"
+
+#include "src/boot.h"
+#include "src/console.h"
+#include "src/core_msg.h"
+#include "src/display.h"
+#include "src/font.h"
+#include "src/mcp9808.h"
+#include "src/timer_wheel.h"
+#include "src/wall_clock.h"
+
+static_assert(DISPLAY_COLS < 32, "dirty rows are 32 bit");
+static_assert(FONT_WIDTH * DISPLAY_SCALE < DISPLAY_CELL_WIDTH && FONT_HEIGHT * DISPLAY_SCALE < DISPLAY_CELL_HEIGHT,
+    "a cell is a glyph and its spacing");
+
+#define STATUS_COLOUR DISPLAY_COLOUR(DISPLAY_WHITE, DISPLAY_BLACK)
+#define TITLE_COLOUR DISPLAY_COLOUR(DISPLAY_BLACK, DISPLAY_CYAN)
+#define SENSOR_ROW 3
+
+typedef struct {
+    char c;
+    uint8_t colour;
+} display_cell_t;
+
+static const uint16_t palette[16] = {
+    [DISPLAY_BLACK] = ILI9341_RGB(0, 0, 0),
+    [DISPLAY_WHITE] = ILI9341_RGB(255, 255, 255),
+    [DISPLAY_GREY] = ILI9341_RGB(128, 128, 128),
+    [DISPLAY_RED] = ILI9341_RGB(255, 64, 64),
+    [DISPLAY_GREEN] = ILI9341_RGB(64, 255, 64),
+    [DISPLAY_BLUE] = ILI9341_RGB(96, 128, 255),
+    [DISPLAY_CYAN] = ILI9341_RGB(0, 255, 255),
+    [DISPLAY_YELLOW] = ILI9341_RGB(255, 255, 0),
+};
+
+// The cells are changed by the drawing core's thread and read by its DMA
+// interrupt as they are sent. A cell changed while it is being sent is marked
+// again, so at worst it is sent twice.
+static display_cell_t cells[DISPLAY_ROWS][DISPLAY_COLS];
+static uint32_t dirty[DISPLAY_ROWS];    // A bit per cell changed since the last flush
+static uint32_t flushing[DISPLAY_ROWS]; // Those of this flush not yet sent
+static uint flush_row;
+static uint run_col;
+static uint run_len;
+static uint32_t update_start;
+static volatile bool updating = false;
+static volatile bool status_due = false;
+static bool cleared = false;
+static display_stats_t stats;
+static timer_wheel_timer_t status_timer;
+
+// One line of the run of cells being sent.
+static void __not_in_flash_func(display_line)(uint line, uint16_t *pixels, void *user_data) {
+    const display_cell_t *cell = &cells[flush_row][run_col];
+    uint font_row = line / DISPLAY_SCALE;
+
+    for (uint i = 0; i < run_len; i++, cell++) {
+        const uint8_t *glyph = font_glyph(cell->c);
+        uint16_t fg = palette[cell->colour >> 4];
+        uint16_t bg = palette[cell->colour & 0xF];
+        uint x = 0;
+        if (font_row < FONT_HEIGHT) {
+            for (; x < FONT_WIDTH * DISPLAY_SCALE; x++) {
+                *pixels++ = glyph[x / DISPLAY_SCALE] >> font_row & 1 ? fg : bg;
+            }
+        }
+        for (; x < DISPLAY_CELL_WIDTH; x++) {
+            *pixels++ = bg;
+        }
+    }
+}
+
+static void display_blank(uint line, uint16_t *pixels, void *user_data) {
+    for (uint x = 0; x < ILI9341_WIDTH; x++) {
+        pixels[x] = palette[DISPLAY_BLACK];
+    }
+}
+
+// The clear isn't counted as an update.
+static void display_cleared(void *user_data) {
+    updating = false;
+    __sev();
+}
+
+static void display_finish(void) {
+    uint32_t bytes = ili9341_bytes() - update_start;
+    stats.updates++;
+    stats.last_bytes = bytes;
+    stats.total_bytes += bytes;
+    boot_mark(BOOT_FIRST_FRAME);
+    updating = false;
+    // The main loop may have marked more meanwhile.
+    __sev();
+}
+
+// Streams the next run of marked cells, rows top to bottom and each row
+// left to right, then finishes the update. From the DMA interrupt as each
+// window completes.
+static void __not_in_flash_func(display_next)(void *user_data) {
+    while (flush_row < DISPLAY_ROWS && !flushing[flush_row]) {
+        flush_row++;
+    }
+    if (flush_row == DISPLAY_ROWS) {
+        display_finish();
+        return;
+    }
+    uint32_t marked = flushing[flush_row];
+    run_col = (uint) __builtin_ctz(marked);
+    run_len = (uint) __builtin_ctz(~(marked >> run_col));
+    flushing[flush_row] &= ~(((1u << run_len) - 1) << run_col);
+    stats.windows++;
+    stats.cells += run_len;
+    ili9341_stream(DISPLAY_X + run_col * DISPLAY_CELL_WIDTH, flush_row * DISPLAY_CELL_HEIGHT,
+        run_len * DISPLAY_CELL_WIDTH, DISPLAY_CELL_HEIGHT, display_line, display_next, NULL);
+}
+
+void display_text(uint col, uint row, const char *text, uint8_t colour) {
+    if (row >= DISPLAY_ROWS) {
+        return;
+    }
+    for (; *text && col < DISPLAY_COLS; text++, col++) {
+        display_cell_t *cell = &cells[row][col];
+        if (cell->c != *text || cell->colour != colour) {
+            cell->c = *text;
+            cell->colour = colour;
+            dirty[row] |= 1u << col;
+        }
+    }
+}
+
+// The whole row, padded with spaces.
+static void display_row(uint row, const char *text, uint8_t colour) {
+    char line[DISPLAY_COLS + 1];
+    snprintf(line, sizeof(line), "%-*s", DISPLAY_COLS, text);
+    display_text(0, row, line, colour);
+}
+
+void display_redraw(void) {
+    for (uint row = 0; row < DISPLAY_ROWS; row++) {
+        dirty[row] = (1u << DISPLAY_COLS) - 1;
+    }
+}
+
+// The time, then a row per sensor coloured by which of the thermostat's
+// limits it is past.
+static void display_status(void) {
+    char line[DISPLAY_COLS + 1];
+    char temp[MCP9808_TEMP_STR_LEN];
+    mcp9808_reading_t reading;
+    datetime_t t;
+
+    display_row(0, " Pico W temperatures", TITLE_COLOUR);
+    if (wall_clock_datetime(&t)) {
+        // Bounded to their widths so the line provably fits.
+        snprintf(line, sizeof(line), "%04u-%02u-%02u %02u:%02u:%02u UTC", (uint) t.year % 10000, (uint) t.month % 100,
+            (uint) t.day % 100, (uint) t.hour % 100, (uint) t.min % 100, (uint) t.sec % 100);
+    } else {
+        snprintf(line, sizeof(line), "waiting for NTP");
+    }
+    display_row(1, line, STATUS_COLOUR);
+
+    for (uint i = 0; SENSOR_ROW + i < DISPLAY_ROWS && mcp9808_get_reading(i, &reading); i++) {
+        const char *state = "";
+        display_colour_t fg = DISPLAY_GREEN;
+        if (reading.flags & 4) {
+            state = "cooling";
+            fg = DISPLAY_RED;
+        } else if (reading.flags & 1) {
+            state = "frost";
+            fg = DISPLAY_BLUE;
+        } else if (!(reading.flags & 2)) {
+            state = "heating";
+            fg = DISPLAY_YELLOW;
+        }
+        snprintf(line, sizeof(line), "%02x %7s" FONT_DEGREE "C %s", reading.addr, mcp9808_temp_format(temp, reading.temp), state);
+        display_row(SENSOR_ROW + i, line, DISPLAY_COLOUR(fg, DISPLAY_BLACK));
+    }
+}
+
+static uint32_t display_status_tick(timer_wheel_timer_t *timer) {
+    status_due = true;
+    __sev();
+    return DISPLAY_STATUS_MS;
+}
+
+// The first update clears the whole panel, after that only marked cells are
+// sent, one update at a time.
+void display_task(void) {
+    if (status_due) {
+        status_due = false;
+        display_status();
+    }
+    if (updating || !ili9341_ready()) {
+        return;
+    }
+    if (!cleared) {
+        cleared = true;
+        updating = true;
+        ili9341_stream(0, 0, ILI9341_WIDTH, ILI9341_HEIGHT, display_blank, display_cleared, NULL);
+        return;
+    }
+    uint32_t any = 0;
+    for (uint row = 0; row < DISPLAY_ROWS; row++) {
+        flushing[row] = dirty[row];
+        any |= dirty[row];
+        dirty[row] = 0;
+    }
+    if (!any) {
+        return;
+    }
+    updating = true;
+    update_start = ili9341_bytes();
+    flush_row = 0;
+    display_next(NULL);
+}
+
+void display_get_stats(display_stats_t *s) {
+    *s = stats;
+}
+
+void display_init(void) {
+    for (uint row = 0; row < DISPLAY_ROWS; row++) {
+        for (uint col = 0; col < DISPLAY_COLS; col++) {
+            cells[row][col] = (display_cell_t) {' ', STATUS_COLOUR};
+        }
+    }
+    ili9341_init();
+    timer_wheel_timer_init(&status_timer, display_status_tick, NULL, 20);
+    timer_wheel_add(&status_timer, 0);
+}
+
+static void display_command(const char *args) {
+    display_stats_t s;
+
+    if (!strcmp(args, "redraw")) {
+        if (!core_msg_send(CORE_MSG_DISPLAY_REDRAW, 0)) {
+            printf("display core busy, try again\n");
+        }
+        return;
+    }
+    display_get_stats(&s);
+    uint32_t average = s.updates ? (uint32_t) (s.total_bytes / s.updates) : 0;
+    printf("%ux%u cells, %lu updates, %lu windows, %lu cells redrawn\n", DISPLAY_COLS, DISPLAY_ROWS,
+        (unsigned long) s.updates, (unsigned long) s.windows, (unsigned long) s.cells);
+    printf("bytes per update last %lu average %lu, full screen %u (%lu.%02lu%%)\n",
+        (unsigned long) s.last_bytes, (unsigned long) average, DISPLAY_FULL_BYTES,
+        (unsigned long) (average * 100ull / DISPLAY_FULL_BYTES), (unsigned long) (average * 10000ull / DISPLAY_FULL_BYTES % 100));
+}
+
+void display_console_init(void) {
+    console_register("display", "status screen updates and bytes sent, display redraw to send every cell", display_command);
+}
@@ -0,0 +1,63 @@
+#ifndef _DISPLAY_H
+#define _DISPLAY_H
+
+#include "pico/stdlib.h"
+#include "src/ili9341.h"
+
+// The status screen on the ILI9341: the time and each sensor's reading as a
+// grid of text cells. A cell is the 5x7 font doubled with a blank column and
+// row, and is also the unit of redraw. Changing text only marks the cells
+// that differ, and a flush streams each row's runs of marked cells as one
+// window, so a reading that goes from 21.25 to 21.31 sends two cells. The
+// pixels are rendered from the cells a line at a time as they are sent,
+// there is no framebuffer.
+//
+// The "display" console command shows the updates and bytes sent per update
+// against a full screen, "display redraw" marks every cell to compare.
+
+#define DISPLAY_SCALE 2
+#define DISPLAY_CELL_WIDTH 12
+#define DISPLAY_CELL_HEIGHT 16
+#define DISPLAY_COLS (ILI9341_WIDTH / DISPLAY_CELL_WIDTH)
+#define DISPLAY_ROWS (ILI9341_HEIGHT / DISPLAY_CELL_HEIGHT)
+#define DISPLAY_X ((ILI9341_WIDTH - DISPLAY_COLS * DISPLAY_CELL_WIDTH) / 2) // Grid's left edge
+#define DISPLAY_STATUS_MS 1000
+#define DISPLAY_FULL_BYTES (ILI9341_WIDTH * ILI9341_HEIGHT * 2)
+
+typedef enum {
+    DISPLAY_BLACK,
+    DISPLAY_WHITE,
+    DISPLAY_GREY,
+    DISPLAY_RED,
+    DISPLAY_GREEN,
+    DISPLAY_BLUE,
+    DISPLAY_CYAN,
+    DISPLAY_YELLOW,
+    DISPLAY_COLOURS
+} display_colour_t;
+
+// A cell's colours, foreground and background.
+#define DISPLAY_COLOUR(fg, bg) ((uint8_t) ((fg) << 4 | (bg)))
+
+typedef struct {
+    uint32_t updates;     // Flushes sent
+    uint32_t windows;     // Runs of cells streamed
+    uint32_t cells;       // Cells redrawn
+    uint32_t last_bytes;  // Sent by the last update
+    uint64_t total_bytes;
+} display_stats_t;
+
+// On the core that draws, after the core's timer wheel. The status is
+// redrawn every DISPLAY_STATUS_MS by display_task, from that core's main
+// loop.
+void display_init(void);
+void display_task(void);
+// Drawing core. Text past the end of the row is dropped.
+void display_text(uint col, uint row, const char *text, uint8_t colour);
+void display_redraw(void);
+void display_get_stats(display_stats_t *stats);
+// core0, registers the console command, which sends a redraw to the drawing
+// core as CORE_MSG_DISPLAY_REDRAW.
+void display_console_init(void);
+
+#endif
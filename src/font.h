@@ -0,0 +1,18 @@
+#ifndef _FONT_H
+#define _FONT_H
+
+#include "pico/stdlib.h"
+
+// The classic 5x7 fixed font for printable ASCII, a byte per column with
+// the top row in bit 0. FONT_DEGREE, in place of DEL, is a degree sign.
+
+#define FONT_WIDTH 5
+#define FONT_HEIGHT 7
+#define FONT_FIRST ' '
+#define FONT_LAST '\x7f'
+#define FONT_DEGREE "\x7f"
+
+// Characters outside the font come back as '?'.
+const uint8_t *font_glyph(char c);
+
+#endif
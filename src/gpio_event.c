@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware/structs/iobank0.h"
+#include "hardware/sync.h"
+
+#include "src/console.h"
+#include "src/gpio_event.h"
+#include "src/isr_stats.h"
+#include "src/timer_wheel.h"
+#include "src/trace.h"
+
+#define GPIO_EVENT_MAX_PINS 4
+
+typedef struct {
+    uint8_t gpio;
+    bool passed;             // Anything passed on yet, last is valid
+    uint32_t holdoff_us;
+    uint32_t last;           // When the last event was passed on
+    uint32_t held;           // Events suppressed since, passed on as the holdoff ends
+    uint32_t held_timestamp; // First of them
+    gpio_event_isr_t isr;
+    gpio_event_task_t task;
+    timer_wheel_timer_t timer;
+    gpio_event_stats_t stats;
+} GPIO_EVENT_PIN_T;
+
+// slots[gpio] is the pin's entry plus one, 0 for a pin not registered.
+static GPIO_EVENT_PIN_T pins[GPIO_EVENT_MAX_PINS];
+static uint8_t slots[NUM_BANK0_GPIOS];
+static uint pin_count;
+
+// Single producer (the IO_IRQ_BANK0 handler, and the holdoff timers on the
+// same core, which can't preempt it) and single consumer (the main loop).
+// head and tail are free running, only the producer writes head and only the
+// consumer writes tail, so no locking is needed.
+static_assert((GPIO_EVENT_RING_SIZE & (GPIO_EVENT_RING_SIZE - 1)) == 0, "GPIO_EVENT_RING_SIZE must be a power of two");
+
+static gpio_event_t ring[GPIO_EVENT_RING_SIZE];
+static volatile uint32_t head = 0;
+static volatile uint32_t tail = 0;
+static volatile uint32_t dropped = 0;
+
+// Called from interrupt context. Records the event and returns, anything
+// slow is left for the consumer.
+static bool __not_in_flash_func(gpio_event_push)(uint gpio, uint32_t events, uint32_t timestamp) {
+    uint32_t h = head;
+    if (h - tail == GPIO_EVENT_RING_SIZE) {
+        dropped += 1;
+        return false;
+    }
+    gpio_event_t *event = &ring[h & (GPIO_EVENT_RING_SIZE - 1)];
+    event->gpio = (uint8_t) gpio;
+    event->events = (uint8_t) events;
+    event->timestamp = timestamp;
+    // Publish the record before the new head.
+    __mem_fence_release();
+    head = h + 1;
+    // Wake the consumer if it is in idle_wait.
+    __sev();
+    return true;
+}
+
+static bool gpio_event_pop(gpio_event_t *event) {
+    uint32_t t = tail;
+    if (head == t) {
+        return false;
+    }
+    __mem_fence_acquire();
+    *event = ring[t & (GPIO_EVENT_RING_SIZE - 1)];
+    // Finish reading the record before handing the slot back.
+    __mem_fence_release();
+    tail = t + 1;
+    return true;
+}
+
+// The holdoff starts again from here, whether the edge is new or held.
+static void __not_in_flash_func(gpio_event_pass)(GPIO_EVENT_PIN_T *pin, uint32_t events, uint32_t timestamp) {
+    pin->last = time_us_32();
+    pin->passed = true;
+    if (pin->isr) {
+        pin->isr(pin->gpio, events, timestamp);
+    }
+    if (pin->task) {
+        gpio_event_push(pin->gpio, events, timestamp);
+    }
+}
+
+static void __not_in_flash_func(gpio_event_edge)(GPIO_EVENT_PIN_T *pin, uint32_t events) {
+    uint32_t now = time_us_32();
+    uint32_t since = now - pin->last;
+
+    gpio_acknowledge_irq(pin->gpio, events);
+    pin->stats.edges += 1;
+    // Held events go first, the timer may run a tick after the holdoff.
+    if (pin->held || (pin->passed && since < pin->holdoff_us)) {
+        pin->stats.suppressed += 1;
+        if (!pin->held) {
+            pin->held_timestamp = now;
+            timer_wheel_add(&pin->timer, (pin->holdoff_us - since + 999) / 1000);
+        }
+        pin->held |= events;
+        return;
+    }
+    gpio_event_pass(pin, events, now);
+}
+
+static uint32_t gpio_event_holdoff_end(timer_wheel_timer_t *timer) {
+    GPIO_EVENT_PIN_T *pin = timer->user_data;
+    uint32_t events = pin->held;
+
+    pin->held = 0;
+    pin->stats.coalesced += 1;
+    gpio_event_pass(pin, events, pin->held_timestamp);
+    return 0;
+}
+
+// This core's pending events, four bits a pin, eight pins a register. Only
+// the pins pending are visited and each is found by its slot, pins left to
+// another raw handler are not acknowledged. In SRAM, like the other
+// handlers, so an XIP cache miss does not add to the latency.
+static void __not_in_flash_func(gpio_event_irq)(void) {
+    ISR_STATS_ENTER(ISR_GPIO);
+    const volatile uint32_t *pending = get_core_num() ? iobank0_hw->proc1_irq_ctrl.ints : iobank0_hw->proc0_irq_ctrl.ints;
+    for (uint reg = 0; reg < (NUM_BANK0_GPIOS + 7) / 8; reg++) {
+        uint32_t ints = pending[reg];
+        while (ints) {
+            uint shift = (uint) __builtin_ctz(ints) & ~3u;
+            uint gpio = reg * 8 + shift / 4;
+            uint32_t events = (ints >> shift) & 0xF;
+            ints &= ~(0xFu << shift);
+            if (gpio < NUM_BANK0_GPIOS && slots[gpio]) {
+                gpio_event_edge(&pins[slots[gpio] - 1], events);
+            }
+        }
+    }
+    ISR_STATS_EXIT(ISR_GPIO);
+}
+
+void gpio_event_init(void) {
+    // The mask only says which pins the handler may see, the table decides.
+    gpio_add_raw_irq_handler_masked((1u << NUM_BANK0_GPIOS) - 1, gpio_event_irq);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+void gpio_event_register(uint gpio, uint32_t events, uint32_t holdoff_ms, gpio_event_isr_t isr, gpio_event_task_t task) {
+    hard_assert(pin_count < GPIO_EVENT_MAX_PINS && !slots[gpio]);
+    GPIO_EVENT_PIN_T *pin = &pins[pin_count++];
+    pin->gpio = (uint8_t) gpio;
+    pin->holdoff_us = holdoff_ms * 1000;
+    pin->isr = isr;
+    pin->task = task;
+    timer_wheel_timer_init(&pin->timer, gpio_event_holdoff_end, pin, 1);
+    slots[gpio] = (uint8_t) pin_count;
+    gpio_set_irq_enabled(gpio, events, true);
+}
+
+// Bottom half of the interrupt, called from the main loop.
+void gpio_event_dispatch(void) {
+    static uint32_t reported_dropped = 0;
+    gpio_event_t event;
+
+    while (gpio_event_pop(&event)) {
+        TRACE3(TRACE_GPIO_EVENT, event.gpio, event.events, time_us_32() - event.timestamp);
+        pins[slots[event.gpio] - 1].task(event.gpio, event.events);
+    }
+
+    uint32_t d = dropped;
+    if (d != reported_dropped) {
+        TRACE1(TRACE_GPIO_DROPPED, d - reported_dropped);
+        reported_dropped = d;
+    }
+}
+
+// Counters are read from the other core a word at a time, each on its own
+// is current.
+bool gpio_event_get_stats(uint gpio, gpio_event_stats_t *stats) {
+    if (gpio >= NUM_BANK0_GPIOS || !slots[gpio]) {
+        return false;
+    }
+    *stats = pins[slots[gpio] - 1].stats;
+    return true;
+}
+
+uint32_t gpio_event_dropped(void) {
+    return dropped;
+}
+
+static void gpio_event_command(const char *args) {
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++) {
+        gpio_event_stats_t stats;
+        if (gpio_event_get_stats(gpio, &stats)) {
+            printf("gpio %u holdoff %lums: %lu edges, %lu suppressed, %lu passed on after a holdoff\n", gpio,
+                (unsigned long) (pins[slots[gpio] - 1].holdoff_us / 1000), (unsigned long) stats.edges,
+                (unsigned long) stats.suppressed, (unsigned long) stats.coalesced);
+        }
+    }
+    printf("%lu events dropped\n", (unsigned long) gpio_event_dropped());
+}
+
+void gpio_event_console_init(void) {
+    console_register("gpio", "edges and suppressed edges per registered pin", gpio_event_command);
+}
@@ -0,0 +1,50 @@
+#ifndef _GPIO_EVENT_H
+#define _GPIO_EVENT_H
+
+#include "pico/stdlib.h"
+
+// GPIO interrupts by pin. One raw IO_IRQ_BANK0 handler reads its core's
+// pending status and goes straight to each pending pin's table entry, so
+// modules register their own pins instead of sharing the SDK's single
+// callback.
+//
+// An entry has an optional handler run in the interrupt and a task run by
+// gpio_event_dispatch from the main loop of the core taking the interrupts,
+// the event is queued for it with the time the interrupt was taken. An edge
+// within holdoff_ms of the last one passed on is suppressed in the interrupt,
+// before the handler or the queue, and counted. If any were suppressed one
+// event, their events together, is passed on as the holdoff ends, so a
+// chattering line costs one event per holdoff and its last edge is never
+// lost. Only edge events are supported, a level would fire continuously.
+
+// Must be a power of two.
+#define GPIO_EVENT_RING_SIZE 32
+
+typedef void (*gpio_event_isr_t)(uint gpio, uint32_t events, uint32_t timestamp);
+typedef void (*gpio_event_task_t)(uint gpio, uint32_t events);
+
+typedef struct {
+    uint8_t gpio;
+    uint8_t events;
+    uint32_t timestamp; // time_us_32() when the interrupt was taken
+} gpio_event_t;
+
+typedef struct {
+    uint32_t edges;      // Interrupts taken
+    uint32_t suppressed; // Within the holdoff
+    uint32_t coalesced;  // Events passed on as a holdoff ended
+} gpio_event_stats_t;
+
+// On the core to take the interrupts, after its timer wheel, before any pin
+// is registered.
+void gpio_event_init(void);
+// Same core. Enables the events, either function may be NULL.
+void gpio_event_register(uint gpio, uint32_t events, uint32_t holdoff_ms, gpio_event_isr_t isr, gpio_event_task_t task);
+// From the main loop of the same core, runs the tasks of the queued events.
+void gpio_event_dispatch(void);
+bool gpio_event_get_stats(uint gpio, gpio_event_stats_t *stats);
+uint32_t gpio_event_dropped(void);
+// core0, registers the console command.
+void gpio_event_console_init(void);
+
+#endif
@@ -0,0 +1,89 @@
+#include <string.h>
+
+#include "hardware/sync.h"
+
+#include "src/i2c_async.h"
+
+// One queue per i2c block, the head is the transaction on the bus.
+typedef struct {
+    i2c_async_xfer_t *head;
+    i2c_async_xfer_t *tail;
+} I2C_ASYNC_QUEUE_T;
+
+static I2C_ASYNC_QUEUE_T queues[2];
+
+void i2c_async_init(i2c_inst_t *i2c) {
+    I2C_ASYNC_QUEUE_T *queue = &queues[i2c_hw_index(i2c)];
+    queue->head = NULL;
+    queue->tail = NULL;
+    i2c_async_port_init(i2c);
+}
+
+void i2c_async_set_read(i2c_async_xfer_t *xfer, uint8_t addr, uint8_t reg, uint8_t rx_len) {
+    hard_assert(rx_len <= I2C_ASYNC_MAX_RX);
+    xfer->addr = addr;
+    xfer->tx[0] = reg;
+    xfer->tx_len = 1;
+    xfer->rx_len = rx_len;
+}
+
+void i2c_async_set_write(i2c_async_xfer_t *xfer, uint8_t addr, uint8_t reg, const uint8_t *data, uint8_t len) {
+    hard_assert(len < I2C_ASYNC_MAX_TX);
+    xfer->addr = addr;
+    xfer->tx[0] = reg;
+    memcpy(&xfer->tx[1], data, len);
+    xfer->tx_len = len + 1;
+    xfer->rx_len = 0;
+}
+
+// Safe to call from interrupt context, including from a completion callback.
+// Returns false if the descriptor is still queued from a previous submit.
+bool i2c_async_submit(i2c_inst_t *i2c, i2c_async_xfer_t *xfer) {
+    I2C_ASYNC_QUEUE_T *queue = &queues[i2c_hw_index(i2c)];
+    uint32_t save = save_and_disable_interrupts();
+    if (xfer->pending) {
+        restore_interrupts(save);
+        return false;
+    }
+    xfer->pending = true;
+    xfer->next = NULL;
+    if (queue->head) {
+        queue->tail->next = xfer;
+        queue->tail = xfer;
+    } else {
+        queue->head = xfer;
+        queue->tail = xfer;
+        i2c_async_port_start(i2c, xfer);
+    }
+    restore_interrupts(save);
+    return true;
+}
+
+bool i2c_async_idle(i2c_inst_t *i2c) {
+    return queues[i2c_hw_index(i2c)].head == NULL;
+}
+
+// Called by the port when the head of the queue has finished. The next
+// transaction is put on the bus before the callback so the bus does not
+// sit idle while the callback runs.
+void __not_in_flash_func(i2c_async_port_done)(i2c_inst_t *i2c, i2c_async_result_t result) {
+    I2C_ASYNC_QUEUE_T *queue = &queues[i2c_hw_index(i2c)];
+    uint32_t save = save_and_disable_interrupts();
+    i2c_async_xfer_t *xfer = queue->head;
+    if (!xfer) {
+        restore_interrupts(save);
+        return;
+    }
+    queue->head = xfer->next;
+    if (queue->head) {
+        i2c_async_port_start(i2c, queue->head);
+    } else {
+        queue->tail = NULL;
+    }
+    xfer->pending = false;
+    restore_interrupts(save);
+
+    if (xfer->callback) {
+        xfer->callback(xfer, result);
+    }
+}
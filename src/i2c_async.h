@@ -0,0 +1,47 @@
+#ifndef _I2C_ASYNC_H
+#define _I2C_ASYNC_H
+
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+
+#define I2C_ASYNC_MAX_TX 4
+#define I2C_ASYNC_MAX_RX 4
+
+typedef enum {
+    I2C_ASYNC_OK = 0,
+    I2C_ASYNC_WRITE_ERROR = -1, // Address or register/data byte not acknowledged
+    I2C_ASYNC_READ_ERROR = -2   // Device went away on the repeated start
+} i2c_async_result_t;
+
+typedef struct i2c_async_xfer i2c_async_xfer_t;
+typedef void (*i2c_async_callback_t)(i2c_async_xfer_t *xfer, i2c_async_result_t result);
+
+// A register transaction. tx is written first (normally the register pointer
+// followed by any data), then if rx_len is not zero a repeated start reads
+// rx_len bytes into rx. The descriptor is owned by the caller and must stay
+// valid until the callback has run.
+struct i2c_async_xfer {
+    i2c_async_xfer_t *next;
+    i2c_async_callback_t callback; // Called from interrupt context
+    void *user_data;
+    uint8_t addr;
+    uint8_t tx_len;
+    uint8_t rx_len;
+    uint8_t tx[I2C_ASYNC_MAX_TX];
+    uint8_t rx[I2C_ASYNC_MAX_RX];
+    volatile bool pending;
+};
+
+void i2c_async_init(i2c_inst_t *i2c);
+void i2c_async_set_read(i2c_async_xfer_t *xfer, uint8_t addr, uint8_t reg, uint8_t rx_len);
+void i2c_async_set_write(i2c_async_xfer_t *xfer, uint8_t addr, uint8_t reg, const uint8_t *data, uint8_t len);
+bool i2c_async_submit(i2c_inst_t *i2c, i2c_async_xfer_t *xfer);
+bool i2c_async_idle(i2c_inst_t *i2c);
+
+// Backend interface. The port starts one transaction at a time and reports
+// back through i2c_async_port_done, normally from its interrupt handler.
+void i2c_async_port_init(i2c_inst_t *i2c);
+void i2c_async_port_start(i2c_inst_t *i2c, i2c_async_xfer_t *xfer);
+void i2c_async_port_done(i2c_inst_t *i2c, i2c_async_result_t result);
+
+#endif
\ No newline at end of file
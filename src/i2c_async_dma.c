@@ -0,0 +1,137 @@
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+
+#include "src/i2c_async.h"
+#include "src/isr_stats.h"
+
+// RP2040 backend for i2c_async. The command words for a whole transaction are
+// written to IC_DATA_CMD by one DMA channel and the read data is collected by
+// another, so the CPU is only involved at the start and in the STOP_DET or
+// TX_ABRT interrupt at the end.
+typedef struct {
+    uint tx_dma;
+    uint rx_dma;
+    dma_channel_config tx_config;
+    dma_channel_config rx_config;
+    i2c_async_xfer_t *xfer;
+    i2c_async_result_t result;
+    uint16_t cmd[I2C_ASYNC_MAX_TX + I2C_ASYNC_MAX_RX];
+} I2C_ASYNC_PORT_T;
+
+static I2C_ASYNC_PORT_T ports[2];
+
+static void i2c_async_irq(i2c_inst_t *i2c);
+static void i2c0_async_irq(void);
+static void i2c1_async_irq(void);
+
+void i2c_async_port_init(i2c_inst_t *i2c) {
+    uint index = i2c_hw_index(i2c);
+    I2C_ASYNC_PORT_T *port = &ports[index];
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+
+    port->tx_dma = dma_claim_unused_channel(true);
+    port->tx_config = dma_channel_get_default_config(port->tx_dma);
+    channel_config_set_transfer_data_size(&port->tx_config, DMA_SIZE_16);
+    channel_config_set_read_increment(&port->tx_config, true);
+    channel_config_set_write_increment(&port->tx_config, false);
+    channel_config_set_dreq(&port->tx_config, i2c_get_dreq(i2c, true));
+
+    port->rx_dma = dma_claim_unused_channel(true);
+    port->rx_config = dma_channel_get_default_config(port->rx_dma);
+    channel_config_set_transfer_data_size(&port->rx_config, DMA_SIZE_8);
+    channel_config_set_read_increment(&port->rx_config, false);
+    channel_config_set_write_increment(&port->rx_config, true);
+    channel_config_set_dreq(&port->rx_config, i2c_get_dreq(i2c, false));
+
+    hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS;
+    hw->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+    (void) hw->clr_intr;
+
+    irq_set_exclusive_handler(I2C0_IRQ + index, index ? i2c1_async_irq : i2c0_async_irq);
+    irq_set_enabled(I2C0_IRQ + index, true);
+}
+
+void __not_in_flash_func(i2c_async_port_start)(i2c_inst_t *i2c, i2c_async_xfer_t *xfer) {
+    I2C_ASYNC_PORT_T *port = &ports[i2c_hw_index(i2c)];
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+    uint count = 0;
+
+    // Write phase, STOP after the last byte unless there is a read to follow.
+    for (uint i = 0; i < xfer->tx_len; i++) {
+        port->cmd[count] = xfer->tx[i];
+        if (i + 1 == xfer->tx_len && xfer->rx_len == 0) {
+            port->cmd[count] |= I2C_IC_DATA_CMD_STOP_BITS;
+        }
+        count++;
+    }
+    // Read phase, RESTART on the first byte and STOP after the last.
+    for (uint i = 0; i < xfer->rx_len; i++) {
+        port->cmd[count] = I2C_IC_DATA_CMD_CMD_BITS;
+        if (i == 0) {
+            port->cmd[count] |= I2C_IC_DATA_CMD_RESTART_BITS;
+        }
+        if (i + 1 == xfer->rx_len) {
+            port->cmd[count] |= I2C_IC_DATA_CMD_STOP_BITS;
+        }
+        count++;
+    }
+
+    // The target address can only be changed while the block is disabled.
+    hw->enable = 0;
+    hw->tar = xfer->addr;
+    hw->enable = 1;
+    (void) hw->clr_intr;
+
+    port->xfer = xfer;
+    port->result = I2C_ASYNC_OK;
+    if (xfer->rx_len) {
+        dma_channel_configure(port->rx_dma, &port->rx_config, xfer->rx, &hw->data_cmd, xfer->rx_len, true);
+    }
+    dma_channel_configure(port->tx_dma, &port->tx_config, &hw->data_cmd, port->cmd, count, true);
+}
+
+static void __not_in_flash_func(i2c_async_irq)(i2c_inst_t *i2c) {
+    I2C_ASYNC_PORT_T *port = &ports[i2c_hw_index(i2c)];
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+    uint32_t status = hw->intr_stat;
+
+    if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+        // The controller flushes whatever was left in the tx FIFO. If every read
+        // command was still waiting then the write phase was not acknowledged.
+        uint32_t flushed = (hw->tx_abrt_source & I2C_IC_TX_ABRT_SOURCE_TX_FLUSH_CNT_BITS) >> I2C_IC_TX_ABRT_SOURCE_TX_FLUSH_CNT_LSB;
+        if (port->xfer && port->xfer->rx_len && flushed < port->xfer->rx_len) {
+            port->result = I2C_ASYNC_READ_ERROR;
+        } else {
+            port->result = I2C_ASYNC_WRITE_ERROR;
+        }
+        dma_channel_abort(port->tx_dma);
+        dma_channel_abort(port->rx_dma);
+        (void) hw->clr_tx_abrt;
+    }
+
+    // An abort is always followed by a STOP so completion is only reported here.
+    if (status & I2C_IC_INTR_STAT_R_STOP_DET_BITS) {
+        (void) hw->clr_stop_det;
+        if (!port->xfer) {
+            return;
+        }
+        // The last byte may still be on its way out of the rx FIFO.
+        while (port->result == I2C_ASYNC_OK && dma_channel_is_busy(port->rx_dma)) {
+            tight_loop_contents();
+        }
+        port->xfer = NULL;
+        i2c_async_port_done(i2c, port->result);
+    }
+}
+
+static void __not_in_flash_func(i2c0_async_irq)(void) {
+    ISR_STATS_ENTER(ISR_I2C0);
+    i2c_async_irq(i2c0);
+    ISR_STATS_EXIT(ISR_I2C0);
+}
+
+static void __not_in_flash_func(i2c1_async_irq)(void) {
+    ISR_STATS_ENTER(ISR_I2C1);
+    i2c_async_irq(i2c1);
+    ISR_STATS_EXIT(ISR_I2C1);
+}
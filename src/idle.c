@@ -0,0 +1,73 @@
+#include "hardware/sync.h"
+
+#include "src/console.h"
+#include "src/idle.h"
+
+typedef struct {
+    uint64_t last_wake; // End of the last wait
+    uint32_t reset;     // Last reset applied
+    idle_stats_t stats;
+} IDLE_CORE_T;
+
+// Each core only writes its own entry, a reset is picked up by each core at
+// its next wait.
+static IDLE_CORE_T cores[2];
+static volatile uint32_t reset_count = 0;
+
+static void idle_command(const char *args) {
+    if (!strcmp(args, "reset")) {
+        idle_reset();
+        return;
+    }
+    for (uint core = 0; core < 2; core++) {
+        idle_stats_t stats;
+        idle_get_stats(core, &stats);
+        uint64_t total = stats.idle_us + stats.busy_us;
+        if (!total) {
+            continue;
+        }
+        printf("core%u idle %lu.%lu%% busy %lluus wakes %lu (%lu/s)\n", core,
+            (unsigned long) (stats.idle_us * 1000 / total / 10), (unsigned long) (stats.idle_us * 1000 / total % 10),
+            (unsigned long long) stats.busy_us, (unsigned long) stats.wakes,
+            (unsigned long) ((uint64_t) stats.wakes * 1000000 / total));
+    }
+}
+
+void idle_init(void) {
+    uint64_t now = time_us_64();
+    cores[0].last_wake = now;
+    cores[1].last_wake = now;
+    console_register("idle", "idle and busy time per core, idle reset to clear", idle_command);
+}
+
+void idle_wait(void) {
+    IDLE_CORE_T *core = &cores[get_core_num()];
+    uint64_t start = time_us_64();
+    if (core->reset != reset_count) {
+        core->reset = reset_count;
+        core->stats = (idle_stats_t) {0};
+    } else {
+        core->stats.busy_us += start - core->last_wake;
+    }
+
+    __wfe();
+
+    core->last_wake = time_us_64();
+    core->stats.idle_us += core->last_wake - start;
+    core->stats.wakes++;
+}
+
+// Includes the time since the core last woke as busy so a core that never
+// sleeps still shows up.
+void idle_get_stats(uint core, idle_stats_t *stats) {
+    uint64_t now = time_us_64();
+    *stats = cores[core].stats;
+    if (now > cores[core].last_wake) {
+        stats->busy_us += now - cores[core].last_wake;
+    }
+}
+
+void idle_reset(void) {
+    reset_count += 1;
+    __sev();
+}
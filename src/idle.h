@@ -0,0 +1,27 @@
+#ifndef _IDLE_H
+#define _IDLE_H
+
+#include "pico/stdlib.h"
+
+// Per core idle loop support. Each core's main loop runs its deferred work
+// and then calls idle_wait, which sleeps in __wfe until an interrupt is
+// taken or the other core, or an interrupt handler, signals with __sev.
+// Anything that queues work for a main loop must __sev after publishing it
+// so a wait that has already started still sees it.
+//
+// Time is accounted as busy from waking to the next idle_wait and as idle
+// inside it. The "idle" console command shows the split since the last
+// "idle reset".
+
+typedef struct {
+    uint64_t idle_us;
+    uint64_t busy_us;
+    uint32_t wakes;
+} idle_stats_t;
+
+void idle_init(void);
+void idle_wait(void);
+void idle_get_stats(uint core, idle_stats_t *stats);
+void idle_reset(void);
+
+#endif
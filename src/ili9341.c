@@ -0,0 +1,208 @@
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+#include "src/ili9341.h"
+#include "src/timer_wheel.h"
+
+#define CMD_SWRESET 0x01
+#define CMD_SLPOUT 0x11
+#define CMD_GAMSET 0x26
+#define CMD_DISPON 0x29
+#define CMD_CASET 0x2A
+#define CMD_PASET 0x2B
+#define CMD_RAMWR 0x2C
+#define CMD_MADCTL 0x36
+#define CMD_COLMOD 0x3A
+#define CMD_FRMCTR1 0xB1
+#define CMD_DFUNCTR 0xB6
+#define CMD_PWCTR1 0xC0
+#define CMD_PWCTR2 0xC1
+#define CMD_VMCTR1 0xC5
+#define CMD_VMCTR2 0xC7
+#define CMD_PGAMCTRL 0xE0
+#define CMD_NGAMCTRL 0xE1
+
+#define MADCTL_MV 0x20  // Rows and columns exchanged, landscape
+#define MADCTL_BGR 0x08 // The panel's subpixels are BGR
+#define COLMOD_16BIT 0x55
+
+typedef enum {
+    PANEL_RESET,    // Waiting out the reset
+    PANEL_SLEEPING, // Configured, waiting out sleep out
+    PANEL_READY,
+} panel_state_t;
+
+// Each entry is the command, its parameter count and the parameters.
+static const uint8_t init_commands[] = {
+    CMD_PWCTR1, 1, 0x23,
+    CMD_PWCTR2, 1, 0x10,
+    CMD_VMCTR1, 2, 0x3E, 0x28,
+    CMD_VMCTR2, 1, 0x86,
+    CMD_MADCTL, 1, MADCTL_MV | MADCTL_BGR,
+    CMD_COLMOD, 1, COLMOD_16BIT,
+    CMD_FRMCTR1, 2, 0x00, 0x18,
+    CMD_DFUNCTR, 3, 0x08, 0x82, 0x27,
+    CMD_GAMSET, 1, 0x01,
+    CMD_PGAMCTRL, 15, 0x0F, 0x31, 0x2B, 0x0C, 0x0E, 0x08, 0x4E, 0xF1, 0x37, 0x07, 0x10, 0x03, 0x0E, 0x09, 0x00,
+    CMD_NGAMCTRL, 15, 0x00, 0x0E, 0x14, 0x03, 0x11, 0x07, 0x31, 0xC1, 0x48, 0x08, 0x0F, 0x0C, 0x31, 0x36, 0x0F,
+    CMD_SLPOUT, 0,
+};
+
+typedef struct {
+    ili9341_line_fn line;
+    ili9341_done_fn done;
+    void *user_data;
+    uint w;
+    uint h;
+    uint sent; // Line DMA is sending
+} ILI9341_STREAM_T;
+
+static uint16_t lines[2][ILI9341_WIDTH];
+static ILI9341_STREAM_T stream;
+static volatile bool busy = false;
+static volatile panel_state_t state = PANEL_RESET;
+static volatile uint32_t bytes = 0;
+static timer_wheel_timer_t wake_timer;
+static uint dma;
+
+// Blocking, spi_write_blocking returns once the bytes are out so D/C can
+// change straight after.
+static void ili9341_command(uint8_t cmd, const uint8_t *params, size_t len) {
+    gpio_put(ILI9341_DC, false);
+    spi_write_blocking(ILI9341_SPI, &cmd, 1);
+    gpio_put(ILI9341_DC, true);
+    if (len) {
+        spi_write_blocking(ILI9341_SPI, params, len);
+    }
+    bytes += 1 + len;
+}
+
+static void ili9341_window(uint x, uint y, uint w, uint h) {
+    uint8_t cols[4] = {x >> 8, x & 0xFF, (x + w - 1) >> 8, (x + w - 1) & 0xFF};
+    uint8_t pages[4] = {y >> 8, y & 0xFF, (y + h - 1) >> 8, (y + h - 1) & 0xFF};
+    ili9341_command(CMD_CASET, cols, sizeof(cols));
+    ili9341_command(CMD_PASET, pages, sizeof(pages));
+    ili9341_command(CMD_RAMWR, NULL, 0);
+}
+
+static void ili9341_send_line(uint line) {
+    dma_channel_set_read_addr(dma, lines[line & 1], false);
+    dma_channel_set_trans_count(dma, stream.w * 2, true);
+    bytes += stream.w * 2;
+}
+
+// The last line may still be shifting out when its DMA completes. Sending
+// without reading overruns the receive FIFO, it is emptied and the overrun
+// cleared before the next blocking call.
+static void ili9341_stream_end(void) {
+    while (spi_is_busy(ILI9341_SPI)) {
+        tight_loop_contents();
+    }
+    while (spi_is_readable(ILI9341_SPI)) {
+        (void) spi_get_hw(ILI9341_SPI)->dr;
+    }
+    spi_get_hw(ILI9341_SPI)->icr = SPI_SSPICR_RORIC_BITS;
+    gpio_put(ILI9341_CS, true);
+    busy = false;
+}
+
+static void __not_in_flash_func(ili9341_dma_irq)(void) {
+    if (!dma_channel_get_irq0_status(dma)) {
+        return;
+    }
+    dma_channel_acknowledge_irq0(dma);
+    if (++stream.sent < stream.h) {
+        ili9341_send_line(stream.sent);
+        if (stream.sent + 1 < stream.h) {
+            stream.line(stream.sent + 1, lines[(stream.sent + 1) & 1], stream.user_data);
+        }
+        return;
+    }
+    ili9341_stream_end();
+    if (stream.done) {
+        stream.done(stream.user_data);
+    }
+}
+
+void ili9341_stream(uint x, uint y, uint w, uint h, ili9341_line_fn line, ili9341_done_fn done, void *user_data) {
+    stream = (ILI9341_STREAM_T) {
+        .line = line,
+        .done = done,
+        .user_data = user_data,
+        .w = w,
+        .h = h,
+    };
+    busy = true;
+    gpio_put(ILI9341_CS, false);
+    ili9341_window(x, y, w, h);
+    line(0, lines[0], user_data);
+    ili9341_send_line(0);
+    if (h > 1) {
+        line(1, lines[1], user_data);
+    }
+}
+
+// Runs once the reset, then sleep out, has had its time.
+static uint32_t ili9341_wake(timer_wheel_timer_t *timer) {
+    if (state == PANEL_RESET) {
+        gpio_put(ILI9341_CS, false);
+        for (uint i = 0; i < sizeof(init_commands); i += 2 + init_commands[i + 1]) {
+            ili9341_command(init_commands[i], &init_commands[i + 2], init_commands[i + 1]);
+        }
+        gpio_put(ILI9341_CS, true);
+        state = PANEL_SLEEPING;
+        return ILI9341_RESET_MS;
+    }
+    gpio_put(ILI9341_CS, false);
+    ili9341_command(CMD_DISPON, NULL, 0);
+    gpio_put(ILI9341_CS, true);
+    state = PANEL_READY;
+    // The drawing core may be waiting for it.
+    __sev();
+    return 0;
+}
+
+bool ili9341_ready(void) {
+    return state == PANEL_READY;
+}
+
+bool ili9341_busy(void) {
+    return busy;
+}
+
+uint32_t ili9341_bytes(void) {
+    return bytes;
+}
+
+void ili9341_init(void) {
+    spi_init(ILI9341_SPI, ILI9341_SPI_HZ);
+    spi_set_format(ILI9341_SPI, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+    gpio_set_function(ILI9341_SCK, GPIO_FUNC_SPI);
+    gpio_set_function(ILI9341_MOSI, GPIO_FUNC_SPI);
+
+    uint outputs[] = {ILI9341_CS, ILI9341_DC, ILI9341_RESET};
+    for (uint i = 0; i < count_of(outputs); i++) {
+        gpio_init(outputs[i]);
+        gpio_put(outputs[i], true);
+        gpio_set_dir(outputs[i], GPIO_OUT);
+    }
+
+    dma = dma_claim_unused_channel(true);
+    dma_channel_config config = dma_channel_get_default_config(dma);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, spi_get_dreq(ILI9341_SPI, true));
+    dma_channel_configure(dma, &config, &spi_get_hw(ILI9341_SPI)->dr, lines[0], 0, false);
+    dma_channel_set_irq0_enabled(dma, true);
+    irq_add_shared_handler(DMA_IRQ_0, ili9341_dma_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    // A hardware reset puts everything back, however the panel was left.
+    gpio_put(ILI9341_RESET, false);
+    busy_wait_us(20);
+    gpio_put(ILI9341_RESET, true);
+    timer_wheel_timer_init(&wake_timer, ili9341_wake, NULL, 5);
+    timer_wheel_add(&wake_timer, ILI9341_RESET_MS);
+}
@@ -0,0 +1,45 @@
+#ifndef _ILI9341_H
+#define _ILI9341_H
+
+#include "pico/stdlib.h"
+#include "hardware/spi.h"
+
+// The MSP2807's ILI9341 panel, written over SPI0 by DMA in landscape. There
+// is no framebuffer: a window is streamed a line at a time from two line
+// buffers, the caller renders each line into one while DMA sends the other.
+// Only writes are used so the read pin is left to the touch controller.
+
+#define ILI9341_SPI spi0
+#define ILI9341_SCK 18
+#define ILI9341_MOSI 19
+#define ILI9341_CS 21
+#define ILI9341_DC 22
+#define ILI9341_RESET 26
+#define ILI9341_SPI_HZ (40 * 1000 * 1000) // spi_init rounds it down to 31.25MHz
+#define ILI9341_RESET_MS 120 // After reset and after sleep out
+#define ILI9341_WIDTH 320
+#define ILI9341_HEIGHT 240
+
+// RGB565 byte swapped so the panel, which takes it big endian, gets it from
+// a uint16_t array.
+#define ILI9341_RGB565(r, g, b) (((r) & 0xF8) << 8 | ((g) & 0xFC) << 3 | (b) >> 3)
+#define ILI9341_RGB(r, g, b) ((uint16_t) (ILI9341_RGB565(r, g, b) >> 8 | (ILI9341_RGB565(r, g, b) & 0xFF) << 8))
+
+// Renders line of the window, w pixels, into pixels.
+typedef void (*ili9341_line_fn)(uint line, uint16_t *pixels, void *user_data);
+typedef void (*ili9341_done_fn)(void *user_data);
+
+// Must be called on the core that draws, its DMA interrupt is taken there.
+// The reset and wake up run on that core's timer wheel, the panel is ready
+// some 250ms later.
+void ili9341_init(void);
+bool ili9341_ready(void);
+bool ili9341_busy(void);
+// Streams the window at x, y, w by h. The first two lines are rendered
+// here, the rest and done run in the DMA interrupt. done may start the next
+// stream. Not while busy.
+void ili9341_stream(uint x, uint y, uint w, uint h, ili9341_line_fn line, ili9341_done_fn done, void *user_data);
+// Bytes sent since boot, commands and pixels.
+uint32_t ili9341_bytes(void);
+
+#endif
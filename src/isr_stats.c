@@ -0,0 +1,78 @@
+#include "hardware/sync.h"
+
+#include "src/console.h"
+#include "src/isr_stats.h"
+
+#if ISR_STATS_ENABLED
+
+#define ISR_STATS_NAME(id, name) name,
+static const char *const names[ISR_STATS_COUNT] = { ISR_STATS_HANDLERS(ISR_STATS_NAME) };
+#undef ISR_STATS_NAME
+
+isr_histogram_t isr_stats_exec[ISR_STATS_COUNT];
+static isr_histogram_t latency[ISR_STATS_COUNT];
+static uint32_t last_start[ISR_STATS_COUNT];
+
+static void isr_stats_command(const char *args) {
+    if (!strcmp(args, "reset")) {
+        isr_stats_reset();
+    } else {
+        isr_stats_dump();
+    }
+}
+
+void isr_stats_init(void) {
+    console_register("isr", "handler time histograms, isr reset to clear", isr_stats_command);
+}
+
+// Called on entry to a repeating timer callback. The first call only sets
+// the reference point.
+uint32_t __not_in_flash_func(isr_stats_timer_start)(isr_stats_id_t id, uint32_t period_us) {
+    uint32_t now = time_us_32();
+    if (last_start[id]) {
+        int32_t late = (int32_t) (now - last_start[id] - period_us);
+        isr_stats_record(&latency[id], late > 0 ? (uint32_t) late : 0);
+    }
+    last_start[id] = now;
+    return now;
+}
+
+static void isr_stats_print(const char *name, const char *kind, const isr_histogram_t *histogram) {
+    printf("%-24s %-7s n=%lu max=%luus", name, kind, (unsigned long) histogram->count, (unsigned long) histogram->max);
+    for (uint i = 0; i < ISR_STATS_BUCKETS; i++) {
+        if (histogram->bucket[i] && i == ISR_STATS_BUCKETS - 1) {
+            printf(" >=%lu:%lu", 1ul << (i - 1), (unsigned long) histogram->bucket[i]);
+        } else if (histogram->bucket[i]) {
+            printf(" <%lu:%lu", 1ul << i, (unsigned long) histogram->bucket[i]);
+        }
+    }
+    printf("\n");
+}
+
+void isr_stats_dump(void) {
+    isr_histogram_t exec_copy;
+    isr_histogram_t latency_copy;
+    for (uint i = 0; i < ISR_STATS_COUNT; i++) {
+        // Copy with interrupts off so each line is self consistent.
+        uint32_t save = save_and_disable_interrupts();
+        exec_copy = isr_stats_exec[i];
+        latency_copy = latency[i];
+        restore_interrupts(save);
+        if (exec_copy.count) {
+            isr_stats_print(names[i], "exec", &exec_copy);
+        }
+        if (latency_copy.count) {
+            isr_stats_print(names[i], "latency", &latency_copy);
+        }
+    }
+}
+
+void isr_stats_reset(void) {
+    uint32_t save = save_and_disable_interrupts();
+    memset(isr_stats_exec, 0, sizeof(isr_stats_exec));
+    memset(latency, 0, sizeof(latency));
+    memset(last_start, 0, sizeof(last_start));
+    restore_interrupts(save);
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef _ISR_STATS_H
+#define _ISR_STATS_H
+
+#include "pico/stdlib.h"
+
+// Execution time and start latency histograms for interrupt handlers and
+// timer callbacks. Times are whole microseconds from time_us_32 (the 1 MHz
+// timer), bucket n counts values in [2^(n-1), 2^n) with everything from
+// 2^(ISR_STATS_BUCKETS-2) up in the last bucket. Each handler only writes its
+// own entry so recording needs no locking, a few loads and stores.
+//
+// Latency is only measured for repeating timers, as the time from one start
+// to the next beyond the period. The "isr" console command dumps the tables.
+
+#ifndef ISR_STATS_ENABLED
+#define ISR_STATS_ENABLED 1
+#endif
+
+#define ISR_STATS_BUCKETS 16
+
+// Position in the list is the id, the string is the name in the dump.
+#define ISR_STATS_HANDLERS(X) \
+    X(ISR_GPIO,      "gpio_event_irq") \
+    X(ISR_I2C0,      "i2c0_async_irq") \
+    X(ISR_I2C1,      "i2c1_async_irq") \
+    X(ISR_BLINK_LED, "cyw43_blink_led_process") \
+    X(ISR_MCP9808,   "mcp9808_process") \
+    X(ISR_NTP,       "cyw43_ntp_process")
+
+#define ISR_STATS_ENUM(id, name) id,
+typedef enum { ISR_STATS_HANDLERS(ISR_STATS_ENUM) ISR_STATS_COUNT } isr_stats_id_t;
+#undef ISR_STATS_ENUM
+
+typedef struct {
+    uint32_t count;
+    uint32_t max;
+    uint32_t bucket[ISR_STATS_BUCKETS];
+} isr_histogram_t;
+
+#if ISR_STATS_ENABLED
+// First and last statements of the handler body.
+#define ISR_STATS_ENTER(id)              uint32_t isr_stats_entry = time_us_32()
+#define ISR_STATS_ENTER_TIMER(id, period) uint32_t isr_stats_entry = isr_stats_timer_start((id), (period))
+#define ISR_STATS_EXIT(id)               isr_stats_record(&isr_stats_exec[(id)], time_us_32() - isr_stats_entry)
+
+extern isr_histogram_t isr_stats_exec[ISR_STATS_COUNT];
+
+void isr_stats_init(void);
+uint32_t isr_stats_timer_start(isr_stats_id_t id, uint32_t period_us);
+void isr_stats_dump(void);
+void isr_stats_reset(void);
+
+static inline void isr_stats_record(isr_histogram_t *histogram, uint32_t us) {
+    uint bucket = us ? 32 - __builtin_clz(us) : 0;
+    histogram->bucket[bucket < ISR_STATS_BUCKETS ? bucket : ISR_STATS_BUCKETS - 1]++;
+    histogram->count++;
+    if (us > histogram->max) {
+        histogram->max = us;
+    }
+}
+#else
+#define ISR_STATS_ENTER(id)               ((void) 0)
+#define ISR_STATS_ENTER_TIMER(id, period) ((void) 0)
+#define ISR_STATS_EXIT(id)                ((void) 0)
+
+static inline void isr_stats_init(void) {}
+#endif
+
+#endif
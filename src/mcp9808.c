@@ -1,23 +1,49 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "hardware/i2c.h"
-#include "hardware/rtc.h"
-
+#include "hardware/structs/systick.h"
+#include "hardware/sync.h"
+
+#include "src/boot.h"
+#include "src/console.h"
+#include "src/core_msg.h"
+#include "src/gpio_event.h"
+#include "src/i2c_async.h"
+#include "src/isr_stats.h"
 #include "src/mcp9808.h"
+#include "src/telemetry.h"
+#include "src/temp_history.h"
+#include "src/timer_wheel.h"
+#include "src/trace.h"
+#include "src/wall_clock.h"
 #define LSB(w) ((uint8_t) ((w) & 0xFF))
 #define MSB(w) ((uint8_t) ((w) >> 8))
-static uint16_t mcp9808_calc_register(float temp);
-static void mcp9808_set_limits(uint8_t i, u_int16_t reg_frost, uint16_t reg_heating, u_int16_t reg_conditioning);
-static void mcp9808_print_temp(void);
-static void mcp9808_print_time(void);
-static void mcp9808_check_limits(uint8_t upper_byte);
-static float mcp9808_convert_temp(uint8_t upper_byte, uint8_t lower_byte);
-static bool mcp9808_process(repeating_timer_t *rt);
+static void mcp9808_probe(void);
+static void mcp9808_probe_done(i2c_async_xfer_t *xfer, i2c_async_result_t result);
+static void mcp9808_probe_finish(void);
+static void mcp9808_read_temps(uint32_t mask);
+static void mcp9808_trace_error(i2c_async_xfer_t *xfer, i2c_async_result_t result);
+static void mcp9808_check_limits(uint8_t id, uint8_t upper_byte);
+static uint32_t mcp9808_process(timer_wheel_timer_t *timer);
+static void mcp9808_temp_done(i2c_async_xfer_t *xfer, i2c_async_result_t result);
+static void mcp9808_limit_done(i2c_async_xfer_t *xfer, i2c_async_result_t result);
+static void mcp9808_alert_next(void);
+static void mcp9808_alert_done(i2c_async_xfer_t *xfer, i2c_async_result_t result);
 
 //The bus address is determined by the state of pins A0, A1 and A2 on the MCP9808 board
-#define MCP9808_DEV_COUNT 2
-const uint8_t MCP9808_ADDRESS[MCP9808_DEV_COUNT] = {0x18, 0x19};
+#define MCP9808_BASE_ADDRESS 0x18
+#define MCP9808_ADDRESSES 8
+#define MCP9808_BUSES 2
+#define MCP9808_MANUFACTURER_ID 0x0054
+#define MCP9808_DEVICE_ID 0x04 // Upper byte of the device ID register, the lower is the revision
 const int32_t MCP9808_CALLBACK_TIME = 30000; // 30 Seconds
+#define MCP9808_CALLBACK_SLACK 100         // ms, the history doesn't mind
+#define MCP9808_ALERT_PASSES 3             // over the sensors per alert, while the line stays low
+#define MCP9808_BENCH_REGISTERS 0x2000     // Every value of the 13 bit ambient register
+#define MCP9808_BENCH_BATCH 256            // Registers timed at a time
+#define MCP9808_BENCH_SYSTICK_MASK 0x00ffffffu // SysTick is a 24 bit down counter
 //hardware registers
 const uint8_t REG_POINTER = 0x00;
 const uint8_t REG_CONFIG = 0x01;
@@ -25,223 +51,751 @@ const uint8_t REG_TEMP_FROST = 0x03; // Lower temp.
 const uint8_t REG_TEMP_HEATING = 0x02; // Upper temp.
 const uint8_t REG_TEMP_CONDITIONING = 0x04; // Critical temp.
 const uint8_t REG_TEMP_AMB = 0x05;
+const uint8_t REG_MANUFACTURER = 0x06;
+const uint8_t REG_DEVICE = 0x07;
 const uint8_t REG_RESOLUTION = 0x08;
+#define CONFIG_ALERT_STATUS (1 << 4) // Read only, this device is asserting the alert line
+#define CONFIG_INT_CLEAR (1 << 5)    // Write only, reads as 0
+
+static_assert(MCP9808_BUSES * MCP9808_ADDRESSES == MCP9808_MAX_SENSORS, "a descriptor per possible sensor");
+static_assert(MCP9808_MAX_SENSORS <= TEMP_HISTORY_SENSORS, "temp_history needs a store per sensor");
+static_assert(MCP9808_MAX_SENSORS <= 32, "sensor masks are 32 bit");
+
+// Limit programming sequence, written in this order then the config read back.
+// The thermostat limits come first, in mcp9808_limit_t order.
+enum {
+    LIMIT_FROST = MCP9808_LIMIT_FROST,
+    LIMIT_HEATING = MCP9808_LIMIT_HEATING,
+    LIMIT_CONDITIONING = MCP9808_LIMIT_CONDITIONING,
+    LIMIT_RESOLUTION,
+    LIMIT_CONFIG,
+    LIMIT_VERIFY,
+    LIMIT_STEPS
+};
+#define LIMIT_ALL ((1 << LIMIT_STEPS) - 1)
+
+// Alert servicing, config read then, if this device asserted, clear.
+enum { ALERT_READ, ALERT_CLEAR };
+
+// All i2c traffic is queued on i2c_async and completes in interrupt context,
+// the callbacks report through the trace log. The i2c0 and i2c1 interrupts
+// are both taken on core1 at the same priority so they never nest, and the
+// counts they share need no locking.
+typedef struct {
+    i2c_inst_t *i2c;
+    uint8_t id; // Address, with MCP9808_I2C1 for the second bus
+    uint8_t limit_step; // On the bus
+    uint8_t limit_dirty; // Steps still to do, a bit each
+    bool limit_busy;
+    uint8_t alert_step;
+    uint8_t shadow_valid; // A bit per register in shadow
+    // Write through copies of the registers up to LIMIT_CONFIG, config
+    // without the status and clear bits. Only valid once written or read.
+    uint16_t shadow[LIMIT_VERIFY];
+    uint16_t alert_config; // Config as read, to report with the clear
+    i2c_async_xfer_t temp; // Also the probe, before the table is compacted
+    i2c_async_xfer_t limit;
+    i2c_async_xfer_t alert;
+    // Written on core1, read from core0, one word each so they can't tear.
+    volatile uint32_t latest; // id << 24 | flags << 16 | temp, 0 until read
+    volatile uint32_t alerts;
+} MCP9808_T;
+
+// The same limits are written to every sensor.
+typedef struct {
+    uint8_t reg;
+    uint8_t len;
+    uint8_t data[2];
+} MCP9808_WRITE_T;
+
+// One descriptor per address and bus while probing, then those found packed
+// to the front in the same order. Only the first device_count are used.
+static MCP9808_T devices[MCP9808_MAX_SENSORS];
+static volatile uint8_t device_count = 0;
+static bool found[MCP9808_MAX_SENSORS];
+static volatile uint8_t probes_pending = 0;
+static volatile uint8_t limits_pending = 0;
+static volatile uint8_t temps_pending = 0;
+static uint32_t temps_requested; // Sensors to read once the sweep on the bus is done
+static uint32_t sweep_start;
+static uint8_t sweep_count;
+static MCP9808_WRITE_T limit_writes[LIMIT_VERIFY];
+// The thermostat set points, the limits are written a little above them for
+// the hysteresis wanted on each.
+static mcp9808_temp_t setpoints[MCP9808_LIMITS];
+static const mcp9808_temp_t LIMIT_OFFSET[MCP9808_LIMITS] = {MCP9808_TEMP(1), MCP9808_TEMP(0), MCP9808_TEMP(1.5)};
+
+// One alert is serviced at a time, a sensor at a time in alert_order.
+static volatile bool alert_active = false;
+static uint8_t alert_order[MCP9808_MAX_SENSORS];
+static uint8_t alert_next;
+static uint8_t alert_passes;
+static uint32_t alert_serviced; // Mask of the sensors that asserted, kept for the next alert
+static uint32_t alert_transactions;
+
+static volatile uint32_t transactions = 0;
+static volatile uint32_t transactions_saved = 0;
+
+static timer_wheel_timer_t timer;
+
+// The limit registers hold a 13 bit two's complement value in bits 12-2,
+// i.e. the temperature in sixteenths with the bottom two bits dropped.
+// Values between quarters round down.
+uint16_t mcp9808_temp_to_register(mcp9808_temp_t temp) {
+    return (uint16_t) temp & 0x1FFC;
+}
 
-static repeating_timer_t timer;
+static void mcp9808_set_write(MCP9808_WRITE_T *write, uint8_t reg, uint16_t value) {
+    *write = (MCP9808_WRITE_T) {reg, 2, {MSB(value), LSB(value)}};
+}
 
-static uint16_t mcp9808_calc_register(float temp) {
-    return (int16_t)temp << 4 | (int16_t)((temp - (int16_t)temp) / .25) << 2;
+// The value a step leaves in the register, as kept in the shadow.
+static uint16_t mcp9808_write_value(uint8_t step) {
+    const MCP9808_WRITE_T *write = &limit_writes[step];
+    uint16_t value = write->len == 2 ? write->data[0] << 8 | write->data[1] : write->data[0];
+    return step == LIMIT_CONFIG ? value & ~(CONFIG_ALERT_STATUS | CONFIG_INT_CLEAR) : value;
 }
 
-void mcp9808_init(gpio_irq_callback_t irq_callback) {
+static bool mcp9808_submit(MCP9808_T *dev, i2c_async_xfer_t *xfer) {
+    transactions += 1;
+    return i2c_async_submit(dev->i2c, xfer);
+}
+
+static void mcp9808_alert_task(uint gpio, uint32_t events) {
+    mcp9808_reset_irq();
+}
+
+void mcp9808_init(void) {
+
+    const uint8_t limit_regs[MCP9808_LIMITS] = {REG_TEMP_FROST, REG_TEMP_HEATING, REG_TEMP_CONDITIONING};
+    char str[6][MCP9808_TEMP_STR_LEN];
+    uint16_t reg[MCP9808_LIMITS];
 
     // Frost protection calculation is 1°C higher for +1°C to -.5°C hysteresis.
-    float frost = 10.00;
-    uint16_t reg_frost = mcp9808_calc_register(frost + 1);
-    float adj_frost = mcp9808_convert_temp(MSB(reg_frost), LSB(reg_frost));
     // Heating calculation is .75°C higher for +.75°C to -.75°C hysteresis.
-    float heating = 20.50;
-    uint16_t reg_heating = mcp9808_calc_register(heating + 0.00);
-    float adj_heating = mcp9808_convert_temp(MSB(reg_heating), LSB(reg_heating));
     // Air conditioning calculation is 1.5°C higher for +1.5°C to -.00°C hysteresis.
-    float conditioning = 24.00;
-    uint16_t reg_conditioning = mcp9808_calc_register(conditioning + 1.5);
-    float adj_conditioning = mcp9808_convert_temp(MSB(reg_conditioning), LSB(reg_conditioning));
-
-    printf("Temps: Frost(%2.2f %04X %2.2f) Heating(%2.2f %04X %2.2f) Conditioning(%2.2f %04X %2.2f) \n"
-        , frost, reg_frost, adj_frost, heating, reg_heating, adj_heating, conditioning, reg_conditioning, adj_conditioning);
-
-    //
-    for (uint8_t i = 0; i < MCP9808_DEV_COUNT; i++) {
-        mcp9808_set_limits(i, reg_frost, reg_heating, reg_conditioning);
+    setpoints[MCP9808_LIMIT_FROST] = MCP9808_TEMP(10.00);
+    setpoints[MCP9808_LIMIT_HEATING] = MCP9808_TEMP(20.50);
+    setpoints[MCP9808_LIMIT_CONDITIONING] = MCP9808_TEMP(24.00);
+    for (uint limit = 0; limit < MCP9808_LIMITS; limit++) {
+        reg[limit] = mcp9808_temp_to_register(setpoints[limit] + LIMIT_OFFSET[limit]);
+        mcp9808_set_write(&limit_writes[limit], limit_regs[limit], reg[limit]);
     }
+    limit_writes[LIMIT_RESOLUTION] = (MCP9808_WRITE_T) {REG_RESOLUTION, 1, {0x01}}; // .25°C resolution
+    // 21:Hysteresis 1.5°C, 5:Interrupt clear 3:Alert 0:interrupt mode
+    limit_writes[LIMIT_CONFIG] = (MCP9808_WRITE_T) {REG_CONFIG, 2, {0x02, 0x39}};
+
+    printf("Temps: Frost(%s %04X %s) Heating(%s %04X %s) Conditioning(%s %04X %s) \n"
+        , mcp9808_temp_format(str[0], setpoints[0]), reg[0], mcp9808_temp_format(str[1], mcp9808_temp_from_register(MSB(reg[0]), LSB(reg[0])))
+        , mcp9808_temp_format(str[2], setpoints[1]), reg[1], mcp9808_temp_format(str[3], mcp9808_temp_from_register(MSB(reg[1]), LSB(reg[1])))
+        , mcp9808_temp_format(str[4], setpoints[2]), reg[2], mcp9808_temp_format(str[5], mcp9808_temp_from_register(MSB(reg[2]), LSB(reg[2]))));
 
-    gpio_set_irq_enabled(MCP9808_IRQ, GPIO_IRQ_EDGE_FALL, true);
-    gpio_set_irq_callback(irq_callback);
-    irq_set_enabled(IO_IRQ_BANK0, true);
+    gpio_event_register(MCP9808_IRQ, GPIO_IRQ_EDGE_FALL, MCP9808_IRQ_HOLDOFF_MS, NULL, mcp9808_alert_task);
     gpio_pull_up(MCP9808_IRQ);
 
-    mcp9808_print_temp();
+    // The limits and the first sweep follow once the scan is done.
+    mcp9808_probe();
 
-    add_repeating_timer_ms(MCP9808_CALLBACK_TIME, mcp9808_process, NULL, &timer);
+    timer_wheel_timer_init(&timer, mcp9808_process, NULL, MCP9808_CALLBACK_SLACK);
+    timer_wheel_add(&timer, MCP9808_CALLBACK_TIME);
 
 }
 
-void mcp9808_set_limits(uint8_t i, u_int16_t reg_frost, uint16_t reg_heating, u_int16_t reg_conditioning) {
-
-    uint8_t buf[3];
-
-    printf("Init (%d", MCP9808_ADDRESS[i]);
+// Both buses are scanned at once, each address by its manufacturer ID then,
+// if that matches, its device ID.
+static void mcp9808_probe(void) {
+    probes_pending = MCP9808_MAX_SENSORS;
+    for (uint8_t i = 0; i < MCP9808_MAX_SENSORS; i++) {
+        MCP9808_T *dev = &devices[i];
+        uint8_t bus = i / MCP9808_ADDRESSES;
+        dev->i2c = bus ? i2c1 : i2c0;
+        dev->id = (uint8_t) (MCP9808_BASE_ADDRESS + i % MCP9808_ADDRESSES) | (bus ? MCP9808_I2C1 : 0);
+        dev->temp.callback = mcp9808_probe_done;
+        dev->temp.user_data = dev;
+        i2c_async_set_read(&dev->temp, dev->id & ~MCP9808_I2C1, REG_MANUFACTURER, 2);
+        mcp9808_submit(dev, &dev->temp);
+    }
+}
 
-    buf[0] = REG_TEMP_FROST;
-    buf[1] = MSB(reg_frost);
-    buf[2] = LSB(reg_frost);
-    if (i2c_write_blocking(i2c0, MCP9808_ADDRESS[i], buf, 3, false) <0) {
-        printf("*WE*");
-    } else {
-        printf(":LT-%02x%02x", buf[1], buf[2]);
+static void mcp9808_probe_done(i2c_async_xfer_t *xfer, i2c_async_result_t result) {
+    MCP9808_T *dev = (MCP9808_T *) xfer->user_data;
+    uint16_t id = xfer->rx[0] << 8 | xfer->rx[1];
+
+    // A NAK is just an empty address, not worth a trace.
+    if (result == I2C_ASYNC_OK) {
+        if (xfer->tx[0] == REG_MANUFACTURER && id == MCP9808_MANUFACTURER_ID) {
+            i2c_async_set_read(xfer, xfer->addr, REG_DEVICE, 2);
+            mcp9808_submit(dev, xfer);
+            return;
+        } else if (xfer->tx[0] == REG_DEVICE && MSB(id) == MCP9808_DEVICE_ID) {
+            TRACE2(TRACE_MCP9808_FOUND, dev->id, LSB(id));
+            found[dev - devices] = true;
+        } else {
+            TRACE3(TRACE_MCP9808_UNKNOWN, dev->id, xfer->tx[0], id);
+        }
     }
+    if (--probes_pending == 0) {
+        mcp9808_probe_finish();
+    }
+}
 
-    buf[0] = REG_TEMP_HEATING;
-    buf[1] = MSB(reg_heating);
-    buf[2] = LSB(reg_heating);
-    if (i2c_write_blocking(i2c0, MCP9808_ADDRESS[i], buf, 3, false) <0) {
-        printf("*WE*");
-    } else {
-        printf(":UT-%02x%02x", buf[1], buf[2]);
+// Queues the next limit step that would change something, the rest are
+// skipped. With interrupts off, or from a limit callback. Each time the
+// limits have all been set the sensors are read again.
+static void mcp9808_limit_next(MCP9808_T *dev) {
+    uint8_t addr = dev->id & ~MCP9808_I2C1;
+    while (dev->limit_dirty) {
+        uint8_t step = (uint8_t) __builtin_ctz(dev->limit_dirty);
+        dev->limit_dirty &= ~(1 << step);
+        if (step == LIMIT_VERIFY) {
+            i2c_async_set_read(&dev->limit, addr, REG_CONFIG, 2);
+        } else if (dev->shadow_valid & (1 << step) && dev->shadow[step] == mcp9808_write_value(step)) {
+            transactions_saved += 1;
+            continue;
+        } else {
+            const MCP9808_WRITE_T *write = &limit_writes[step];
+            i2c_async_set_write(&dev->limit, addr, write->reg, write->data, write->len);
+        }
+        if (!dev->limit_busy) {
+            dev->limit_busy = true;
+            limits_pending += 1;
+        }
+        dev->limit_step = step;
+        mcp9808_submit(dev, &dev->limit);
+        return;
     }
+    if (dev->limit_busy) {
+        dev->limit_busy = false;
+        if (--limits_pending == 0) {
+            boot_mark(BOOT_LIMITS);
+            // Readings against the new limits, and any alert that came in
+            // while they were being set.
+            mcp9808_read_temps(UINT32_MAX);
+            if (!gpio_get(MCP9808_IRQ)) {
+                mcp9808_reset_irq();
+            }
+        }
+    }
+}
 
-    buf[0] = REG_TEMP_CONDITIONING;
-    buf[1] = MSB(reg_conditioning);
-    buf[2] = LSB(reg_conditioning);
-    if (i2c_write_blocking(i2c0, MCP9808_ADDRESS[i], buf, 3, false) <0) {
-        printf("*WE*");
-    } else {
-        printf(":CT-%02x%02x", buf[1], buf[2]);
+// Runs in the last probe's callback, nothing else is using the table.
+static void mcp9808_probe_finish(void) {
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < MCP9808_MAX_SENSORS; i++) {
+        if (found[i]) {
+            devices[count].i2c = devices[i].i2c;
+            devices[count].id = devices[i].id;
+            count++;
+        }
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        MCP9808_T *dev = &devices[i];
+        dev->temp.callback = mcp9808_temp_done;
+        dev->temp.user_data = dev;
+        dev->limit.callback = mcp9808_limit_done;
+        dev->limit.user_data = dev;
+        dev->alert.callback = mcp9808_alert_done;
+        dev->alert.user_data = dev;
+        // Nothing is known of the registers, the sensors may have kept
+        // their power through a reset of the pico.
+        dev->shadow_valid = 0;
+    }
+    TRACE1(TRACE_MCP9808_SCAN, count);
+    temp_history_init(MCP9808_CALLBACK_TIME / 1000, count);
+    device_count = count;
+    boot_mark(BOOT_SCAN);
+
+    // The first sweep is queued ahead of the limits so a sample is in without
+    // waiting on a dozen writes. Its limit flags are against whatever the
+    // registers held, so they are ignored while the limits are busy, and the
+    // sweep once they are set checks them. Both are queued from this callback
+    // so no transfer finishes before limit_busy is set.
+    for (uint8_t i = 0; i < count; i++) {
+        devices[i].limit_dirty = LIMIT_ALL;
+    }
+    mcp9808_read_temps(UINT32_MAX);
+    for (uint8_t i = 0; i < count; i++) {
+        mcp9808_limit_next(&devices[i]);
     }
+}
 
-    buf[0] = REG_RESOLUTION;
-    buf[1] = 0x01; // .25°C resolution
-    if (i2c_write_blocking(i2c0, MCP9808_ADDRESS[i], buf, 2, false) <0) {
-        printf("*WE*");
-    } else {
-        printf(":RS-%02x", buf[1]);
+// core1. Only the sensors whose register differs are written.
+void mcp9808_set_limit(mcp9808_limit_t limit, mcp9808_temp_t temp) {
+    if (limit >= MCP9808_LIMITS) {
+        return;
     }
+    uint32_t save = save_and_disable_interrupts();
+    setpoints[limit] = temp;
+    mcp9808_set_write(&limit_writes[limit], limit_writes[limit].reg, mcp9808_temp_to_register(temp + LIMIT_OFFSET[limit]));
+    for (uint8_t i = 0; i < device_count; i++) {
+        MCP9808_T *dev = &devices[i];
+        dev->limit_dirty |= 1 << limit;
+        if (!dev->limit.pending) {
+            mcp9808_limit_next(dev);
+        }
+    }
+    restore_interrupts(save);
+}
 
-    buf[0] = REG_CONFIG;
-    buf[1] = 0x02; // 21:Hysteresis 1.5°C
-    buf[2] = 0x39; // 5:Interrupt clear 3:Alert 0:interrupt mode
-    if (i2c_write_blocking(i2c0, MCP9808_ADDRESS[i], buf, 3, false) < 0) {
-        printf("*WE*");
+static void mcp9808_limit_done(i2c_async_xfer_t *xfer, i2c_async_result_t result) {
+    MCP9808_T *dev = (MCP9808_T *) xfer->user_data;
+    uint8_t step = dev->limit_step;
+    if (result != I2C_ASYNC_OK) {
+        mcp9808_trace_error(xfer, result);
+        if (step < LIMIT_VERIFY) {
+            // Whether it took is unknown, write it next time whatever.
+            dev->shadow_valid &= ~(1 << step);
+        }
+    } else if (xfer->rx_len) {
+        TRACE2(TRACE_MCP9808_CONFIG, dev->id, xfer->rx[0] << 8 | xfer->rx[1]);
+        dev->shadow[LIMIT_CONFIG] = (xfer->rx[0] << 8 | xfer->rx[1]) & ~(CONFIG_ALERT_STATUS | CONFIG_INT_CLEAR);
+        dev->shadow_valid |= 1 << LIMIT_CONFIG;
     } else {
-        printf(":CN-%02x%02x", buf[1], buf[2]);
+        if (xfer->tx_len == 2) {
+            TRACE3(TRACE_MCP9808_LIMIT, dev->id, xfer->tx[0], xfer->tx[1]);
+        } else {
+            TRACE3(TRACE_MCP9808_LIMIT, dev->id, xfer->tx[0], xfer->tx[1] << 8 | xfer->tx[2]);
+        }
+        dev->shadow[step] = mcp9808_write_value(step);
+        dev->shadow_valid |= 1 << step;
     }
+    mcp9808_limit_next(dev);
+}
 
-    buf[1] = 0;
-    buf[2] = 0;
-    if (i2c_write_blocking(i2c0, MCP9808_ADDRESS[i], &REG_CONFIG, 1, true) < 0) {
-        printf("*WE*");
-    } else if (i2c_read_blocking(i2c0, MCP9808_ADDRESS[i], &buf[1], 2, false) < 0) {
-        printf("*RE*");
+static void mcp9808_trace_error(i2c_async_xfer_t *xfer, i2c_async_result_t result) {
+    MCP9808_T *dev = (MCP9808_T *) xfer->user_data;
+    if (result == I2C_ASYNC_READ_ERROR) {
+        TRACE2(TRACE_MCP9808_READ_ERROR, dev->id, xfer->tx[0]);
     } else {
-        printf(":%02x%02x*OK*) ", buf[1], buf[2]);
+        TRACE2(TRACE_MCP9808_WRITE_ERROR, dev->id, xfer->tx[0]);
     }
+}
 
-    printf("\n");
+// How close the last reading was to where the alert output changes, going
+// by the cached limits and hysteresis. Sensors that asserted last time, as
+// in a storm, and unread or uncached ones come first.
+static uint16_t mcp9808_alert_distance(const MCP9808_T *dev) {
+    static const mcp9808_temp_t hysteresis[4] = {0, MCP9808_TEMP(1.5), MCP9808_TEMP(3), MCP9808_TEMP(6)};
+    uint32_t latest = dev->latest;
+    uint16_t distance = UINT16_MAX;
 
+    if (alert_serviced & (1u << (dev - devices)) || !latest || !(dev->shadow_valid & (1 << LIMIT_CONFIG))) {
+        return 0;
+    }
+    mcp9808_temp_t temp = (mcp9808_temp_t) latest;
+    mcp9808_temp_t hyst = hysteresis[(dev->shadow[LIMIT_CONFIG] >> 9) & 3];
+    for (uint8_t step = LIMIT_FROST; step <= LIMIT_CONDITIONING; step++) {
+        if (!(dev->shadow_valid & (1 << step))) {
+            return 0;
+        }
+        mcp9808_temp_t limit = mcp9808_temp_from_register(MSB(dev->shadow[step]), LSB(dev->shadow[step]));
+        uint16_t above = (uint16_t) abs(temp - limit);
+        uint16_t below = (uint16_t) abs(temp - (limit - hyst));
+        distance = above < distance ? above : distance;
+        distance = below < distance ? below : distance;
+    }
+    return distance;
 }
 
+// Called from the main loop when the shared alert line falls, and once the
+// limits are set if it is already low. The sensors are asked in turn, the
+// one last read nearest a limit first, and the asking stops as soon as the
+// line is released. Only those that asserted are read afterwards.
 void mcp9808_reset_irq(void) {
-    uint8_t buf[3];
-    buf[0] = REG_CONFIG;
-    buf[1] = 0;
-    buf[2] = 0;
-    for (uint8_t i = 0; i < MCP9808_DEV_COUNT; i++) {
-        printf("(%d ", MCP9808_ADDRESS[i]);
-        if (i2c_write_blocking(i2c0, MCP9808_ADDRESS[i], &REG_CONFIG, 1, true) < 0) {
-            printf("*WE*");
-        } else if (i2c_read_blocking(i2c0, MCP9808_ADDRESS[i], &buf[1], 2, false) < 0) {
-            printf("*RE*");
-        } else {
-            printf(":%02x%02x*OK*", buf[1], buf[2]);
-            if (buf[2] & (1 << 4)) { // 4:Interrupt this device
-                buf[2] |= (1 << 5); // 5:Interrupt clear
-                printf("\033[0;32m:%02x%02x", buf[1], buf[2]);
-                if (i2c_write_blocking(i2c0, MCP9808_ADDRESS[i], buf, 3, false) < 0) {
-                    printf("*WE*");
-                } else if (i2c_write_blocking(i2c0, MCP9808_ADDRESS[i], &REG_CONFIG, 1, true) < 0) {
-                    printf("*WE*");
-                } else if (i2c_read_blocking(i2c0, MCP9808_ADDRESS[i], &buf[1], 2, false) < 0) {
-                    printf("*RE*");
-                } else {
-                    printf(":%02x%02x*OK*", buf[1], buf[2]);
-                }
-                printf("\033[0m");
-            }
-            printf(") ");
+    uint16_t distance[MCP9808_MAX_SENSORS];
+
+    uint32_t save = save_and_disable_interrupts();
+    if (alert_active || limits_pending || !device_count) {
+        // Still servicing the last alert, it will pick this one up too, or
+        // the limits aren't set yet and the line is checked after them.
+        restore_interrupts(save);
+        return;
+    }
+    alert_active = true;
+    restore_interrupts(save);
+
+    for (uint8_t i = 0; i < device_count; i++) {
+        uint8_t j = i;
+        distance[i] = mcp9808_alert_distance(&devices[i]);
+        for (; j > 0 && distance[alert_order[j - 1]] > distance[i]; j--) {
+            alert_order[j] = alert_order[j - 1];
         }
+        alert_order[j] = i;
     }
-    printf(" \n");
-    mcp9808_print_temp();
+    alert_next = 0;
+    alert_passes = 1;
+    alert_serviced = 0;
+    alert_transactions = 0;
+    mcp9808_alert_next();
 }
 
-void mcp9808_check_limits(uint8_t upper_byte) {
-
-    // Check flags and raise alerts accordingly
-    if ((upper_byte & 0x20) == 0x20) { // < (frost - hysteresis)
-        printf("\033[0;32m*frost*\033[0m");
+static void mcp9808_alert_next(void) {
+    // Still low with every sensor asked, one asserted again behind the
+    // pass. The edge came while the line was already low, so go round again.
+    if (alert_next == device_count && !gpio_get(MCP9808_IRQ) && alert_passes < MCP9808_ALERT_PASSES) {
+        alert_next = 0;
+        alert_passes += 1;
     }
-    if ((upper_byte & 0x40) != 0x40) { // < (heating) or < (heating - hysteresis)
-        printf("\033[0;32m*heat*\033[0m");
+    if (alert_next < device_count && !gpio_get(MCP9808_IRQ)) {
+        MCP9808_T *dev = &devices[alert_order[alert_next++]];
+        dev->alert_step = ALERT_READ;
+        i2c_async_set_read(&dev->alert, dev->id & ~MCP9808_I2C1, REG_CONFIG, 2);
+        alert_transactions += 1;
+        mcp9808_submit(dev, &dev->alert);
+        return;
     }
-    if ((upper_byte & 0x80) == 0x80) { // > (conditioning)
-        printf("\033[0;32m*conditioning*\033[0m");
+
+    // Against reading every config, a clear and a read back for each that
+    // asserted, then reading every sensor, for each pass.
+    uint32_t serviced = (uint32_t) __builtin_popcount(alert_serviced);
+    uint32_t before = 2 * device_count * alert_passes + 2 * serviced;
+    uint32_t after = alert_transactions + serviced;
+    if (before > after) {
+        transactions_saved += before - after;
     }
+    alert_active = false;
+    mcp9808_read_temps(alert_serviced);
 }
 
-float mcp9808_convert_temp(uint8_t upper_byte, uint8_t lower_byte) {
+static void mcp9808_alert_done(i2c_async_xfer_t *xfer, i2c_async_result_t result) {
+    MCP9808_T *dev = (MCP9808_T *) xfer->user_data;
+    uint16_t config;
+    uint8_t buf[2];
 
-    float temperature;
+    if (result != I2C_ASYNC_OK) {
+        mcp9808_trace_error(xfer, result);
+    } else {
+        switch (dev->alert_step) {
+            case ALERT_READ:
+                config = xfer->rx[0] << 8 | xfer->rx[1];
+                dev->shadow[LIMIT_CONFIG] = config & ~(CONFIG_ALERT_STATUS | CONFIG_INT_CLEAR);
+                dev->shadow_valid |= 1 << LIMIT_CONFIG;
+                if (config & CONFIG_ALERT_STATUS) {
+                    // The cached config with the clear bit, nothing to read back.
+                    buf[0] = MSB(dev->shadow[LIMIT_CONFIG]);
+                    buf[1] = LSB(dev->shadow[LIMIT_CONFIG] | CONFIG_INT_CLEAR);
+                    dev->alert_config = config;
+                    dev->alert_step = ALERT_CLEAR;
+                    i2c_async_set_write(xfer, xfer->addr, REG_CONFIG, buf, 2);
+                    alert_transactions += 1;
+                    mcp9808_submit(dev, xfer);
+                    return;
+                }
+                break;
+            case ALERT_CLEAR:
+                TRACE3(TRACE_MCP9808_ALERT_CLEAR, dev->id, dev->alert_config, dev->shadow[LIMIT_CONFIG]);
+                telemetry_push(TELEMETRY_ALERT, dev->id, dev->alert_config);
+                dev->alerts += 1;
+                alert_serviced |= 1u << (dev - devices);
+                break;
+        }
+    }
+    mcp9808_alert_next();
+}
 
+void mcp9808_get_stats(mcp9808_stats_t *stats) {
+    stats->sensors = device_count;
+    stats->transactions = transactions;
+    stats->saved = transactions_saved;
+    for (uint limit = 0; limit < MCP9808_LIMITS; limit++) {
+        stats->setpoints[limit] = setpoints[limit];
+    }
+}
+
+// The float conversion the sixteenths replaced, kept only for "mcp9808
+// bench" to time against, as it was, sign mistake and all.
+static __attribute__((noinline)) float mcp9808_bench_float_convert(uint8_t upper_byte, uint8_t lower_byte) {
+    float temperature;
 
-    //Check if TA <= 0°C and convert to denary accordingly
     if ((upper_byte & 0x10) == 0x10) {
         upper_byte = upper_byte & 0x0F;
         temperature = 256 - (((float) upper_byte * 16) + ((float) lower_byte / 16));
     } else {
         temperature = (((float) upper_byte * 16) + ((float) lower_byte / 16));
-
     }
     return temperature;
 }
 
-bool mcp9808_process(repeating_timer_t *rt){
-    mcp9808_print_temp();
+static __attribute__((noinline)) void mcp9808_bench_float_format(char *text, uint8_t upper, uint8_t lower) {
+    snprintf(text, MCP9808_TEMP_STR_LEN, "%.2f", mcp9808_bench_float_convert(upper, lower));
+}
+
+static __attribute__((noinline)) void mcp9808_bench_fixed_format(char *text, uint8_t upper, uint8_t lower) {
+    mcp9808_temp_format(text, mcp9808_temp_from_register(upper, lower));
+}
+
+static volatile float bench_float_sink;
+static volatile int32_t bench_fixed_sink;
+
+// SysTick cycles over every ambient register value, in batches that each fit
+// its 24 bits, with interrupts off so nothing else is counted.
+static uint32_t mcp9808_bench_run(uint path) {
+    char text[MCP9808_TEMP_STR_LEN];
+    uint32_t total = 0;
+
+    for (uint batch = 0; batch < MCP9808_BENCH_REGISTERS; batch += MCP9808_BENCH_BATCH) {
+        uint32_t save = save_and_disable_interrupts();
+        uint32_t start = systick_hw->cvr;
+        for (uint reg = batch; reg < batch + MCP9808_BENCH_BATCH; reg++) {
+            uint8_t upper = (uint8_t) (reg >> 8), lower = (uint8_t) reg;
+            switch (path) {
+                case 0:
+                    bench_float_sink = mcp9808_bench_float_convert(upper, lower);
+                    break;
+                case 1:
+                    bench_fixed_sink = mcp9808_temp_from_register(upper, lower);
+                    break;
+                case 2:
+                    mcp9808_bench_float_format(text, upper, lower);
+                    break;
+                default:
+                    mcp9808_bench_fixed_format(text, upper, lower);
+                    break;
+            }
+        }
+        total += (start - systick_hw->cvr) & MCP9808_BENCH_SYSTICK_MASK;
+        restore_interrupts(save);
+    }
+    return total;
+}
+
+// The float and %.2f path against the sixteenths, per call. On the RP2040
+// the float side is the ROM's soft float.
+static void mcp9808_bench(void) {
+    static const char *const names[4] = {"float convert", "sixteenths convert", "float %.2f", "sixteenths format"};
+
+    // Free running at the processor clock. Nothing else uses SysTick.
+    systick_hw->rvr = MCP9808_BENCH_SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+    for (uint path = 0; path < count_of(names); path++) {
+        uint32_t cycles = mcp9808_bench_run(path);
+        printf("%-18s %lu.%02lu cycles per call\n", names[path], (unsigned long) (cycles / MCP9808_BENCH_REGISTERS),
+            (unsigned long) (cycles % MCP9808_BENCH_REGISTERS * 100 / MCP9808_BENCH_REGISTERS));
+    }
+    systick_hw->csr = 0;
+}
+
+static void mcp9808_command(const char *args) {
+    static const char *const names[MCP9808_LIMITS] = {"frost", "heat", "conditioning"};
+    char str[MCP9808_LIMITS][MCP9808_TEMP_STR_LEN];
+    mcp9808_reading_t reading;
+    mcp9808_stats_t stats;
+    mcp9808_temp_t temp;
+
+    if (!strcmp(args, "bench")) {
+        mcp9808_bench();
+        return;
+    }
+    for (uint limit = 0; limit < MCP9808_LIMITS && *args; limit++) {
+        size_t len = strlen(names[limit]);
+        if (!strncmp(args, names[limit], len) && args[len] == ' ') {
+            if (!mcp9808_temp_parse(args + len + 1, &temp)) {
+                printf("mcp9808 %s <°C>, e.g. 20.5\n", names[limit]);
+            } else if (!core_msg_send(CORE_MSG_MCP9808_LIMIT, limit << 16 | (uint16_t) temp)) {
+                printf("sensor core busy, try again\n");
+            }
+            return;
+        }
+    }
+
+    mcp9808_get_stats(&stats);
+    for (uint i = 0; mcp9808_get_reading(i, &reading); i++) {
+        printf("%02x %s°C flags %u alerts %lu\n", reading.addr, mcp9808_temp_format(str[0], reading.temp),
+            reading.flags, (unsigned long) reading.alerts);
+    }
+    printf("frost %s heat %s conditioning %s\n", mcp9808_temp_format(str[0], stats.setpoints[0]),
+        mcp9808_temp_format(str[1], stats.setpoints[1]), mcp9808_temp_format(str[2], stats.setpoints[2]));
+    printf("%lu sensors, %lu i2c transactions, %lu saved\n", (unsigned long) stats.sensors,
+        (unsigned long) stats.transactions, (unsigned long) stats.saved);
+}
+
+// Min, max and mean of each sensor's history over the last minutes, and how
+// well it is packed.
+static void mcp9808_history_command(const char *args) {
+    char str[3][MCP9808_TEMP_STR_LEN];
+    mcp9808_reading_t reading;
+    temp_history_stats_t stats;
+    uint32_t minutes = *args ? (uint32_t) strtoul(args, NULL, 10) : 60;
+    uint32_t now = wall_clock_seconds();
+
+    if (!now || !minutes) {
+        printf(now ? "history [minutes]\n" : "no history until the clock is set\n");
+        return;
+    }
+    uint32_t from = now > minutes * 60 ? now - minutes * 60 : 0;
+    for (uint i = 0; mcp9808_get_reading(i, &reading); i++) {
+        uint32_t samples = temp_history_samples(i);
+        if (temp_history_stats(i, from, now, &stats)) {
+            printf("%02x %lu samples min %s max %s mean %s°C", reading.addr, (unsigned long) stats.count,
+                mcp9808_temp_format(str[0], stats.min), mcp9808_temp_format(str[1], stats.max),
+                mcp9808_temp_format(str[2], stats.mean));
+        } else {
+            printf("%02x no samples", reading.addr);
+        }
+        printf(", %lu kept in %lu bytes, %lu raw\n", (unsigned long) samples,
+            (unsigned long) temp_history_bytes(i), (unsigned long) (samples * sizeof(temp_sample_t)));
+    }
+}
+
+void mcp9808_console_init(void) {
+    console_register("mcp9808", "sensors and i2c counts, mcp9808 <frost|heat|conditioning> <°C> to set, mcp9808 bench to time the conversions", mcp9808_command);
+    console_register("history", "temperature min, max and mean over the last hour, history <minutes>", mcp9808_history_command);
+}
+
+bool mcp9808_get_reading(uint i, mcp9808_reading_t *reading) {
+    if (i >= device_count) {
+        return false;
+    }
+    uint32_t latest = devices[i].latest;
+    if (!latest) {
+        return false;
+    }
+    reading->addr = (uint8_t) (latest >> 24);
+    reading->flags = (uint8_t) (latest >> 16);
+    reading->temp = (mcp9808_temp_t) latest;
+    reading->alerts = devices[i].alerts;
     return true;
 }
 
-void mcp9808_print_time() {
-    datetime_t t;
-    if (rtc_running()) {
-        rtc_get_datetime(&t);
-        printf("(%02d/%02d/%04d %02d:%02d:%02d) ", t.day, t.month, t.year, t.hour, t.min, t.sec);
+void mcp9808_check_limits(uint8_t id, uint8_t upper_byte) {
+
+    // Check flags and raise alerts accordingly
+    if ((upper_byte & 0x20) == 0x20) { // < (frost - hysteresis)
+        TRACE1(TRACE_MCP9808_FROST, id);
+    }
+    if ((upper_byte & 0x40) != 0x40) { // < (heating) or < (heating - hysteresis)
+        TRACE1(TRACE_MCP9808_HEAT, id);
+    }
+    if ((upper_byte & 0x80) == 0x80) { // > (conditioning)
+        TRACE1(TRACE_MCP9808_CONDITIONING, id);
     }
 }
 
-void mcp9808_print_temp() {
-    uint8_t buf[2];
-    uint16_t upper_byte;
-    uint16_t lower_byte;
+// The ambient register is a 13 bit two's complement value in sixteenths of a
+// degree with the alert flags in the top three bits. Bit 12 set means TA < 0°C.
+mcp9808_temp_t mcp9808_temp_from_register(uint8_t upper_byte, uint8_t lower_byte) {
+    int16_t raw = (int16_t) ((upper_byte & 0x1F) << 8 | lower_byte);
 
-    float temperature;
+    if ((raw & 0x1000) == 0x1000) {
+        raw -= 0x2000;
+    }
+    return raw;
+}
 
-    printf("Temp: ");
+// Formats as %.2f would, including its round half to even, without pulling
+// in the float printf path. Returns buf, which must hold MCP9808_TEMP_STR_LEN.
+char *mcp9808_temp_format(char *buf, mcp9808_temp_t temp) {
+    uint32_t magnitude = temp < 0 ? -temp : temp;
+    uint32_t centi = magnitude * 100 / 16;
+    uint32_t remainder = magnitude * 100 % 16;
 
-    mcp9808_print_time();
+    if (remainder > 8 || (remainder == 8 && (centi & 1))) {
+        centi += 1;
+    }
+    snprintf(buf, MCP9808_TEMP_STR_LEN, "%s%u.%02u", temp < 0 ? "-" : "", (unsigned) (centi / 100), (unsigned) (centi % 100));
+    return buf;
+}
 
-    for (uint8_t i = 0; i < MCP9808_DEV_COUNT; i++) {
-        // Start reading ambient temperature register for 2 bytes
-        if (i2c_write_blocking(i2c0, MCP9808_ADDRESS[i], &REG_TEMP_AMB, 1, true) < 0) {
-            printf("*WE*");
-            continue;
-        } else if (i2c_read_blocking(i2c0, MCP9808_ADDRESS[i], buf, 2, false) < 0) {
-            printf("*RE*");
-            continue;
+// Reads a temperature as mcp9808_temp_format writes it, up to two decimals,
+// to the nearest sixteenth.
+bool mcp9808_temp_parse(const char *text, mcp9808_temp_t *temp) {
+    bool negative = *text == '-';
+    uint32_t centi = 0;
+    uint digits = 0;
+
+    text += negative;
+    for (; *text >= '0' && *text <= '9' && centi <= 256; text++, digits++) {
+        centi = centi * 10 + (*text - '0');
+    }
+    centi *= 100;
+    if (*text == '.') {
+        text++;
+        for (uint scale = 10; *text >= '0' && *text <= '9' && scale; text++, scale /= 10) {
+            centi += (*text - '0') * scale;
         }
+    }
+    if (!digits || *text || centi > 25600) {
+        return false;
+    }
+    *temp = (mcp9808_temp_t) ((centi * 16 + 50) / 100);
+    *temp = negative ? -*temp : *temp;
+    return true;
+}
 
-        upper_byte = buf[0];
-        lower_byte = buf[1];
+uint32_t __not_in_flash_func(mcp9808_process)(timer_wheel_timer_t *timer){
+    ISR_STATS_ENTER_TIMER(ISR_MCP9808, MCP9808_CALLBACK_TIME * 1000);
+    mcp9808_read_temps(UINT32_MAX);
+    // An alert given up on after its passes, there won't be another edge.
+    if (!gpio_get(MCP9808_IRQ)) {
+        mcp9808_reset_irq();
+    }
+    ISR_STATS_EXIT(ISR_MCP9808);
+    return MCP9808_CALLBACK_TIME;
+}
 
-        // printf("UB:%x ", upper_byte);
+// Queue an ambient temperature read on the sensors in mask, a bit each.
+// Safe from interrupt context. While a sweep is on the bus, which may only
+// be some of the sensors, the mask waits for it to finish.
+static void mcp9808_read_temps(uint32_t mask) {
+    uint32_t save = save_and_disable_interrupts();
+    if (device_count < 32) {
+        mask &= (1u << device_count) - 1;
+    }
+    if (temps_pending || !mask) {
+        temps_requested |= mask;
+        restore_interrupts(save);
+        return;
+    }
+    temps_pending = (uint8_t) __builtin_popcount(mask);
+    sweep_count = temps_pending;
+    sweep_start = time_us_32();
+    restore_interrupts(save);
+
+    // Each bus works through its own queue, so the sweep takes as long as
+    // the busier bus.
+    for (uint8_t i = 0; i < device_count; i++) {
+        if (mask & (1u << i)) {
+            i2c_async_set_read(&devices[i].temp, devices[i].id & ~MCP9808_I2C1, REG_TEMP_AMB, 2);
+            mcp9808_submit(&devices[i], &devices[i].temp);
+        }
+    }
+}
 
+static void mcp9808_temp_done(i2c_async_xfer_t *xfer, i2c_async_result_t result) {
+    MCP9808_T *dev = (MCP9808_T *) xfer->user_data;
+    uint32_t now;
+
+    if (result != I2C_ASYNC_OK) {
+        mcp9808_trace_error(xfer, result);
+    } else {
         //clears flag bits in upper byte
-        temperature = mcp9808_convert_temp(upper_byte & 0x1F, lower_byte);
-        printf("(%d: %.2f°C", MCP9808_ADDRESS[i], temperature);
+        mcp9808_temp_t temp = mcp9808_temp_from_register(xfer->rx[0] & 0x1F, xfer->rx[1]);
+        TRACE2(TRACE_MCP9808_TEMP, dev->id, temp);
+        telemetry_push(TELEMETRY_TEMP, dev->id, xfer->rx[0] << 8 | xfer->rx[1]);
+        dev->latest = (uint32_t) dev->id << 24 | (uint32_t) (xfer->rx[0] >> 5) << 16 | (uint16_t) temp;
+
+        // History is only kept once the clock has been set.
+        now = wall_clock_seconds();
+        if (now) {
+            temp_history_append(dev - devices, now, temp);
+        }
 
-        //isolates limit flags in upper byte
-        mcp9808_check_limits(upper_byte & 0xE0);
+        boot_mark(BOOT_FIRST_SAMPLE);
 
-        printf(") ");
+        //isolates limit flags in upper byte
+        if (!dev->limit_busy) {
+            mcp9808_check_limits(dev->id, xfer->rx[0] & 0xE0);
+        }
+    }
+    if (--temps_pending == 0) {
+        TRACE2(TRACE_MCP9808_SWEEP, sweep_count, time_us_32() - sweep_start);
+        uint32_t save = save_and_disable_interrupts();
+        uint32_t mask = temps_requested;
+        temps_requested = 0;
+        restore_interrupts(save);
+        mcp9808_read_temps(mask);
     }
-    printf("\n");
 }
+
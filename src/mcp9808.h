@@ -4,8 +4,61 @@
 #include "pico/stdlib.h"
 
 #define MCP9808_IRQ 4
+#define MCP9808_IRQ_HOLDOFF_MS 10 // Alert edges closer than this are serviced once
 
-void mcp9808_init(gpio_irq_callback_t irq_callback);
+// Temperatures are held as sixteenths of a °C, the resolution of the ambient
+// temperature register, so no float maths is needed. MCP9808_TEMP is for
+// constants only, e.g. MCP9808_TEMP(20.50).
+typedef int16_t mcp9808_temp_t;
+#define MCP9808_TEMP(c) ((mcp9808_temp_t) ((c) * 16))
+#define MCP9808_TEMP_STR_LEN 9 // "-2048.00", the most mcp9808_temp_t holds, and the terminator
+#define MCP9808_MAX_SENSORS 16 // Eight addresses on each of two buses
+// Sensors are named by their address, with this bit set for those on i2c1,
+// in the trace log, telemetry and readings.
+#define MCP9808_I2C1 0x80
+
+mcp9808_temp_t mcp9808_temp_from_register(uint8_t upper_byte, uint8_t lower_byte);
+uint16_t mcp9808_temp_to_register(mcp9808_temp_t temp);
+char *mcp9808_temp_format(char *buf, mcp9808_temp_t temp);
+bool mcp9808_temp_parse(const char *text, mcp9808_temp_t *temp);
+
+// The thermostat set points, each written to every sensor as a limit
+// register a little above it for the hysteresis wanted.
+typedef enum {
+    MCP9808_LIMIT_FROST,        // Lower limit
+    MCP9808_LIMIT_HEATING,      // Upper limit
+    MCP9808_LIMIT_CONDITIONING, // Critical limit
+    MCP9808_LIMITS
+} mcp9808_limit_t;
+
+typedef struct {
+    uint8_t addr; // Including MCP9808_I2C1
+    uint8_t flags; // Ambient register bits 15-13 moved down: conditioning, heating, frost
+    mcp9808_temp_t temp;
+    uint32_t alerts; // Alerts serviced since boot
+} mcp9808_reading_t;
+
+typedef struct {
+    uint32_t sensors;
+    uint32_t transactions; // i2c transactions queued since boot
+    uint32_t saved;        // Left out thanks to the register cache and alert servicing
+    mcp9808_temp_t setpoints[MCP9808_LIMITS];
+} mcp9808_stats_t;
+
+// Must be called on the core that owns i2c0, i2c1 and the sensors, with
+// i2c_async running on both. Every sensor address is probed on both buses
+// and the periodic reads of those found run from that core's timer wheel.
+void mcp9808_init(void);
 void mcp9808_reset_irq(void);
+// The latest reading of sensor i, from any core. False before the first,
+// or if there are not that many sensors. Sensors are numbered by bus then
+// address.
+bool mcp9808_get_reading(uint i, mcp9808_reading_t *reading);
+void mcp9808_get_stats(mcp9808_stats_t *stats);
+// Sensor core. Only registers that change are written.
+void mcp9808_set_limit(mcp9808_limit_t limit, mcp9808_temp_t temp);
+// core0, registers the console command, which sends limit changes to the
+// sensor core as CORE_MSG_MCP9808_LIMIT.
+void mcp9808_console_init(void);
 
 #endif
\ No newline at end of file
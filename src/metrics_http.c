@@ -0,0 +1,344 @@
+#include <stdarg.h>
+
+#include "pico/cyw43_arch.h"
+#include "lwip/tcp.h"
+
+#include "src/core_msg.h"
+#include "src/gpio_event.h"
+#include "src/idle.h"
+#include "src/mcp9808.h"
+#include "src/metrics_http.h"
+#include "src/ntp_clock.h"
+#include "src/telemetry.h"
+#include "src/wall_clock.h"
+
+static_assert(METRICS_HTTP_BODY_LEN <= UINT16_MAX, "body lengths are 16 bit");
+
+typedef struct {
+    char header[96];
+    char body[METRICS_HTTP_BODY_LEN];
+    uint16_t header_len;
+    uint16_t body_len;
+    uint16_t truncated; // Lines dropped for want of room
+    uint8_t users; // Responses still sending from it
+    absolute_time_t taken;
+} METRICS_SNAPSHOT_T;
+
+typedef struct {
+    struct tcp_pcb *pcb; // NULL when the slot is free
+    METRICS_SNAPSHOT_T *snapshot;
+    const char *part[2]; // Header and body, written in order
+    uint16_t part_len[2];
+    uint8_t next_part;
+    uint16_t offset;
+    uint32_t unacked;
+    bool responding;
+    uint8_t idle_polls;
+    uint8_t request_len;
+    char request[METRICS_HTTP_REQUEST_LEN];
+} METRICS_CLIENT_T;
+
+typedef struct {
+    struct tcp_pcb *listen;
+    METRICS_CLIENT_T clients[METRICS_HTTP_CLIENTS];
+    METRICS_SNAPSHOT_T snapshots[2];
+    uint8_t current;
+    uint32_t requests;
+    uint32_t refused;
+    uint32_t rejected;
+} METRICS_HTTP_T;
+
+static const char NOT_FOUND[] = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char NOT_ALLOWED[] = "HTTP/1.0 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+// All of it is only touched from lwIP callbacks, on core0.
+static METRICS_HTTP_T state;
+
+static void metrics_http_append(METRICS_SNAPSHOT_T *snapshot, const char *format, ...) {
+    va_list args;
+    uint16_t room = sizeof(snapshot->body) - METRICS_HTTP_TRAILER_LEN - snapshot->body_len;
+    va_start(args, format);
+    int len = vsnprintf(&snapshot->body[snapshot->body_len], room, format, args);
+    va_end(args);
+    // A line that doesn't fit is dropped whole so the output stays parseable.
+    if (len > 0 && len < room) {
+        snapshot->body_len += (uint16_t) len;
+    } else {
+        snapshot->body[snapshot->body_len] = 0;
+        snapshot->truncated += 1;
+    }
+}
+
+// Microseconds as seconds, without the float printf path.
+static void metrics_http_seconds(METRICS_SNAPSHOT_T *snapshot, const char *name, uint core, uint64_t us) {
+    metrics_http_append(snapshot, "%s{core=\"%u\"} %llu.%06lu\n", name, core,
+        (unsigned long long) (us / 1000000), (unsigned long) (us % 1000000));
+}
+
+static void metrics_http_format(METRICS_SNAPSHOT_T *snapshot) {
+    static const char *const calls[3] = {"frost", "heat", "conditioning"};
+    char temp[MCP9808_TEMP_STR_LEN];
+    mcp9808_reading_t readings[MCP9808_MAX_SENSORS];
+    uint count = 0;
+
+    for (uint i = 0; i < MCP9808_MAX_SENSORS; i++) {
+        if (mcp9808_get_reading(i, &readings[count])) {
+            count++;
+        }
+    }
+
+    snapshot->body_len = 0;
+    snapshot->truncated = 0;
+    metrics_http_append(snapshot, "# TYPE pico_uptime_seconds counter\npico_uptime_seconds %lu\n",
+        (unsigned long) (time_us_64() / 1000000));
+
+    metrics_http_append(snapshot, "# TYPE pico_temperature_celsius gauge\n");
+    for (uint i = 0; i < count; i++) {
+        metrics_http_append(snapshot, "pico_temperature_celsius{sensor=\"0x%02x\"} %s\n", readings[i].addr,
+            mcp9808_temp_format(temp, readings[i].temp));
+    }
+    // The calls mcp9808_check_limits makes, from the limit flags.
+    metrics_http_append(snapshot, "# TYPE pico_temperature_call gauge\n");
+    for (uint i = 0; i < count; i++) {
+        bool active[3] = {readings[i].flags & 0x1, !(readings[i].flags & 0x2), readings[i].flags & 0x4};
+        for (uint call = 0; call < 3; call++) {
+            metrics_http_append(snapshot, "pico_temperature_call{sensor=\"0x%02x\",call=\"%s\"} %u\n",
+                readings[i].addr, calls[call], active[call]);
+        }
+    }
+    metrics_http_append(snapshot, "# TYPE pico_temperature_alerts_total counter\n");
+    for (uint i = 0; i < count; i++) {
+        metrics_http_append(snapshot, "pico_temperature_alerts_total{sensor=\"0x%02x\"} %lu\n", readings[i].addr,
+            (unsigned long) readings[i].alerts);
+    }
+
+    metrics_http_append(snapshot, "# TYPE pico_ntp_synced gauge\npico_ntp_synced %u\n", ntp_clock_synced());
+    metrics_http_append(snapshot, "# TYPE pico_ntp_frequency_ppb gauge\npico_ntp_frequency_ppb %ld\n",
+        (long) ntp_clock_freq_ppb());
+    metrics_http_append(snapshot, "# TYPE pico_time_seconds gauge\npico_time_seconds %lu\n",
+        (unsigned long) wall_clock_seconds());
+
+    idle_stats_t idle[2];
+    idle_get_stats(0, &idle[0]);
+    idle_get_stats(1, &idle[1]);
+    metrics_http_append(snapshot, "# TYPE pico_cpu_idle_seconds_total counter\n");
+    metrics_http_seconds(snapshot, "pico_cpu_idle_seconds_total", 0, idle[0].idle_us);
+    metrics_http_seconds(snapshot, "pico_cpu_idle_seconds_total", 1, idle[1].idle_us);
+    metrics_http_append(snapshot, "# TYPE pico_cpu_busy_seconds_total counter\n");
+    metrics_http_seconds(snapshot, "pico_cpu_busy_seconds_total", 0, idle[0].busy_us);
+    metrics_http_seconds(snapshot, "pico_cpu_busy_seconds_total", 1, idle[1].busy_us);
+    metrics_http_append(snapshot, "# TYPE pico_cpu_wakes_total counter\n"
+        "pico_cpu_wakes_total{core=\"0\"} %lu\npico_cpu_wakes_total{core=\"1\"} %lu\n",
+        (unsigned long) idle[0].wakes, (unsigned long) idle[1].wakes);
+
+    telemetry_stats_t telemetry;
+    telemetry_get_stats(&telemetry);
+    metrics_http_append(snapshot, "# TYPE pico_dropped_total counter\n"
+        "pico_dropped_total{queue=\"gpio_event\"} %lu\npico_dropped_total{queue=\"core_msg\"} %lu\n"
+        "pico_dropped_total{queue=\"telemetry\"} %lu\n",
+        (unsigned long) gpio_event_dropped(), (unsigned long) core_msg_dropped(), (unsigned long) telemetry.dropped);
+    metrics_http_append(snapshot, "# TYPE pico_gpio_edges_total counter\n");
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++) {
+        gpio_event_stats_t edges;
+        if (gpio_event_get_stats(gpio, &edges)) {
+            metrics_http_append(snapshot, "pico_gpio_edges_total{gpio=\"%u\",result=\"passed\"} %lu\n"
+                "pico_gpio_edges_total{gpio=\"%u\",result=\"suppressed\"} %lu\n", gpio,
+                (unsigned long) (edges.edges - edges.suppressed), gpio, (unsigned long) edges.suppressed);
+        }
+    }
+    metrics_http_append(snapshot, "# TYPE pico_telemetry_datagrams_total counter\n"
+        "pico_telemetry_datagrams_total{result=\"sent\"} %lu\npico_telemetry_datagrams_total{result=\"error\"} %lu\n",
+        (unsigned long) telemetry.sent, (unsigned long) telemetry.send_errors);
+    metrics_http_append(snapshot, "# TYPE pico_http_requests_total counter\n"
+        "pico_http_requests_total{code=\"200\"} %lu\npico_http_requests_total{code=\"4xx\"} %lu\n"
+        "# TYPE pico_http_refused_total counter\npico_http_refused_total %lu\n",
+        (unsigned long) state.requests, (unsigned long) state.rejected, (unsigned long) state.refused);
+    // Into the room kept for it.
+    int len = snprintf(&snapshot->body[snapshot->body_len], sizeof(snapshot->body) - snapshot->body_len,
+        "# TYPE pico_metrics_truncated gauge\npico_metrics_truncated %u\n", snapshot->truncated);
+    snapshot->body_len += (uint16_t) len;
+
+    len = snprintf(snapshot->header, sizeof(snapshot->header),
+        "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %u\r\n\r\n",
+        snapshot->body_len);
+    snapshot->header_len = (uint16_t) len;
+    snapshot->taken = get_absolute_time();
+}
+
+// Scrapes close together share a snapshot. A new one is only formatted into
+// a buffer nobody is still sending, failing that the old one is served.
+static METRICS_SNAPSHOT_T *metrics_http_snapshot(void) {
+    METRICS_SNAPSHOT_T *current = &state.snapshots[state.current];
+    METRICS_SNAPSHOT_T *other = &state.snapshots[!state.current];
+    if (!current->header_len || absolute_time_diff_us(current->taken, get_absolute_time()) >= METRICS_HTTP_MAX_AGE_MS * 1000) {
+        if (!other->users) {
+            metrics_http_format(other);
+            state.current = !state.current;
+            current = other;
+        } else if (!current->users) {
+            metrics_http_format(current);
+        }
+    }
+    current->users += 1;
+    return current;
+}
+
+static err_t metrics_http_close(METRICS_CLIENT_T *client, bool abort) {
+    struct tcp_pcb *pcb = client->pcb;
+    err_t err = ERR_OK;
+
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+    // Once closed nothing of ours is referenced, all of it was acked.
+    if (abort || tcp_close(pcb) != ERR_OK) {
+        tcp_abort(pcb);
+        err = ERR_ABRT;
+    }
+    if (client->snapshot) {
+        client->snapshot->users -= 1;
+    }
+    client->pcb = NULL;
+    return err;
+}
+
+// As much as the send buffer takes, the rest goes from the sent callback.
+static err_t metrics_http_send(METRICS_CLIENT_T *client) {
+    while (client->next_part < 2) {
+        uint16_t left = client->part_len[client->next_part] - client->offset;
+        if (!left) {
+            client->next_part += 1;
+            client->offset = 0;
+            continue;
+        }
+        uint16_t room = tcp_sndbuf(client->pcb);
+        if (!room) {
+            break;
+        }
+        uint16_t len = left < room ? left : room;
+        bool more = len < left || (client->next_part == 0 && client->part_len[1]);
+        err_t err = tcp_write(client->pcb, client->part[client->next_part] + client->offset, len,
+            more ? TCP_WRITE_FLAG_MORE : 0);
+        if (err == ERR_MEM) {
+            break; // Out of pbufs or queue space for now, retried when something is acked or on poll
+        } else if (err != ERR_OK) {
+            return metrics_http_close(client, true);
+        }
+        client->offset += len;
+        client->unacked += len;
+    }
+    tcp_output(client->pcb);
+    return ERR_OK;
+}
+
+static err_t metrics_http_sent(void *arg, struct tcp_pcb *pcb, u16_t len) {
+    METRICS_CLIENT_T *client = (METRICS_CLIENT_T *) arg;
+    client->unacked -= len;
+    client->idle_polls = 0;
+    if (client->next_part == 2 && !client->unacked) {
+        if (client->snapshot) {
+            state.requests += 1;
+        }
+        return metrics_http_close(client, false);
+    }
+    return metrics_http_send(client);
+}
+
+static err_t metrics_http_respond(METRICS_CLIENT_T *client) {
+    client->responding = true;
+    if (strncmp(client->request, "GET ", 4)) {
+        client->part[0] = NOT_ALLOWED;
+        client->part_len[0] = sizeof(NOT_ALLOWED) - 1;
+        state.rejected += 1;
+    } else if (!strncmp(client->request + 4, "/metrics", 8) && (client->request[12] == ' ' || client->request[12] == '?')) {
+        client->snapshot = metrics_http_snapshot();
+        client->part[0] = client->snapshot->header;
+        client->part_len[0] = client->snapshot->header_len;
+        client->part[1] = client->snapshot->body;
+        client->part_len[1] = client->snapshot->body_len;
+    } else {
+        client->part[0] = NOT_FOUND;
+        client->part_len[0] = sizeof(NOT_FOUND) - 1;
+        state.rejected += 1;
+    }
+    return metrics_http_send(client);
+}
+
+// Only the request line matters, the rest of the request is read and dropped.
+static err_t metrics_http_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    METRICS_CLIENT_T *client = (METRICS_CLIENT_T *) arg;
+    if (!p) {
+        // Closed by the client, the response is abandoned if still going.
+        return metrics_http_close(client, client->unacked || (client->responding && client->next_part < 2));
+    }
+    tcp_recved(pcb, p->tot_len);
+    client->idle_polls = 0;
+    if (!client->responding) {
+        uint16_t room = sizeof(client->request) - 1 - client->request_len;
+        client->request_len += pbuf_copy_partial(p, &client->request[client->request_len], room, 0);
+        client->request[client->request_len] = 0;
+        if (strstr(client->request, "\r\n") || client->request_len == sizeof(client->request) - 1) {
+            pbuf_free(p);
+            return metrics_http_respond(client);
+        }
+    }
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static err_t metrics_http_poll(void *arg, struct tcp_pcb *pcb) {
+    METRICS_CLIENT_T *client = (METRICS_CLIENT_T *) arg;
+    if (++client->idle_polls >= METRICS_HTTP_TIMEOUT_POLLS) {
+        return metrics_http_close(client, true);
+    }
+    return client->responding ? metrics_http_send(client) : ERR_OK;
+}
+
+// lwIP has already freed the pcb.
+static void metrics_http_error(void *arg, err_t err) {
+    METRICS_CLIENT_T *client = (METRICS_CLIENT_T *) arg;
+    if (client->snapshot) {
+        client->snapshot->users -= 1;
+    }
+    client->pcb = NULL;
+}
+
+static err_t metrics_http_accept(void *arg, struct tcp_pcb *pcb, err_t err) {
+    if (err != ERR_OK || !pcb) {
+        return ERR_VAL;
+    }
+    METRICS_CLIENT_T *client = NULL;
+    for (uint i = 0; i < METRICS_HTTP_CLIENTS && !client; i++) {
+        if (!state.clients[i].pcb) {
+            client = &state.clients[i];
+        }
+    }
+    if (!client) {
+        state.refused += 1;
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    memset(client, 0, sizeof(METRICS_CLIENT_T));
+    client->pcb = pcb;
+    tcp_arg(pcb, client);
+    tcp_recv(pcb, metrics_http_recv);
+    tcp_sent(pcb, metrics_http_sent);
+    tcp_err(pcb, metrics_http_error);
+    tcp_poll(pcb, metrics_http_poll, METRICS_HTTP_POLL);
+    return ERR_OK;
+}
+
+void metrics_http_init(void) {
+    cyw43_arch_lwip_begin();
+    struct tcp_pcb *pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if (pcb && tcp_bind(pcb, NULL, METRICS_HTTP_PORT) == ERR_OK) {
+        state.listen = tcp_listen_with_backlog(pcb, METRICS_HTTP_CLIENTS);
+        tcp_accept(state.listen, metrics_http_accept);
+    }
+    cyw43_arch_lwip_end();
+    if (!state.listen) {
+        printf("failed to listen for metrics on port %u\n", METRICS_HTTP_PORT);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef _METRICS_HTTP_H
+#define _METRICS_HTTP_H
+
+#include "pico/stdlib.h"
+
+#include "src/mcp9808.h"
+
+// GET /metrics in the Prometheus text format, on the lwIP raw TCP API. The
+// response is written without copying: the status lines are static and the
+// body comes from one of two snapshot buffers, shared by every scrape in
+// METRICS_HTTP_MAX_AGE_MS and kept until the last of them has been acked.
+//
+// The body is sized for every family at full width with MCP9808_MAX_SENSORS
+// sensors and METRICS_HTTP_GPIO_PINS pins. A line that still doesn't fit is
+// dropped whole and counted in pico_metrics_truncated, the last line, which
+// always has room kept for it.
+//
+// Budget with the defaults: lwIP has 5 TCP pcbs (MEMP_NUM_TCP_PCB), 4 in the
+// minimal profile, and 16 pbufs for referenced data (MEMP_NUM_PBUF). A
+// response is a header and a body of up to five segments, as much of it
+// queued as TCP_SND_BUF takes: three pbufs in the minimal profile, so
+// METRICS_HTTP_CLIENTS scrapers need at most 9 of them, and six otherwise,
+// where a third scraper of a full body waits for the others' acks once the
+// pbufs run out. Each segment's headers are a small PBUF_RAM from MEM_SIZE,
+// and the requests lwIP receives are in the PBUF_POOL.
+
+#ifndef METRICS_HTTP_PORT
+#define METRICS_HTTP_PORT 80
+#endif
+#define METRICS_HTTP_CLIENTS 3
+#define METRICS_HTTP_SENSOR_LEN 288  // A sensor's temperature, three calls and alerts
+#define METRICS_HTTP_GPIO_LEN 128    // A pin's passed and suppressed edges
+#define METRICS_HTTP_GPIO_PINS 4
+#define METRICS_HTTP_FIXED_LEN 1408  // The rest, but for the truncated count
+#define METRICS_HTTP_TRAILER_LEN 72  // pico_metrics_truncated
+#define METRICS_HTTP_BODY_LEN (METRICS_HTTP_FIXED_LEN + MCP9808_MAX_SENSORS * METRICS_HTTP_SENSOR_LEN + \
+                               METRICS_HTTP_GPIO_PINS * METRICS_HTTP_GPIO_LEN + METRICS_HTTP_TRAILER_LEN)
+#define METRICS_HTTP_MAX_AGE_MS 1000
+#define METRICS_HTTP_REQUEST_LEN 128
+#define METRICS_HTTP_POLL 4          // TCP coarse timer ticks, 2s
+#define METRICS_HTTP_TIMEOUT_POLLS 3 // idle polls before a client is dropped
+
+// core0, after lwIP is up.
+void metrics_http_init(void);
+
+#endif
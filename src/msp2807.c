@@ -1,84 +1,170 @@
+#include <math.h>
 #include <stdio.h>
+#include "src/console.h"
+#include "src/core_msg.h"
+#include "src/gpio_event.h"
 #include "src/msp2807.h"
+#include "src/trace.h"
+#include "src/xpt2046.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
 #include "hardware/pwm.h"
 
-static volatile int backlight_brightness = BACKLIGHT_MAX;
-static volatile alarm_id_t alarm_id = 0;
-static volatile alarm_callback_t alarm_callback = NULL;
-
-void backlight_check_timer(alarm_id_t id) {
-    // if this timer firing is the one set by the touchscreen event
-    // then the timer is complete so it can be cleared.
-    if (id == alarm_id) {
-        printf("Alarm complete for id: %d\n", alarm_id);
-        alarm_id = 0;
-    }
+// The backlight fade runs without the CPU. A spare PWM slice wraps once per
+// fade step and paces two chained DMA channels that write the backlight
+// compare register: the hold channel repeats full brightness for the hold
+// time, then the fade channel walks a precomputed gamma table down to off.
+// A touch just restarts the hold channel.
+
+// The pace slice's slowest step, 133.7ms at 125MHz, bounds the fade at
+// BACKLIGHT_FADE_STEPS of them. The hold is counted in the same steps.
+#define PACE_CLKDIV 255
+#define PACE_WRAP_MAX 0x10000
+
+// Whole compare register values, the other channel of the backlight slice
+// is unused and gets 0.
+static uint32_t fade_table[BACKLIGHT_FADE_STEPS];
+static uint32_t hold_steps;
+static uint32_t fade_steps; // From the end of the table, only off without a fade
+static uint hold_dma;
+static uint fade_dma;
+// The curve as last set, written on core1 and read by the console on core0.
+static volatile uint32_t fade_hold_ms;
+static volatile uint32_t fade_fade_ms;
+static volatile uint8_t fade_gamma;
+
+static void backlight_start(uint32_t hold);
+
+void __not_in_flash_func(msp2807_reset_irq)(void) {
+    backlight_start(hold_steps);
+    TRACE0(TRACE_BACKLIGHT_WAKE);
 }
 
-void msp2807_reset_irq(void) {
-    backlight_brightness = BACKLIGHT_MAX;
-    pwm_set_gpio_level(BACKLIGHT_LED, (backlight_brightness * backlight_brightness));
-
-    // If active alarm then cancel it
-    if (alarm_id > 0) {
-        cancel_alarm(alarm_id);
-        printf("Cancel: %d ", alarm_id);
-    }
-    // Call alarm_callback in 60 seconds
-    alarm_id = add_alarm_in_ms(60000, alarm_callback, NULL, false);
-    printf("Set: %d ", alarm_id);
+static void touchscreen_task(uint gpio, uint32_t events) {
+    msp2807_reset_irq();
 }
 
-void touchscreen_init(gpio_irq_callback_t callback) {
-    gpio_set_irq_enabled(TOUCHSCREEN_IRQ, GPIO_IRQ_EDGE_FALL, true);
-    gpio_set_irq_callback(callback);
-    irq_set_enabled(IO_IRQ_BANK0, true);
+// PENIRQ's falling edge starts the sample burst in the interrupt, the
+// backlight is woken from the main loop.
+void touchscreen_init(void) {
+    xpt2046_init();
+    gpio_event_register(TOUCHSCREEN_IRQ, GPIO_IRQ_EDGE_FALL, TOUCHSCREEN_IRQ_HOLDOFF_MS, xpt2046_pen_irq, touchscreen_task);
     gpio_pull_up(TOUCHSCREEN_IRQ);
 }
 
+// Abort whatever part of the sequence is running and start again from full
+// brightness, hold is the number of steps to stay there.
+static void __not_in_flash_func(backlight_start)(uint32_t hold) {
+    // Abort the hold channel first, aborting it can trigger its chain.
+    dma_channel_abort(hold_dma);
+    dma_channel_abort(fade_dma);
 
-void backlight_pwm_wrap(void) {
-    static volatile int null_loop = 0;
+    pwm_hw->slice[pwm_gpio_to_slice_num(BACKLIGHT_LED)].cc = fade_table[0];
 
-    pwm_clear_irq(pwm_gpio_to_slice_num(BACKLIGHT_LED));
-
-    if (alarm_id != 0) {
-        return;
+    dma_channel_set_read_addr(fade_dma, &fade_table[BACKLIGHT_FADE_STEPS - fade_steps], false);
+    dma_channel_set_trans_count(fade_dma, fade_steps, false);
+    if (hold) {
+        dma_channel_set_trans_count(hold_dma, hold, true);
+    } else {
+        dma_channel_start(fade_dma);
     }
+}
 
-    // As we change the brightness in only 255 steps we need to
-    // lengthen the time it takes to perform the stepped fade.
-    if (null_loop <= BACKLIGHT_STEP) {
-        null_loop += 1;
-        return;
-    } else {
-        null_loop = 0;
+// The longest fade the pacing can run at the current clock.
+uint32_t backlight_fade_max_ms(void) {
+    return (uint32_t) ((uint64_t) BACKLIGHT_FADE_STEPS * PACE_CLKDIV * PACE_WRAP_MAX * 1000 / clock_get_hz(clk_sys));
+}
+
+// Can be called at any time, the new curve starts as if the screen had just
+// been touched. gamma is in tenths. A fade longer than backlight_fade_max_ms
+// runs at that. Without a fade the light goes off in one step after the
+// hold, which is then paced by the slowest step. core1 only, the console
+// sends it over.
+void backlight_set_fade(uint32_t hold_ms, uint32_t fade_ms, uint8_t gamma) {
+    uint shift = pwm_gpio_to_channel(BACKLIGHT_LED) ? 16 : 0;
+    uint64_t clk_khz = clock_get_hz(clk_sys) / 1000;
+
+    dma_channel_abort(hold_dma);
+    dma_channel_abort(fade_dma);
+
+    // Only done when the curve changes so the float maths does not matter.
+    for (uint i = 0; i < BACKLIGHT_FADE_STEPS; i++) {
+        float x = (float) (BACKLIGHT_FADE_STEPS - 1 - i) / (BACKLIGHT_FADE_STEPS - 1);
+        uint32_t level = (uint32_t) (powf(x, gamma / 10.f) * 0xFFFF + .5f);
+        fade_table[i] = level << shift;
     }
 
-    pwm_set_gpio_level(BACKLIGHT_LED, (backlight_brightness * backlight_brightness));
-    if (backlight_brightness == 0) {
-        return;
+    // The pacing slice runs at the slowest divider, one wrap per step.
+    uint64_t wrap = PACE_WRAP_MAX;
+    fade_steps = 1;
+    if (fade_ms) {
+        wrap = (uint64_t) fade_ms * clk_khz / ((uint64_t) PACE_CLKDIV * BACKLIGHT_FADE_STEPS);
+        wrap = wrap > PACE_WRAP_MAX ? PACE_WRAP_MAX : wrap < 1 ? 1 : wrap;
+        fade_steps = BACKLIGHT_FADE_STEPS;
     }
+    pwm_config pace_config = pwm_get_default_config();
+    pwm_config_set_clkdiv_int(&pace_config, PACE_CLKDIV);
+    pwm_config_set_wrap(&pace_config, (uint16_t) (wrap - 1));
+    pwm_init(BACKLIGHT_PACE_SLICE, &pace_config, true);
+
+    // From the step the slice actually runs, in 64 bits as hold_ms * clk_khz
+    // overflows past 34 seconds.
+    uint64_t step_cycles = PACE_CLKDIV * wrap;
+    uint64_t steps = (uint64_t) hold_ms * clk_khz / step_cycles;
+    hold_steps = steps > UINT32_MAX ? UINT32_MAX : (uint32_t) steps;
+    fade_hold_ms = hold_ms;
+    fade_fade_ms = fade_ms ? (uint32_t) ((BACKLIGHT_FADE_STEPS * step_cycles + clk_khz / 2) / clk_khz) : 0;
+    fade_gamma = gamma;
+    backlight_start(hold_steps);
+}
 
-    // printf("brightness: %i\n", brightness);
-    backlight_brightness -= 1;
-    if (backlight_brightness <= 0) {
-        backlight_brightness = 0;
+static void backlight_command(const char *args) {
+    unsigned hold, fade, gamma = BACKLIGHT_GAMMA;
+    int fields = sscanf(args, "%u %u %u", &hold, &fade, &gamma);
+
+    if (fields >= 2 && fade <= UINT8_MAX && fade * 1000 > backlight_fade_max_ms()) {
+        printf("fade at most %lus at this clock\n", (unsigned long) (backlight_fade_max_ms() / 1000));
+    } else if (fields < 2 || hold > UINT16_MAX || fade > UINT8_MAX || gamma > UINT8_MAX) {
+        printf("hold %lus fade %lus gamma %u.%u, backlight <hold s> <fade s> [gamma, tenths]\n",
+            (unsigned long) (fade_hold_ms / 1000), (unsigned long) (fade_fade_ms / 1000), fade_gamma / 10, fade_gamma % 10);
+    } else if (!core_msg_send(CORE_MSG_BACKLIGHT_FADE, hold << 16 | fade << 8 | gamma)) {
+        printf("display core busy, try again\n");
     }
 }
 
+void backlight_console_init(void) {
+    console_register("backlight", "backlight hold, fade and curve, backlight <hold s> <fade s> [gamma] to set", backlight_command);
+}
 
-void backlight_init(alarm_callback_t callback) {
-    alarm_callback = callback;
+void backlight_init(void) {
     gpio_set_function(BACKLIGHT_LED, GPIO_FUNC_PWM);
     uint backlight_slice = pwm_gpio_to_slice_num(BACKLIGHT_LED);
-    pwm_clear_irq(backlight_slice);
-    pwm_set_irq_enabled(backlight_slice, true);
-    irq_set_exclusive_handler(PWM_IRQ_WRAP, backlight_pwm_wrap);
-    irq_set_enabled(PWM_IRQ_WRAP, true);
     pwm_config backlight_config = pwm_get_default_config();
     pwm_config_set_clkdiv(&backlight_config, 4.f);
     pwm_init(backlight_slice, &backlight_config, true);
-}
-
 
+    volatile void *cc = &pwm_hw->slice[backlight_slice].cc;
+    uint pace_dreq = pwm_get_dreq(BACKLIGHT_PACE_SLICE);
+
+    hold_dma = dma_claim_unused_channel(true);
+    fade_dma = dma_claim_unused_channel(true);
+
+    dma_channel_config fade_config = dma_channel_get_default_config(fade_dma);
+    channel_config_set_transfer_data_size(&fade_config, DMA_SIZE_32);
+    channel_config_set_read_increment(&fade_config, true);
+    channel_config_set_write_increment(&fade_config, false);
+    channel_config_set_dreq(&fade_config, pace_dreq);
+    dma_channel_configure(fade_dma, &fade_config, cc, fade_table, BACKLIGHT_FADE_STEPS, false);
+
+    dma_channel_config hold_config = dma_channel_get_default_config(hold_dma);
+    channel_config_set_transfer_data_size(&hold_config, DMA_SIZE_32);
+    channel_config_set_read_increment(&hold_config, false);
+    channel_config_set_write_increment(&hold_config, false);
+    channel_config_set_dreq(&hold_config, pace_dreq);
+    channel_config_set_chain_to(&hold_config, fade_dma);
+    dma_channel_configure(hold_dma, &hold_config, cc, &fade_table[0], 0, false);
+
+    backlight_set_fade(BACKLIGHT_HOLD_MS, BACKLIGHT_FADE_MS, BACKLIGHT_GAMMA);
+    // As before, fade straight away after power on until the screen is touched.
+    backlight_start(0);
+}
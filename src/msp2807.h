@@ -5,13 +5,18 @@
 
 #define BACKLIGHT_LED 7
 #define TOUCHSCREEN_IRQ 3
-#define BACKLIGHT_MAX 0xFF
-#define BACKLIGHT_STEP 35
+#define TOUCHSCREEN_IRQ_HOLDOFF_MS 5 // PENIRQ edges closer than this are one
+#define BACKLIGHT_PACE_SLICE 7 // Spare PWM slice, only its wrap is used to pace the fade DMA
+#define BACKLIGHT_FADE_STEPS 256
+#define BACKLIGHT_HOLD_MS (60 * 1000)
+#define BACKLIGHT_FADE_MS (20 * 1000)
+#define BACKLIGHT_GAMMA 20 // In tenths, 2.0 is the old brightness squared curve
 
-void backlight_pwm_wrap(void);
-void backlight_init(alarm_callback_t callback);
-void backlight_check_timer(alarm_id_t id);
-void touchscreen_init(gpio_irq_callback_t callback);
+void backlight_init(void);
+void backlight_set_fade(uint32_t hold_ms, uint32_t fade_ms, uint8_t gamma);
+uint32_t backlight_fade_max_ms(void);
+void backlight_console_init(void);
+void touchscreen_init(void);
 void msp2807_reset_irq(void);
 
 #endif
\ No newline at end of file
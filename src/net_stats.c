@@ -0,0 +1,58 @@
+#include "pico/cyw43_arch.h"
+#include "lwip/stats.h"
+
+#include "src/console.h"
+#include "src/net_stats.h"
+
+// lwIP only names the pools in debug builds.
+#define LWIP_MEMPOOL(name, num, size, desc) desc,
+static const char *const names[MEMP_MAX] = {
+#include "lwip/priv/memp_std.h"
+};
+
+static void net_stats_copy(net_pool_stats_t *pool, const char *name, const struct stats_mem *stats) {
+    pool->name = name;
+    pool->size = (uint16_t) stats->avail;
+    pool->used = (uint16_t) stats->used;
+    pool->peak = (uint16_t) stats->max;
+    pool->failed = (uint16_t) stats->err;
+}
+
+uint net_stats_get(net_pool_stats_t *pools, uint count) {
+    cyw43_arch_lwip_begin();
+    if (count) {
+        net_stats_copy(&pools[0], "MEM", &lwip_stats.mem);
+    }
+    for (uint i = 0; i < MEMP_MAX && i + 1 < count; i++) {
+        net_stats_copy(&pools[i + 1], names[i], lwip_stats.memp[i]);
+    }
+    cyw43_arch_lwip_end();
+    return NET_STATS_POOLS;
+}
+
+void net_stats_reset(void) {
+    cyw43_arch_lwip_begin();
+    lwip_stats.mem.max = lwip_stats.mem.used;
+    for (uint i = 0; i < MEMP_MAX; i++) {
+        lwip_stats.memp[i]->max = lwip_stats.memp[i]->used;
+    }
+    cyw43_arch_lwip_end();
+}
+
+static void net_stats_command(const char *args) {
+    net_pool_stats_t pools[NET_STATS_POOLS];
+
+    if (!strcmp(args, "reset")) {
+        net_stats_reset();
+        return;
+    }
+    net_stats_get(pools, NET_STATS_POOLS);
+    printf("%-16s %5s %5s %5s %6s\n", "pool", "used", "peak", "size", "failed");
+    for (uint i = 0; i < NET_STATS_POOLS; i++) {
+        printf("%-16s %5u %5u %5u %6u\n", pools[i].name, pools[i].used, pools[i].peak, pools[i].size, pools[i].failed);
+    }
+}
+
+void net_stats_init(void) {
+    console_register("lwip", "lwIP heap and pool use and peaks, lwip reset for new peaks", net_stats_command);
+}
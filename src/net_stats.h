@@ -0,0 +1,29 @@
+#ifndef _NET_STATS_H
+#define _NET_STATS_H
+
+#include "pico/stdlib.h"
+#include "lwip/memp.h"
+
+// lwIP's memory use against the sizes in include/lwipopts.h, from the
+// counters lwIP keeps with MEM_STATS and MEMP_STATS: the MEM_SIZE heap first,
+// in bytes, then each memp pool. Peaks are since boot or the last reset. The
+// "lwip" console command prints the table, lwip reset starts new peaks.
+//
+// core0, as lwIP is.
+
+#define NET_STATS_POOLS (MEMP_MAX + 1)
+
+typedef struct {
+    const char *name;
+    uint16_t size;
+    uint16_t used;
+    uint16_t peak;
+    uint16_t failed; // Allocations refused
+} net_pool_stats_t;
+
+void net_stats_init(void);
+// Fills up to count entries and returns how many there are.
+uint net_stats_get(net_pool_stats_t *pools, uint count);
+void net_stats_reset(void);
+
+#endif
@@ -0,0 +1,120 @@
+#include "hardware/sync.h"
+
+#include "src/ntp_clock.h"
+
+// The clock is a line from the anchor: time runs at 1 + freq, plus slew for
+// the first slew_us microseconds after the anchor, which adds up to the
+// offset being slewed out. Each adjustment re-anchors at the current reading
+// so the clock is continuous, and the rate never drops below 0.999 so it
+// always moves forwards. The rates are also kept as fractions of 2^32 so a
+// reading is multiplies and shifts, the M0+ has no 64 bit divide.
+typedef struct {
+    uint64_t anchor_timer;
+    uint64_t anchor_utc;
+    int32_t freq_ppb;
+    int32_t slew_ppb;
+    int32_t freq_frac;
+    int32_t slew_frac;
+    uint64_t slew_us;
+    uint64_t last_adjust;
+    bool synced;
+} NTP_CLOCK_T;
+
+// Readers retry while seq is odd or has changed, the writer has interrupts
+// off so a reader on core0 never spins on an update it interrupted.
+static NTP_CLOCK_T state;
+static volatile uint32_t seq = 0;
+
+static void ntp_clock_read(NTP_CLOCK_T *copy) {
+    uint32_t s;
+    do {
+        s = seq;
+        __mem_fence_acquire();
+        *copy = state;
+        __mem_fence_acquire();
+    } while ((s & 1) || s != seq);
+}
+
+// us * frac / 2^32, split so it can't overflow for any sane elapsed time.
+static inline int64_t ntp_clock_scale(int64_t us, int32_t frac) {
+    return ((us >> 16) * frac + (((us & 0xFFFF) * frac) >> 16)) >> 16;
+}
+
+static int32_t ntp_clock_frac(int32_t ppb) {
+    return (int32_t) (((int64_t) ppb << 32) / 1000000000);
+}
+
+static uint64_t ntp_clock_at(const NTP_CLOCK_T *c, uint64_t timer_us) {
+    // Before the anchor only happens for a reading taken before an update.
+    int64_t elapsed = (int64_t) (timer_us - c->anchor_timer);
+    int64_t slewed = elapsed;
+    if (elapsed > (int64_t) c->slew_us) {
+        slewed = (int64_t) c->slew_us;
+    } else if (elapsed < 0) {
+        slewed = 0;
+    }
+    return c->anchor_utc + elapsed + ntp_clock_scale(elapsed, c->freq_frac) + ntp_clock_scale(slewed, c->slew_frac);
+}
+
+bool ntp_clock_synced(void) {
+    return state.synced;
+}
+
+uint64_t ntp_clock_at_us(uint64_t timer_us) {
+    NTP_CLOCK_T c;
+    ntp_clock_read(&c);
+    return ntp_clock_at(&c, timer_us);
+}
+
+uint64_t ntp_clock_now_us(void) {
+    return ntp_clock_at_us(time_us_64());
+}
+
+int32_t ntp_clock_freq_ppb(void) {
+    return state.freq_ppb;
+}
+
+ntp_clock_result_t ntp_clock_adjust(int64_t offset_us, uint64_t timer_us) {
+    NTP_CLOCK_T c = state;
+    ntp_clock_result_t result = NTP_CLOCK_SLEWED;
+    uint64_t now = ntp_clock_at(&c, timer_us);
+
+    if (!c.synced || offset_us > NTP_CLOCK_STEP_US) {
+        c.anchor_utc = now + offset_us;
+        c.slew_ppb = 0;
+        c.slew_us = 0;
+        result = NTP_CLOCK_STEPPED;
+    } else {
+        // Less any slew still to run, what is left is frequency error since
+        // the last adjustment.
+        if (c.last_adjust && timer_us > c.last_adjust) {
+            uint64_t elapsed = timer_us - c.anchor_timer;
+            int64_t unslewed = elapsed < c.slew_us ? (int64_t) (c.slew_us - elapsed) * c.slew_ppb / 1000000000 : 0;
+            int64_t error = (offset_us - unslewed) * 1000000000 / (int64_t) (timer_us - c.last_adjust);
+            int64_t freq = c.freq_ppb + (error >> NTP_CLOCK_FREQ_SHIFT);
+            if (freq > NTP_CLOCK_FREQ_MAX_PPB) {
+                freq = NTP_CLOCK_FREQ_MAX_PPB;
+            } else if (freq < -NTP_CLOCK_FREQ_MAX_PPB) {
+                freq = -NTP_CLOCK_FREQ_MAX_PPB;
+            }
+            c.freq_ppb = (int32_t) freq;
+        }
+        c.anchor_utc = now;
+        c.slew_ppb = offset_us < 0 ? -NTP_CLOCK_SLEW_PPB : NTP_CLOCK_SLEW_PPB;
+        c.slew_us = (uint64_t) (offset_us < 0 ? -offset_us : offset_us) * 1000000000 / NTP_CLOCK_SLEW_PPB;
+    }
+    c.freq_frac = ntp_clock_frac(c.freq_ppb);
+    c.slew_frac = ntp_clock_frac(c.slew_ppb);
+    c.anchor_timer = timer_us;
+    c.last_adjust = timer_us;
+    c.synced = true;
+
+    uint32_t save = save_and_disable_interrupts();
+    seq += 1;
+    __mem_fence_release();
+    state = c;
+    __mem_fence_release();
+    seq += 1;
+    restore_interrupts(save);
+    return result;
+}
@@ -0,0 +1,35 @@
+#ifndef _NTP_CLOCK_H
+#define _NTP_CLOCK_H
+
+#include "pico/stdlib.h"
+
+// Local wall clock in microseconds since 1970, derived from the 64 bit
+// microsecond timer and disciplined by NTP. Corrections are slewed, the
+// clock only ever steps forwards (and on the first sync), so readings never
+// go backwards. Until the first sync it counts from boot.
+//
+// NTP on core0 is the only writer, any core or interrupt may read.
+
+// Offsets above this are stepped if positive, everything else is slewed.
+#define NTP_CLOCK_STEP_US 128000
+// Rate the clock runs fast or slow by while slewing, and the limit of the
+// frequency correction, in parts per billion.
+#define NTP_CLOCK_SLEW_PPB 500000
+#define NTP_CLOCK_FREQ_MAX_PPB 500000
+// The frequency takes 1/2^NTP_CLOCK_FREQ_SHIFT of each measured error.
+#define NTP_CLOCK_FREQ_SHIFT 1
+
+typedef enum {
+    NTP_CLOCK_SLEWED,
+    NTP_CLOCK_STEPPED,
+} ntp_clock_result_t;
+
+bool ntp_clock_synced(void);
+uint64_t ntp_clock_now_us(void);
+// The clock reading for an earlier or later time_us_64() value.
+uint64_t ntp_clock_at_us(uint64_t timer_us);
+// offset_us is how far the clock was behind the reference at timer_us.
+ntp_clock_result_t ntp_clock_adjust(int64_t offset_us, uint64_t timer_us);
+int32_t ntp_clock_freq_ppb(void);
+
+#endif
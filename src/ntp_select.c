@@ -0,0 +1,145 @@
+#include <stdlib.h>
+
+#include "src/ntp_select.h"
+
+typedef struct {
+    int64_t value;
+    int8_t type; // +1 lower end, 0 midpoint, -1 upper end
+} NTP_ENDPOINT_T;
+
+void ntp_filter_reset(ntp_filter_t *filter) {
+    filter->count = 0;
+}
+
+void ntp_filter_add(ntp_filter_t *filter, const ntp_sample_t *sample) {
+    if (filter->count < NTP_FILTER_SAMPLES) {
+        filter->sample[filter->count++] = *sample;
+    }
+}
+
+static uint32_t ntp_isqrt(uint64_t value) {
+    uint64_t root = 0;
+    uint64_t bit = (uint64_t) 1 << 62;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t) root;
+}
+
+// The lowest delay sample has the least room for asymmetry so its offset is
+// taken. Jitter is the RMS difference of the other offsets from it.
+bool ntp_filter_peer(const ntp_filter_t *filter, ntp_peer_t *peer) {
+    if (!filter->count) {
+        return false;
+    }
+    const ntp_sample_t *best = &filter->sample[0];
+    for (uint i = 1; i < filter->count; i++) {
+        if (filter->sample[i].delay_us < best->delay_us) {
+            best = &filter->sample[i];
+        }
+    }
+
+    uint64_t sum = 0;
+    for (uint i = 0; i < filter->count; i++) {
+        int64_t diff = filter->sample[i].offset_us - best->offset_us;
+        sum += (uint64_t) (diff * diff);
+    }
+    uint32_t jitter = filter->count > 1 ? ntp_isqrt(sum / (filter->count - 1)) : 0;
+    int64_t delay = best->delay_us > 0 ? best->delay_us : 0;
+
+    peer->offset_us = best->offset_us;
+    peer->delay_us = best->delay_us;
+    peer->jitter_us = jitter;
+    // Never zero, the weights divide by it.
+    peer->distance_us = (uint32_t) (delay / 2) + best->root_us + jitter + 1;
+    peer->timer_us = best->timer_us;
+    return true;
+}
+
+static int ntp_endpoint_compare(const void *a, const void *b) {
+    int64_t va = ((const NTP_ENDPOINT_T *) a)->value;
+    int64_t vb = ((const NTP_ENDPOINT_T *) b)->value;
+    return va < vb ? -1 : va > vb;
+}
+
+uint ntp_select(const ntp_peer_t *peers, uint count, int64_t *offset_us, uint64_t *timer_us) {
+    NTP_ENDPOINT_T endpoints[3 * NTP_SELECT_MAX_PEERS];
+    int64_t low = 0;
+    int64_t high = 0;
+    uint n = count < NTP_SELECT_MAX_PEERS ? count : NTP_SELECT_MAX_PEERS;
+    uint allow;
+
+    if (!n) {
+        return 0;
+    }
+    for (uint i = 0; i < n; i++) {
+        endpoints[3 * i] = (NTP_ENDPOINT_T) {peers[i].offset_us - peers[i].distance_us, 1};
+        endpoints[3 * i + 1] = (NTP_ENDPOINT_T) {peers[i].offset_us, 0};
+        endpoints[3 * i + 2] = (NTP_ENDPOINT_T) {peers[i].offset_us + peers[i].distance_us, -1};
+    }
+    qsort(endpoints, 3 * n, sizeof(endpoints[0]), ntp_endpoint_compare);
+
+    // Find the smallest number of falsetickers that leaves an interval where
+    // the rest overlap, with no more midpoints outside it than falsetickers.
+    for (allow = 0; 2 * allow < n; allow++) {
+        uint found = 0;
+        int chime = 0;
+        for (uint i = 0; i < 3 * n; i++) {
+            chime += endpoints[i].type;
+            if (chime >= (int) (n - allow)) {
+                low = endpoints[i].value;
+                break;
+            }
+            if (endpoints[i].type == 0) {
+                found++;
+            }
+        }
+        chime = 0;
+        for (int i = 3 * n - 1; i >= 0; i--) {
+            chime -= endpoints[i].type;
+            if (chime >= (int) (n - allow)) {
+                high = endpoints[i].value;
+                break;
+            }
+            if (endpoints[i].type == 0) {
+                found++;
+            }
+        }
+        if (found <= allow && low < high) {
+            break;
+        }
+    }
+    if (2 * allow >= n) {
+        return 0;
+    }
+
+    // Truechimers are those whose interval meets the intersection, combined
+    // with weights of 1/distance.
+    uint survivors = 0;
+    int64_t weighted = 0;
+    uint64_t weights = 0;
+    *timer_us = 0;
+    for (uint i = 0; i < n; i++) {
+        if (peers[i].offset_us + peers[i].distance_us < low || peers[i].offset_us - peers[i].distance_us > high) {
+            continue;
+        }
+        uint64_t weight = ((uint64_t) 1 << 32) / peers[i].distance_us;
+        weighted += (peers[i].offset_us - low) * (int64_t) weight;
+        weights += weight;
+        if (peers[i].timer_us > *timer_us) {
+            *timer_us = peers[i].timer_us;
+        }
+        survivors++;
+    }
+    *offset_us = low + weighted / (int64_t) weights;
+    return survivors;
+}
@@ -0,0 +1,44 @@
+#ifndef _NTP_SELECT_H
+#define _NTP_SELECT_H
+
+#include "pico/stdlib.h"
+
+// NTP sample processing, after RFC 5905. Each server's replies from one
+// burst go through a clock filter that keeps the lowest delay sample and
+// measures the jitter of the rest. The selection then intersects the
+// servers' correctness intervals (offset +- root distance) to find the
+// majority that agree, and combines the survivors weighted by distance.
+
+#define NTP_FILTER_SAMPLES 8
+#define NTP_SELECT_MAX_PEERS 8
+
+typedef struct {
+    int64_t offset_us;
+    int64_t delay_us;
+    uint32_t root_us;  // Server's root delay / 2 + root dispersion
+    uint64_t timer_us; // time_us_64() when the reply arrived
+} ntp_sample_t;
+
+typedef struct {
+    ntp_sample_t sample[NTP_FILTER_SAMPLES];
+    uint8_t count;
+} ntp_filter_t;
+
+typedef struct {
+    int64_t offset_us;
+    int64_t delay_us;
+    uint32_t jitter_us;
+    uint32_t distance_us;
+    uint64_t timer_us;
+} ntp_peer_t;
+
+void ntp_filter_reset(ntp_filter_t *filter);
+// Drops the sample if the filter is full.
+void ntp_filter_add(ntp_filter_t *filter, const ntp_sample_t *sample);
+bool ntp_filter_peer(const ntp_filter_t *filter, ntp_peer_t *peer);
+
+// Returns the number of survivors, 0 if no majority agrees. offset_us is the
+// combined offset as at timer_us, the latest reply of the survivors.
+uint ntp_select(const ntp_peer_t *peers, uint count, int64_t *offset_us, uint64_t *timer_us);
+
+#endif
@@ -0,0 +1,266 @@
+#include "pico/cyw43_arch.h"
+#include "pico/unique_id.h"
+#include "hardware/sync.h"
+#include "lwip/udp.h"
+
+#include "src/console.h"
+#include "src/telemetry.h"
+#include "src/timer_wheel.h"
+#include "src/wall_clock.h"
+#include "src/wifi_link.h"
+
+#define TELEMETRY_PAYLOAD_LEN (TELEMETRY_HEADER_LEN + TELEMETRY_MAX_RECORDS * TELEMETRY_RECORD_LEN)
+// lwIP puts the UDP, IP and link headers in front of the payload.
+#define TELEMETRY_HEADROOM LWIP_MEM_ALIGN_SIZE(PBUF_TRANSPORT)
+// The interval flush can share another timer's wakeup.
+#define TELEMETRY_FLUSH_SLACK_MS (TELEMETRY_FLUSH_MS / 8)
+
+static_assert((TELEMETRY_RING_SIZE & (TELEMETRY_RING_SIZE - 1)) == 0, "TELEMETRY_RING_SIZE must be a power of two");
+static_assert(TELEMETRY_FLUSH_BYTES <= TELEMETRY_PAYLOAD_LEN, "TELEMETRY_FLUSH_BYTES must fit a datagram");
+
+typedef struct {
+    uint8_t type;
+    uint8_t addr;
+    uint16_t value;
+    uint32_t time;
+} telemetry_record_t;
+
+// The memory follows the pbuf so lwIP's check that a PBUF_RAM header stays
+// after the struct passes and the headers are added in place, not chained.
+typedef struct {
+    struct pbuf_custom pc;
+    bool in_use;
+    uint8_t mem[TELEMETRY_HEADROOM + TELEMETRY_PAYLOAD_LEN] __attribute__((aligned(4)));
+} TELEMETRY_BUF_T;
+
+typedef struct {
+    TELEMETRY_BUF_T *buf; // Being filled, NULL when there is nothing to send
+    uint8_t count;
+    uint32_t base_time;
+    absolute_time_t flush_at;
+    timer_wheel_timer_t flush_timer;
+    uint16_t sequence;
+    ip_addr_t collector;
+    uint16_t port;
+    struct udp_pcb *pcb;
+    uint32_t sent;
+    uint32_t send_errors;
+    uint32_t pool_empty;
+    bool link_up;
+} TELEMETRY_T;
+
+// Single producer (core1) and single consumer (core0), as core_msg.
+static telemetry_record_t ring[TELEMETRY_RING_SIZE];
+static volatile uint32_t head = 0;
+static volatile uint32_t tail = 0;
+static volatile uint32_t dropped = 0;
+
+static TELEMETRY_BUF_T pool[TELEMETRY_POOL_SIZE];
+static TELEMETRY_T state;
+static pico_unique_board_id_t board_id;
+
+bool telemetry_push(telemetry_type_t type, uint8_t addr, uint16_t value) {
+    uint32_t h = head;
+    if (h - tail == TELEMETRY_RING_SIZE) {
+        dropped += 1;
+        return false;
+    }
+    telemetry_record_t *record = &ring[h & (TELEMETRY_RING_SIZE - 1)];
+    record->type = (uint8_t) type;
+    record->addr = addr;
+    record->value = value;
+    record->time = wall_clock_seconds();
+    __mem_fence_release();
+    head = h + 1;
+    __sev();
+    return true;
+}
+
+// The record is only taken off the ring with telemetry_pop, so it can wait
+// there for a buffer.
+static bool telemetry_peek(telemetry_record_t *record) {
+    uint32_t t = tail;
+    if (head == t) {
+        return false;
+    }
+    __mem_fence_acquire();
+    *record = ring[t & (TELEMETRY_RING_SIZE - 1)];
+    return true;
+}
+
+static void telemetry_pop(void) {
+    __mem_fence_release();
+    tail = tail + 1;
+}
+
+// lwIP calls this when it drops its last reference, which is after the
+// driver has copied the frame out, or later if it was queued for ARP.
+static void telemetry_buf_free(struct pbuf *p) {
+    TELEMETRY_BUF_T *buf = (TELEMETRY_BUF_T *) p;
+    buf->in_use = false;
+    __sev(); // Records may be waiting for it
+}
+
+static TELEMETRY_BUF_T *telemetry_buf_get(void) {
+    for (uint i = 0; i < TELEMETRY_POOL_SIZE; i++) {
+        if (!pool[i].in_use) {
+            pool[i].in_use = true;
+            pool[i].pc.custom_free_function = telemetry_buf_free;
+            return &pool[i];
+        }
+    }
+    return NULL;
+}
+
+static void telemetry_put_u16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t) (value >> 8);
+    p[1] = (uint8_t) value;
+}
+
+static void telemetry_put_u32(uint8_t *p, uint32_t value) {
+    telemetry_put_u16(p, (uint16_t) (value >> 16));
+    telemetry_put_u16(p + 2, (uint16_t) value);
+}
+
+static void telemetry_flush(void) {
+    TELEMETRY_BUF_T *buf = state.buf;
+    if (!buf) {
+        return;
+    }
+    state.buf = NULL;
+    timer_wheel_cancel(&state.flush_timer);
+
+    uint8_t *payload = &buf->mem[TELEMETRY_HEADROOM];
+    uint16_t len = (uint16_t) (TELEMETRY_HEADER_LEN + state.count * TELEMETRY_RECORD_LEN);
+    payload[0] = 'T';
+    payload[1] = 'M';
+    payload[2] = TELEMETRY_VERSION;
+    payload[3] = state.count;
+    telemetry_put_u16(&payload[4], state.sequence++);
+    memcpy(&payload[6], board_id.id, 8);
+    telemetry_put_u32(&payload[14], state.base_time);
+
+    cyw43_arch_lwip_begin();
+    struct pbuf *p = pbuf_alloced_custom(PBUF_TRANSPORT, len, PBUF_RAM, &buf->pc, buf->mem, sizeof(buf->mem));
+    if (!p) {
+        buf->in_use = false;
+        state.send_errors += 1;
+    } else {
+        if (udp_sendto(state.pcb, p, &state.collector, state.port) == ERR_OK) {
+            state.sent += 1;
+        } else {
+            state.send_errors += 1;
+        }
+        pbuf_free(p);
+    }
+    cyw43_arch_lwip_end();
+}
+
+// Wakes core0 for the interval flush, telemetry_task does the work.
+static uint32_t telemetry_alarm(timer_wheel_timer_t *timer) {
+    __sev();
+    return 0;
+}
+
+// Starts a new datagram for a record that doesn't fit the current one.
+static bool telemetry_add(const telemetry_record_t *record) {
+    if (state.buf && (state.count == TELEMETRY_MAX_RECORDS || record->time - state.base_time > UINT16_MAX)) {
+        telemetry_flush();
+    }
+    if (!state.buf) {
+        state.buf = telemetry_buf_get();
+        if (!state.buf) {
+            return false;
+        }
+        state.count = 0;
+        state.base_time = record->time;
+        state.flush_at = make_timeout_time_ms(TELEMETRY_FLUSH_MS);
+        timer_wheel_add(&state.flush_timer, TELEMETRY_FLUSH_MS);
+    }
+    // Before the first sync the base is 0 and later records are clamped to it.
+    uint16_t offset = record->time > state.base_time ? (uint16_t) (record->time - state.base_time) : 0;
+    uint8_t *p = &state.buf->mem[TELEMETRY_HEADROOM + TELEMETRY_HEADER_LEN + state.count * TELEMETRY_RECORD_LEN];
+    p[0] = record->type;
+    p[1] = record->addr;
+    telemetry_put_u16(&p[2], offset);
+    telemetry_put_u16(&p[4], record->value);
+    state.count += 1;
+    return true;
+}
+
+// Records stay on the ring while the pool is empty or the link is down, and
+// are discarded while there is no collector.
+void telemetry_task(void) {
+    telemetry_record_t record;
+    if (!state.link_up) {
+        return;
+    }
+    while (telemetry_peek(&record)) {
+        if (ip_addr_isany(&state.collector)) {
+            telemetry_pop();
+            continue;
+        }
+        if (!telemetry_add(&record)) {
+            state.pool_empty += 1;
+            break;
+        }
+        telemetry_pop();
+        if (TELEMETRY_HEADER_LEN + state.count * TELEMETRY_RECORD_LEN >= TELEMETRY_FLUSH_BYTES) {
+            telemetry_flush();
+        }
+    }
+    if (state.buf && absolute_time_diff_us(get_absolute_time(), state.flush_at) <= 0) {
+        telemetry_flush();
+    }
+}
+
+void telemetry_get_stats(telemetry_stats_t *stats) {
+    stats->sent = state.sent;
+    stats->send_errors = state.send_errors;
+    stats->dropped = dropped;
+}
+
+static void telemetry_command(const char *args) {
+    char address[16];
+    unsigned port = TELEMETRY_PORT;
+    if (sscanf(args, "%15s %u", address, &port) >= 1) {
+        ip_addr_t collector;
+        if (!ipaddr_aton(address, &collector) || port == 0 || port > UINT16_MAX) {
+            printf("usage: telemetry [address [port]]\n");
+            return;
+        }
+        state.collector = collector;
+        state.port = (uint16_t) port;
+    }
+    uint in_use = 0;
+    for (uint i = 0; i < TELEMETRY_POOL_SIZE; i++) {
+        in_use += pool[i].in_use;
+    }
+    printf("collector %s:%u sent %lu errors %lu dropped %lu pool empty %lu buffers in use %u/%u\n",
+        ip_addr_isany(&state.collector) ? "none" : ipaddr_ntoa(&state.collector), state.port,
+        (unsigned long) state.sent, (unsigned long) state.send_errors, (unsigned long) dropped,
+        (unsigned long) state.pool_empty, in_use, TELEMETRY_POOL_SIZE);
+}
+
+// What was held while the link was down goes out on the next pass.
+static void telemetry_link(bool up) {
+    state.link_up = up;
+}
+
+void telemetry_init(void) {
+    pico_get_unique_board_id(&board_id);
+    timer_wheel_timer_init(&state.flush_timer, telemetry_alarm, NULL, TELEMETRY_FLUSH_SLACK_MS);
+    state.port = TELEMETRY_PORT;
+    if (TELEMETRY_COLLECTOR[0] && !ipaddr_aton(TELEMETRY_COLLECTOR, &state.collector)) {
+        printf("Bad TELEMETRY_COLLECTOR %s \n", TELEMETRY_COLLECTOR);
+    }
+    cyw43_arch_lwip_begin();
+    state.pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    cyw43_arch_lwip_end();
+    if (!state.pcb) {
+        printf("failed to create telemetry pcb\n");
+        return;
+    }
+    wifi_link_subscribe(telemetry_link);
+    console_register("telemetry", "collector and counts, telemetry <address> [port] to set", telemetry_command);
+}
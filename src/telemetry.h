@@ -0,0 +1,64 @@
+#ifndef _TELEMETRY_H
+#define _TELEMETRY_H
+
+#include "pico/stdlib.h"
+
+// Sensor readings and alerts batched into UDP datagrams for a collector.
+// core1 pushes records onto a lock free ring, core0 packs them into buffers
+// from a fixed pool of custom pbufs and sends a datagram when it reaches
+// TELEMETRY_FLUSH_BYTES or TELEMETRY_FLUSH_MS after its first record.
+//
+// Datagram, all fields big endian:
+//   "TM", version 1, record count, u16 sequence, 8 byte board id,
+//   u32 base time (seconds since 1970, 0 before the first NTP sync),
+//   then per record: type, sensor (see mcp9808.h), u16 seconds after base, u16 value.
+// A TELEMETRY_TEMP value is the MCP9808 ambient register as read, limit
+// flags in bits 15-13 and sixteenths of a °C below. A TELEMETRY_ALERT value
+// is the config register the alert was found with.
+//
+// Nothing is sent while the Wi-Fi link is down, records wait on the ring and
+// those that don't fit are dropped.
+//
+// tools/telemetry_listen.py receives and prints them.
+
+#ifndef TELEMETRY_COLLECTOR
+#define TELEMETRY_COLLECTOR "" // Off until set with the telemetry command
+#endif
+#ifndef TELEMETRY_PORT
+#define TELEMETRY_PORT 5140
+#endif
+#ifndef TELEMETRY_FLUSH_MS
+#define TELEMETRY_FLUSH_MS (60 * 1000)
+#endif
+#ifndef TELEMETRY_FLUSH_BYTES
+#define TELEMETRY_FLUSH_BYTES 256
+#endif
+
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_HEADER_LEN 18
+#define TELEMETRY_RECORD_LEN 6
+#define TELEMETRY_MAX_RECORDS 64
+#define TELEMETRY_POOL_SIZE 4
+// Must be a power of two.
+#define TELEMETRY_RING_SIZE 32
+
+typedef enum {
+    TELEMETRY_TEMP = 1,
+    TELEMETRY_ALERT = 2,
+} telemetry_type_t;
+
+typedef struct {
+    uint32_t sent;
+    uint32_t send_errors;
+    uint32_t dropped;
+} telemetry_stats_t;
+
+// core0, after wifi_link_init.
+void telemetry_init(void);
+// core0 main loop.
+void telemetry_task(void);
+// core1 only, from one interrupt. Wakes core0.
+bool telemetry_push(telemetry_type_t type, uint8_t addr, uint16_t value);
+void telemetry_get_stats(telemetry_stats_t *stats);
+
+#endif
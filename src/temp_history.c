@@ -0,0 +1,308 @@
+#include "hardware/sync.h"
+
+#include "src/temp_history.h"
+
+// Tokens, after the absolute sample in the block header:
+//  00dddddd           one sample a period after the last, 6 bit zigzag delta
+//  01nnnnnn           n + 1 samples a period apart with no change
+//  10000000 dt dq     one sample, varint seconds and zigzag varint delta
+#define TOKEN_STEP 0x00
+#define TOKEN_RUN 0x40
+#define TOKEN_FULL 0x80
+#define TOKEN_TYPE_MASK 0xC0
+#define TOKEN_VALUE_MASK 0x3F
+#define TOKEN_NONE 0xFF
+#define STEP_MIN -32
+#define STEP_MAX 31
+#define FULL_TOKEN_MAX 9 // Token byte, 5 byte varint time and 3 byte varint delta
+
+typedef struct {
+    temp_history_block_t *block; // This sensor's share of the pool
+    uint32_t blocks;
+    uint32_t next_sequence;
+    uint32_t count; // Blocks in use
+    uint32_t samples;
+    uint32_t last_time;
+    int16_t last_quarters;
+} TEMP_HISTORY_T;
+
+// Appends come from core1's i2c interrupts and queries from either core, so
+// the stores are behind a spin lock rather than just interrupts off.
+static TEMP_HISTORY_T history[TEMP_HISTORY_SENSORS];
+static temp_history_block_t pool[TEMP_HISTORY_POOL_BLOCKS];
+static uint32_t sample_period;
+static spin_lock_t *lock = NULL;
+
+static inline uint32_t zigzag(int32_t value) {
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value) {
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+static uint8_t put_varint(uint8_t *buf, uint32_t value) {
+    uint8_t len = 0;
+    while (value >= 0x80) {
+        buf[len++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    buf[len++] = (uint8_t) value;
+    return len;
+}
+
+static uint32_t get_varint(const temp_history_block_t *block, uint8_t *offset) {
+    uint32_t value = 0;
+    uint shift = 0;
+    while (*offset < block->used) {
+        uint8_t byte = block->data[(*offset)++];
+        value |= (uint32_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+        shift += 7;
+    }
+    return value;
+}
+
+// period is the nominal sample interval in seconds, samples that arrive on
+// time get the one byte encodings. The pool is split evenly between the
+// stores of the first sensors, the rest keep no history.
+void temp_history_init(uint32_t period, uint sensors) {
+    if (sensors > TEMP_HISTORY_SENSORS) {
+        sensors = TEMP_HISTORY_SENSORS;
+    }
+    uint32_t blocks = sensors ? TEMP_HISTORY_POOL_BLOCKS / sensors : 0;
+
+    if (!lock) {
+        lock = spin_lock_instance(spin_lock_claim_unused(true));
+    }
+    uint32_t save = spin_lock_blocking(lock);
+    sample_period = period;
+    for (uint i = 0; i < TEMP_HISTORY_SENSORS; i++) {
+        history[i].block = &pool[i * blocks];
+        history[i].blocks = i < sensors ? blocks : 0;
+        history[i].next_sequence = 0;
+        history[i].count = 0;
+        history[i].samples = 0;
+    }
+    spin_unlock(lock, save);
+}
+
+static void temp_history_new_block(TEMP_HISTORY_T *store, uint32_t time, int16_t quarters) {
+    uint32_t sequence = store->next_sequence++;
+    temp_history_block_t *block = &store->block[sequence % store->blocks];
+    if (store->count == store->blocks) {
+        store->samples -= block->samples;
+    } else {
+        store->count += 1;
+    }
+    block->sequence = sequence;
+    block->start_time = time;
+    block->end_time = time;
+    block->start_quarters = quarters;
+    block->samples = 1;
+    block->used = 0;
+    block->last_token = TOKEN_NONE;
+}
+
+// Cheap enough to call from the i2c completion interrupt. A time before the
+// last starts a new block.
+bool temp_history_append(uint sensor, uint32_t time, mcp9808_temp_t temp) {
+    if (sensor >= TEMP_HISTORY_SENSORS || !history[sensor].blocks) {
+        return false;
+    }
+    TEMP_HISTORY_T *store = &history[sensor];
+    int16_t quarters = temp >> 2;
+    uint32_t save = spin_lock_blocking(lock);
+
+    if (store->count == 0 || time < store->last_time) {
+        temp_history_new_block(store, time, quarters);
+    } else {
+        temp_history_block_t *block = &store->block[(store->next_sequence - 1) % store->blocks];
+        uint32_t elapsed = time - store->last_time;
+        int32_t delta = quarters - store->last_quarters;
+        uint8_t token[FULL_TOKEN_MAX];
+        uint8_t len;
+
+        if (elapsed == sample_period && delta == 0 && block->last_token != TOKEN_NONE
+            && (block->data[block->last_token] & TOKEN_TYPE_MASK) == TOKEN_RUN
+            && (block->data[block->last_token] & TOKEN_VALUE_MASK) != TOKEN_VALUE_MASK) {
+            // Extend the run in place.
+            block->data[block->last_token] += 1;
+            block->samples += 1;
+            block->end_time = time;
+            len = 0;
+        } else if (elapsed == sample_period && delta == 0) {
+            token[0] = TOKEN_RUN;
+            len = 1;
+        } else if (elapsed == sample_period && delta >= STEP_MIN && delta <= STEP_MAX) {
+            token[0] = TOKEN_STEP | (uint8_t) zigzag(delta);
+            len = 1;
+        } else {
+            token[0] = TOKEN_FULL;
+            len = 1;
+            len += put_varint(&token[len], elapsed);
+            len += put_varint(&token[len], zigzag(delta));
+        }
+
+        if (len && block->used + len > TEMP_HISTORY_BLOCK_DATA) {
+            temp_history_new_block(store, time, quarters);
+        } else if (len) {
+            block->last_token = block->used;
+            for (uint8_t i = 0; i < len; i++) {
+                block->data[block->used++] = token[i];
+            }
+            block->samples += 1;
+            block->end_time = time;
+        }
+    }
+    store->samples += 1;
+    store->last_time = time;
+    store->last_quarters = quarters;
+    spin_unlock(lock, save);
+    return true;
+}
+
+// Copy the block with the given sequence number if it holds samples between
+// from and to, false if not or if it has been recycled or not written yet.
+static bool temp_history_copy_block(uint sensor, uint32_t sequence, uint32_t from, uint32_t to,
+    temp_history_block_t *copy) {
+    TEMP_HISTORY_T *store = &history[sensor];
+    bool valid;
+    uint32_t save = spin_lock_blocking(lock);
+    valid = sequence < store->next_sequence && sequence + store->count >= store->next_sequence;
+    if (valid) {
+        const temp_history_block_t *block = &store->block[sequence % store->blocks];
+        valid = block->start_time <= to && block->end_time >= from;
+        if (valid) {
+            *copy = *block;
+        }
+    }
+    spin_unlock(lock, save);
+    return valid;
+}
+
+void temp_history_iter_init(temp_history_iter_t *iter, uint sensor, uint32_t from, uint32_t to) {
+    iter->sensor = sensor;
+    iter->from = from;
+    iter->to = to;
+    iter->block_valid = false;
+    iter->sequence = 0;
+    if (sensor >= TEMP_HISTORY_SENSORS || !lock) {
+        iter->sensor = TEMP_HISTORY_SENSORS;
+        return;
+    }
+
+    // Blocks outside the window are passed over by their header alone. Not
+    // by their position, the clock can be stepped back between any two.
+    TEMP_HISTORY_T *store = &history[sensor];
+    uint32_t save = spin_lock_blocking(lock);
+    iter->sequence = store->next_sequence - store->count;
+    spin_unlock(lock, save);
+}
+
+static bool temp_history_iter_decode(temp_history_iter_t *iter) {
+    temp_history_block_t *block = &iter->block;
+    if (iter->start_pending) {
+        iter->start_pending = false;
+        iter->time = block->start_time;
+        iter->quarters = block->start_quarters;
+        return true;
+    }
+    if (iter->run) {
+        iter->run -= 1;
+        iter->time += sample_period;
+        return true;
+    }
+    if (iter->offset >= block->used) {
+        return false;
+    }
+    uint8_t token = block->data[iter->offset++];
+    switch (token & TOKEN_TYPE_MASK) {
+        case TOKEN_STEP:
+            iter->time += sample_period;
+            iter->quarters += unzigzag(token & TOKEN_VALUE_MASK);
+            break;
+        case TOKEN_RUN:
+            iter->run = token & TOKEN_VALUE_MASK;
+            iter->time += sample_period;
+            break;
+        default:
+            iter->time += get_varint(block, &iter->offset);
+            iter->quarters += unzigzag(get_varint(block, &iter->offset));
+            break;
+    }
+    return true;
+}
+
+// Returns the samples between from and to inclusive in the order they were
+// taken, which is time order unless the clock was stepped back.
+bool temp_history_iter_next(temp_history_iter_t *iter, temp_sample_t *sample) {
+    if (iter->sensor >= TEMP_HISTORY_SENSORS) {
+        return false;
+    }
+    while (true) {
+        if (!iter->block_valid) {
+            // Blocks outside the window, or recycled under us, are skipped.
+            // The next still holds newer data.
+            while (!temp_history_copy_block(iter->sensor, iter->sequence, iter->from, iter->to, &iter->block)) {
+                if (iter->sequence >= history[iter->sensor].next_sequence) {
+                    return false;
+                }
+                iter->sequence += 1;
+            }
+            iter->block_valid = true;
+            iter->start_pending = true;
+            iter->offset = 0;
+            iter->run = 0;
+        }
+        if (!temp_history_iter_decode(iter) || iter->time > iter->to) {
+            // Times only rise within a block, the rest of it is past the
+            // window but a later block may not be.
+            iter->block_valid = false;
+            iter->sequence += 1;
+            continue;
+        }
+        if (iter->time < iter->from) {
+            continue;
+        }
+        sample->time = iter->time;
+        sample->temp = (mcp9808_temp_t) (iter->quarters * 4);
+        return true;
+    }
+}
+
+bool temp_history_stats(uint sensor, uint32_t from, uint32_t to, temp_history_stats_t *stats) {
+    temp_history_iter_t iter;
+    temp_sample_t sample;
+    int32_t sum = 0;
+
+    stats->count = 0;
+    temp_history_iter_init(&iter, sensor, from, to);
+    while (temp_history_iter_next(&iter, &sample)) {
+        if (stats->count == 0 || sample.temp < stats->min) {
+            stats->min = sample.temp;
+        }
+        if (stats->count == 0 || sample.temp > stats->max) {
+            stats->max = sample.temp;
+        }
+        sum += sample.temp;
+        stats->count += 1;
+    }
+    if (stats->count == 0) {
+        return false;
+    }
+    // Round to the nearest sixteenth.
+    stats->mean = (mcp9808_temp_t) ((sum + (sum < 0 ? -(int32_t) stats->count : (int32_t) stats->count) / 2) / (int32_t) stats->count);
+    return true;
+}
+
+uint32_t temp_history_samples(uint sensor) {
+    return sensor < TEMP_HISTORY_SENSORS ? history[sensor].samples : 0;
+}
+
+// Storage in use including block headers, for comparing with the raw size.
+uint32_t temp_history_bytes(uint sensor) {
+    return sensor < TEMP_HISTORY_SENSORS ? history[sensor].count * sizeof(temp_history_block_t) : 0;
+}
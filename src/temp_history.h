@@ -0,0 +1,73 @@
+#ifndef _TEMP_HISTORY_H
+#define _TEMP_HISTORY_H
+
+#include "pico/stdlib.h"
+#include "src/mcp9808.h"
+
+// In RAM temperature history, one circular store per sensor. Samples are kept
+// as 0.25°C steps, delta encoded against the previous sample in fixed size
+// blocks that each start with an absolute sample, so the oldest block can be
+// dropped when the store is full. A steady temperature sampled at the nominal
+// period costs one byte per 64 samples, a noisy one about a byte a sample.
+//
+// The stores share one pool, split evenly between the sensors found. With
+// the two sensors on the bench each has 32 blocks, about 15 hours at the 30
+// second period even when every reading differs from the last. With all 16 there are 4 each.
+
+#define TEMP_HISTORY_SENSORS MCP9808_MAX_SENSORS
+#if LWIP_PROFILE_MINIMAL
+// 19KB, most of the 21KB the minimal lwIP profile saves.
+#define TEMP_HISTORY_POOL_BLOCKS 256
+#else
+#define TEMP_HISTORY_POOL_BLOCKS 64 // 4.75KB
+#endif
+#define TEMP_HISTORY_BLOCK_DATA 56 // Encoded bytes per block after the header
+
+typedef struct {
+    uint32_t time; // Seconds since 1970
+    mcp9808_temp_t temp;
+} temp_sample_t;
+
+typedef struct {
+    uint32_t count;
+    mcp9808_temp_t min;
+    mcp9808_temp_t max;
+    mcp9808_temp_t mean;
+} temp_history_stats_t;
+
+typedef struct {
+    uint32_t start_time;
+    uint32_t end_time; // Of the last sample, times only rise within a block
+    uint32_t sequence;
+    int16_t start_quarters;
+    uint16_t samples;
+    uint8_t used;
+    uint8_t last_token;
+    uint8_t data[TEMP_HISTORY_BLOCK_DATA];
+} temp_history_block_t;
+
+// Iterators work on a copy of one block at a time so appends from interrupt
+// context, or the other core, can carry on while a query runs.
+typedef struct {
+    uint sensor;
+    uint32_t sequence;
+    uint32_t from;
+    uint32_t to;
+    temp_history_block_t block;
+    bool block_valid;
+    bool start_pending;
+    uint8_t offset;
+    uint8_t run;
+    uint32_t time;
+    int16_t quarters;
+} temp_history_iter_t;
+
+void temp_history_init(uint32_t period, uint sensors);
+bool temp_history_append(uint sensor, uint32_t time, mcp9808_temp_t temp);
+void temp_history_iter_init(temp_history_iter_t *iter, uint sensor, uint32_t from, uint32_t to);
+bool temp_history_iter_next(temp_history_iter_t *iter, temp_sample_t *sample);
+bool temp_history_stats(uint sensor, uint32_t from, uint32_t to, temp_history_stats_t *stats);
+uint32_t temp_history_samples(uint sensor);
+uint32_t temp_history_bytes(uint sensor);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,279 @@
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#include "src/console.h"
+#include "src/timer_wheel.h"
+
+#define LEVEL_SHIFT(level) ((level) * TIMER_WHEEL_SLOT_BITS)
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_RUNNING TIMER_WHEEL_LEVELS // Level of a timer taken off the wheel to run
+
+static_assert(TIMER_WHEEL_SLOTS <= 64, "occupancy masks are 64 bit");
+
+typedef struct {
+    timer_wheel_timer_t *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS]; // A bit per slot with timers in it
+    uint64_t now;                          // Every tick before this has been run
+    uint64_t armed;                        // Tick the alarm is set for, UINT64_MAX for none, no later than the earliest timer
+    int alarm;                             // -1 until timer_wheel_init
+    bool running;                          // In the interrupt, it arms the alarm when done
+    uint32_t pending;
+    uint32_t wakeups;
+    uint32_t callbacks;
+    uint32_t reset;                        // Last reset applied
+} TIMER_WHEEL_T;
+
+// Each core only touches its own wheel, from its thread with interrupts off
+// or from its alarm interrupt. A reset is picked up at the next interrupt.
+static TIMER_WHEEL_T wheels[2] = {{.alarm = -1}, {.alarm = -1}};
+static volatile uint32_t reset_count = 0;
+static volatile uint64_t reset_us = 0;
+
+static void timer_wheel_irq(uint alarm_num);
+
+static inline uint64_t rotr64(uint64_t x, uint n) {
+    return n ? x >> n | x << (64 - n) : x;
+}
+
+static inline uint64_t rotl64(uint64_t x, uint n) {
+    return n ? x << n | x >> (64 - n) : x;
+}
+
+// The tick in [due, due + slack] with the most trailing zero bits, so that
+// timers with overlapping windows agree on it.
+static uint64_t timer_wheel_round(uint64_t due, uint32_t slack_ms) {
+    uint64_t limit = due + slack_ms;
+    uint64_t differ = due ^ limit;
+    if (!differ) {
+        return due;
+    }
+    return limit & ~((1ull << (63 - __builtin_clzll(differ))) - 1);
+}
+
+static void timer_wheel_link(TIMER_WHEEL_T *wheel, timer_wheel_timer_t **head, timer_wheel_timer_t *timer) {
+    timer->next = *head;
+    if (*head) {
+        (*head)->pprev = &timer->next;
+    }
+    *head = timer;
+    timer->pprev = head;
+    wheel->pending++;
+}
+
+static void timer_wheel_unlink(TIMER_WHEEL_T *wheel, timer_wheel_timer_t *timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->pprev = NULL;
+    wheel->pending--;
+    if (timer->level < TIMER_WHEEL_LEVELS && !wheel->slots[timer->level][timer->slot]) {
+        wheel->occupied[timer->level] &= ~(1ull << timer->slot);
+    }
+}
+
+// Into the lowest level whose slots, counted from the wheel's now, reach the
+// timer's deadline. Past the top level it waits in the furthest slot and is
+// put back from there when that comes round.
+static void timer_wheel_insert(TIMER_WHEEL_T *wheel, timer_wheel_timer_t *timer) {
+    uint64_t tick = timer->due > wheel->now ? timer->due : wheel->now;
+    uint level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+           (tick >> LEVEL_SHIFT(level)) - (wheel->now >> LEVEL_SHIFT(level)) >= TIMER_WHEEL_SLOTS) {
+        level++;
+    }
+    if ((tick >> LEVEL_SHIFT(level)) - (wheel->now >> LEVEL_SHIFT(level)) >= TIMER_WHEEL_SLOTS) {
+        tick = ((wheel->now >> LEVEL_SHIFT(level)) + TIMER_WHEEL_SLOTS - 1) << LEVEL_SHIFT(level);
+    }
+    uint slot = (uint) (tick >> LEVEL_SHIFT(level)) & SLOT_MASK;
+    timer->level = (uint8_t) level;
+    timer->slot = (uint8_t) slot;
+    timer_wheel_link(wheel, &wheel->slots[level][slot], timer);
+    wheel->occupied[level] |= 1ull << slot;
+}
+
+// The earliest tick any timer must run at. Slots are in deadline order and a
+// timer's tick is no earlier than its deadline, so each level is walked from
+// now only until its slots start after the earliest tick found. Only the
+// interrupt walks it, once per wakeup.
+static uint64_t timer_wheel_next(TIMER_WHEEL_T *wheel) {
+    uint64_t next = UINT64_MAX;
+    for (uint level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint64_t first = wheel->now >> LEVEL_SHIFT(level);
+        uint64_t occupied = rotr64(wheel->occupied[level], (uint) first & SLOT_MASK);
+        while (occupied) {
+            uint64_t period = first + (uint) __builtin_ctzll(occupied);
+            occupied &= occupied - 1;
+            if (period << LEVEL_SHIFT(level) >= next) {
+                break;
+            }
+            for (timer_wheel_timer_t *timer = wheel->slots[level][period & SLOT_MASK]; timer; timer = timer->next) {
+                if (timer->tick < next) {
+                    next = timer->tick;
+                }
+            }
+        }
+    }
+    return next;
+}
+
+// With interrupts off or from the alarm interrupt. The alarm is only ever
+// brought earlier: a timer cancelled or moved later leaves it where it is,
+// and the interrupt it raises finds the next tick from the wheel. An alarm
+// already in the past raises the interrupt straight away.
+static void timer_wheel_arm(TIMER_WHEEL_T *wheel, uint64_t tick) {
+    if (wheel->running || tick >= wheel->armed) {
+        return;
+    }
+    wheel->armed = tick;
+    if (hardware_alarm_set_target((uint) wheel->alarm, from_us_since_boot(tick * 1000))) {
+        hardware_alarm_force_irq((uint) wheel->alarm);
+    }
+}
+
+// Takes every slot that up to tick now has come round off the wheel, runs
+// the timers whose deadline has passed, whether or not their slack has run
+// out, and puts the rest back a level or more down.
+static void timer_wheel_run(TIMER_WHEEL_T *wheel, uint64_t now) {
+    timer_wheel_timer_t *taken = NULL;
+
+    // A forced interrupt can come in the tick that was last run.
+    if (now < wheel->now) {
+        return;
+    }
+    for (uint level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint64_t first = wheel->now >> LEVEL_SHIFT(level);
+        uint64_t periods = (now >> LEVEL_SHIFT(level)) - first + 1;
+        uint64_t range = periods >= TIMER_WHEEL_SLOTS ? UINT64_MAX : rotl64((1ull << periods) - 1, (uint) first & SLOT_MASK);
+        uint64_t slots = wheel->occupied[level] & range;
+        while (slots) {
+            uint slot = (uint) __builtin_ctzll(slots);
+            slots &= slots - 1;
+            while (wheel->slots[level][slot]) {
+                timer_wheel_timer_t *timer = wheel->slots[level][slot];
+                timer_wheel_unlink(wheel, timer);
+                timer->level = TIMER_RUNNING;
+                timer_wheel_link(wheel, &taken, timer);
+            }
+        }
+    }
+    wheel->now = now + 1;
+
+    // A callback can add or cancel any timer, including those still taken.
+    while (taken) {
+        timer_wheel_timer_t *timer = taken;
+        timer_wheel_unlink(wheel, timer);
+        if (timer->due > now) {
+            timer_wheel_insert(wheel, timer);
+            continue;
+        }
+        wheel->callbacks++;
+        uint32_t delay_ms = timer->callback(timer);
+        if (delay_ms && !timer->pprev) {
+            timer->due += delay_ms;
+            if (timer->due < wheel->now) {
+                timer->due = wheel->now;
+            }
+            timer->tick = timer_wheel_round(timer->due, timer->slack_ms);
+            timer_wheel_insert(wheel, timer);
+        }
+    }
+}
+
+static void __not_in_flash_func(timer_wheel_irq)(uint alarm_num) {
+    TIMER_WHEEL_T *wheel = &wheels[wheels[0].alarm == (int) alarm_num ? 0 : 1];
+    if (wheel->reset != reset_count) {
+        wheel->reset = reset_count;
+        wheel->wakeups = 0;
+        wheel->callbacks = 0;
+    }
+    wheel->wakeups++;
+    wheel->armed = UINT64_MAX;
+    wheel->running = true;
+    timer_wheel_run(wheel, time_us_64() / 1000);
+    wheel->running = false;
+    timer_wheel_arm(wheel, timer_wheel_next(wheel));
+}
+
+void timer_wheel_timer_init(timer_wheel_timer_t *timer, timer_wheel_callback_t callback, void *user_data, uint32_t slack_ms) {
+    *timer = (timer_wheel_timer_t) {
+        .core = (uint8_t) get_core_num(),
+        .slack_ms = slack_ms,
+        .callback = callback,
+        .user_data = user_data,
+    };
+}
+
+void timer_wheel_add(timer_wheel_timer_t *timer, uint32_t delay_ms) {
+    TIMER_WHEEL_T *wheel = &wheels[timer->core];
+    uint32_t save = save_and_disable_interrupts();
+    if (timer->pprev) {
+        timer_wheel_unlink(wheel, timer);
+    }
+    // Rounded up, it never runs early.
+    timer->due = (time_us_64() + 999) / 1000 + delay_ms;
+    timer->tick = timer_wheel_round(timer->due, timer->slack_ms);
+    timer_wheel_insert(wheel, timer);
+    timer_wheel_arm(wheel, timer->tick);
+    restore_interrupts(save);
+}
+
+bool timer_wheel_cancel(timer_wheel_timer_t *timer) {
+    TIMER_WHEEL_T *wheel = &wheels[timer->core];
+    uint32_t save = save_and_disable_interrupts();
+    bool queued = timer->pprev != NULL;
+    if (queued) {
+        timer_wheel_unlink(wheel, timer);
+    }
+    restore_interrupts(save);
+    return queued;
+}
+
+bool timer_wheel_pending(const timer_wheel_timer_t *timer) {
+    return timer->pprev != NULL;
+}
+
+void timer_wheel_get_stats(uint core, timer_wheel_stats_t *stats) {
+    const TIMER_WHEEL_T *wheel = &wheels[core];
+    bool current = wheel->reset == reset_count;
+    stats->wakeups = current ? wheel->wakeups : 0;
+    stats->callbacks = current ? wheel->callbacks : 0;
+    stats->pending = wheel->pending;
+    stats->since_us = reset_us;
+}
+
+void timer_wheel_reset(void) {
+    reset_us = time_us_64();
+    reset_count += 1;
+}
+
+static void timer_wheel_command(const char *args) {
+    if (!strcmp(args, "reset")) {
+        timer_wheel_reset();
+        return;
+    }
+    for (uint core = 0; core < 2; core++) {
+        timer_wheel_stats_t stats;
+        timer_wheel_get_stats(core, &stats);
+        uint64_t ms = (time_us_64() - stats.since_us) / 1000;
+        if (!ms || wheels[core].alarm < 0) {
+            continue;
+        }
+        printf("core%u alarm %d wakeups %lu (%lu.%02lu/s) callbacks %lu (%lu.%02lu/s) pending %lu\n", core, wheels[core].alarm,
+            (unsigned long) stats.wakeups, (unsigned long) (stats.wakeups * 1000ull / ms), (unsigned long) (stats.wakeups * 100000ull / ms % 100),
+            (unsigned long) stats.callbacks, (unsigned long) (stats.callbacks * 1000ull / ms), (unsigned long) (stats.callbacks * 100000ull / ms % 100),
+            (unsigned long) stats.pending);
+    }
+}
+
+// core0's also registers the console command.
+void timer_wheel_init(void) {
+    TIMER_WHEEL_T *wheel = &wheels[get_core_num()];
+    wheel->now = time_us_64() / 1000;
+    wheel->armed = UINT64_MAX;
+    wheel->alarm = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback((uint) wheel->alarm, timer_wheel_irq);
+    if (!get_core_num()) {
+        console_register("timers", "timer interrupts and callbacks per core, timers reset to clear", timer_wheel_command);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef _TIMER_WHEEL_H
+#define _TIMER_WHEEL_H
+
+#include "pico/stdlib.h"
+
+// The firmware's own timers, a hierarchical timer wheel per core on a single
+// hardware alarm each, so every timer of a core shares one interrupt. The
+// SDK's default alarm pool is left to the SDK.
+//
+// Time is in ms ticks. Level 0 has a slot per tick, each level above has
+// slots TIMER_WHEEL_SLOTS times as wide, and a timer sits by its deadline in
+// the lowest level whose span reaches it. It moves down a level as its slot
+// comes round, so adding, re-arming and cancelling are O(1). The alarm is
+// only moved when an add brings it earlier. A cancel, or a re-arm further
+// out, leaves it, and the wakeup that then comes early runs whatever is
+// due and sets the alarm for the next timer.
+//
+// Each timer has a slack, it may run up to slack_ms after its deadline. The
+// hardware alarm is set for the end of the earliest window, rounded within
+// it to the tick with the most trailing zero bits so overlapping windows
+// tend to end together, and each interrupt runs every timer whose deadline
+// has passed. A timer's callback returns the ms to its next deadline,
+// counted from its last so a periodic timer doesn't drift, or 0 to stop.
+//
+// Timers belong to the core that initialised them and are only added or
+// cancelled from that core. Callbacks run in the alarm interrupt. The
+// "timers" console command shows the interrupts and callbacks per second on
+// each core since the last "timers reset".
+
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_LEVELS 4 // Reaches 2^24ms, 4.6 hours, further is clamped
+
+typedef struct timer_wheel_timer timer_wheel_timer_t;
+typedef uint32_t (*timer_wheel_callback_t)(timer_wheel_timer_t *timer);
+
+struct timer_wheel_timer {
+    timer_wheel_timer_t *next;
+    timer_wheel_timer_t **pprev; // NULL when not queued
+    uint64_t due;                // Deadline in ticks
+    uint64_t tick;               // Runs by, due plus part of the slack
+    uint32_t slack_ms;
+    uint8_t core;
+    uint8_t level;
+    uint8_t slot;
+    timer_wheel_callback_t callback;
+    void *user_data;
+};
+
+typedef struct {
+    uint32_t wakeups;   // Alarm interrupts
+    uint32_t callbacks;
+    uint32_t pending;
+    uint64_t since_us;
+} timer_wheel_stats_t;
+
+// Once on each core, its alarm interrupt is taken there.
+void timer_wheel_init(void);
+void timer_wheel_timer_init(timer_wheel_timer_t *timer, timer_wheel_callback_t callback, void *user_data, uint32_t slack_ms);
+// Queues, or moves if already queued, the timer delay_ms from now.
+void timer_wheel_add(timer_wheel_timer_t *timer, uint32_t delay_ms);
+bool timer_wheel_cancel(timer_wheel_timer_t *timer);
+bool timer_wheel_pending(const timer_wheel_timer_t *timer);
+void timer_wheel_get_stats(uint core, timer_wheel_stats_t *stats);
+void timer_wheel_reset(void);
+
+#endif
@@ -0,0 +1,87 @@
+#include "hardware/sync.h"
+
+#include "src/trace.h"
+
+typedef struct {
+    uint32_t timestamp;
+    uint8_t id;
+    uint8_t argc;
+    uint32_t arg[TRACE_MAX_ARGS];
+} TRACE_RECORD_T;
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of two");
+
+// Any context on either core may write, writers are serialised by a hardware
+// spin lock. Only trace_task reads so tail needs no lock.
+static TRACE_RECORD_T ring[TRACE_RING_SIZE];
+static volatile uint32_t head = 0;
+static volatile uint32_t tail = 0;
+static volatile uint32_t dropped = 0;
+static spin_lock_t *lock = NULL;
+
+void trace_init(void) {
+    lock = spin_lock_instance(spin_lock_claim_unused(true));
+}
+
+void __not_in_flash_func(trace_write)(trace_id_t id, uint8_t argc, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+    if (!lock) {
+        return;
+    }
+    uint32_t save = spin_lock_blocking(lock);
+    uint32_t h = head;
+    if (h - tail == TRACE_RING_SIZE) {
+        dropped += 1;
+    } else {
+        TRACE_RECORD_T *record = &ring[h & (TRACE_RING_SIZE - 1)];
+        record->timestamp = time_us_32();
+        record->id = id;
+        record->argc = argc;
+        record->arg[0] = a0;
+        record->arg[1] = a1;
+        record->arg[2] = a2;
+        record->arg[3] = a3;
+        head = h + 1;
+    }
+    spin_unlock(lock, save);
+    // Wake core0's idle loop to drain it.
+    __sev();
+}
+
+static void trace_put_u32(uint32_t value) {
+    for (uint i = 0; i < 4; i++) {
+        putchar_raw((int) (value & 0xFF));
+        value >>= 8;
+    }
+}
+
+// Called from the main loop. Emits at most one frame per call so a long
+// backlog on a slow UART cannot hold up the rest of the loop, returns true
+// while there is more to send.
+bool trace_task(void) {
+    static uint32_t reported_dropped = 0;
+    TRACE_RECORD_T record;
+    uint32_t t = tail;
+
+    if (head == t) {
+        uint32_t lost = dropped;
+        if (lost != reported_dropped) {
+            TRACE1(TRACE_DROPPED, lost - reported_dropped);
+            reported_dropped = lost;
+            return true;
+        }
+        return false;
+    }
+    __mem_fence_acquire();
+    record = ring[t & (TRACE_RING_SIZE - 1)];
+    __mem_fence_release();
+    tail = t + 1;
+
+    putchar_raw(TRACE_FRAME_START);
+    putchar_raw(record.id);
+    putchar_raw(record.argc);
+    trace_put_u32(record.timestamp);
+    for (uint i = 0; i < record.argc; i++) {
+        trace_put_u32(record.arg[i]);
+    }
+    return head != tail;
+}
@@ -0,0 +1,46 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "pico/stdlib.h"
+#include "src/trace_ids.h"
+
+// Binary trace log. A call site stores a format id and up to four raw 32 bit
+// arguments in a RAM ring, trace_task drains the ring to stdio as frames and
+// tools/trace_decode.py turns them back into text on the host.
+//
+// Frame: 0x1E, id, argc, timestamp (time_us_32, LE), argc * arg (LE)
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+// Must be a power of two.
+#define TRACE_RING_SIZE 128
+#define TRACE_MAX_ARGS 4
+#define TRACE_FRAME_START 0x1E
+
+#define TRACE_ENUM(id, format) id,
+typedef enum { TRACE_FORMATS(TRACE_ENUM) TRACE_ID_COUNT } trace_id_t;
+#undef TRACE_ENUM
+
+#if TRACE_ENABLED
+#define TRACE0(id)             trace_write((id), 0, 0, 0, 0, 0)
+#define TRACE1(id, a)          trace_write((id), 1, (uint32_t) (a), 0, 0, 0)
+#define TRACE2(id, a, b)       trace_write((id), 2, (uint32_t) (a), (uint32_t) (b), 0, 0)
+#define TRACE3(id, a, b, c)    trace_write((id), 3, (uint32_t) (a), (uint32_t) (b), (uint32_t) (c), 0)
+#define TRACE4(id, a, b, c, d) trace_write((id), 4, (uint32_t) (a), (uint32_t) (b), (uint32_t) (c), (uint32_t) (d))
+#else
+// The arguments are still evaluated, as they would be traced, so a variable
+// only kept for the trace isn't left unused.
+#define TRACE0(id)             ((void) 0)
+#define TRACE1(id, a)          ((void) (a))
+#define TRACE2(id, a, b)       ((void) (a), (void) (b))
+#define TRACE3(id, a, b, c)    ((void) (a), (void) (b), (void) (c))
+#define TRACE4(id, a, b, c, d) ((void) (a), (void) (b), (void) (c), (void) (d))
+#endif
+
+void trace_init(void);
+void trace_write(trace_id_t id, uint8_t argc, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+bool trace_task(void);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef _TRACE_IDS_H
+#define _TRACE_IDS_H
+
+// Format strings for the trace log, the position in the list is the id.
+// tools/trace_decode.py builds its string table from this file so keep one
+// entry per line and only ever append. Arguments are 32 bit, as well as the
+// usual integer conversions the decoder understands %t, a mcp9808_temp_t.
+#define TRACE_FORMATS(X) \
+    X(TRACE_DROPPED,              "trace: %u records dropped") \
+    X(TRACE_GPIO_EVENT,           "GPIO %u events %x (%uus)") \
+    X(TRACE_GPIO_DROPPED,         "GPIO events dropped: %u") \
+    X(TRACE_ALARM_FIRED,          "Timer %d fired!") \
+    X(TRACE_BACKLIGHT_COMPLETE,   "Alarm complete for id: %d") \
+    X(TRACE_BACKLIGHT_CANCEL,     "Cancel: %d") \
+    X(TRACE_BACKLIGHT_SET,        "Set: %d") \
+    X(TRACE_MCP9808_WRITE_ERROR,  "mcp9808 %02x reg %02x *WE*") \
+    X(TRACE_MCP9808_READ_ERROR,   "mcp9808 %02x reg %02x *RE*") \
+    X(TRACE_MCP9808_LIMIT,        "mcp9808 %02x init reg %02x:%04x") \
+    X(TRACE_MCP9808_CONFIG,       "mcp9808 %02x config %04x *OK*") \
+    X(TRACE_MCP9808_ALERT_CLEAR,  "mcp9808 %02x alert cleared %04x:%04x") \
+    X(TRACE_MCP9808_TEMP,         "mcp9808 %02x %t°C") \
+    X(TRACE_MCP9808_FROST,        "mcp9808 %02x *frost*") \
+    X(TRACE_MCP9808_HEAT,         "mcp9808 %02x *heat*") \
+    X(TRACE_MCP9808_CONDITIONING, "mcp9808 %02x *conditioning*") \
+    X(TRACE_NTP_ADDR,             "ntp Addr(%u.%u.%u.%u)") \
+    X(TRACE_NTP_RECV,             "ntp SecsSince1970(%u) FracSecs(%u)") \
+    X(TRACE_NTP_TIME,             "ntp time set %u") \
+    X(TRACE_NTP_FAILED,           "ntp request failed") \
+    X(TRACE_NTP_INVALID,          "invalid ntp response") \
+    X(TRACE_NTP_DNS_FAILED,       "ntp dns request failed") \
+    X(TRACE_BACKLIGHT_WAKE,       "Backlight wake") \
+    X(TRACE_NTP_SAMPLE,           "ntp offset %dus delay %dus") \
+    X(TRACE_NTP_FREQ,             "ntp clock slewing, frequency %dppb") \
+    X(TRACE_NTP_PEER,             "ntp server %u offset %dus delay %dus jitter %uus") \
+    X(TRACE_NTP_SELECT,           "ntp %u of %u servers agree") \
+    X(TRACE_NTP_SERVER_LOST,      "ntp server %u silent, resolving again") \
+    X(TRACE_WALL_CLOCK,           "wall clock %u.%06u") \
+    X(TRACE_MCP9808_FOUND,        "mcp9808 %02x found, revision %02x") \
+    X(TRACE_MCP9808_UNKNOWN,      "mcp9808 %02x reg %02x id %04x, not an mcp9808") \
+    X(TRACE_MCP9808_SCAN,         "mcp9808 scan found %u sensors") \
+    X(TRACE_MCP9808_SWEEP,        "mcp9808 sweep of %u sensors took %uus") \
+    X(TRACE_WIFI_JOIN,            "wifi joining, attempt %u") \
+    X(TRACE_WIFI_UP,              "wifi link up after %ums") \
+    X(TRACE_WIFI_DOWN,            "wifi link down, status %d, retry in %ums") \
+    X(TRACE_WIFI_RETRY,           "wifi join failed, status %d, retry in %ums") \
+    X(TRACE_TOUCH_PRESS,          "touch press %u,%u z %u after %uus") \
+    X(TRACE_TOUCH_MOVE,           "touch move %u,%u z %u") \
+    X(TRACE_TOUCH_RELEASE,        "touch release %u,%u")
+
+#endif
\ No newline at end of file
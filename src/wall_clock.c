@@ -0,0 +1,207 @@
+#include <time.h>
+
+#include "hardware/clocks.h"
+#include "hardware/rtc.h"
+#include "hardware/sync.h"
+
+#include "src/console.h"
+#include "src/ntp_clock.h"
+#include "src/wall_clock.h"
+
+#define WALL_CLOCK_DAY_US (86400ull * 1000000)
+
+typedef struct {
+    uint64_t start_us; // Midnight
+    uint32_t days;     // Since 1970
+    int16_t year;
+    int8_t month;
+    int8_t day;
+    int8_t dotw;
+} WALL_CLOCK_DAY_T;
+
+// Two entries per core, the new day is written to the one not in use and
+// then published, so a reader interrupted part way through still has a
+// consistent entry.
+static WALL_CLOCK_DAY_T days[2][2];
+static const WALL_CLOCK_DAY_T *volatile today[2];
+
+// Civil from days, March based year so the leap day is last.
+static void wall_clock_civil(uint32_t days_since_1970, WALL_CLOCK_DAY_T *day) {
+    uint32_t z = days_since_1970 + 719468;
+    uint32_t era = z / 146097;
+    uint32_t day_of_era = z - era * 146097;
+    uint32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    uint32_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    uint32_t mp = (5 * day_of_year + 2) / 153;
+    uint32_t month = mp < 10 ? mp + 3 : mp - 9;
+
+    day->days = days_since_1970;
+    day->start_us = days_since_1970 * WALL_CLOCK_DAY_US;
+    day->year = (int16_t) (year_of_era + era * 400 + (month <= 2));
+    day->month = (int8_t) month;
+    day->day = (int8_t) (day_of_year - (153 * mp + 2) / 5 + 1);
+    day->dotw = (int8_t) ((days_since_1970 + 4) % 7); // 1 Jan 1970 was a Thursday
+}
+
+// The 64 bit divide only happens once a day per core.
+static const WALL_CLOCK_DAY_T *wall_clock_day(uint64_t utc_us) {
+    uint core = get_core_num();
+    const WALL_CLOCK_DAY_T *day = today[core];
+    if (day && utc_us - day->start_us < WALL_CLOCK_DAY_US) {
+        return day;
+    }
+    uint32_t save = save_and_disable_interrupts();
+    WALL_CLOCK_DAY_T *next = &days[core][today[core] == &days[core][0]];
+    wall_clock_civil((uint32_t) (utc_us / WALL_CLOCK_DAY_US), next);
+    __mem_fence_release();
+    today[core] = next;
+    restore_interrupts(save);
+    return next;
+}
+
+// Microseconds into the day are under 2^37, dividing by 64 first leaves a
+// 32 bit division by 15625.
+static uint32_t wall_clock_second_of_day(uint64_t us_of_day, uint32_t *usec) {
+    uint32_t seconds = (uint32_t) (us_of_day >> 6) / 15625;
+    *usec = (uint32_t) us_of_day - seconds * 1000000;
+    return seconds;
+}
+
+static void wall_clock_fill(const WALL_CLOCK_DAY_T *day, uint32_t seconds, datetime_t *t) {
+    t->year = day->year;
+    t->month = day->month;
+    t->day = day->day;
+    t->dotw = day->dotw;
+    t->hour = (int8_t) (seconds / 3600);
+    t->min = (int8_t) (seconds / 60 % 60);
+    t->sec = (int8_t) (seconds % 60);
+}
+
+bool wall_clock_synced(void) {
+    return ntp_clock_synced();
+}
+
+uint64_t wall_clock_us(void) {
+    return ntp_clock_now_us();
+}
+
+uint64_t wall_clock_ns(void) {
+    return ntp_clock_now_us() * 1000;
+}
+
+uint32_t wall_clock_seconds(void) {
+    if (!ntp_clock_synced()) {
+        return 0;
+    }
+    uint64_t now = ntp_clock_now_us();
+    const WALL_CLOCK_DAY_T *day = wall_clock_day(now);
+    uint32_t usec;
+    return day->days * 86400 + wall_clock_second_of_day(now - day->start_us, &usec);
+}
+
+bool wall_clock_datetime(datetime_t *t) {
+    if (!ntp_clock_synced()) {
+        return false;
+    }
+    uint64_t now = ntp_clock_now_us();
+    const WALL_CLOCK_DAY_T *day = wall_clock_day(now);
+    uint32_t usec;
+    wall_clock_fill(day, wall_clock_second_of_day(now - day->start_us, &usec), t);
+    return true;
+}
+
+void wall_clock_to_datetime(uint64_t utc_us, datetime_t *t) {
+    WALL_CLOCK_DAY_T day;
+    uint32_t usec;
+    wall_clock_civil((uint32_t) (utc_us / WALL_CLOCK_DAY_US), &day);
+    wall_clock_fill(&day, wall_clock_second_of_day(utc_us - day.start_us, &usec), t);
+}
+
+// The path mcp9808 took before, the RTC is only read here so using it from
+// core0 doesn't disturb core1.
+static uint32_t wall_clock_rtc_seconds(void) {
+    datetime_t t;
+    if (!rtc_running() || !rtc_get_datetime(&t)) {
+        return 0;
+    }
+    int32_t year = t.year - (t.month <= 2);
+    int32_t era = year / 400;
+    uint32_t year_of_era = (uint32_t) (year - era * 400);
+    uint32_t day_of_year = (153 * (t.month + (t.month > 2 ? -3 : 9)) + 2) / 5 + t.day - 1;
+    uint32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    int32_t days = era * 146097 + (int32_t) day_of_era - 719468;
+    return (uint32_t) days * 86400 + t.hour * 3600 + t.min * 60 + t.sec;
+}
+
+static uint32_t wall_clock_gmtime_datetime(void) {
+    time_t now = (time_t) (ntp_clock_now_us() / 1000000);
+    struct tm utc;
+    gmtime_r(&now, &utc);
+    datetime_t t = {
+        .year  = utc.tm_year + 1900,
+        .month = utc.tm_mon + 1,
+        .day   = utc.tm_mday,
+        .dotw  = utc.tm_wday,
+        .hour  = utc.tm_hour,
+        .min   = utc.tm_min,
+        .sec   = utc.tm_sec
+    };
+    return t.sec;
+}
+
+static uint32_t wall_clock_cached_datetime(void) {
+    datetime_t t;
+    return wall_clock_datetime(&t) ? t.sec : 0;
+}
+
+static uint32_t wall_clock_ns_low(void) {
+    return (uint32_t) wall_clock_ns();
+}
+
+typedef struct {
+    const char *name;
+    uint32_t (*call)(void);
+} WALL_CLOCK_BENCH_T;
+
+static const WALL_CLOCK_BENCH_T bench[] = {
+    {"rtc seconds", wall_clock_rtc_seconds},
+    {"wall_clock_seconds", wall_clock_seconds},
+    {"gmtime datetime", wall_clock_gmtime_datetime},
+    {"wall_clock_datetime", wall_clock_cached_datetime},
+    {"wall_clock_ns", wall_clock_ns_low},
+};
+
+// Time per call with interrupts off, so nothing else is counted.
+static void wall_clock_bench(void) {
+    uint32_t hz = clock_get_hz(clk_sys);
+    for (uint i = 0; i < count_of(bench); i++) {
+        volatile uint32_t sink;
+        uint32_t save = save_and_disable_interrupts();
+        uint64_t start = time_us_64();
+        for (uint n = 0; n < WALL_CLOCK_BENCH_CALLS; n++) {
+            sink = bench[i].call();
+        }
+        uint64_t elapsed = time_us_64() - start;
+        restore_interrupts(save);
+        (void) sink;
+        printf("%-20s %lluns %llu cycles per call\n", bench[i].name,
+            (unsigned long long) (elapsed * 1000 / WALL_CLOCK_BENCH_CALLS),
+            (unsigned long long) (elapsed * (hz / 1000000) / WALL_CLOCK_BENCH_CALLS));
+    }
+}
+
+static void wall_clock_command(const char *args) {
+    if (!strcmp(args, "bench")) {
+        wall_clock_bench();
+        return;
+    }
+    uint64_t now = wall_clock_us();
+    datetime_t t;
+    wall_clock_to_datetime(now, &t);
+    printf("%04d-%02d-%02d %02d:%02d:%02d.%06lu %s, frequency %ldppb\n", t.year, t.month, t.day, t.hour, t.min, t.sec,
+        (unsigned long) (now % 1000000), wall_clock_synced() ? "synced" : "not synced", (long) ntp_clock_freq_ppb());
+}
+
+void wall_clock_init(void) {
+    console_register("clock", "UTC time, clock bench to time it against the RTC", wall_clock_command);
+}
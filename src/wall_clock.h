@@ -0,0 +1,27 @@
+#ifndef _WALL_CLOCK_H
+#define _WALL_CLOCK_H
+
+#include "pico/stdlib.h"
+#include "pico/util/datetime.h"
+
+// UTC from the NTP disciplined clock for timestamps, without the RTC or
+// newlib's gmtime. Readings are monotonic and have the timer's microsecond
+// resolution. Each core caches the calendar date of the current day so a
+// breakdown is only 32 bit divisions until midnight.
+//
+// Any core or interrupt may call these.
+
+#define WALL_CLOCK_BENCH_CALLS 1000
+
+void wall_clock_init(void);
+bool wall_clock_synced(void);
+uint64_t wall_clock_ns(void);
+uint64_t wall_clock_us(void);
+// Seconds since 1970, 0 until the first NTP sync.
+uint32_t wall_clock_seconds(void);
+// False until the first NTP sync.
+bool wall_clock_datetime(datetime_t *t);
+// Any time, not cached, for the odd conversion off the hot path.
+void wall_clock_to_datetime(uint64_t utc_us, datetime_t *t);
+
+#endif
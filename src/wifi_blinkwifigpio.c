@@ -2,85 +2,148 @@
 #include <string.h>
 
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
 #include "hardware/irq.h"
 #include "hardware/i2c.h"
 #include "hardware/rtc.h"
+#include "src/boot.h"
 #include "src/mcp9808.h"
 #include "src/cyw43_ntp.h"
 #include "src/msp2807.h"
+#include "src/net_stats.h"
 #include "src/cyw43_blink_led.h"
+#include "src/display.h"
+#include "src/gpio_event.h"
+#include "src/idle.h"
+#include "src/i2c_async.h"
+#include "src/console.h"
+#include "src/core_msg.h"
+#include "src/isr_stats.h"
+#include "src/metrics_http.h"
+#include "src/telemetry.h"
+#include "src/timer_wheel.h"
+#include "src/trace.h"
+#include "src/wall_clock.h"
+#include "src/wifi_link.h"
+#include "src/xip_bench.h"
+#include "src/xpt2046.h"
 
 #define I2C0_SCL_PIN 17
 #define I2C0_SDA_PIN 16
-
-void gpio_event_string(char *buf, uint32_t events) {
-    static const char *gpio_irq_str[] = {
-        "LEVEL_LOW",  // 0x1
-        "LEVEL_HIGH", // 0x2
-        "EDGE_FALL",  // 0x4
-        "EDGE_RISE"   // 0x8
-    };
-
-    for (uint i = 0; i < 4; i++) {
-        uint mask = (1 << i);
-        if (events & mask) {
-            // Copy this event string into the user string
-            const char *event_str = gpio_irq_str[i];
-            while (*event_str != '\0') {
-                *buf++ = *event_str++;
-            }
-            events &= ~mask;
-
-            // If more events add ", "
-            if (events) {
-                *buf++ = ',';
-                *buf++ = ' ';
-            }
+#define I2C1_SCL_PIN 15
+#define I2C1_SDA_PIN 14
+
+static void touch_event_dispatch(void) {
+    touch_event_t event;
+
+    while (xpt2046_event_pop(&event)) {
+        switch (event.type) {
+            case TOUCH_PRESS:
+                TRACE4(TRACE_TOUCH_PRESS, event.x, event.y, event.z, time_us_32() - event.timestamp);
+                break;
+            case TOUCH_MOVE:
+                TRACE3(TRACE_TOUCH_MOVE, event.x, event.y, event.z);
+                break;
+            case TOUCH_RELEASE:
+                TRACE2(TRACE_TOUCH_RELEASE, event.x, event.y);
+                break;
         }
     }
-    *buf++ = '\0';
 }
 
-void gpio_callback(uint gpio, uint32_t events) {
-    static char event_str[128];
-    // Put the GPIO event(s) that just happened into event_str
-    // so we can print it
-    gpio_event_string(event_str, events);
-    printf("GPIO %d %s ", gpio, event_str);
-
-    switch(gpio)
-    {
-        case TOUCHSCREEN_IRQ:
-            msp2807_reset_irq();
-            break;
-        case MCP9808_IRQ:
-            mcp9808_reset_irq();
-            break;
-    }
-    printf("\n");
+// The RTC is only touched from core1, core0 sends it the NTP time.
+static void rtc_set_epoch(time_t epoch) {
+    datetime_t t;
+    wall_clock_to_datetime((uint64_t) epoch * 1000000, &t);
+    rtc_set_datetime(&t);
 }
 
-int64_t alarm_callback(alarm_id_t id, void *user_data) {
-    printf("Timer %d fired!\n", (int) id);
+static void core_msg_dispatch(void) {
+    core_msg_t msg;
+
+    while (core_msg_receive(&msg)) {
+        switch (msg.type) {
+            case CORE_MSG_TIME_SET:
+                rtc_set_epoch((time_t) msg.arg);
+                break;
+            case CORE_MSG_MCP9808_LIMIT:
+                mcp9808_set_limit((mcp9808_limit_t) (msg.arg >> 16), (mcp9808_temp_t) (msg.arg & 0xFFFF));
+                break;
+            case CORE_MSG_DISPLAY_REDRAW:
+                display_redraw();
+                break;
+            case CORE_MSG_BACKLIGHT_FADE:
+                backlight_set_fade((msg.arg >> 16) * 1000, (msg.arg >> 8 & 0xFF) * 1000, (uint8_t) msg.arg);
+                break;
+        }
+    }
+}
 
-    backlight_check_timer(id);
+static void i2c_bus_init(i2c_inst_t *i2c, uint scl_pin, uint sda_pin) {
+    i2c_init(i2c, 400 * 1000);
+    gpio_set_function(scl_pin, GPIO_FUNC_I2C);
+    gpio_set_function(sda_pin, GPIO_FUNC_I2C);
+    gpio_pull_up(scl_pin);
+    gpio_pull_up(sda_pin);
+    i2c_async_init(i2c);
+}
 
-    // Can return a value here in us to fire in the future
-    return 0;
+static void core1_i2c_init(void) {
+    i2c_bus_init(i2c0, I2C0_SCL_PIN, I2C0_SDA_PIN);
+    i2c_bus_init(i2c1, I2C1_SCL_PIN, I2C1_SDA_PIN);
 }
 
-static void i2c0_init(void) {
-    i2c_init(i2c0, 400 * 1000);
-    gpio_set_function(I2C0_SCL_PIN, GPIO_FUNC_I2C);
-    gpio_set_function(I2C0_SDA_PIN, GPIO_FUNC_I2C);
-    gpio_pull_up(I2C0_SCL_PIN);
-    gpio_pull_up(I2C0_SDA_PIN);
+// The sensor scan and limits run on the i2c interrupts, so they are started
+// first and go on while the RTC and the display are set up.
+static const boot_step_t core1_boot[] = {
+    {BOOT_I2C, 0, core1_i2c_init},
+    {BOOT_SENSORS, BOOT_AFTER(BOOT_I2C), mcp9808_init},
+    {BOOT_RTC, 0, rtc_init},
+    {BOOT_BACKLIGHT, 0, backlight_init},
+    {BOOT_TOUCH, 0, touchscreen_init},
+    {BOOT_DISPLAY, 0, display_init},
+};
+
+// Core1 owns both i2c blocks, the RTC, the sensors and the display. Its
+// interrupts (i2c0, i2c1, GPIO, its timer wheel's alarm) are enabled from
+// here so they are taken on core1, and nothing on core0 can hold them up.
+static void core1_main(void) {
+    timer_wheel_init();
+    gpio_event_init();
+    boot_start(core1_boot, count_of(core1_boot));
+    boot_mark(BOOT_CORE1_LOOP);
+
+    while (true) {
+        boot_task();
+        gpio_event_dispatch();
+        touch_event_dispatch();
+        core_msg_dispatch();
+        display_task();
+        idle_wait();
+    }
 }
 
+static void core1_launch(void) {
+    multicore_launch_core1(core1_main);
+}
 
+// Core0 keeps Wi-Fi and NTP. Core1 is launched first so the sensors are
+// programmed while the CYW43 firmware loads. The join runs in the background,
+// NTP and telemetry start when the link comes up and the metrics server is
+// not started until then, nothing could reach it before.
+static const boot_step_t core0_boot[] = {
+    {BOOT_CORE1, 0, core1_launch},
+    {BOOT_CYW43, 0, cyw43_blink_led_init},
+    {BOOT_WIFI, BOOT_AFTER(BOOT_CYW43), wifi_link_init},
+    {BOOT_NTP, BOOT_AFTER(BOOT_WIFI), cyw43_ntp_init},
+    {BOOT_TELEMETRY, BOOT_AFTER(BOOT_WIFI), telemetry_init},
+    {BOOT_METRICS, BOOT_AFTER(BOOT_LINK_UP), metrics_http_init},
+};
 
 int main()
 {
+    boot_mark(BOOT_MAIN);
+
     // Must be set to zero when debugging else tick tests cause infinite loops.
     // Additional information suggests that the issue is caused by debugging both
     // cores (latest openocd default) when in reality only one is being worked on.
@@ -90,31 +153,36 @@ int main()
 #endif
 
     stdio_init_all();
+    boot_mark(BOOT_STDIO);
+    trace_init();
+    idle_init();
+    boot_init();
+    isr_stats_init();
+    xip_bench_init();
+    net_stats_init();
+    wall_clock_init();
+    mcp9808_console_init();
+    display_console_init();
+    xpt2046_console_init();
+    backlight_console_init();
+    gpio_event_console_init();
+    timer_wheel_init();
 
     printf("\n\nPico is alive. \n");
 
-    printf("Initialising rtc. \n");
-    rtc_init();
-
-    printf("Initialising i2c0. \n");
-    i2c0_init();
-
-    printf("Initialising backlight. \n");
-    backlight_init(alarm_callback);
-
-    printf("Initialising touch screen. \n");
-    touchscreen_init(gpio_callback);
-
-    printf("Initialising mcp9808 devices. \n");
-    mcp9808_init(gpio_callback);
-
-    printf("Initialising cyw43 for blink led \n");
-    cyw43_blink_led_init();
-
-    printf("Initialising cyw43 for ntp \n");
-    cyw43_ntp_init();
+    boot_start(core0_boot, count_of(core0_boot));
+    boot_mark(BOOT_CORE0_LOOP);
 
+    // Sleep between events, the trace backlog is drained first.
     while (true) {
-        tight_loop_contents;
+        bool more = trace_task();
+        console_task();
+        boot_task();
+        wifi_link_task();
+        cyw43_ntp_task();
+        telemetry_task();
+        if (!more) {
+            idle_wait();
+        }
     }
 }
@@ -0,0 +1,151 @@
+#include "pico/cyw43_arch.h"
+
+#include "src/boot.h"
+#include "src/console.h"
+#include "src/timer_wheel.h"
+#include "src/trace.h"
+#include "src/wifi_link.h"
+
+typedef struct {
+    wifi_link_state_t state;
+    absolute_time_t since;      // Entered the state
+    absolute_time_t down_since; // First attempt since the link was last up
+    absolute_time_t retry_at;
+    uint32_t backoff_ms;        // For the next failure
+    uint32_t attempts;          // Since the link was last up
+    uint32_t joins;
+    uint32_t drops;
+    int status;                 // Last link status polled
+    volatile bool poll_due;
+    timer_wheel_timer_t timer;
+    wifi_link_callback_t subscribers[WIFI_LINK_SUBSCRIBERS];
+    uint subscriber_count;
+} WIFI_LINK_T;
+
+static const char *const state_names[] = {"off", "joining", "up", "backoff"};
+
+static WIFI_LINK_T wifi;
+
+// Wakes core0 for the poll, wifi_link_task does the work.
+static uint32_t wifi_link_timer(timer_wheel_timer_t *timer) {
+    wifi.poll_due = true;
+    __sev();
+    return WIFI_LINK_POLL_MS;
+}
+
+static void wifi_link_set_state(wifi_link_state_t state) {
+    wifi.state = state;
+    wifi.since = get_absolute_time();
+}
+
+static void wifi_link_notify(bool up) {
+    for (uint i = 0; i < wifi.subscriber_count; i++) {
+        wifi.subscribers[i](up);
+    }
+}
+
+static void wifi_link_backoff(void) {
+    // Drop whatever the driver is part way through before the next attempt.
+    cyw43_arch_lwip_begin();
+    cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+    cyw43_arch_lwip_end();
+    wifi_link_set_state(WIFI_LINK_BACKOFF);
+    wifi.retry_at = make_timeout_time_ms(wifi.backoff_ms);
+    wifi.backoff_ms = wifi.backoff_ms < WIFI_LINK_BACKOFF_MAX_MS / 2 ? wifi.backoff_ms * 2 : WIFI_LINK_BACKOFF_MAX_MS;
+}
+
+static void wifi_link_join(void) {
+    wifi.attempts++;
+    TRACE1(TRACE_WIFI_JOIN, wifi.attempts);
+    wifi_link_set_state(WIFI_LINK_JOINING);
+    int err = cyw43_arch_wifi_connect_async(WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK);
+    if (err) {
+        TRACE2(TRACE_WIFI_RETRY, (uint32_t) err, wifi.backoff_ms);
+        wifi_link_backoff();
+    }
+}
+
+void wifi_link_task(void) {
+    if (!wifi.poll_due) {
+        return;
+    }
+    wifi.poll_due = false;
+    wifi.status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+
+    switch (wifi.state) {
+        case WIFI_LINK_JOINING:
+            if (wifi.status == CYW43_LINK_UP) {
+                TRACE1(TRACE_WIFI_UP, (uint32_t) (absolute_time_diff_us(wifi.down_since, get_absolute_time()) / 1000));
+                wifi_link_set_state(WIFI_LINK_UP);
+                wifi.attempts = 0;
+                wifi.joins++;
+                wifi.backoff_ms = WIFI_LINK_BACKOFF_MIN_MS;
+                boot_mark(BOOT_LINK_UP);
+                wifi_link_notify(true);
+            } else if (wifi.status < 0 ||
+                       absolute_time_diff_us(wifi.since, get_absolute_time()) > WIFI_LINK_JOIN_TIMEOUT_MS * 1000ll) {
+                // Failed, no network or bad password, all retried the same.
+                TRACE2(TRACE_WIFI_RETRY, (uint32_t) wifi.status, wifi.backoff_ms);
+                wifi_link_backoff();
+            }
+            break;
+        case WIFI_LINK_UP:
+            if (wifi.status != CYW43_LINK_UP) {
+                TRACE2(TRACE_WIFI_DOWN, (uint32_t) wifi.status, wifi.backoff_ms);
+                wifi.drops++;
+                wifi.down_since = get_absolute_time();
+                wifi_link_notify(false);
+                wifi_link_backoff();
+            }
+            break;
+        case WIFI_LINK_BACKOFF:
+            if (time_reached(wifi.retry_at)) {
+                wifi_link_join();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+bool wifi_link_up(void) {
+    return wifi.state == WIFI_LINK_UP;
+}
+
+bool wifi_link_subscribe(wifi_link_callback_t callback) {
+    if (wifi.subscriber_count == WIFI_LINK_SUBSCRIBERS) {
+        return false;
+    }
+    wifi.subscribers[wifi.subscriber_count++] = callback;
+    if (wifi.state == WIFI_LINK_UP) {
+        callback(true);
+    }
+    return true;
+}
+
+static void wifi_link_command(const char *args) {
+    printf("%s for %llus, status %d, attempt %lu, joins %lu, drops %lu", state_names[wifi.state],
+        (unsigned long long) (absolute_time_diff_us(wifi.since, get_absolute_time()) / 1000000), wifi.status,
+        (unsigned long) wifi.attempts, (unsigned long) wifi.joins, (unsigned long) wifi.drops);
+    if (wifi.state == WIFI_LINK_BACKOFF) {
+        printf(", retry in %lldms", (long long) (absolute_time_diff_us(get_absolute_time(), wifi.retry_at) / 1000));
+    }
+    printf("\n");
+}
+
+void wifi_link_init(void) {
+    console_register("wifi", "link state, join attempts and drops", wifi_link_command);
+    wifi_link_set_state(WIFI_LINK_OFF);
+    if (!cyw43_is_initialized(&cyw43_state)) {
+        if (cyw43_arch_init()) {
+            printf("Wi-Fi init failed \n");
+            return;
+        }
+    }
+    cyw43_arch_enable_sta_mode();
+    wifi.backoff_ms = WIFI_LINK_BACKOFF_MIN_MS;
+    wifi.down_since = get_absolute_time();
+    timer_wheel_timer_init(&wifi.timer, wifi_link_timer, NULL, WIFI_LINK_POLL_SLACK_MS);
+    timer_wheel_add(&wifi.timer, WIFI_LINK_POLL_MS);
+    wifi_link_join();
+}
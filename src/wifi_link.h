@@ -0,0 +1,40 @@
+#ifndef _WIFI_LINK_H
+#define _WIFI_LINK_H
+
+#include "pico/stdlib.h"
+
+// Station mode Wi-Fi that never blocks. wifi_link_init starts a join with
+// cyw43_arch_wifi_connect_async and returns, wifi_link_task polls the link
+// status every WIFI_LINK_POLL_MS. A failed or timed out join, or a link that
+// drops, is retried after a backoff that doubles from WIFI_LINK_BACKOFF_MIN_MS
+// to WIFI_LINK_BACKOFF_MAX_MS and goes back to the minimum once the link is
+// up. Up is CYW43_LINK_UP, joined with an address from DHCP.
+//
+// Anything that needs the network subscribes and is called on each change,
+// from wifi_link_task. The "wifi" console command shows the state.
+//
+// core0 only.
+
+#define WIFI_LINK_POLL_MS 250
+#define WIFI_LINK_POLL_SLACK_MS 50
+#define WIFI_LINK_JOIN_TIMEOUT_MS (30 * 1000)
+#define WIFI_LINK_BACKOFF_MIN_MS 1000
+#define WIFI_LINK_BACKOFF_MAX_MS (5 * 60 * 1000)
+#define WIFI_LINK_SUBSCRIBERS 4
+
+typedef enum {
+    WIFI_LINK_OFF,     // cyw43_arch_init failed
+    WIFI_LINK_JOINING,
+    WIFI_LINK_UP,
+    WIFI_LINK_BACKOFF, // Waiting to join again
+} wifi_link_state_t;
+
+typedef void (*wifi_link_callback_t)(bool up);
+
+void wifi_link_init(void);
+void wifi_link_task(void);
+bool wifi_link_up(void);
+// Called straight away if the link is already up.
+bool wifi_link_subscribe(wifi_link_callback_t callback);
+
+#endif
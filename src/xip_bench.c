@@ -0,0 +1,114 @@
+#include "hardware/irq.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/xip_ctrl.h"
+#include "hardware/sync.h"
+
+#include "src/console.h"
+#include "src/xip_bench.h"
+
+#if PICO_COPY_TO_RAM
+#define XIP_BENCH_LAYOUT "copy_to_ram"
+#else
+#define XIP_BENCH_LAYOUT "flash XIP"
+#endif
+
+// SysTick is a 24 bit down counter.
+#define XIP_BENCH_SYSTICK_MASK 0x00ffffffu
+
+typedef struct {
+    uint32_t min;
+    uint32_t max;
+    uint32_t total;
+} XIP_BENCH_RESULT_T;
+
+static uint bench_irq;
+static volatile uint32_t entry_tick;
+
+// The same handler twice. Each only reads SysTick so the time up to that read
+// is the interrupt entry plus whatever it takes to fetch the handler.
+static void xip_bench_flash_irq(void) {
+    entry_tick = systick_hw->cvr;
+}
+
+static void __not_in_flash_func(xip_bench_ram_irq)(void) {
+    entry_tick = systick_hw->cvr;
+}
+
+// In SRAM so that after a flush the only fetches from flash are the
+// handler's. The interrupt is pended before the flush.
+static void __not_in_flash_func(xip_bench_loop)(bool flush, XIP_BENCH_RESULT_T *result) {
+    result->min = UINT32_MAX;
+    result->max = 0;
+    result->total = 0;
+    for (uint n = 0; n < XIP_BENCH_RUNS; n++) {
+        uint32_t save = save_and_disable_interrupts();
+        irq_set_pending(bench_irq);
+        if (flush) {
+            xip_ctrl_hw->flush = 1;
+            // Reading holds the bus until the flush has finished.
+            (void) xip_ctrl_hw->flush;
+        }
+        uint32_t start = systick_hw->cvr;
+        restore_interrupts(save);
+        uint32_t cycles = (start - entry_tick) & XIP_BENCH_SYSTICK_MASK;
+        result->min = cycles < result->min ? cycles : result->min;
+        result->max = cycles > result->max ? cycles : result->max;
+        result->total += cycles;
+    }
+}
+
+static void xip_bench_run(const char *name, irq_handler_t handler) {
+    static const char *const cache[2] = {"warm", "cold"};
+    XIP_BENCH_RESULT_T result;
+
+    irq_set_exclusive_handler(bench_irq, handler);
+    irq_set_enabled(bench_irq, true);
+    for (uint flush = 0; flush < 2; flush++) {
+        xip_bench_loop(flush, &result);
+        printf("%-5s handler %s cache min %lu max %lu mean %lu cycles\n", name, cache[flush],
+            (unsigned long) result.min, (unsigned long) result.max, (unsigned long) (result.total / XIP_BENCH_RUNS));
+    }
+    irq_set_enabled(bench_irq, false);
+    irq_remove_handler(bench_irq, handler);
+}
+
+static void xip_bench(void) {
+    // Free running at the processor clock. Nothing else uses SysTick.
+    systick_hw->rvr = XIP_BENCH_SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+
+    printf("%s, %u entries each\n", XIP_BENCH_LAYOUT, XIP_BENCH_RUNS);
+    xip_bench_run("flash", xip_bench_flash_irq);
+    xip_bench_run("sram", xip_bench_ram_irq);
+
+    systick_hw->csr = 0;
+    // Writing either counter clears it.
+    xip_ctrl_hw->ctr_hit = 0;
+    xip_ctrl_hw->ctr_acc = 0;
+}
+
+static void xip_bench_command(const char *args) {
+    if (!strcmp(args, "bench")) {
+        xip_bench();
+        return;
+    }
+    if (!strcmp(args, "reset")) {
+        xip_ctrl_hw->ctr_hit = 0;
+        xip_ctrl_hw->ctr_acc = 0;
+        return;
+    }
+    uint32_t hit = xip_ctrl_hw->ctr_hit;
+    uint32_t acc = xip_ctrl_hw->ctr_acc;
+    if (!acc) {
+        printf("%s, no cached flash accesses\n", XIP_BENCH_LAYOUT);
+        return;
+    }
+    printf("%s, cache %lu hits in %lu accesses %lu.%lu%%\n", XIP_BENCH_LAYOUT, (unsigned long) hit, (unsigned long) acc,
+        (unsigned long) ((uint64_t) hit * 1000 / acc / 10), (unsigned long) ((uint64_t) hit * 1000 / acc % 10));
+}
+
+void xip_bench_init(void) {
+    bench_irq = (uint) user_irq_claim_unused(true);
+    console_register("xip", "XIP cache hit rate, xip bench to time interrupt entry, xip reset to clear", xip_bench_command);
+}
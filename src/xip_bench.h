@@ -0,0 +1,21 @@
+#ifndef _XIP_BENCH_H
+#define _XIP_BENCH_H
+
+#include "pico/stdlib.h"
+
+// Compares the two binary layouts, wifi_blinkwifigpio executes in place from
+// flash through the XIP cache and wifi_blinkwifigpio_ram is copied to SRAM at
+// boot. The "xip" console command shows the XIP cache hit rate since the last
+// "xip reset", run the same load on each build to compare them.
+//
+// "xip bench" times interrupt entry, from enabling interrupts with one pending
+// to the first instruction of the handler, in SysTick cycles. The handler has
+// a copy in flash and a copy in SRAM and each is timed with the cache warm and
+// with it flushed before every entry. In the copy_to_ram build both copies
+// are in SRAM. The bench flushes the cache so it also clears the counters.
+
+#define XIP_BENCH_RUNS 100
+
+void xip_bench_init(void);
+
+#endif
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+#include "src/console.h"
+#include "src/msp2807.h"
+#include "src/timer_wheel.h"
+#include "src/trace.h"
+#include "src/xpt2046.h"
+
+static_assert((XPT2046_EVENT_RING_SIZE & (XPT2046_EVENT_RING_SIZE - 1)) == 0, "XPT2046_EVENT_RING_SIZE must be a power of two");
+static_assert(XPT2046_SAMPLES & 1, "XPT2046_SAMPLES must be odd");
+
+#define CONVERSIONS (XPT2046_CHANNELS * XPT2046_SAMPLES)
+// A control byte and a zero per conversion, each control byte but the
+// first going out with the last bits of the conversion before, then the
+// power down and its two bytes.
+#define BURST_BYTES (2 * CONVERSIONS + 3)
+
+typedef struct {
+    bool pressed;
+    int32_t x; // Smoothed, raw counts
+    int32_t y;
+    uint16_t screen_x; // Of the last event
+    uint16_t screen_y;
+} XPT2046_FILTER_T;
+
+static uint8_t burst_tx[BURST_BYTES];
+static uint8_t burst_rx[BURST_BYTES];
+static uint16_t last_raw[XPT2046_CHANNELS][XPT2046_SAMPLES];
+static XPT2046_FILTER_T filter;
+static uint32_t burst_timestamp;
+static uint32_t pen_timestamp;
+static timer_wheel_timer_t burst_timer;
+static xpt2046_stats_t stats;
+static uint tx_dma;
+static uint rx_dma;
+
+// Single producer (the DMA interrupt) and single consumer (the main loop of
+// the same core), as gpio_event.
+static touch_event_t ring[XPT2046_EVENT_RING_SIZE];
+static volatile uint32_t head = 0;
+static volatile uint32_t tail = 0;
+
+static void xpt2046_push(touch_type_t type, uint16_t z, uint32_t timestamp) {
+    uint32_t h = head;
+    if (h - tail == XPT2046_EVENT_RING_SIZE) {
+        stats.dropped_events++;
+        return;
+    }
+    ring[h & (XPT2046_EVENT_RING_SIZE - 1)] = (touch_event_t) {
+        .type = (uint8_t) type,
+        .x = filter.screen_x,
+        .y = filter.screen_y,
+        .z = z,
+        .timestamp = timestamp,
+    };
+    __dmb();
+    head = h + 1;
+    stats.events++;
+    __sev();
+}
+
+bool xpt2046_event_pop(touch_event_t *event) {
+    uint32_t t = tail;
+    if (t == head) {
+        return false;
+    }
+    __dmb();
+    *event = ring[t & (XPT2046_EVENT_RING_SIZE - 1)];
+    __dmb();
+    tail = t + 1;
+    return true;
+}
+
+static void xpt2046_burst(uint32_t timestamp) {
+    burst_timestamp = timestamp;
+    gpio_put(XPT2046_CS, false);
+    // The receive channel first, it must be ready for the first byte in.
+    dma_channel_set_write_addr(rx_dma, burst_rx, false);
+    dma_channel_set_trans_count(rx_dma, BURST_BYTES, true);
+    dma_channel_set_read_addr(tx_dma, burst_tx, false);
+    dma_channel_set_trans_count(tx_dma, BURST_BYTES, true);
+}
+
+// Edge disabled until the pen is lifted, PENIRQ follows the conversions.
+void __not_in_flash_func(xpt2046_pen_irq)(uint gpio, uint32_t events, uint32_t timestamp) {
+    gpio_set_irq_enabled(TOUCHSCREEN_IRQ, GPIO_IRQ_EDGE_FALL, false);
+    pen_timestamp = timestamp;
+    xpt2046_burst(timestamp);
+}
+
+static uint32_t xpt2046_burst_tick(timer_wheel_timer_t *timer) {
+    xpt2046_burst(time_us_32());
+    return 0;
+}
+
+// Sorts a channel's samples in place, there are only a few.
+static void xpt2046_sort(uint16_t *samples) {
+    for (uint i = 1; i < XPT2046_SAMPLES; i++) {
+        uint16_t v = samples[i];
+        uint j = i;
+        for (; j && samples[j - 1] > v; j--) {
+            samples[j] = samples[j - 1];
+        }
+        samples[j] = v;
+    }
+}
+
+// A raw reading to a screen axis by its calibration, clamped.
+static uint16_t xpt2046_scale(int32_t raw, int32_t raw_min, int32_t raw_max, uint size) {
+    int32_t pos = (raw - raw_min) * (int32_t) (size - 1) / (raw_max - raw_min);
+    return (uint16_t) (pos < 0 ? 0 : pos >= (int32_t) size ? (int32_t) size - 1 : pos);
+}
+
+static void xpt2046_filter(uint16_t samples[XPT2046_CHANNELS][XPT2046_SAMPLES]) {
+    uint mid = XPT2046_SAMPLES / 2;
+    uint16_t median[XPT2046_CHANNELS];
+
+    for (uint c = 0; c < XPT2046_CHANNELS; c++) {
+        xpt2046_sort(samples[c]);
+        median[c] = samples[c][mid];
+    }
+    int32_t z = median[XPT2046_Z1] + 4095 - median[XPT2046_Z2];
+    uint32_t timestamp = filter.pressed ? burst_timestamp : pen_timestamp;
+
+    if (filter.pressed && z < XPT2046_Z_RELEASE) {
+        filter.pressed = false;
+        xpt2046_push(TOUCH_RELEASE, (uint16_t) (z < 0 ? 0 : z), timestamp);
+        return;
+    }
+    if (!filter.pressed && z < XPT2046_Z_PRESS) {
+        return;
+    }
+    // Positions are only trusted when the samples either side of the
+    // median agree, a burst taken as the pen lands or lifts won't.
+    for (uint c = XPT2046_X; c <= XPT2046_Y; c++) {
+        if (samples[c][mid + 1] - samples[c][mid - 1] > XPT2046_SPREAD_MAX) {
+            stats.dropped_bursts++;
+            return;
+        }
+    }
+    if (filter.pressed) {
+        filter.x += (median[XPT2046_X] - filter.x) >> XPT2046_IIR_SHIFT;
+        filter.y += (median[XPT2046_Y] - filter.y) >> XPT2046_IIR_SHIFT;
+    } else {
+        filter.x = median[XPT2046_X];
+        filter.y = median[XPT2046_Y];
+    }
+    int32_t along_x = XPT2046_CAL_SWAP ? filter.y : filter.x;
+    int32_t along_y = XPT2046_CAL_SWAP ? filter.x : filter.y;
+    uint16_t x = xpt2046_scale(along_x, XPT2046_CAL_X_MIN, XPT2046_CAL_X_MAX, ILI9341_WIDTH);
+    uint16_t y = xpt2046_scale(along_y, XPT2046_CAL_Y_MIN, XPT2046_CAL_Y_MAX, ILI9341_HEIGHT);
+
+    if (!filter.pressed) {
+        filter.pressed = true;
+        filter.screen_x = x;
+        filter.screen_y = y;
+        stats.latency_us = time_us_32() - pen_timestamp;
+        if (stats.latency_us > stats.latency_max_us) {
+            stats.latency_max_us = stats.latency_us;
+        }
+        xpt2046_push(TOUCH_PRESS, (uint16_t) z, timestamp);
+    } else if (abs(x - filter.screen_x) >= XPT2046_MOVE_MIN || abs(y - filter.screen_y) >= XPT2046_MOVE_MIN) {
+        filter.screen_x = x;
+        filter.screen_y = y;
+        xpt2046_push(TOUCH_MOVE, (uint16_t) z, timestamp);
+    }
+}
+
+// The burst is in. While pressed, or while PENIRQ is held low by a touch
+// too light to count, the next burst is timed, otherwise the edge is
+// waited for again.
+static void __not_in_flash_func(xpt2046_dma_irq)(void) {
+    if (!dma_channel_get_irq0_status(rx_dma)) {
+        return;
+    }
+    dma_channel_acknowledge_irq0(rx_dma);
+    gpio_put(XPT2046_CS, true);
+    stats.bursts++;
+
+    uint16_t samples[XPT2046_CHANNELS][XPT2046_SAMPLES];
+    for (uint i = 0; i < CONVERSIONS; i++) {
+        uint16_t value = (uint16_t) ((burst_rx[2 * i + 1] << 8 | burst_rx[2 * i + 2]) >> 3 & 0xFFF);
+        samples[i / XPT2046_SAMPLES][i % XPT2046_SAMPLES] = value;
+    }
+    memcpy(last_raw, samples, sizeof(last_raw));
+    xpt2046_filter(samples);
+
+    if (filter.pressed || !gpio_get(TOUCHSCREEN_IRQ)) {
+        timer_wheel_add(&burst_timer, XPT2046_SAMPLE_MS);
+    } else {
+        gpio_set_irq_enabled(TOUCHSCREEN_IRQ, GPIO_IRQ_EDGE_FALL, true);
+    }
+}
+
+void xpt2046_get_stats(xpt2046_stats_t *s) {
+    *s = stats;
+}
+
+void xpt2046_init(void) {
+    static const uint8_t ctrl[XPT2046_CHANNELS] = {XPT2046_CTRL_X, XPT2046_CTRL_Y, XPT2046_CTRL_Z1, XPT2046_CTRL_Z2};
+    for (uint i = 0; i < CONVERSIONS; i++) {
+        burst_tx[2 * i] = ctrl[i / XPT2046_SAMPLES];
+    }
+    burst_tx[2 * CONVERSIONS] = XPT2046_CTRL_POWER_DOWN;
+
+    spi_init(XPT2046_SPI, XPT2046_SPI_HZ);
+    spi_set_format(XPT2046_SPI, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+    gpio_set_function(XPT2046_SCK, GPIO_FUNC_SPI);
+    gpio_set_function(XPT2046_MOSI, GPIO_FUNC_SPI);
+    gpio_set_function(XPT2046_MISO, GPIO_FUNC_SPI);
+    gpio_init(XPT2046_CS);
+    gpio_put(XPT2046_CS, true);
+    gpio_set_dir(XPT2046_CS, GPIO_OUT);
+
+    tx_dma = dma_claim_unused_channel(true);
+    rx_dma = dma_claim_unused_channel(true);
+    dma_channel_config tx_config = dma_channel_get_default_config(tx_dma);
+    channel_config_set_transfer_data_size(&tx_config, DMA_SIZE_8);
+    channel_config_set_read_increment(&tx_config, true);
+    channel_config_set_write_increment(&tx_config, false);
+    channel_config_set_dreq(&tx_config, spi_get_dreq(XPT2046_SPI, true));
+    dma_channel_configure(tx_dma, &tx_config, &spi_get_hw(XPT2046_SPI)->dr, burst_tx, 0, false);
+
+    dma_channel_config rx_config = dma_channel_get_default_config(rx_dma);
+    channel_config_set_transfer_data_size(&rx_config, DMA_SIZE_8);
+    channel_config_set_read_increment(&rx_config, false);
+    channel_config_set_write_increment(&rx_config, true);
+    channel_config_set_dreq(&rx_config, spi_get_dreq(XPT2046_SPI, false));
+    dma_channel_configure(rx_dma, &rx_config, burst_rx, &spi_get_hw(XPT2046_SPI)->dr, 0, false);
+    dma_channel_set_irq0_enabled(rx_dma, true);
+    irq_add_shared_handler(DMA_IRQ_0, xpt2046_dma_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    timer_wheel_timer_init(&burst_timer, xpt2046_burst_tick, NULL, 1);
+}
+
+static void xpt2046_command(const char *args) {
+    xpt2046_stats_t s;
+
+    if (!strcmp(args, "raw")) {
+        for (uint c = 0; c < XPT2046_CHANNELS; c++) {
+            for (uint i = 0; i < XPT2046_SAMPLES; i++) {
+                printf("%u%c", last_raw[c][i], c == XPT2046_CHANNELS - 1 && i == XPT2046_SAMPLES - 1 ? '\n' : ' ');
+            }
+        }
+        return;
+    }
+    xpt2046_get_stats(&s);
+    printf("%lu bursts, %lu dropped, %lu events, %lu not queued\n", (unsigned long) s.bursts,
+        (unsigned long) s.dropped_bursts, (unsigned long) s.events, (unsigned long) s.dropped_events);
+    printf("press latency last %luus max %luus\n", (unsigned long) s.latency_us, (unsigned long) s.latency_max_us);
+}
+
+void xpt2046_console_init(void) {
+    console_register("touch", "touch bursts, events and latency, touch raw for the last burst's samples", xpt2046_command);
+}
@@ -0,0 +1,95 @@
+#ifndef _XPT2046_H
+#define _XPT2046_H
+
+#include "pico/stdlib.h"
+#include "src/ili9341.h"
+
+// The MSP2807's XPT2046 touch controller on SPI1, its own bus so a touch
+// never waits behind a display update. PENIRQ's falling edge starts a DMA
+// burst of XPT2046_SAMPLES conversions each of X, Y, Z1 and Z2, 16 clocks
+// a conversion, ending with a power down that enables PENIRQ again. The
+// DMA interrupt takes the median of each channel, drops bursts whose
+// samples disagree, smooths the position with an IIR filter and turns
+// pressure into press and release with some hysteresis. Calibrated events
+// go into a queue for the main loop. While pressed a burst runs every
+// XPT2046_SAMPLE_MS from the timer wheel, once released PENIRQ's edge is
+// waited for again, so nothing polls an idle panel.
+//
+// The "touch" console command shows the bursts, events and the latency
+// from the edge to the press event, "touch raw" the last burst's samples
+// as a line the host build's touch traces take.
+
+#define XPT2046_SPI spi1
+#define XPT2046_SCK 10
+#define XPT2046_MOSI 11
+#define XPT2046_MISO 12
+#define XPT2046_CS 13
+#define XPT2046_SPI_HZ (2 * 1000 * 1000) // 2.5MHz at most, spi_init makes it 1.95MHz
+#define XPT2046_SAMPLES 5                // Of each channel per burst, odd for the median
+#define XPT2046_SAMPLE_MS 10             // Between bursts while pressed
+#define XPT2046_SPREAD_MAX 48            // Raw counts across the middle samples, more is dropped
+#define XPT2046_Z_PRESS 600              // Pressure, Z1 + 4095 - Z2
+#define XPT2046_Z_RELEASE 400
+#define XPT2046_IIR_SHIFT 1              // New position weighs 1 / 2^shift
+#define XPT2046_MOVE_MIN 2               // Pixels before a move is queued
+#define XPT2046_EVENT_RING_SIZE 16       // Must be a power of two
+
+// A starting calibration, each screen axis as the raw reading at its two
+// edges, measure the panel's own. Swapped as the display is in landscape,
+// raw X runs along the screen's y.
+#define XPT2046_CAL_X_MIN 300
+#define XPT2046_CAL_X_MAX 3800
+#define XPT2046_CAL_Y_MIN 300
+#define XPT2046_CAL_Y_MAX 3800
+#define XPT2046_CAL_SWAP true
+
+// Control bytes: start, channel, 12 bit differential, then the power down
+// bits, here the ADC kept on and PENIRQ off through the burst.
+#define XPT2046_CTRL_X 0xD1
+#define XPT2046_CTRL_Y 0x91
+#define XPT2046_CTRL_Z1 0xB1
+#define XPT2046_CTRL_Z2 0xC1
+#define XPT2046_CTRL_POWER_DOWN 0xD0
+
+typedef enum {
+    XPT2046_X,
+    XPT2046_Y,
+    XPT2046_Z1,
+    XPT2046_Z2,
+    XPT2046_CHANNELS
+} xpt2046_channel_t;
+
+typedef enum {
+    TOUCH_PRESS,
+    TOUCH_MOVE,
+    TOUCH_RELEASE,
+} touch_type_t;
+
+typedef struct {
+    uint8_t type;
+    uint16_t x; // Screen pixels
+    uint16_t y;
+    uint16_t z;
+    uint32_t timestamp; // time_us_32() of PENIRQ's edge for a press, of the burst otherwise
+} touch_event_t;
+
+typedef struct {
+    uint32_t bursts;
+    uint32_t dropped_bursts; // Samples too spread to trust
+    uint32_t events;
+    uint32_t dropped_events; // Queue full
+    uint32_t latency_us;     // PENIRQ's edge to the last press event
+    uint32_t latency_max_us;
+} xpt2046_stats_t;
+
+// On the core that takes the touch interrupts, after its timer wheel.
+void xpt2046_init(void);
+// From the GPIO interrupt on PENIRQ's falling edge, a gpio_event_isr_t.
+void xpt2046_pen_irq(uint gpio, uint32_t events, uint32_t timestamp);
+// The core that called xpt2046_init.
+bool xpt2046_event_pop(touch_event_t *event);
+void xpt2046_get_stats(xpt2046_stats_t *stats);
+// core0, registers the console command.
+void xpt2046_console_init(void);
+
+#endif
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Receive and print the telemetry datagrams sent by src/telemetry.c.
+
+Listens on a UDP port (5140 by default) and prints one line per record,
+prefixed with the sending board's id. The datagram layout is described in
+src/telemetry.h.
+
+    tools/telemetry_listen.py
+    tools/telemetry_listen.py --port 5141 --count 10
+"""
+
+import argparse
+import datetime
+import socket
+import struct
+
+MAGIC = b"TM"
+VERSION = 1
+HEADER = struct.Struct(">2sBBH8sI")  # magic, version, count, sequence, board id, base time
+RECORD = struct.Struct(">BBHH")  # type, sensor address, seconds after base, value
+TEMP = 1
+ALERT = 2
+
+
+def temperature(register):
+    """Sixteenths of a degree from the ambient register, as mcp9808_temp_from_register."""
+    raw = register & 0x1FFF
+    if raw & 0x1000:
+        raw -= 0x2000
+    return raw / 16
+
+
+def limits(register):
+    """The calls mcp9808_check_limits makes from the flag bits."""
+    calls = []
+    if register & 0x2000:  # below frost
+        calls.append("frost")
+    if not register & 0x4000:  # below heating
+        calls.append("heat")
+    if register & 0x8000:  # above conditioning
+        calls.append("conditioning")
+    return calls
+
+
+def stamp(base, offset):
+    if not base:
+        return "unsynced+%us" % offset
+    wall = datetime.datetime.fromtimestamp(base + offset, datetime.timezone.utc)
+    return wall.strftime("%Y-%m-%d %H:%M:%S")
+
+
+def decode(data):
+    """Yield the text for each record, or one line saying why it was rejected."""
+    if len(data) < HEADER.size:
+        yield "short datagram, %u bytes" % len(data)
+        return
+    magic, version, count, sequence, board, base = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        yield "not telemetry, or an unknown version"
+        return
+    if len(data) != HEADER.size + count * RECORD.size:
+        yield "%u bytes for %u records" % (len(data), count)
+        return
+    for i in range(count):
+        kind, addr, offset, value = RECORD.unpack_from(data, HEADER.size + i * RECORD.size)
+        prefix = "%s #%u %s %02x" % (board.hex(), sequence, stamp(base, offset), addr)
+        if kind == TEMP:
+            yield "%s %.4f°C %s" % (prefix, temperature(value), " ".join(limits(value)))
+        elif kind == ALERT:
+            yield "%s alert config %04x" % (prefix, value)
+        else:
+            yield "%s unknown record %u %04x" % (prefix, kind, value)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--address", default="0.0.0.0", help="address to listen on")
+    parser.add_argument("--port", type=int, default=5140, help="UDP port, TELEMETRY_PORT")
+    parser.add_argument("--count", type=int, default=0, help="exit after this many datagrams")
+    options = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((options.address, options.port))
+    received = 0
+    while not options.count or received < options.count:
+        data, sender = sock.recvfrom(2048)
+        received += 1
+        for line in decode(data):
+            print("%s %s" % (sender[0], line.rstrip()), flush=True)
+
+
+if __name__ == "__main__":
+    main()
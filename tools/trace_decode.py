@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""Decode the binary trace log written by src/trace.c.
+
+Reads a capture of the board's stdio (a file, or stdin when none is given),
+passes ordinary text straight through and replaces each trace frame with its
+formatted text. The string table is built from src/trace_ids.h.
+
+    cat /dev/ttyACM0 | tools/trace_decode.py
+    tools/trace_decode.py capture.bin
+"""
+
+import argparse
+import datetime
+import os
+import re
+import struct
+import sys
+
+FRAME_START = 0x1E
+HEADER = struct.Struct("<BBI")  # id, argc, timestamp
+MAX_ARGS = 4
+
+ENTRY_RE = re.compile(r'X\(\s*(TRACE_\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+CONVERSION_RE = re.compile(r"%([-+ 0#]*\d*(?:\.\d+)?)(?:hh|h|ll|l)?([diuxXct%])")
+NTP_TIME = "TRACE_NTP_TIME"
+WALL_CLOCK = "TRACE_WALL_CLOCK"
+
+
+def load_formats(path):
+    with open(path, encoding="utf-8") as f:
+        source = f.read()
+    entries = ENTRY_RE.findall(source)
+    names = [name for name, _ in entries]
+    formats = [fmt.encode("utf-8").decode("unicode_escape").encode("latin-1").decode("utf-8")
+               for _, fmt in entries]
+    return names, formats
+
+
+def signed(value, bits=32):
+    if value & (1 << (bits - 1)):
+        value -= 1 << bits
+    return value
+
+
+def render(fmt, args):
+    args = list(args)
+
+    def convert(match):
+        flags, conv = match.groups()
+        if conv == "%":
+            return "%"
+        value = args.pop(0) if args else 0
+        if conv == "t":
+            # mcp9808_temp_t, sixteenths of a degree
+            return ("%" + (flags or ".2") + "f") % (signed(value & 0xFFFF, 16) / 16)
+        if conv in "di":
+            return ("%" + flags + "d") % signed(value)
+        if conv == "u":
+            return ("%" + flags + "d") % value
+        if conv == "c":
+            return chr(value & 0xFF)
+        return ("%" + flags + conv) % value
+
+    return CONVERSION_RE.sub(convert, fmt)
+
+
+class Decoder:
+    def __init__(self, names, formats, out):
+        self.names = names
+        self.formats = formats
+        self.out = out
+        self.wraps = 0
+        self.last = 0
+        self.epoch = None  # wall clock seconds at boot, once ntp has run
+        self.at_line_start = True
+
+    def timestamp(self, raw):
+        if raw < self.last:
+            self.wraps += 1
+        self.last = raw
+        return ((self.wraps << 32) + raw) / 1e6
+
+    def stamp_text(self, uptime):
+        if self.epoch is None:
+            return "%12.6f" % uptime
+        wall = datetime.datetime.fromtimestamp(self.epoch + uptime, datetime.timezone.utc)
+        return wall.strftime("%Y-%m-%d %H:%M:%S.%f")
+
+    def frame(self, ident, args, raw_timestamp):
+        uptime = self.timestamp(raw_timestamp)
+        if ident < len(self.formats):
+            text = render(self.formats[ident], args)
+            if self.names[ident] == NTP_TIME and args:
+                self.epoch = args[0] - uptime
+            elif self.names[ident] == WALL_CLOCK and len(args) == 2:
+                self.epoch = args[0] + args[1] / 1e6 - uptime
+        else:
+            text = "unknown trace id %d %s" % (ident, " ".join("%08x" % a for a in args))
+        if not self.at_line_start:
+            self.out.write("\n")
+        self.out.write("[%s] %s\n" % (self.stamp_text(uptime), text))
+        self.at_line_start = True
+
+    def text(self, data):
+        if data:
+            self.out.write(data.decode("utf-8", errors="replace"))
+            self.at_line_start = data.endswith(b"\n")
+
+    def feed(self, buf):
+        """Consume as much of buf as possible, returning the undecoded tail."""
+        pos = 0
+        while True:
+            start = buf.find(bytes([FRAME_START]), pos)
+            if start < 0:
+                self.text(buf[pos:])
+                return b""
+            self.text(buf[pos:start])
+            if len(buf) - start < 1 + HEADER.size:
+                return buf[start:]
+            ident, argc, raw_timestamp = HEADER.unpack_from(buf, start + 1)
+            if argc > MAX_ARGS:
+                # Not a frame after all, treat the start byte as text.
+                self.text(buf[start:start + 1])
+                pos = start + 1
+                continue
+            end = start + 1 + HEADER.size + 4 * argc
+            if len(buf) < end:
+                return buf[start:]
+            args = struct.unpack_from("<%dI" % argc, buf, start + 1 + HEADER.size)
+            self.frame(ident, args, raw_timestamp)
+            pos = end
+
+
+def main():
+    default_ids = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "trace_ids.h")
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", nargs="?", help="captured stdio output, stdin if omitted")
+    parser.add_argument("--ids", default=default_ids, help="path to trace_ids.h")
+    options = parser.parse_args()
+
+    names, formats = load_formats(options.ids)
+    decoder = Decoder(names, formats, sys.stdout)
+    source = open(options.capture, "rb") if options.capture else sys.stdin.buffer
+    pending = b""
+    with source:
+        while True:
+            chunk = source.read1(4096) if hasattr(source, "read1") else source.read(4096)
+            if not chunk:
+                break
+            pending = decoder.feed(pending + chunk)
+            sys.stdout.flush()
+    decoder.text(pending)
+
+
+if __name__ == "__main__":
+    main()